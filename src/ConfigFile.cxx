@@ -88,6 +88,9 @@ static struct config_entry config_entries[] = {
 	{ CONF_SAMPLERATE_CONVERTER, false, false },
 	{ CONF_AUDIO_BUFFER_SIZE, false, false },
 	{ CONF_BUFFER_BEFORE_PLAY, false, false },
+	{ CONF_INPUT_BUFFER_SIZE, false, false },
+	{ CONF_PREFETCH_SIZE, false, false },
+	{ CONF_PREFETCH_SONGS, false, false },
 	{ CONF_HTTP_PROXY_HOST, false, false },
 	{ CONF_HTTP_PROXY_PORT, false, false },
 	{ CONF_HTTP_PROXY_USER, false, false },
@@ -110,6 +113,7 @@ static struct config_entry config_entries[] = {
 	{ CONF_DESPOTIFY_USER, false, false },
 	{ CONF_DESPOTIFY_PASSWORD, false, false},
 	{ CONF_DESPOTIFY_HIGH_BITRATE, false, false },
+	{ CONF_PROFILE, false, false },
 	{ "filter", true, true },
 	{ "database", false, true },
 };
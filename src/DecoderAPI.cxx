@@ -22,6 +22,7 @@
 
 extern "C" {
 #include "audio_config.h"
+#include "input/readahead_input_plugin.h"
 }
 
 #include "replay_gain_config.h"
@@ -157,6 +158,7 @@ decoder_command_finished(struct decoder *decoder)
 
 	decoder_lock(dc);
 
+	assert(!decoder->writing);
 	assert(dc->command != DECODE_COMMAND_NONE ||
 	       decoder->initial_seek_running);
 	assert(dc->command != DECODE_COMMAND_SEEK ||
@@ -296,11 +298,40 @@ size_t decoder_read(struct decoder *decoder,
 		g_error_free(error);
 	}
 
+	if (decoder != NULL)
+		/* the read-ahead stream shares the decoder's mutex,
+		   which is locked here */
+		input_readahead_get_fill(is, &decoder->dc->input_buffered,
+					 &decoder->dc->input_buffer_size);
+
 	input_stream_unlock(is);
 
 	return nbytes;
 }
 
+const void *
+decoder_read_mapped(struct decoder *decoder, struct input_stream *is,
+		    size_t length, size_t *nbytes_r)
+{
+	assert(decoder == NULL ||
+	       decoder->dc->state == DECODE_STATE_START ||
+	       decoder->dc->state == DECODE_STATE_DECODE);
+	assert(is != NULL);
+	assert(length > 0);
+
+	input_stream_lock(is);
+
+	/* streams which support this never block, so there's no
+	   need to wait for input_stream_available() */
+	const void *p = decoder_check_cancel_read(decoder)
+		? NULL
+		: input_stream_read_mapped(is, length, nbytes_r);
+
+	input_stream_unlock(is);
+
+	return p;
+}
+
 void
 decoder_timestamp(struct decoder *decoder, double t)
 {
@@ -363,6 +394,90 @@ update_stream_tag(struct decoder *decoder, struct input_stream *is)
 	return true;
 }
 
+/**
+ * Sends the stream tag (merged with the decoder plugin's tag) to the
+ * music pipe if it has changed.
+ */
+static enum decoder_command
+send_stream_tag(struct decoder *decoder, struct input_stream *is)
+{
+	if (!update_stream_tag(decoder, is))
+		return DECODE_COMMAND_NONE;
+
+	if (decoder->decoder_tag == NULL)
+		/* send only the stream tag */
+		return do_send_tag(decoder, decoder->stream_tag);
+
+	/* merge with tag from decoder plugin */
+	struct tag *tag = tag_merge(decoder->decoder_tag,
+				    decoder->stream_tag);
+	enum decoder_command cmd = do_send_tag(decoder, tag);
+	tag_free(tag);
+	return cmd;
+}
+
+/**
+ * Obtains a writable buffer at the end of the current chunk.  Full
+ * chunks are flushed, and a new one is allocated if necessary.
+ *
+ * @param max_length_r the number of bytes which may be written
+ * @return the buffer, or NULL if a command was received while
+ * waiting for a free chunk
+ */
+static void *
+decoder_get_chunk_buffer(struct decoder *decoder, uint16_t kbit_rate,
+			 size_t *max_length_r)
+{
+	struct decoder_control *dc = decoder->dc;
+
+	while (true) {
+		struct music_chunk *chunk = decoder_get_chunk(decoder);
+		if (chunk == NULL) {
+			assert(dc->command != DECODE_COMMAND_NONE);
+			return NULL;
+		}
+
+		void *dest = chunk->Write(dc->out_audio_format,
+					  decoder->timestamp -
+					  dc->song->start_ms / 1000.0,
+					  kbit_rate, max_length_r);
+		if (dest != NULL) {
+			assert(*max_length_r > 0);
+			return dest;
+		}
+
+		/* the chunk is full, flush it */
+		decoder_flush_chunk(decoder);
+		g_cond_signal(dc->client_cond);
+	}
+}
+
+/**
+ * Adds data which was written to the buffer returned by
+ * decoder_get_chunk_buffer() to the current chunk, and advances the
+ * time stamp.
+ *
+ * @return false if the end of the song range has been reached
+ */
+static bool
+decoder_expand_chunk(struct decoder *decoder, size_t nbytes)
+{
+	struct decoder_control *dc = decoder->dc;
+
+	if (decoder->chunk->Expand(dc->out_audio_format, nbytes)) {
+		/* the chunk is full, flush it */
+		decoder_flush_chunk(decoder);
+		g_cond_signal(dc->client_cond);
+	}
+
+	decoder->timestamp += (double)nbytes /
+		audio_format_time_to_size(&dc->out_audio_format);
+
+	/* if the end of this range has been reached, stop
+	   decoding */
+	return dc->end_ms == 0 || decoder->timestamp < dc->end_ms / 1000.0;
+}
+
 enum decoder_command
 decoder_data(struct decoder *decoder,
 	     struct input_stream *is,
@@ -376,6 +491,7 @@ decoder_data(struct decoder *decoder,
 	assert(dc->state == DECODE_STATE_DECODE);
 	assert(dc->pipe != NULL);
 	assert(length % audio_format_frame_size(&dc->in_audio_format) == 0);
+	assert(!decoder->writing);
 
 	decoder_lock(dc);
 	cmd = decoder_get_virtual_command(decoder);
@@ -387,22 +503,9 @@ decoder_data(struct decoder *decoder,
 
 	/* send stream tags */
 
-	if (update_stream_tag(decoder, is)) {
-		if (decoder->decoder_tag != NULL) {
-			/* merge with tag from decoder plugin */
-			struct tag *tag;
-
-			tag = tag_merge(decoder->decoder_tag,
-					decoder->stream_tag);
-			cmd = do_send_tag(decoder, tag);
-			tag_free(tag);
-		} else
-			/* send only the stream tag */
-			cmd = do_send_tag(decoder, decoder->stream_tag);
-
-		if (cmd != DECODE_COMMAND_NONE)
-			return cmd;
-	}
+	cmd = send_stream_tag(decoder, is);
+	if (cmd != DECODE_COMMAND_NONE)
+		return cmd;
 
 	if (!audio_format_equals(&dc->in_audio_format, &dc->out_audio_format)) {
 		data = pcm_convert(&decoder->conv_state,
@@ -419,28 +522,11 @@ decoder_data(struct decoder *decoder,
 	}
 
 	while (length > 0) {
-		struct music_chunk *chunk;
 		size_t nbytes;
-		bool full;
-
-		chunk = decoder_get_chunk(decoder);
-		if (chunk == NULL) {
-			assert(dc->command != DECODE_COMMAND_NONE);
+		void *dest = decoder_get_chunk_buffer(decoder, kbit_rate,
+						      &nbytes);
+		if (dest == NULL)
 			return dc->command;
-		}
-
-		void *dest = chunk->Write(dc->out_audio_format,
-					  decoder->timestamp -
-					  dc->song->start_ms / 1000.0,
-					  kbit_rate, &nbytes);
-		if (dest == NULL) {
-			/* the chunk is full, flush it */
-			decoder_flush_chunk(decoder);
-			g_cond_signal(dc->client_cond);
-			continue;
-		}
-
-		assert(nbytes > 0);
 
 		if (nbytes > length)
 			nbytes = length;
@@ -449,31 +535,83 @@ decoder_data(struct decoder *decoder,
 
 		memcpy(dest, data, nbytes);
 
-		/* expand the music pipe chunk */
-
-		full = chunk->Expand(dc->out_audio_format, nbytes);
-		if (full) {
-			/* the chunk is full, flush it */
-			decoder_flush_chunk(decoder);
-			g_cond_signal(dc->client_cond);
-		}
-
 		data = (const uint8_t *)data + nbytes;
 		length -= nbytes;
 
-		decoder->timestamp += (double)nbytes /
-			audio_format_time_to_size(&dc->out_audio_format);
-
-		if (dc->end_ms > 0 &&
-		    decoder->timestamp >= dc->end_ms / 1000.0)
-			/* the end of this range has been reached:
-			   stop decoding */
+		if (!decoder_expand_chunk(decoder, nbytes))
 			return DECODE_COMMAND_STOP;
 	}
 
 	return DECODE_COMMAND_NONE;
 }
 
+void *
+decoder_data_begin(struct decoder *decoder, struct input_stream *is,
+		   uint16_t kbit_rate, size_t *max_length_r)
+{
+	struct decoder_control *dc = decoder->dc;
+
+	assert(dc->state == DECODE_STATE_DECODE);
+	assert(dc->pipe != NULL);
+	assert(!decoder->writing);
+	assert(max_length_r != NULL);
+
+	if (!audio_format_equals(&dc->in_audio_format, &dc->out_audio_format))
+		/* the data must be converted; decoder_data() will do
+		   that */
+		return NULL;
+
+	decoder_lock(dc);
+	enum decoder_command cmd = decoder_get_virtual_command(decoder);
+	decoder_unlock(dc);
+
+	if (cmd != DECODE_COMMAND_NONE ||
+	    send_stream_tag(decoder, is) != DECODE_COMMAND_NONE)
+		return NULL;
+
+	void *dest = decoder_get_chunk_buffer(decoder, kbit_rate,
+					      max_length_r);
+	if (dest == NULL)
+		return NULL;
+
+	assert(*max_length_r %
+	       audio_format_frame_size(&dc->out_audio_format) == 0);
+
+	decoder->writing = true;
+	return dest;
+}
+
+enum decoder_command
+decoder_data_commit(struct decoder *decoder, size_t length)
+{
+	struct decoder_control *dc = decoder->dc;
+
+	assert(decoder->writing);
+	assert(decoder->chunk != NULL);
+	assert(length % audio_format_frame_size(&dc->out_audio_format) == 0);
+
+	decoder->writing = false;
+
+	if (length > 0 && !decoder_expand_chunk(decoder, length))
+		return DECODE_COMMAND_STOP;
+
+	decoder_lock(dc);
+	enum decoder_command cmd = decoder_get_virtual_command(decoder);
+	decoder_unlock(dc);
+
+	return cmd;
+}
+
+void
+decoder_data_abort(struct decoder *decoder)
+{
+	assert(decoder->writing);
+
+	/* nothing has been appended to the chunk yet; the next
+	   music_chunk::Write() call returns the same buffer */
+	decoder->writing = false;
+}
+
 enum decoder_command
 decoder_tag(G_GNUC_UNUSED struct decoder *decoder, struct input_stream *is,
 	    const struct tag *tag)
@@ -484,6 +622,7 @@ decoder_tag(G_GNUC_UNUSED struct decoder *decoder, struct input_stream *is,
 	assert(dc->state == DECODE_STATE_DECODE);
 	assert(dc->pipe != NULL);
 	assert(tag != NULL);
+	assert(!decoder->writing);
 
 	/* save the tag */
 
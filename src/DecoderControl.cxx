@@ -43,6 +43,9 @@ dc_new()
 
 	dc->song = NULL;
 
+	dc->input_buffered = 0;
+	dc->input_buffer_size = 0;
+
 	dc->replay_gain_db = 0;
 	dc->replay_gain_prev_db = 0;
 	dc->mixramp_start = NULL;
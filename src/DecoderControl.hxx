@@ -124,6 +124,12 @@ struct decoder_control {
 	 */
 	struct music_pipe *pipe;
 
+	/**
+	 * The fill level and the size of the current input stream's
+	 * read-ahead buffer [bytes]; both are 0 if there is none.
+	 */
+	size_t input_buffered, input_buffer_size;
+
 	float replay_gain_db;
 	float replay_gain_prev_db;
 	char *mixramp_start;
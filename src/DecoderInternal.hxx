@@ -73,6 +73,13 @@ struct decoder {
 	/** the chunk currently being written to */
 	struct music_chunk *chunk;
 
+	/**
+	 * Has the decoder plugin obtained a buffer with
+	 * decoder_data_begin() which has not been committed or
+	 * aborted yet?
+	 */
+	bool writing;
+
 	struct replay_gain_info replay_gain_info;
 
 	/**
@@ -89,7 +96,7 @@ struct decoder {
 		 initial_seek_running(false),
 		 seeking(false),
 		 song_tag(_tag), stream_tag(nullptr), decoder_tag(nullptr),
-		 chunk(nullptr),
+		 chunk(nullptr), writing(false),
 		 replay_gain_serial(0) {
 		pcm_convert_init(&conv_state);
 	}
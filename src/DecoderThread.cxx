@@ -29,11 +29,15 @@
 #include "decoder_api.h"
 #include "tag.h"
 #include "input_stream.h"
+#include "conf.h"
 
 extern "C" {
+#include "input/readahead_input_plugin.h"
+#include "input/prefetch_input_plugin.h"
 #include "decoder_list.h"
 #include "replay_gain_ape.h"
 #include "uri.h"
+#include "ThreadProfile.hxx"
 }
 
 #include <glib.h>
@@ -44,6 +48,12 @@ extern "C" {
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "decoder_thread"
 
+/**
+ * The size of the read-ahead buffer of input streams [bytes]; 0
+ * disables it.
+ */
+static size_t input_buffer_size;
+
 /**
  * Marks the current decoder command as "finished" and notifies the
  * player thread.
@@ -77,7 +87,12 @@ decoder_input_stream_open(struct decoder_control *dc, const char *uri)
 	GError *error = NULL;
 	struct input_stream *is;
 
-	is = input_stream_open(uri, dc->mutex, dc->cond, &error);
+	is = prefetch_open(uri, dc->mutex, dc->cond);
+	if (is == NULL)
+		is = input_buffer_size > 0
+			? input_readahead_open(uri, dc->mutex, dc->cond,
+					       input_buffer_size, &error)
+			: input_stream_open(uri, dc->mutex, dc->cond, &error);
 	if (is == NULL) {
 		if (error != NULL) {
 			g_warning("%s", error->message);
@@ -114,6 +129,23 @@ decoder_input_stream_open(struct decoder_control *dc, const char *uri)
 	return is;
 }
 
+/**
+ * Closes a stream which was opened with decoder_input_stream_open().
+ *
+ * Unlock the decoder before calling this function.
+ */
+static void
+decoder_input_stream_close(struct decoder_control *dc,
+			   struct input_stream *is)
+{
+	input_stream_close(is);
+
+	decoder_lock(dc);
+	dc->input_buffered = 0;
+	dc->input_buffer_size = 0;
+	decoder_unlock(dc);
+}
+
 static bool
 decoder_stream_decode(const struct decoder_plugin *plugin,
 		      struct decoder *decoder,
@@ -305,7 +337,7 @@ decoder_run_stream(struct decoder *decoder, const char *uri)
 	g_slist_free(tried);
 
 	decoder_unlock(dc);
-	input_stream_close(input_stream);
+	decoder_input_stream_close(dc, input_stream);
 	decoder_lock(dc);
 
 	return success;
@@ -363,7 +395,7 @@ decoder_run_file(struct decoder *decoder, const char *path_fs)
 
 			decoder_unlock(dc);
 
-			input_stream_close(input_stream);
+			decoder_input_stream_close(dc, input_stream);
 
 			if (success) {
 				decoder_lock(dc);
@@ -454,6 +486,8 @@ decoder_task(gpointer arg)
 {
 	struct decoder_control *dc = (struct decoder_control *)arg;
 
+	thread_profile_register("decoder");
+
 	decoder_lock(dc);
 
 	do {
@@ -486,6 +520,8 @@ decoder_task(gpointer arg)
 
 	decoder_unlock(dc);
 
+	thread_profile_unregister();
+
 	return NULL;
 }
 
@@ -498,6 +534,9 @@ decoder_thread_start(struct decoder_control *dc)
 
 	dc->quit = false;
 
+	input_buffer_size =
+		(size_t)config_get_unsigned(CONF_INPUT_BUFFER_SIZE, 0) * 1024;
+
 	dc->thread = g_thread_create(decoder_task, dc, true, &e);
 	if (dc->thread == NULL)
 		MPD_ERROR("Failed to spawn decoder task: %s", e->message);
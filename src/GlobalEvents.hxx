@@ -54,6 +54,9 @@ namespace GlobalEvents {
 		/** shutdown requested */
 		SHUTDOWN,
 
+		/** SIGUSR2 received: log the profiling counters */
+		PROFILE,
+
 		MAX
 	};
 
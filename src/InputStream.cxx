@@ -208,6 +208,18 @@ input_stream_read(struct input_stream *is, void *ptr, size_t size,
 	return is->plugin->read(is, ptr, size, error_r);
 }
 
+const void *
+input_stream_read_mapped(struct input_stream *is, size_t size,
+			 size_t *length_r)
+{
+	assert(size > 0);
+	assert(length_r != NULL);
+
+	return is->plugin->read_mapped != NULL
+		? is->plugin->read_mapped(is, size, length_r)
+		: NULL;
+}
+
 size_t
 input_stream_lock_read(struct input_stream *is, void *ptr, size_t size,
 		       GError **error_r)
@@ -47,6 +47,7 @@
 #include "InputInit.hxx"
 #include "event/Loop.hxx"
 #include "IOThread.hxx"
+#include "ThreadProfile.hxx"
 
 extern "C" {
 #include "daemon.h"
@@ -57,6 +58,7 @@ extern "C" {
 #include "decoder_list.h"
 #include "playlist_list.h"
 #include "zeroconf.h"
+#include "input/prefetch_input_plugin.h"
 }
 
 #include "mpd_error.h"
@@ -242,6 +244,13 @@ glue_state_file_init(GError **error_r)
 	return true;
 }
 
+static gpointer
+register_io_thread(G_GNUC_UNUSED gpointer data)
+{
+	thread_profile_register("io");
+	return nullptr;
+}
+
 /**
  * Windows-only initialization of the Winsock2 library.
  */
@@ -464,12 +473,23 @@ int mpd_main(int argc, char *argv[])
 
 	initSigHandlers();
 
+	thread_profile_global_init();
+
 	if (!io_thread_start(&error)) {
 		g_warning("%s", error->message);
 		g_error_free(error);
 		return EXIT_FAILURE;
 	}
 
+	if (thread_profile_enabled())
+		io_thread_call(register_io_thread, nullptr);
+
+	if (!prefetch_global_init(&error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
 	initZeroconf();
 
 	player_create(&global_partition->pc);
@@ -547,6 +567,7 @@ int mpd_main(int argc, char *argv[])
 	GlobalEvents::Deinitialize();
 
 	playlist_list_global_finish();
+	prefetch_global_finish();
 	input_stream_global_finish();
 	audio_output_all_finish();
 	volume_finish();
@@ -563,6 +584,7 @@ int mpd_main(int argc, char *argv[])
 	idle_deinit();
 	stats_global_finish();
 	io_thread_deinit();
+	thread_profile_global_finish();
 	daemonize_finish();
 #ifdef WIN32
 	WSACleanup();
@@ -85,6 +85,13 @@ struct music_chunk {
 	 */
 	unsigned replay_gain_serial;
 
+	/**
+	 * The monotonic time [microseconds] when this chunk was
+	 * submitted to the audio outputs; 0 if it has not been
+	 * submitted yet.  Used for the output statistics.
+	 */
+	uint64_t push_time;
+
 	/** the data (probably PCM) */
 	char data[CHUNK_SIZE];
 
@@ -96,7 +103,7 @@ struct music_chunk {
 		:other(nullptr),
 		 length(0),
 		 tag(nullptr),
-		 replay_gain_serial(0) {}
+		 replay_gain_serial(0), push_time(0) {}
 
 	~music_chunk();
 
@@ -21,6 +21,7 @@
 #include "MusicPipe.hxx"
 #include "MusicBuffer.hxx"
 #include "MusicChunk.hxx"
+#include "ThreadProfile.hxx"
 #include "thread/Mutex.hxx"
 
 #include <glib.h>
@@ -60,7 +61,9 @@ struct music_pipe {
 struct music_pipe *
 music_pipe_new(void)
 {
-	return new music_pipe();
+	music_pipe *mp = new music_pipe();
+	thread_profile_attach(mp->mutex, "music_pipe");
+	return mp;
 }
 
 void
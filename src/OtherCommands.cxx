@@ -33,6 +33,7 @@
 #include "protocol/Result.hxx"
 #include "ls.hxx"
 #include "Volume.hxx"
+#include "ThreadProfile.hxx"
 
 extern "C" {
 #include "uri.h"
@@ -238,6 +239,20 @@ handle_stats(Client *client,
 	return COMMAND_RETURN_OK;
 }
 
+enum command_return
+handle_profile(Client *client,
+	       G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
+{
+	if (!thread_profile_enabled()) {
+		command_error(client, ACK_ERROR_NO_EXIST,
+			      "profiling is disabled");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	thread_profile_print(client);
+	return COMMAND_RETURN_OK;
+}
+
 enum command_return
 handle_ping(G_GNUC_UNUSED Client *client,
 	    G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
@@ -54,6 +54,9 @@ handle_setvol(Client *client, int argc, char *argv[]);
 enum command_return
 handle_stats(Client *client, int argc, char *argv[]);
 
+enum command_return
+handle_profile(Client *client, int argc, char *argv[]);
+
 enum command_return
 handle_ping(Client *client, int argc, char *argv[]);
 
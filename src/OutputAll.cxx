@@ -30,8 +30,10 @@ extern "C" {
 #include "MusicBuffer.hxx"
 #include "MusicPipe.hxx"
 #include "MusicChunk.hxx"
+#include "OutputFilterCache.hxx"
 #include "mpd_error.h"
 #include "conf.h"
+#include "clock.h"
 #include "notify.hxx"
 
 #include <assert.h>
@@ -292,6 +294,7 @@ audio_output_all_play(struct music_chunk *chunk, GError **error_r)
 		return false;
 	}
 
+	chunk->push_time = monotonic_clock_us();
 	music_pipe_push(g_mp, chunk);
 
 	for (i = 0; i < num_audio_outputs; ++i)
@@ -472,6 +475,7 @@ audio_output_all_check(void)
 					g_mutex_unlock(audio_outputs[i]->mutex);
 
 		/* return the chunk to the buffer */
+		output_filter_cache_forget(shifted);
 		music_buffer_return(g_music_buffer, shifted);
 	}
 
@@ -530,8 +534,10 @@ audio_output_all_cancel(void)
 
 	/* clear the music pipe and return all chunks to the buffer */
 
-	if (g_mp != NULL)
+	if (g_mp != NULL) {
+		output_filter_cache_clear();
 		music_pipe_clear(g_mp, g_music_buffer);
+	}
 
 	/* the audio outputs are now waiting for a signal, to
 	   synchronize the cleared music pipe */
@@ -554,6 +560,7 @@ audio_output_all_close(void)
 	if (g_mp != NULL) {
 		assert(g_music_buffer != NULL);
 
+		output_filter_cache_clear();
 		music_pipe_clear(g_mp, g_music_buffer);
 		music_pipe_free(g_mp);
 		g_mp = NULL;
@@ -577,6 +584,7 @@ audio_output_all_release(void)
 	if (g_mp != NULL) {
 		assert(g_music_buffer != NULL);
 
+		output_filter_cache_clear();
 		music_pipe_clear(g_mp, g_music_buffer);
 		music_pipe_free(g_mp);
 		g_mp = NULL;
@@ -72,3 +72,25 @@ handle_devices(Client *client,
 
 	return COMMAND_RETURN_OK;
 }
+
+enum command_return
+handle_outputstats(Client *client, int argc, char *argv[])
+{
+	int device = -1;
+
+	if (argc > 1) {
+		unsigned value;
+		if (!check_unsigned(client, &value, argv[1]))
+			return COMMAND_RETURN_ERROR;
+
+		device = value;
+	}
+
+	if (!printAudioOutputStats(client, device)) {
+		command_error(client, ACK_ERROR_NO_EXIST,
+			      "No such audio output");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	return COMMAND_RETURN_OK;
+}
@@ -33,4 +33,7 @@ handle_disableoutput(Client *client, int argc, char *argv[]);
 enum command_return
 handle_devices(Client *client, int argc, char *argv[]);
 
+enum command_return
+handle_outputstats(Client *client, int argc, char *argv[]);
+
 #endif
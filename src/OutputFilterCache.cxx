@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "OutputFilterCache.hxx"
+#include "MusicChunk.hxx"
+#include "thread/Mutex.hxx"
+
+extern "C" {
+#include "audio_format.h"
+#include "filter_plugin.h"
+#include "filter_registry.h"
+#include "filter/convert_filter_plugin.h"
+}
+
+#include <glib.h>
+
+#include <list>
+
+#include <assert.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "output"
+
+struct output_filter_entry {
+	struct output_filter_group *group;
+
+	const struct music_chunk *chunk;
+
+	/**
+	 * The number of references.  The cache itself holds one as
+	 * long as the entry is listed in output_filter_group::entries.
+	 * Protected by output_filter_group::mutex.
+	 */
+	unsigned ref;
+
+	size_t length;
+	void *data;
+
+	output_filter_entry(struct output_filter_group *_group,
+			    const struct music_chunk *_chunk,
+			    const void *_data, size_t _length)
+		:group(_group), chunk(_chunk), ref(1),
+		 length(_length),
+		 /* never NULL, even if the resampler has returned
+		    nothing yet */
+		 data(g_malloc(MAX(_length, 1))) {
+		memcpy(data, _data, length);
+	}
+
+	~output_filter_entry() {
+		g_free(data);
+	}
+};
+
+struct output_filter_group {
+	/**
+	 * The number of audio outputs using this group.  Protected
+	 * by #groups_mutex.
+	 */
+	unsigned users;
+
+	struct audio_format in_audio_format, out_audio_format;
+
+	bool replay_gain;
+
+	/**
+	 * The convert_filter_plugin instance shared by all outputs
+	 * of this group.
+	 */
+	struct filter *filter;
+
+	/**
+	 * Protects #entries, #last and the #filter state.
+	 */
+	Mutex mutex;
+
+	std::list<output_filter_entry *> entries;
+
+	/**
+	 * The last chunk which was passed to #filter, or NULL if the
+	 * filter may continue with any chunk.
+	 */
+	const struct music_chunk *last;
+
+	output_filter_group(const struct audio_format &in,
+			    const struct audio_format &out,
+			    bool _replay_gain, struct filter *_filter)
+		:users(1), in_audio_format(in), out_audio_format(out),
+		 replay_gain(_replay_gain), filter(_filter), last(nullptr) {}
+
+	~output_filter_group() {
+		Clear();
+
+		filter_close(filter);
+		filter_free(filter);
+	}
+
+	bool Match(const struct audio_format &in,
+		   const struct audio_format &out,
+		   bool _replay_gain) const {
+		return audio_format_equals(&in, &in_audio_format) &&
+			audio_format_equals(&out, &out_audio_format) &&
+			_replay_gain == replay_gain;
+	}
+
+	void Unref(output_filter_entry *entry) {
+		assert(entry->ref > 0);
+
+		if (--entry->ref == 0)
+			delete entry;
+	}
+
+	void Forget(const struct music_chunk *chunk) {
+		for (auto i = entries.begin(); i != entries.end();) {
+			if ((*i)->chunk == chunk) {
+				Unref(*i);
+				i = entries.erase(i);
+			} else
+				++i;
+		}
+
+		if (chunk == last)
+			last = nullptr;
+	}
+
+	void Clear() {
+		for (auto entry : entries)
+			Unref(entry);
+		entries.clear();
+
+		last = nullptr;
+	}
+};
+
+static Mutex groups_mutex;
+static std::list<output_filter_group *> groups;
+
+struct output_filter_group *
+output_filter_group_acquire(const struct audio_format *in_audio_format,
+			    const struct audio_format *out_audio_format,
+			    bool replay_gain, GError **error_r)
+{
+	const ScopeLock protect(groups_mutex);
+
+	for (auto group : groups) {
+		if (group->Match(*in_audio_format, *out_audio_format,
+				 replay_gain)) {
+			++group->users;
+			return group;
+		}
+	}
+
+	struct filter *filter =
+		filter_new(&convert_filter_plugin, nullptr, error_r);
+	if (filter == nullptr)
+		return nullptr;
+
+	struct audio_format audio_format = *in_audio_format;
+	if (filter_open(filter, &audio_format, error_r) == nullptr) {
+		filter_free(filter);
+		return nullptr;
+	}
+
+	convert_filter_set(filter, out_audio_format);
+
+	output_filter_group *group =
+		new output_filter_group(*in_audio_format, *out_audio_format,
+					replay_gain, filter);
+	groups.push_back(group);
+	return group;
+}
+
+void
+output_filter_group_release(struct output_filter_group *group)
+{
+	const ScopeLock protect(groups_mutex);
+
+	assert(group->users > 0);
+	if (--group->users > 0)
+		return;
+
+	groups.remove(group);
+	delete group;
+}
+
+bool
+output_filter_group_is_shared(const struct output_filter_group *group)
+{
+	const ScopeLock protect(groups_mutex);
+
+	return group->users > 1;
+}
+
+void
+output_filter_group_lock(struct output_filter_group *group)
+{
+	group->mutex.lock();
+}
+
+void
+output_filter_group_unlock(struct output_filter_group *group)
+{
+	group->mutex.unlock();
+}
+
+const void *
+output_filter_group_get(struct output_filter_group *group,
+			const struct music_chunk *chunk,
+			size_t *length_r,
+			struct output_filter_entry **entry_r)
+{
+	for (auto entry : group->entries) {
+		if (entry->chunk == chunk) {
+			++entry->ref;
+			*entry_r = entry;
+			*length_r = entry->length;
+			return entry->data;
+		}
+	}
+
+	return nullptr;
+}
+
+bool
+output_filter_group_is_next(const struct output_filter_group *group,
+			    const struct music_chunk *chunk)
+{
+	return group->last == nullptr || group->last->next == chunk;
+}
+
+const void *
+output_filter_group_convert(struct output_filter_group *group,
+			    const struct music_chunk *chunk,
+			    const void *src, size_t src_length,
+			    size_t *length_r,
+			    struct output_filter_entry **entry_r,
+			    GError **error_r)
+{
+	assert(output_filter_group_is_next(group, chunk));
+
+	if (src_length == 0) {
+		/* nothing to convert, but remember the position */
+		group->last = chunk;
+		*entry_r = nullptr;
+		*length_r = 0;
+		return src;
+	}
+
+	size_t length;
+	const void *data = filter_filter(group->filter, src, src_length,
+					 &length, error_r);
+	if (data == nullptr)
+		return nullptr;
+
+	group->last = chunk;
+
+	output_filter_entry *entry =
+		new output_filter_entry(group, chunk, data, length);
+	group->entries.push_back(entry);
+
+	/* one more reference for the caller */
+	++entry->ref;
+
+	*entry_r = entry;
+	*length_r = entry->length;
+	return entry->data;
+}
+
+void
+output_filter_entry_unref(struct output_filter_entry *entry)
+{
+	output_filter_group *group = entry->group;
+
+	const ScopeLock protect(group->mutex);
+	group->Unref(entry);
+}
+
+void
+output_filter_cache_forget(const struct music_chunk *chunk)
+{
+	const ScopeLock protect(groups_mutex);
+
+	for (auto group : groups) {
+		const ScopeLock protect2(group->mutex);
+		group->Forget(chunk);
+	}
+}
+
+void
+output_filter_cache_clear(void)
+{
+	const ScopeLock protect(groups_mutex);
+
+	for (auto group : groups) {
+		const ScopeLock protect2(group->mutex);
+		group->Clear();
+	}
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Shares the result of the format conversion among audio outputs
+ * which convert the same input to the same output format.  Each
+ * #output_filter_group owns one convert filter, which converts each
+ * #music_chunk only once; the result is kept until the chunk is
+ * removed from the music pipe.
+ *
+ * Only outputs without a filter chain of their own (no software
+ * mixer, no "filters" setting, no volume normalization) and without
+ * a hardware replay gain mixer may join a group, because the
+ * converted data must not depend on per-output state.
+ */
+
+#ifndef MPD_OUTPUT_FILTER_CACHE_HXX
+#define MPD_OUTPUT_FILTER_CACHE_HXX
+
+#include "gerror.h"
+#include "gcc.h"
+
+#include <stddef.h>
+
+struct audio_format;
+struct music_chunk;
+struct output_filter_group;
+struct output_filter_entry;
+
+/**
+ * Looks up (or creates) the group for the specified conversion, and
+ * adds a reference to it.
+ *
+ * @param replay_gain true if the output applies software replay gain
+ * before the conversion
+ * @return the group, or NULL on error
+ */
+struct output_filter_group *
+output_filter_group_acquire(const struct audio_format *in_audio_format,
+			    const struct audio_format *out_audio_format,
+			    bool replay_gain, GError **error_r);
+
+/**
+ * Releases a reference obtained with output_filter_group_acquire().
+ * The group is freed when the last reference is gone.
+ */
+void
+output_filter_group_release(struct output_filter_group *group);
+
+/**
+ * Is this group used by more than one audio output?  If not, sharing
+ * the conversion result has no benefit, and the output should
+ * filter with its own filter instead, without copying the result.
+ * The caller must not lock the group.
+ */
+bool
+output_filter_group_is_shared(const struct output_filter_group *group);
+
+/**
+ * Locks the group.  The caller must hold the lock while calling
+ * output_filter_group_get() and output_filter_group_convert(), so
+ * two outputs never convert the same chunk.
+ */
+void
+output_filter_group_lock(struct output_filter_group *group);
+
+void
+output_filter_group_unlock(struct output_filter_group *group);
+
+/**
+ * Returns the cached conversion result for the chunk, or NULL if
+ * it has not been converted yet.  On success, a reference to the
+ * entry is returned, which must be released with
+ * output_filter_entry_unref() after the data has been consumed.
+ */
+const void *
+output_filter_group_get(struct output_filter_group *group,
+			const struct music_chunk *chunk,
+			size_t *length_r,
+			struct output_filter_entry **entry_r);
+
+/**
+ * May this chunk be converted with the group's filter?  This is true
+ * if it is the successor of the last converted chunk, i.e. the
+ * (stateful) resampler sees all chunks in order.  An output which
+ * lags behind the group must convert with its own filter instead.
+ */
+gcc_pure
+bool
+output_filter_group_is_next(const struct output_filter_group *group,
+			    const struct music_chunk *chunk);
+
+/**
+ * Converts the chunk's (already cross-faded and replay gain
+ * adjusted) data, and adds the result to the cache.  Returns a
+ * reference like output_filter_group_get().  Empty input is returned
+ * as-is, without an entry (*entry_r is set to NULL).
+ */
+const void *
+output_filter_group_convert(struct output_filter_group *group,
+			    const struct music_chunk *chunk,
+			    const void *src, size_t src_length,
+			    size_t *length_r,
+			    struct output_filter_entry **entry_r,
+			    GError **error_r);
+
+/**
+ * Releases a reference returned by output_filter_group_get() or
+ * output_filter_group_convert().  The group must not be locked by
+ * the caller.
+ */
+void
+output_filter_entry_unref(struct output_filter_entry *entry);
+
+/**
+ * Removes all cached results of the specified chunk.  Call this
+ * before the chunk is returned to the #music_buffer.
+ */
+void
+output_filter_cache_forget(const struct music_chunk *chunk);
+
+/**
+ * Removes all cached results.  Call this before the music pipe is
+ * cleared.
+ */
+void
+output_filter_cache_clear(void);
+
+#endif
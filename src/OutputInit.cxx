@@ -217,6 +217,10 @@ ao_base_init(struct audio_output *ao,
 	ao->mixer = NULL;
 	ao->replay_gain_filter = NULL;
 	ao->other_replay_gain_filter = NULL;
+	ao->share_filter = false;
+	ao->filter_group = NULL;
+
+	output_stats_init(&ao->stats);
 
 	/* done */
 
@@ -278,6 +282,13 @@ audio_output_setup(struct audio_output *ao, const struct config_param *param,
 		return false;
 	}
 
+	/* without other filters, the conversion result only depends
+	   on the chunk and may be shared with other outputs */
+
+	ao->share_filter = filter_chain_is_empty(ao->filter) &&
+		(strcmp(replay_gain_handler, "mixer") != 0 ||
+		 ao->mixer == NULL);
+
 	/* the "convert" filter must be the last one in the chain */
 
 	ao->convert_filter = filter_new(&convert_filter_plugin, NULL, NULL);
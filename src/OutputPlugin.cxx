@@ -111,3 +111,11 @@ ao_plugin_pause(struct audio_output *ao)
 {
 	return ao->plugin->pause != NULL && ao->plugin->pause(ao);
 }
+
+char *
+ao_plugin_stats(struct audio_output *ao)
+{
+	return ao->plugin->stats != NULL
+		? ao->plugin->stats(ao)
+		: NULL;
+}
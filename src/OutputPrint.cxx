@@ -28,6 +28,30 @@
 #include "output_internal.h"
 #include "Client.hxx"
 
+extern "C" {
+#include "output_plugin.h"
+}
+
+#include <glib.h>
+
+/**
+ * Copies the statistics while holding the output's mutex.
+ *
+ * @return true if the output is open; this attribute is also
+ * modified by the output thread, and must be read with the same lock
+ */
+static bool
+audio_output_get_stats(const struct audio_output *ao,
+		       struct output_stats *stats)
+{
+	g_mutex_lock(ao->mutex);
+	*stats = ao->stats;
+	const bool open = ao->open;
+	g_mutex_unlock(ao->mutex);
+
+	return open;
+}
+
 void
 printAudioDevices(Client *client)
 {
@@ -36,10 +60,98 @@ printAudioDevices(Client *client)
 	for (unsigned i = 0; i < n; ++i) {
 		const struct audio_output *ao = audio_output_get(i);
 
+		struct output_stats stats;
+		audio_output_get_stats(ao, &stats);
+
 		client_printf(client,
 			      "outputid: %i\n"
 			      "outputname: %s\n"
-			      "outputenabled: %i\n",
-			      i, ao->name, ao->enabled);
+			      "outputenabled: %i\n"
+			      "outputunderruns: %i\n"
+			      "outputreopens: %u\n",
+			      i, ao->name, ao->enabled,
+			      stats.underruns, stats.reopens);
 	}
 }
+
+static void
+print_histogram(Client *client, const char *name,
+		const struct output_histogram *histogram)
+{
+	/* durations are printed in milliseconds */
+	client_printf(client,
+		      "%s_count: %u\n"
+		      "%s_avg: %.3f\n"
+		      "%s_max: %.3f\n"
+		      "%s_histogram:",
+		      name, histogram->count,
+		      name, histogram->count > 0
+		      ? histogram->sum / 1000.0 / histogram->count
+		      : 0.0,
+		      name, histogram->max / 1000.0,
+		      name);
+
+	for (unsigned i = 0; i < OUTPUT_HISTOGRAM_BUCKETS; ++i)
+		client_printf(client, " %u", histogram->buckets[i]);
+
+	client_puts(client, "\n");
+}
+
+static void
+print_output_stats(Client *client, unsigned i,
+		   const struct audio_output *ao)
+{
+	struct output_stats stats;
+	const bool open = audio_output_get_stats(ao, &stats);
+
+	client_printf(client,
+		      "outputid: %u\n"
+		      "outputname: %s\n"
+		      "opens: %u\n"
+		      "reopens: %u\n"
+		      "underruns: %i\n"
+		      "chunks: %" G_GUINT64_FORMAT "\n"
+		      "bytes: %" G_GUINT64_FORMAT "\n"
+		      "bytes_per_second: %u\n"
+		      "queue_depth: %u\n"
+		      "queue_depth_avg: %.1f\n"
+		      "queue_depth_max: %u\n",
+		      i, ao->name,
+		      stats.opens, stats.reopens, stats.underruns,
+		      stats.chunks, stats.bytes,
+		      open ? output_stats_rate(&stats) : 0,
+		      stats.queue_depth,
+		      stats.chunks > 0
+		      ? (double)stats.queue_depth_sum / stats.chunks
+		      : 0.0,
+		      stats.queue_depth_max);
+
+	print_histogram(client, "queue_time", &stats.queue_time);
+	print_histogram(client, "play_time", &stats.play_time);
+	print_histogram(client, "filter_time", &stats.filter_time);
+
+	char *plugin_stats = ao_plugin_stats(const_cast<audio_output *>(ao));
+	if (plugin_stats != NULL) {
+		client_puts(client, plugin_stats);
+		g_free(plugin_stats);
+	}
+}
+
+bool
+printAudioOutputStats(Client *client, int id)
+{
+	const unsigned n = audio_output_count();
+
+	if (id >= 0) {
+		if ((unsigned)id >= n)
+			return false;
+
+		print_output_stats(client, id, audio_output_get(id));
+		return true;
+	}
+
+	for (unsigned i = 0; i < n; ++i)
+		print_output_stats(client, i, audio_output_get(i));
+
+	return true;
+}
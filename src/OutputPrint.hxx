@@ -30,4 +30,13 @@ class Client;
 void
 printAudioDevices(Client *client);
 
+/**
+ * Prints the performance counters of one audio output, or of all
+ * outputs if the id is negative.
+ *
+ * @return false if there is no such output
+ */
+bool
+printAudioOutputStats(Client *client, int id);
+
 #endif
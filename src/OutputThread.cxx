@@ -28,13 +28,16 @@ extern "C" {
 #include "filter/convert_filter_plugin.h"
 }
 
+#include "OutputFilterCache.hxx"
 #include "notify.hxx"
 #include "filter/ReplayGainFilterPlugin.hxx"
 #include "PlayerControl.hxx"
 #include "MusicPipe.hxx"
 #include "MusicChunk.hxx"
+#include "ThreadProfile.hxx"
 
 #include "mpd_error.h"
+#include "clock.h"
 #include "gcc.h"
 
 #include <glib.h>
@@ -123,9 +126,42 @@ ao_filter_open(struct audio_output *ao,
 	return af;
 }
 
+/**
+ * Join the #output_filter_group for the current conversion, if this
+ * output may share it.
+ */
+static void
+ao_filter_group_acquire(struct audio_output *ao)
+{
+	assert(ao->filter_group == NULL);
+
+	if (!ao->share_filter ||
+	    audio_format_equals(&ao->in_audio_format, &ao->out_audio_format))
+		/* nothing to share */
+		return;
+
+	GError *error = NULL;
+	ao->filter_group =
+		output_filter_group_acquire(&ao->in_audio_format,
+					    &ao->out_audio_format,
+					    ao->replay_gain_filter != NULL,
+					    &error);
+	if (ao->filter_group == NULL) {
+		/* not fatal: this output's own filter is used */
+		g_warning("\"%s\" [%s] failed to share the conversion: %s",
+			  ao->name, ao->plugin->name, error->message);
+		g_error_free(error);
+	}
+}
+
 static void
 ao_filter_close(struct audio_output *ao)
 {
+	if (ao->filter_group != NULL) {
+		output_filter_group_release(ao->filter_group);
+		ao->filter_group = NULL;
+	}
+
 	if (ao->replay_gain_filter != NULL)
 		filter_close(ao->replay_gain_filter);
 	if (ao->other_replay_gain_filter != NULL)
@@ -197,8 +233,10 @@ ao_open(struct audio_output *ao)
 	}
 
 	convert_filter_set(ao->convert_filter, &ao->out_audio_format);
+	ao_filter_group_acquire(ao);
 
 	ao->open = true;
+	output_stats_open(&ao->stats);
 
 	g_debug("opened plugin=%s name=\"%s\" "
 		"audio_format=%s",
@@ -268,11 +306,14 @@ ao_reopen_filter(struct audio_output *ao)
 	}
 
 	convert_filter_set(ao->convert_filter, &ao->out_audio_format);
+	ao_filter_group_acquire(ao);
 }
 
 static void
 ao_reopen(struct audio_output *ao)
 {
+	output_stats_reopen(&ao->stats);
+
 	if (!audio_format_fully_defined(&ao->config_audio_format)) {
 		if (ao->open) {
 			const struct music_pipe *mp = ao->pipe;
@@ -361,12 +402,14 @@ ao_chunk_data(struct audio_output *ao, const struct music_chunk *chunk,
 	return data;
 }
 
+/**
+ * Applies replay gain and cross-fading to the chunk, i.e. everything
+ * which happens before the filter chain.
+ */
 static const void *
-ao_filter_chunk(struct audio_output *ao, const struct music_chunk *chunk,
-		size_t *length_r)
+ao_prepare_chunk(struct audio_output *ao, const struct music_chunk *chunk,
+		 size_t *length_r)
 {
-	GError *error = NULL;
-
 	size_t length;
 	const void *data = ao_chunk_data(ao, chunk, ao->replay_gain_filter,
 					 &ao->replay_gain_serial, &length);
@@ -419,6 +462,76 @@ ao_filter_chunk(struct audio_output *ao, const struct music_chunk *chunk,
 		length = other_length;
 	}
 
+	*length_r = length;
+	return data;
+}
+
+static const void *
+ao_filter_chunk(struct audio_output *ao, const struct music_chunk *chunk,
+		size_t *length_r, struct output_filter_entry **entry_r)
+{
+	GError *error = NULL;
+
+	*entry_r = NULL;
+
+	/* while this output is the only member of its group, there
+	   is nothing to share; filter in place instead of copying the
+	   result into the cache */
+	struct output_filter_group *group = ao->filter_group;
+	if (group != NULL && output_filter_group_is_shared(group)) {
+		output_filter_group_lock(group);
+
+		const void *data =
+			output_filter_group_get(group, chunk, length_r,
+						entry_r);
+		if (data == NULL &&
+		    output_filter_group_is_next(group, chunk)) {
+			/* we're the first output of the group to
+			   play this chunk */
+			size_t length;
+			data = ao_prepare_chunk(ao, chunk, &length);
+			if (data != NULL)
+				data = output_filter_group_convert(group,
+								   chunk,
+								   data,
+								   length,
+								   length_r,
+								   entry_r,
+								   &error);
+
+			output_filter_group_unlock(group);
+
+			if (data == NULL && error != NULL) {
+				g_warning("\"%s\" [%s] failed to filter: %s",
+					  ao->name, ao->plugin->name,
+					  error->message);
+				g_error_free(error);
+			}
+
+			return data;
+		}
+
+		output_filter_group_unlock(group);
+
+		if (data != NULL)
+			return data;
+
+		/* this output lags behind the group, and the group's
+		   filter state has already moved on; fall back to
+		   this output's own filter */
+	}
+
+	size_t length;
+	const void *data = ao_prepare_chunk(ao, chunk, &length);
+	if (data == NULL)
+		return NULL;
+
+	if (length == 0) {
+		/* empty chunk, nothing to do */
+		*length_r = 0;
+		return data;
+	}
+
 	/* apply filter chain */
 
 	data = filter_filter(ao->filter, data, length, &length, &error);
@@ -452,7 +565,13 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 	/* workaround -Wmaybe-uninitialized false positive */
 	size = 0;
 #endif
-	const char *data = (const char *)ao_filter_chunk(ao, chunk, &size);
+	const uint64_t filter_start = monotonic_clock_us();
+	struct output_filter_entry *entry;
+	const char *data = (const char *)ao_filter_chunk(ao, chunk, &size,
+							 &entry);
+	output_stats_chunk(&ao->stats, music_pipe_size(ao->pipe),
+			   chunk->push_time,
+			   monotonic_clock_us() - filter_start);
 	if (data == NULL) {
 		ao_close(ao, false);
 
@@ -468,9 +587,12 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 		if (!ao_wait(ao))
 			break;
 
+		const uint64_t play_start = monotonic_clock_us();
 		g_mutex_unlock(ao->mutex);
 		nbytes = ao_plugin_play(ao, data, size, &error);
 		g_mutex_lock(ao->mutex);
+		output_stats_play(&ao->stats, nbytes,
+				  monotonic_clock_us() - play_start);
 		if (nbytes == 0) {
 			/* play()==0 means failure */
 			g_warning("\"%s\" [%s] failed to play: %s",
@@ -484,6 +606,8 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 			assert(ao->fail_timer == NULL);
 			ao->fail_timer = g_timer_new();
 
+			if (entry != NULL)
+				output_filter_entry_unref(entry);
 			return false;
 		}
 
@@ -494,6 +618,9 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 		size -= nbytes;
 	}
 
+	if (entry != NULL)
+		output_filter_entry_unref(entry);
+
 	return true;
 }
 
@@ -586,6 +713,10 @@ static gpointer audio_output_task(gpointer arg)
 {
 	struct audio_output *ao = (struct audio_output *)arg;
 
+	char *profile_name = g_strconcat("output:", ao->name, NULL);
+	thread_profile_register(profile_name);
+	g_free(profile_name);
+
 	g_mutex_lock(ao->mutex);
 
 	while (1) {
@@ -667,6 +798,7 @@ static gpointer audio_output_task(gpointer arg)
 			ao->chunk = NULL;
 			ao_command_finished(ao);
 			g_mutex_unlock(ao->mutex);
+			thread_profile_unregister();
 			return NULL;
 		}
 
@@ -184,6 +184,12 @@ handle_status(Client *client,
 			      player_status.bit_rate,
 			      audio_format_to_string(&player_status.audio_format,
 						     &af_string));
+
+		if (player_status.input_buffer_size > 0)
+			client_printf(client,
+				      "input_buffer: %lu:%lu\n",
+				      (unsigned long)player_status.input_buffered,
+				      (unsigned long)player_status.input_buffer_size);
 	}
 
 	if ((updateJobId = isUpdatingDB())) {
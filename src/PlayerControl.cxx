@@ -41,6 +41,7 @@ player_control::player_control(unsigned _buffer_chunks,
 	 state(PLAYER_STATE_STOP),
 	 error_type(PLAYER_ERROR_NONE),
 	 error(nullptr),
+	 input_buffered(0), input_buffer_size(0),
 	 next_song(nullptr),
 	 cross_fade_seconds(0),
 	 mixramp_db(0),
@@ -213,6 +214,8 @@ pc_get_status(struct player_control *pc, struct player_status *status)
 		status->audio_format = pc->audio_format;
 		status->total_time = pc->total_time;
 		status->elapsed_time = pc->elapsed_time;
+		status->input_buffered = pc->input_buffered;
+		status->input_buffer_size = pc->input_buffer_size;
 	}
 
 	player_unlock(pc);
@@ -87,6 +87,7 @@ struct player_status {
 	struct audio_format audio_format;
 	float total_time;
 	float elapsed_time;
+	size_t input_buffered, input_buffer_size;
 };
 
 struct player_control {
@@ -126,6 +127,12 @@ struct player_control {
 	float total_time;
 	float elapsed_time;
 
+	/**
+	 * The fill level of the decoder's read-ahead buffer, copied
+	 * from #decoder_control on PLAYER_COMMAND_REFRESH.
+	 */
+	size_t input_buffered, input_buffer_size;
+
 	/**
 	 * The next queued song.
 	 *
@@ -33,6 +33,7 @@
 #include "tag.h"
 #include "Idle.hxx"
 #include "GlobalEvents.hxx"
+#include "ThreadProfile.hxx"
 
 #include <cmath>
 
@@ -633,13 +634,23 @@ static void player_process_command(struct player *player)
 		player_command_finished_locked(pc);
 		break;
 
-	case PLAYER_COMMAND_REFRESH:
+	case PLAYER_COMMAND_REFRESH: {
 		if (player->output_open && !player->paused) {
 			player_unlock(pc);
 			audio_output_all_check();
 			player_lock(pc);
 		}
 
+		player_unlock(pc);
+		decoder_lock(player->dc);
+		const size_t input_buffered = player->dc->input_buffered;
+		const size_t input_buffer_size = player->dc->input_buffer_size;
+		decoder_unlock(player->dc);
+		player_lock(pc);
+
+		pc->input_buffered = input_buffered;
+		pc->input_buffer_size = input_buffer_size;
+
 		pc->elapsed_time = audio_output_all_get_elapsed_time();
 		if (pc->elapsed_time < 0.0)
 			pc->elapsed_time = player->elapsed_time;
@@ -647,6 +658,7 @@ static void player_process_command(struct player *player)
 		player_command_finished_locked(pc);
 		break;
 	}
+	}
 }
 
 static void
@@ -1096,6 +1108,8 @@ player_task(gpointer arg)
 {
 	struct player_control *pc = (struct player_control *)arg;
 
+	thread_profile_register("player");
+
 	struct decoder_control *dc = dc_new();
 	decoder_thread_start(dc);
 
@@ -1161,6 +1175,7 @@ player_task(gpointer arg)
 			audio_output_all_close();
 			music_buffer_free(player_buffer);
 
+			thread_profile_unregister();
 			player_command_finished(pc);
 			return NULL;
 
@@ -1190,6 +1205,8 @@ player_create(struct player_control *pc)
 {
 	assert(pc->thread == NULL);
 
+	thread_profile_attach(pc->mutex, "player_control");
+
 	GError *e = NULL;
 	pc->thread = g_thread_create(player_task, pc, true, &e);
 	if (pc->thread == NULL)
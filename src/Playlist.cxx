@@ -22,6 +22,11 @@
 #include "PlayerControl.hxx"
 #include "song.h"
 #include "Idle.hxx"
+#include "Mapper.hxx"
+
+extern "C" {
+#include "input/prefetch_input_plugin.h"
+}
 
 #include <glib.h>
 
@@ -72,6 +77,37 @@ playlist_queue_song_order(struct playlist *playlist, struct player_control *pc,
 	pc_enqueue_song(pc, song);
 }
 
+/**
+ * Tells the prefetch cache which files will be played next.
+ */
+static void
+playlist_update_prefetch(const struct playlist *playlist, int order)
+{
+	const unsigned max_songs = prefetch_max_songs();
+	if (max_songs == 0)
+		return;
+
+	char **paths = g_new(char *, max_songs);
+	unsigned n = 0;
+
+	for (unsigned i = 0; i < max_songs && order >= 0; ++i) {
+		const struct song *song = playlist->queue.GetOrder(order);
+		if (song_is_file(song)) {
+			char *path = map_song_fs(song);
+			if (path != nullptr)
+				paths[n++] = path;
+		}
+
+		order = playlist->queue.GetNextOrder(order);
+	}
+
+	prefetch_schedule(paths, n);
+
+	for (unsigned i = 0; i < n; ++i)
+		g_free(paths[i]);
+	g_free(paths);
+}
+
 /**
  * Called if the player thread has started playing the "queued" song.
  */
@@ -146,6 +182,8 @@ playlist::UpdateQueuedSong(player_control &pc, const song *prev)
 		else
 			queued = next_order;
 	}
+
+	playlist_update_prefetch(this, next_order);
 }
 
 void
@@ -26,6 +26,7 @@
 #include "Main.hxx"
 #include "event/Loop.hxx"
 #include "GlobalEvents.hxx"
+#include "ThreadProfile.hxx"
 #include "mpd_error.h"
 
 #include <glib.h>
@@ -44,6 +45,11 @@ static void reload_signal_handler(G_GNUC_UNUSED int signum)
 	GlobalEvents::Emit(GlobalEvents::RELOAD);
 }
 
+static void profile_signal_handler(G_GNUC_UNUSED int signum)
+{
+	GlobalEvents::Emit(GlobalEvents::PROFILE);
+}
+
 static void
 x_sigaction(int signum, const struct sigaction *act)
 {
@@ -58,6 +64,12 @@ handle_reload_event(void)
 	cycle_log_files();
 }
 
+static void
+handle_profile_event(void)
+{
+	thread_profile_log();
+}
+
 #endif
 
 void initSigHandlers(void)
@@ -77,5 +89,9 @@ void initSigHandlers(void)
 	GlobalEvents::Register(GlobalEvents::RELOAD, handle_reload_event);
 	sa.sa_handler = reload_signal_handler;
 	x_sigaction(SIGHUP, &sa);
+
+	GlobalEvents::Register(GlobalEvents::PROFILE, handle_profile_event);
+	sa.sa_handler = profile_signal_handler;
+	x_sigaction(SIGUSR2, &sa);
 #endif
 }
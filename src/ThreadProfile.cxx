@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "ThreadProfile.hxx"
+#include "DatabaseLock.hxx"
+#include "TagPool.hxx"
+#include "Client.hxx"
+#include "conf.h"
+
+#include <glib.h>
+
+#include <list>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "profile"
+
+#ifndef WIN32
+
+struct ThreadCounters {
+	/**
+	 * CPU time consumed by the thread [nanoseconds].
+	 */
+	uint64_t cpu_ns;
+
+	/**
+	 * The number of voluntary context switches (i.e. the thread
+	 * went to sleep) and involuntary context switches (it was
+	 * preempted).
+	 */
+	uint64_t voluntary, involuntary;
+
+	constexpr ThreadCounters():cpu_ns(0), voluntary(0), involuntary(0) {}
+
+	void Add(const ThreadCounters &other) {
+		cpu_ns += other.cpu_ns;
+		voluntary += other.voluntary;
+		involuntary += other.involuntary;
+	}
+};
+
+struct ThreadProfile {
+	char *name;
+
+	/**
+	 * How often has a thread with this name been registered?
+	 */
+	unsigned runs;
+
+	bool running;
+
+	/**
+	 * The following attributes describe the currently running
+	 * thread; only valid if #running is true.
+	 */
+	pthread_t thread;
+	clockid_t clock;
+	bool has_clock;
+
+#ifdef __linux__
+	pid_t tid;
+#endif
+
+	/**
+	 * The sum of all threads which have already exited.
+	 */
+	ThreadCounters total;
+
+	ThreadProfile(const char *_name)
+		:name(g_strdup(_name)), runs(0), running(false) {}
+
+	~ThreadProfile() {
+		g_free(name);
+	}
+
+	ThreadProfile(const ThreadProfile &other) = delete;
+	ThreadProfile &operator=(const ThreadProfile &other) = delete;
+
+	/**
+	 * Returns the counters of the running thread.  May be called
+	 * from any thread (while holding #profile_mutex).
+	 */
+	ThreadCounters GetCurrent() const;
+
+	ThreadCounters Get() const {
+		ThreadCounters result = total;
+		if (running)
+			result.Add(GetCurrent());
+		return result;
+	}
+};
+
+static uint64_t
+timespec_ns(const struct timespec &ts)
+{
+	return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef __linux__
+
+/**
+ * Parses the context switch counters from /proc/self/task/TID/status.
+ */
+static void
+read_task_switches(pid_t tid, ThreadCounters &counters)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)tid);
+
+	FILE *file = fopen(path, "r");
+	if (file == nullptr)
+		return;
+
+	char line[256];
+	unsigned long long value;
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		if (sscanf(line, "voluntary_ctxt_switches: %llu",
+			   &value) == 1)
+			counters.voluntary = value;
+		else if (sscanf(line, "nonvoluntary_ctxt_switches: %llu",
+				&value) == 1)
+			counters.involuntary = value;
+	}
+
+	fclose(file);
+}
+
+#endif
+
+ThreadCounters
+ThreadProfile::GetCurrent() const
+{
+	assert(running);
+
+	ThreadCounters result;
+
+	struct timespec ts;
+	if (has_clock && clock_gettime(clock, &ts) == 0)
+		result.cpu_ns = timespec_ns(ts);
+
+#ifdef __linux__
+	read_task_switches(tid, result);
+#endif
+
+	return result;
+}
+
+/**
+ * Returns the counters of the calling thread.
+ */
+static ThreadCounters
+get_self_counters()
+{
+	ThreadCounters result;
+
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		result.cpu_ns = timespec_ns(ts);
+
+#ifdef RUSAGE_THREAD
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		result.voluntary = usage.ru_nvcsw;
+		result.involuntary = usage.ru_nivcsw;
+	}
+#endif
+
+	return result;
+}
+
+static bool profile_enabled;
+
+/**
+ * Protects #profile_threads and #profile_locks (but not the lock
+ * counters, which are atomic).
+ */
+static Mutex profile_mutex;
+
+static std::list<ThreadProfile> profile_threads;
+static std::list<LockProfile> profile_locks;
+
+static LockProfile &
+get_lock_profile(const char *name)
+{
+	const ScopeLock protect(profile_mutex);
+
+	for (auto &i : profile_locks)
+		if (strcmp(i.name, name) == 0)
+			return i;
+
+	profile_locks.emplace_back(name);
+	return profile_locks.back();
+}
+
+void
+thread_profile_global_init(void)
+{
+	profile_enabled = config_get_bool(CONF_PROFILE, false);
+	if (!profile_enabled)
+		return;
+
+	db_mutex.SetProfile(&get_lock_profile("db_mutex"));
+	tag_pool_lock.SetProfile(&get_lock_profile("tag_pool_lock"));
+
+	thread_profile_register("main");
+}
+
+void
+thread_profile_global_finish(void)
+{
+	if (!profile_enabled)
+		return;
+
+	db_mutex.SetProfile(nullptr);
+	tag_pool_lock.SetProfile(nullptr);
+
+	profile_threads.clear();
+	profile_locks.clear();
+	profile_enabled = false;
+}
+
+bool
+thread_profile_enabled(void)
+{
+	return profile_enabled;
+}
+
+void
+thread_profile_register(const char *name)
+{
+	if (!profile_enabled)
+		return;
+
+	const ScopeLock protect(profile_mutex);
+
+	ThreadProfile *profile = nullptr;
+	for (auto &i : profile_threads) {
+		if (!i.running && strcmp(i.name, name) == 0) {
+			profile = &i;
+			break;
+		}
+	}
+
+	if (profile == nullptr) {
+		profile_threads.emplace_back(name);
+		profile = &profile_threads.back();
+	}
+
+	++profile->runs;
+	profile->running = true;
+	profile->thread = pthread_self();
+	profile->has_clock =
+		pthread_getcpuclockid(profile->thread, &profile->clock) == 0;
+#ifdef __linux__
+	profile->tid = syscall(SYS_gettid);
+#endif
+}
+
+void
+thread_profile_unregister(void)
+{
+	if (!profile_enabled)
+		return;
+
+	const ThreadCounters counters = get_self_counters();
+	const pthread_t self = pthread_self();
+
+	const ScopeLock protect(profile_mutex);
+
+	for (auto &i : profile_threads) {
+		if (i.running && pthread_equal(i.thread, self)) {
+			i.running = false;
+			i.total.Add(counters);
+			return;
+		}
+	}
+}
+
+void
+thread_profile_attach(Mutex &mutex, const char *name)
+{
+	if (!profile_enabled)
+		return;
+
+	mutex.SetProfile(&get_lock_profile(name));
+}
+
+static double
+ns_to_s(uint64_t ns)
+{
+	return ns / 1000000000.;
+}
+
+void
+thread_profile_print(Client *client)
+{
+	const ScopeLock protect(profile_mutex);
+
+	for (const auto &i : profile_threads) {
+		const ThreadCounters counters = i.Get();
+
+		client_printf(client,
+			      "thread: %s\n"
+			      "runs: %u\n"
+			      "running: %i\n"
+			      "cpu_time: %.3f\n"
+			      "voluntary_switches: %llu\n"
+			      "involuntary_switches: %llu\n",
+			      i.name, i.runs, i.running,
+			      ns_to_s(counters.cpu_ns),
+			      (unsigned long long)counters.voluntary,
+			      (unsigned long long)counters.involuntary);
+	}
+
+	for (const auto &i : profile_locks)
+		client_printf(client,
+			      "lock: %s\n"
+			      "acquisitions: %llu\n"
+			      "contentions: %llu\n"
+			      "wait_time: %.6f\n"
+			      "max_wait_time: %.6f\n",
+			      i.name,
+			      (unsigned long long)i.acquisitions.load(),
+			      (unsigned long long)i.contentions.load(),
+			      ns_to_s(i.wait_ns.load()),
+			      ns_to_s(i.max_wait_ns.load()));
+}
+
+void
+thread_profile_log(void)
+{
+	if (!profile_enabled) {
+		g_message("profiling is disabled");
+		return;
+	}
+
+	const ScopeLock protect(profile_mutex);
+
+	for (const auto &i : profile_threads) {
+		const ThreadCounters counters = i.Get();
+
+		g_message("thread %s: cpu=%.3fs switches=%llu+%llu runs=%u%s",
+			  i.name, ns_to_s(counters.cpu_ns),
+			  (unsigned long long)counters.voluntary,
+			  (unsigned long long)counters.involuntary,
+			  i.runs, i.running ? "" : " (exited)");
+	}
+
+	for (const auto &i : profile_locks)
+		g_message("lock %s: acquisitions=%llu contentions=%llu "
+			  "wait=%.6fs max_wait=%.6fs",
+			  i.name,
+			  (unsigned long long)i.acquisitions.load(),
+			  (unsigned long long)i.contentions.load(),
+			  ns_to_s(i.wait_ns.load()),
+			  ns_to_s(i.max_wait_ns.load()));
+}
+
+#else /* WIN32 */
+
+void
+thread_profile_global_init(void)
+{
+	if (config_get_bool(CONF_PROFILE, false))
+		g_warning("profiling is not supported on this platform");
+}
+
+void
+thread_profile_global_finish(void)
+{
+}
+
+bool
+thread_profile_enabled(void)
+{
+	return false;
+}
+
+void
+thread_profile_register(gcc_unused const char *name)
+{
+}
+
+void
+thread_profile_unregister(void)
+{
+}
+
+void
+thread_profile_attach(gcc_unused Mutex &mutex, gcc_unused const char *name)
+{
+}
+
+void
+thread_profile_print(gcc_unused Client *client)
+{
+}
+
+void
+thread_profile_log(void)
+{
+}
+
+#endif
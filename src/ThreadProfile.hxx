@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Optional profiling of MPD's threads and its most important locks:
+ * CPU time and context switches per thread, and contention on the
+ * global mutexes.  Enabled with the "profile" setting; the counters
+ * are reported by the "profile" command and on SIGUSR2.
+ */
+
+#ifndef MPD_THREAD_PROFILE_HXX
+#define MPD_THREAD_PROFILE_HXX
+
+#include "thread/Mutex.hxx"
+#include "gcc.h"
+
+class Client;
+
+/**
+ * Reads the configuration, and if profiling is enabled, registers
+ * the calling (main) thread and the global locks.  Call this after
+ * daemonizing, but before starting other threads.
+ */
+void
+thread_profile_global_init(void);
+
+void
+thread_profile_global_finish(void);
+
+gcc_pure
+bool
+thread_profile_enabled(void);
+
+/**
+ * Registers the calling thread.  Threads with the same name share
+ * one entry, i.e. the counters of a thread which is started
+ * repeatedly (e.g. the update thread) are accumulated.  This is a
+ * no-op if profiling is disabled.
+ */
+void
+thread_profile_register(const char *name);
+
+/**
+ * Unregisters the calling thread, and adds its counters to the
+ * entry.  Must be called before a registered thread exits.
+ */
+void
+thread_profile_unregister(void);
+
+/**
+ * Enables contention profiling for the specified mutex.  All
+ * mutexes attached with the same name share their counters.  This
+ * is a no-op if profiling is disabled.  Must be called while no
+ * other thread uses the mutex.
+ *
+ * @param name a string literal
+ */
+void
+thread_profile_attach(Mutex &mutex, const char *name);
+
+/**
+ * Prints all counters to the client.
+ */
+void
+thread_profile_print(Client *client);
+
+/**
+ * Writes all counters to the log file.
+ */
+void
+thread_profile_log(void);
+
+#endif
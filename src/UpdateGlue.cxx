@@ -26,6 +26,7 @@
 #include "DatabaseSimple.hxx"
 #include "Idle.hxx"
 #include "GlobalEvents.hxx"
+#include "ThreadProfile.hxx"
 
 extern "C" {
 #include "stats.h"
@@ -69,6 +70,8 @@ static void * update_task(void *_path)
 {
 	const char *path = (const char *)_path;
 
+	thread_profile_register("update");
+
 	if (path != NULL && *path != 0)
 		g_debug("starting: %s", path);
 	else
@@ -91,6 +94,8 @@ static void * update_task(void *_path)
 		g_debug("finished");
 	g_free(_path);
 
+	thread_profile_unregister();
+
 	progress = UPDATE_PROGRESS_DONE;
 	GlobalEvents::Emit(GlobalEvents::UPDATE);
 	return NULL;
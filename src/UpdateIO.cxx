@@ -28,6 +28,14 @@
 #include <errno.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
 int
 stat_directory(const Directory *directory, struct stat *st)
 {
@@ -115,3 +123,36 @@ directory_child_access(const Directory *directory,
 	return success;
 #endif
 }
+
+uint64_t
+update_io_read_bytes(void)
+{
+#ifdef __linux__
+	/* "rchar" in the per-thread I/O accounting counts all bytes
+	   passed through read() and pread(), which includes the
+	   decoder libraries that open the file by themselves */
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/task/%ld/io",
+		 (long)syscall(SYS_gettid));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	char buffer[512];
+	ssize_t nbytes = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+	if (nbytes <= 0)
+		return 0;
+
+	buffer[nbytes] = 0;
+
+	const char *p = strstr(buffer, "rchar:");
+	if (p == NULL)
+		return 0;
+
+	return strtoull(p + 6, NULL, 10);
+#else
+	return 0;
+#endif
+}
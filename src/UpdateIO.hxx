@@ -23,6 +23,7 @@
 #include "check.h"
 
 #include <sys/stat.h>
+#include <stdint.h>
 
 struct Directory;
 
@@ -47,4 +48,13 @@ bool
 directory_child_access(const Directory *directory,
 		       const char *name, int mode);
 
+/**
+ * Returns the number of bytes the calling thread has read so far
+ * (including reads served from the page cache), or 0 if the operating
+ * system does not tell.  The difference between two calls is the
+ * I/O cost of the work in between.
+ */
+uint64_t
+update_io_read_bytes(void);
+
 #endif
@@ -22,7 +22,16 @@
 
 #include "check.h"
 
+#include <stdint.h>
+
 extern bool walk_discard;
 extern bool modified;
 
+/**
+ * The number of songs scanned by this update, and the number of
+ * bytes read while scanning them.
+ */
+extern unsigned walk_scanned_songs;
+extern uint64_t walk_scanned_bytes;
+
 #endif
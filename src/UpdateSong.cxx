@@ -36,6 +36,24 @@ extern "C" {
 
 #include <unistd.h>
 
+/**
+ * Logs and accounts the I/O of one song scan.
+ *
+ * @param before the value of update_io_read_bytes() before the scan
+ */
+static void
+update_song_scanned(const Directory *directory, const char *name,
+		    uint64_t before)
+{
+	const uint64_t nbytes = update_io_read_bytes() - before;
+
+	++walk_scanned_songs;
+	walk_scanned_bytes += nbytes;
+
+	g_debug("scanned %s/%s: %llu bytes",
+		directory->GetPath(), name, (unsigned long long)nbytes);
+}
+
 static void
 update_song_file2(Directory *directory,
 		  const char *name, const struct stat *st,
@@ -71,7 +89,9 @@ update_song_file2(Directory *directory,
 
 	if (song == NULL) {
 		g_debug("reading %s/%s", directory->GetPath(), name);
+		const uint64_t before = update_io_read_bytes();
 		song = song_file_load(name, directory);
+		update_song_scanned(directory, name, before);
 		if (song == NULL) {
 			g_debug("ignoring unrecognized file %s/%s",
 				directory->GetPath(), name);
@@ -88,7 +108,10 @@ update_song_file2(Directory *directory,
 	} else if (st->st_mtime != song->mtime || walk_discard) {
 		g_message("updating %s/%s",
 			  directory->GetPath(), name);
-		if (!song_file_update(song)) {
+		const uint64_t before = update_io_read_bytes();
+		const bool success = song_file_update(song);
+		update_song_scanned(directory, name, before);
+		if (!success) {
 			g_debug("deleting unrecognized file %s/%s",
 				directory->GetPath(), name);
 			db_lock();
@@ -54,6 +54,8 @@ extern "C" {
 
 bool walk_discard;
 bool modified;
+unsigned walk_scanned_songs;
+uint64_t walk_scanned_bytes;
 
 #ifndef WIN32
 
@@ -496,6 +498,8 @@ update_walk(const char *path, bool discard)
 {
 	walk_discard = discard;
 	modified = false;
+	walk_scanned_songs = 0;
+	walk_scanned_bytes = 0;
 
 	if (path != NULL && !isRootDirectory(path)) {
 		update_uri(path);
@@ -507,5 +511,11 @@ update_walk(const char *path, bool discard)
 			update_directory(directory, &st);
 	}
 
+	if (walk_scanned_bytes > 0)
+		/* not available on all operating systems */
+		g_message("scanned %u songs, read %llu kB",
+			  walk_scanned_songs,
+			  (unsigned long long)(walk_scanned_bytes / 1024));
+
 	return modified;
 }
@@ -53,6 +53,9 @@
 #define CONF_SAMPLERATE_CONVERTER       "samplerate_converter"
 #define CONF_AUDIO_BUFFER_SIZE          "audio_buffer_size"
 #define CONF_BUFFER_BEFORE_PLAY         "buffer_before_play"
+#define CONF_INPUT_BUFFER_SIZE          "input_buffer_size"
+#define CONF_PREFETCH_SIZE              "prefetch_size"
+#define CONF_PREFETCH_SONGS             "prefetch_songs"
 #define CONF_HTTP_PROXY_HOST            "http_proxy_host"
 #define CONF_HTTP_PROXY_PORT            "http_proxy_port"
 #define CONF_HTTP_PROXY_USER            "http_proxy_user"
@@ -75,6 +78,7 @@
 #define CONF_DESPOTIFY_USER             "despotify_user"
 #define CONF_DESPOTIFY_PASSWORD         "despotify_password"
 #define CONF_DESPOTIFY_HIGH_BITRATE     "despotify_high_bitrate"
+#define CONF_PROFILE                    "profile"
 
 #define DEFAULT_PLAYLIST_MAX_LENGTH (1024*16)
 #define DEFAULT_PLAYLIST_SAVE_ABSOLUTE_PATHS false
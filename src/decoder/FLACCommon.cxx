@@ -38,6 +38,7 @@ flac_data::flac_data(struct decoder *_decoder,
 		     struct input_stream *_input_stream)
 	:FLACInput(_input_stream, _decoder),
 	 initialized(false), unsupported(false),
+	 stream_info(),
 	 total_frames(0), first_frame(0), next_frame(0), position(0),
 	 decoder(_decoder), input_stream(_input_stream),
 	 tag(nullptr)
@@ -93,6 +94,7 @@ flac_got_stream_info(struct flac_data *data,
 	}
 
 	data->frame_size = audio_format_frame_size(&data->audio_format);
+	data->stream_info = *stream_info;
 
 	if (data->total_frames == 0)
 		data->total_frames = stream_info->total_samples;
@@ -173,29 +175,60 @@ flac_common_write(struct flac_data *data, const FLAC__Frame * frame,
 		  const FLAC__int32 *const buf[],
 		  FLAC__uint64 nbytes)
 {
-	enum decoder_command cmd;
-	void *buffer;
+	enum decoder_command cmd = DECODE_COMMAND_NONE;
 	unsigned bit_rate;
 
 	if (!data->initialized && !flac_got_first_frame(data, &frame->header))
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
-	size_t buffer_size = frame->header.blocksize * data->frame_size;
-	buffer = pcm_buffer_get(&data->buffer, buffer_size);
-
-	flac_convert(buffer, frame->header.channels,
-		     (enum sample_format)data->audio_format.format, buf,
-		     0, frame->header.blocksize);
-
 	if (nbytes > 0)
 		bit_rate = nbytes * 8 * frame->header.sample_rate /
 			(1000 * frame->header.blocksize);
 	else
 		bit_rate = 0;
 
-	cmd = decoder_data(data->decoder, data->input_stream,
-			   buffer, buffer_size,
-			   bit_rate);
+	const enum sample_format format =
+		(enum sample_format)data->audio_format.format;
+	const unsigned end = frame->header.blocksize;
+	unsigned position = 0;
+
+	while (position < end) {
+		/* interleave directly into the music pipe */
+		size_t max_length;
+		void *dest = decoder_data_begin(data->decoder,
+						data->input_stream,
+						bit_rate, &max_length);
+		if (dest == NULL) {
+			/* conversion needed or command pending: use
+			   our own buffer */
+			size_t buffer_size = (end - position) * data->frame_size;
+			void *buffer = pcm_buffer_get(&data->buffer,
+						      buffer_size);
+
+			flac_convert(buffer, frame->header.channels,
+				     format, buf, position, end);
+
+			cmd = decoder_data(data->decoder, data->input_stream,
+					   buffer, buffer_size,
+					   bit_rate);
+			break;
+		}
+
+		unsigned chunk_end = position + max_length / data->frame_size;
+		if (chunk_end > end)
+			chunk_end = end;
+
+		flac_convert(dest, frame->header.channels,
+			     format, buf, position, chunk_end);
+
+		cmd = decoder_data_commit(data->decoder,
+					  (chunk_end - position) *
+					  data->frame_size);
+		position = chunk_end;
+		if (cmd != DECODE_COMMAND_NONE)
+			break;
+	}
+
 	data->next_frame += frame->header.blocksize;
 	switch (cmd) {
 	case DECODE_COMMAND_NONE:
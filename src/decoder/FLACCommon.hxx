@@ -61,6 +61,12 @@ struct flac_data : public FLACInput {
 	 */
 	struct audio_format audio_format;
 
+	/**
+	 * A copy of the STREAMINFO block.  All attributes are zero if
+	 * there was none.
+	 */
+	FLAC__StreamMetadata_StreamInfo stream_info;
+
 	/**
 	 * The total number of frames in this song.  The decoder
 	 * plugin may initialize this attribute to override the value
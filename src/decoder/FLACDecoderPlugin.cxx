@@ -21,6 +21,7 @@
 #include "FLACDecoderPlugin.h"
 #include "FLACCommon.hxx"
 #include "FLACMetaData.hxx"
+#include "FLACParallel.hxx"
 #include "OggCodec.hxx"
 
 #include <glib.h>
@@ -35,6 +36,12 @@
 #error libFLAC is too old
 #endif
 
+/**
+ * The number of worker threads for decoding native FLAC streams; 0
+ * decodes serially in the decoder thread.
+ */
+static unsigned flac_threads;
+
 static void flacPrintErroredState(FLAC__StreamDecoderState state)
 {
 	switch (state) {
@@ -276,12 +283,24 @@ flac_decode_internal(struct decoder * decoder,
 		return;
 	}
 
-	flac_decoder_loop(&data, flac_dec, 0, 0);
+	if (is_ogg || flac_threads == 0 ||
+	    !flac_parallel_decode(&data, flac_dec, flac_threads))
+		flac_decoder_loop(&data, flac_dec, 0, 0);
 
 	FLAC__stream_decoder_finish(flac_dec);
 	FLAC__stream_decoder_delete(flac_dec);
 }
 
+static bool
+flac_init(const struct config_param *param)
+{
+	flac_threads = config_get_block_unsigned(param, "threads", 0);
+	if (flac_threads > FLAC_PARALLEL_MAX_THREADS)
+		flac_threads = FLAC_PARALLEL_MAX_THREADS;
+
+	return true;
+}
+
 static void
 flac_decode(struct decoder * decoder, struct input_stream *input_stream)
 {
@@ -371,7 +390,7 @@ static const char *const flac_mime_types[] = {
 
 const struct decoder_plugin flac_decoder_plugin = {
 	"flac",
-	nullptr,
+	flac_init,
 	nullptr,
 	flac_decode,
 	nullptr,
@@ -0,0 +1,982 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "FLACParallel.hxx"
+#include "FLAC_PCM.hxx"
+#include "thread/Mutex.hxx"
+#include "thread/Cond.hxx"
+
+#include <glib.h>
+
+#include <deque>
+#include <vector>
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * The maximum size of a FLAC frame header, including the CRC-8.
+ */
+static constexpr size_t FLAC_MAX_FRAME_HEADER = 16;
+
+/**
+ * Give up if no frame header is found within this many bytes.  The
+ * largest possible FLAC frame (65535 samples, 8 channels, 32 bit,
+ * verbatim) is a bit more than 2 MB.
+ */
+static constexpr size_t FLAC_MAX_FRAME_SIZE = 4 * 1024 * 1024;
+
+/**
+ * The size of the synthetic stream header passed to the workers:
+ * "fLaC", the metadata block header and the STREAMINFO block.
+ */
+static constexpr size_t FLAC_STREAM_HEADER_SIZE =
+	4 + 4 + FLAC__STREAM_METADATA_STREAMINFO_LENGTH;
+
+struct flac_frame_header {
+	/**
+	 * Is this a variable block size stream?  Then #number is a
+	 * sample number, otherwise it's a frame number.
+	 */
+	bool variable;
+
+	FLAC__uint64 number;
+
+	unsigned blocksize;
+};
+
+static unsigned
+flac_crc8(const FLAC__byte *p, size_t length)
+{
+	unsigned crc = 0;
+
+	while (length-- > 0) {
+		crc ^= *p++;
+		for (unsigned i = 0; i < 8; ++i)
+			crc = crc & 0x80
+				? ((crc << 1) ^ 0x07) & 0xff
+				: (crc << 1) & 0xff;
+	}
+
+	return crc;
+}
+
+/**
+ * Parses and verifies a frame header.
+ *
+ * @return the length of the header, or 0 if this is not a valid
+ * header (or if it is truncated)
+ */
+static size_t
+flac_parse_frame_header(const FLAC__byte *p, size_t length,
+			struct flac_frame_header *header)
+{
+	if (length < 5 || p[0] != 0xff || (p[1] & 0xfe) != 0xf8)
+		return 0;
+
+	const unsigned blocksize_code = p[2] >> 4;
+	const unsigned rate_code = p[2] & 0xf;
+	if (blocksize_code == 0 || rate_code == 0xf ||
+	    /* reserved channel assignment */
+	    (p[3] >> 4) >= 11 ||
+	    /* reserved sample size */
+	    ((p[3] >> 1) & 0x7) == 3 ||
+	    /* reserved bit */
+	    (p[3] & 0x1) != 0)
+		return 0;
+
+	header->variable = (p[1] & 0x1) != 0;
+
+	/* the frame/sample number, coded like UTF-8 */
+
+	size_t i = 4;
+	FLAC__uint64 number = p[i++];
+	unsigned extra;
+	if ((number & 0x80) == 0)
+		extra = 0;
+	else if ((number & 0xe0) == 0xc0) {
+		number &= 0x1f;
+		extra = 1;
+	} else if ((number & 0xf0) == 0xe0) {
+		number &= 0x0f;
+		extra = 2;
+	} else if ((number & 0xf8) == 0xf0) {
+		number &= 0x07;
+		extra = 3;
+	} else if ((number & 0xfc) == 0xf8) {
+		number &= 0x03;
+		extra = 4;
+	} else if ((number & 0xfe) == 0xfc) {
+		number &= 0x01;
+		extra = 5;
+	} else if (number == 0xfe && header->variable) {
+		number = 0;
+		extra = 6;
+	} else
+		return 0;
+
+	if (i + extra > length)
+		return 0;
+
+	for (; extra > 0; --extra, ++i) {
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+
+		number = (number << 6) | (p[i] & 0x3f);
+	}
+
+	header->number = number;
+
+	switch (blocksize_code) {
+	case 1:
+		header->blocksize = 192;
+		break;
+
+	case 2:
+	case 3:
+	case 4:
+	case 5:
+		header->blocksize = 576 << (blocksize_code - 2);
+		break;
+
+	case 6:
+		if (i + 1 > length)
+			return 0;
+
+		header->blocksize = p[i] + 1;
+		i += 1;
+		break;
+
+	case 7:
+		if (i + 2 > length)
+			return 0;
+
+		header->blocksize = ((p[i] << 8) | p[i + 1]) + 1;
+		i += 2;
+		break;
+
+	default:
+		header->blocksize = 256 << (blocksize_code - 8);
+		break;
+	}
+
+	if (rate_code == 12)
+		i += 1;
+	else if (rate_code == 13 || rate_code == 14)
+		i += 2;
+
+	if (i + 1 > length || flac_crc8(p, i) != p[i])
+		return 0;
+
+	return i + 1;
+}
+
+/**
+ * Reads a FLAC stream and splits it into frames.
+ */
+class FlacFrameScanner {
+	struct decoder *const decoder;
+	struct input_stream *const input_stream;
+
+	std::vector<FLAC__byte> buffer;
+
+	/**
+	 * The range of #buffer which contains data.
+	 */
+	size_t start, end;
+
+	/**
+	 * The stream offset of buffer[start].
+	 */
+	goffset offset;
+
+	/**
+	 * Must the input stream be seeked to #offset before the next
+	 * read?
+	 */
+	bool need_seek;
+
+	bool eof;
+
+	/**
+	 * Has a frame been found since the last Reset()?  Then all
+	 * following frame headers must continue its numbering.
+	 */
+	bool synced;
+
+	bool variable;
+
+	FLAC__uint64 expected_number;
+
+public:
+	FlacFrameScanner(struct decoder *_decoder,
+			 struct input_stream *_input_stream)
+		:decoder(_decoder), input_stream(_input_stream),
+		 buffer(64 * 1024) {}
+
+	/**
+	 * Restart at the specified stream offset, which must be the
+	 * start of a frame.
+	 */
+	void Reset(goffset _offset) {
+		start = end = 0;
+		offset = _offset;
+		need_seek = true;
+		eof = false;
+		synced = false;
+	}
+
+	/**
+	 * Returns the stream offset of the next frame.
+	 */
+	goffset GetOffset() const {
+		return offset;
+	}
+
+	/**
+	 * Copies the next frame to the specified buffer.
+	 *
+	 * @return false on end of stream, on error, or if a decoder
+	 * command has interrupted the read
+	 */
+	bool Read(std::vector<FLAC__byte> &frame);
+
+private:
+	void Consume(size_t length) {
+		assert(length <= end - start);
+
+		start += length;
+		offset += length;
+	}
+
+	/**
+	 * Reads from the stream until at least the specified number
+	 * of bytes are in the buffer, or until the end of the stream.
+	 *
+	 * @return false on error, or if a decoder command has
+	 * interrupted the read
+	 */
+	bool Fill(size_t length);
+
+	/**
+	 * Searches for a valid frame header, starting at the specified
+	 * position relative to #start.  If #synced is true, its
+	 * frame/sample number must be #expected_number.
+	 *
+	 * @return the position of the frame header relative to
+	 * #start, or (size_t)-1 if none was found
+	 */
+	size_t FindHeader(size_t i, struct flac_frame_header *header,
+			  size_t *header_length_r);
+};
+
+bool
+FlacFrameScanner::Fill(size_t length)
+{
+	while (end - start < length && !eof) {
+		if (start > 0 &&
+		    (end == buffer.size() || start >= buffer.size() / 2)) {
+			/* move the data to the beginning of the
+			   buffer */
+			memmove(&buffer[0], &buffer[start], end - start);
+			end -= start;
+			start = 0;
+		}
+
+		if (end == buffer.size())
+			buffer.resize(buffer.size() * 2);
+
+		size_t nbytes = decoder_read(decoder, input_stream,
+					     &buffer[end],
+					     buffer.size() - end);
+		if (nbytes == 0) {
+			if (!input_stream_lock_eof(input_stream))
+				return false;
+
+			eof = true;
+		}
+
+		end += nbytes;
+	}
+
+	return true;
+}
+
+size_t
+FlacFrameScanner::FindHeader(size_t i, struct flac_frame_header *header,
+			     size_t *header_length_r)
+{
+	while (true) {
+		const size_t available = end - start;
+
+		if (i + FLAC_MAX_FRAME_HEADER > available && !eof) {
+			if (i > FLAC_MAX_FRAME_SIZE ||
+			    !Fill(i + FLAC_MAX_FRAME_HEADER))
+				return (size_t)-1;
+
+			continue;
+		}
+
+		if (i + 2 > available)
+			/* end of stream */
+			return (size_t)-1;
+
+		/* all candidates before search_end have enough data
+		   for parsing a complete header */
+		const FLAC__byte *base = &buffer[start];
+		const size_t search_end = eof
+			? available - 1
+			: available - FLAC_MAX_FRAME_HEADER + 1;
+
+		const FLAC__byte *p = (const FLAC__byte *)
+			memchr(base + i, 0xff, search_end - i);
+		if (p == nullptr) {
+			i = search_end;
+			continue;
+		}
+
+		i = p - base;
+
+		size_t header_length =
+			flac_parse_frame_header(p, available - i, header);
+		if (header_length > 0 &&
+		    (!synced || (header->variable == variable &&
+				 header->number == expected_number))) {
+			*header_length_r = header_length;
+			return i;
+		}
+
+		++i;
+	}
+}
+
+bool
+FlacFrameScanner::Read(std::vector<FLAC__byte> &frame)
+{
+	if (need_seek) {
+		if (!input_stream_lock_seek(input_stream, offset, SEEK_SET,
+					    nullptr))
+			return false;
+
+		need_seek = false;
+	}
+
+	struct flac_frame_header header;
+	size_t header_length;
+	size_t i = FindHeader(0, &header, &header_length);
+	if (i == (size_t)-1)
+		return false;
+
+	if (i > 0) {
+		g_debug("skipping %u bytes before frame", (unsigned)i);
+		Consume(i);
+	}
+
+	synced = true;
+	variable = header.variable;
+	expected_number = variable
+		? header.number + header.blocksize
+		: header.number + 1;
+
+	/* the frame ends where the next one begins */
+
+	struct flac_frame_header next;
+	size_t next_header_length;
+	i = FindHeader(header_length, &next, &next_header_length);
+	if (i == (size_t)-1) {
+		if (!eof)
+			return false;
+
+		/* the last frame */
+		i = end - start;
+	}
+
+	frame.assign(&buffer[start], &buffer[start] + i);
+	Consume(i);
+	return true;
+}
+
+struct FlacFrameJob {
+	/**
+	 * The encoded frame.
+	 */
+	std::vector<FLAC__byte> input;
+
+	/**
+	 * The decoded PCM data, in the output sample format.
+	 */
+	std::vector<char> output;
+
+	/**
+	 * The stream offset of the encoded frame.
+	 */
+	goffset offset;
+
+	/**
+	 * The number of samples per channel in #output.  0 if the
+	 * frame could not be decoded.
+	 */
+	unsigned blocksize;
+
+	/**
+	 * Has a worker finished this job?  Protected by
+	 * FlacDecoderPool::mutex.
+	 */
+	bool done;
+};
+
+class FlacDecoderPool;
+
+/**
+ * A worker thread with its own libFLAC decoder, which is fed single
+ * frames through the read callback.
+ */
+class FlacFrameWorker {
+	FlacDecoderPool &pool;
+
+	FLAC__StreamDecoder *flac_decoder;
+
+	GThread *thread;
+
+	/**
+	 * The data which has not been consumed by libFLAC yet.
+	 */
+	const FLAC__byte *input;
+	size_t input_size;
+
+	/**
+	 * The job which is being decoded.
+	 */
+	FlacFrameJob *job;
+
+public:
+	FlacFrameWorker(FlacDecoderPool &_pool)
+		:pool(_pool), flac_decoder(nullptr), thread(nullptr) {}
+
+	~FlacFrameWorker() {
+		assert(thread == nullptr);
+
+		if (flac_decoder != nullptr) {
+			FLAC__stream_decoder_finish(flac_decoder);
+			FLAC__stream_decoder_delete(flac_decoder);
+		}
+	}
+
+	FlacFrameWorker(const FlacFrameWorker &) = delete;
+	FlacFrameWorker &operator=(const FlacFrameWorker &) = delete;
+
+	/**
+	 * Creates the libFLAC decoder and starts the thread.
+	 */
+	bool Start();
+
+	void Join() {
+		assert(thread != nullptr);
+
+		g_thread_join(thread);
+		thread = nullptr;
+	}
+
+private:
+	void Run();
+
+	void Decode(FlacFrameJob &job);
+
+	FLAC__StreamDecoderReadStatus Read(FLAC__byte buffer[],
+					   size_t *bytes);
+
+	FLAC__StreamDecoderWriteStatus Write(const FLAC__Frame *frame,
+					     const FLAC__int32 *const buf[]);
+
+	static gpointer ThreadFunc(gpointer ctx);
+
+	static FLAC__StreamDecoderReadStatus
+	ReadCallback(const FLAC__StreamDecoder *flac_decoder,
+		     FLAC__byte buffer[], size_t *bytes, void *ctx);
+
+	static FLAC__StreamDecoderWriteStatus
+	WriteCallback(const FLAC__StreamDecoder *flac_decoder,
+		      const FLAC__Frame *frame,
+		      const FLAC__int32 *const buf[], void *ctx);
+
+	static void
+	ErrorCallback(const FLAC__StreamDecoder *flac_decoder,
+		      FLAC__StreamDecoderErrorStatus status, void *ctx);
+};
+
+class FlacDecoderPool {
+	friend class FlacFrameWorker;
+
+	Mutex mutex;
+
+	/**
+	 * Signalled when a job is submitted or when the workers shall
+	 * quit.
+	 */
+	Cond work_cond;
+
+	/**
+	 * Signalled when a job is done.
+	 */
+	Cond done_cond;
+
+	std::deque<FlacFrameJob *> queue;
+
+	bool quit;
+
+	std::vector<FlacFrameWorker *> workers;
+
+	/**
+	 * Finished jobs which may be reused.  Only accessed by the
+	 * decoder thread.
+	 */
+	std::vector<FlacFrameJob *> spare;
+
+	const FLAC__StreamMetadata_StreamInfo &stream_info;
+	const struct audio_format &audio_format;
+	const unsigned frame_size;
+
+	/**
+	 * Each worker decoder is initialized with this copy of the
+	 * stream header.
+	 */
+	FLAC__byte stream_header[FLAC_STREAM_HEADER_SIZE];
+
+public:
+	FlacDecoderPool(const FLAC__StreamMetadata_StreamInfo &_stream_info,
+			const struct audio_format &_audio_format,
+			unsigned _frame_size);
+	~FlacDecoderPool();
+
+	FlacDecoderPool(const FlacDecoderPool &) = delete;
+	FlacDecoderPool &operator=(const FlacDecoderPool &) = delete;
+
+	bool Start(unsigned n_threads);
+
+	FlacFrameJob *Allocate() {
+		if (spare.empty())
+			return new FlacFrameJob();
+
+		FlacFrameJob *job = spare.back();
+		spare.pop_back();
+		return job;
+	}
+
+	void Free(FlacFrameJob *job) {
+		spare.push_back(job);
+	}
+
+	void Submit(FlacFrameJob *job) {
+		job->done = false;
+
+		const ScopeLock protect(mutex);
+		queue.push_back(job);
+		work_cond.signal();
+	}
+
+	void Wait(FlacFrameJob *job) {
+		const ScopeLock protect(mutex);
+		while (!job->done)
+			done_cond.wait(mutex);
+	}
+
+	/**
+	 * Waits for all jobs in the list and frees them.
+	 */
+	void Discard(std::deque<FlacFrameJob *> &jobs) {
+		for (auto job : jobs) {
+			Wait(job);
+			Free(job);
+		}
+
+		jobs.clear();
+	}
+};
+
+static void
+flac_write_stream_header(FLAC__byte *p,
+			 const FLAC__StreamMetadata_StreamInfo &stream_info)
+{
+	memcpy(p, "fLaC", 4);
+
+	/* the last metadata block */
+	p[4] = 0x80 | FLAC__METADATA_TYPE_STREAMINFO;
+	p[5] = 0;
+	p[6] = 0;
+	p[7] = FLAC__STREAM_METADATA_STREAMINFO_LENGTH;
+	p += 8;
+
+	p[0] = stream_info.min_blocksize >> 8;
+	p[1] = stream_info.min_blocksize;
+	p[2] = stream_info.max_blocksize >> 8;
+	p[3] = stream_info.max_blocksize;
+	p[4] = stream_info.min_framesize >> 16;
+	p[5] = stream_info.min_framesize >> 8;
+	p[6] = stream_info.min_framesize;
+	p[7] = stream_info.max_framesize >> 16;
+	p[8] = stream_info.max_framesize >> 8;
+	p[9] = stream_info.max_framesize;
+
+	/* the total number of samples and the MD5 sum are left
+	   unknown: each worker sees only a few frames from the middle
+	   of the stream */
+	const FLAC__uint64 x =
+		((FLAC__uint64)stream_info.sample_rate << 44) |
+		((FLAC__uint64)(stream_info.channels - 1) << 41) |
+		((FLAC__uint64)(stream_info.bits_per_sample - 1) << 36);
+	for (unsigned i = 0; i < 8; ++i)
+		p[10 + i] = x >> (56 - 8 * i);
+
+	memset(p + 18, 0, 16);
+}
+
+FlacDecoderPool::FlacDecoderPool(const FLAC__StreamMetadata_StreamInfo &_stream_info,
+				 const struct audio_format &_audio_format,
+				 unsigned _frame_size)
+	:quit(false),
+	 stream_info(_stream_info), audio_format(_audio_format),
+	 frame_size(_frame_size)
+{
+	flac_write_stream_header(stream_header, stream_info);
+}
+
+FlacDecoderPool::~FlacDecoderPool()
+{
+	assert(queue.empty());
+
+	mutex.lock();
+	quit = true;
+	work_cond.broadcast();
+	mutex.unlock();
+
+	for (auto worker : workers) {
+		worker->Join();
+		delete worker;
+	}
+
+	for (auto job : spare)
+		delete job;
+}
+
+bool
+FlacDecoderPool::Start(unsigned n_threads)
+{
+	assert(workers.empty());
+
+	for (unsigned i = 0; i < n_threads; ++i) {
+		FlacFrameWorker *worker = new FlacFrameWorker(*this);
+		if (!worker->Start()) {
+			delete worker;
+			return false;
+		}
+
+		workers.push_back(worker);
+	}
+
+	return true;
+}
+
+bool
+FlacFrameWorker::Start()
+{
+	assert(flac_decoder == nullptr);
+	assert(thread == nullptr);
+
+	flac_decoder = FLAC__stream_decoder_new();
+	if (flac_decoder == nullptr)
+		return false;
+
+	FLAC__StreamDecoderInitStatus status =
+		FLAC__stream_decoder_init_stream(flac_decoder,
+						 ReadCallback,
+						 nullptr, nullptr,
+						 nullptr, nullptr,
+						 WriteCallback,
+						 nullptr,
+						 ErrorCallback,
+						 this);
+	if (status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		g_warning("%s", FLAC__StreamDecoderInitStatusString[status]);
+		return false;
+	}
+
+	job = nullptr;
+	input = pool.stream_header;
+	input_size = sizeof(pool.stream_header);
+	if (!FLAC__stream_decoder_process_until_end_of_metadata(flac_decoder) ||
+	    FLAC__stream_decoder_get_state(flac_decoder) !=
+	    FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) {
+		g_warning("failed to initialize the FLAC worker decoder");
+		return false;
+	}
+
+	GError *error = nullptr;
+	thread = g_thread_create(ThreadFunc, this, true, &error);
+	if (thread == nullptr) {
+		g_warning("failed to start the FLAC worker thread: %s",
+			  error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	return true;
+}
+
+inline void
+FlacFrameWorker::Run()
+{
+	pool.mutex.lock();
+
+	while (true) {
+		while (!pool.quit && pool.queue.empty())
+			pool.work_cond.wait(pool.mutex);
+
+		if (pool.quit)
+			break;
+
+		FlacFrameJob *current = pool.queue.front();
+		pool.queue.pop_front();
+		pool.mutex.unlock();
+
+		Decode(*current);
+
+		pool.mutex.lock();
+		current->done = true;
+		pool.done_cond.broadcast();
+	}
+
+	pool.mutex.unlock();
+}
+
+inline void
+FlacFrameWorker::Decode(FlacFrameJob &_job)
+{
+	job = &_job;
+	job->blocksize = 0;
+
+	input = job->input.data();
+	input_size = job->input.size();
+
+	/* forget the state of the previous frame (this is not
+	   necessarily the preceding frame of the stream) */
+	FLAC__stream_decoder_flush(flac_decoder);
+	FLAC__stream_decoder_process_single(flac_decoder);
+
+	job = nullptr;
+}
+
+inline FLAC__StreamDecoderReadStatus
+FlacFrameWorker::Read(FLAC__byte buffer[], size_t *bytes)
+{
+	if (input_size == 0) {
+		*bytes = 0;
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	}
+
+	if (*bytes > input_size)
+		*bytes = input_size;
+
+	memcpy(buffer, input, *bytes);
+	input += *bytes;
+	input_size -= *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+inline FLAC__StreamDecoderWriteStatus
+FlacFrameWorker::Write(const FLAC__Frame *frame,
+		       const FLAC__int32 *const buf[])
+{
+	if (job == nullptr)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+	if (frame->header.channels != pool.stream_info.channels ||
+	    frame->header.bits_per_sample != pool.stream_info.bits_per_sample) {
+		/* the serial decoder would submit this with the
+		   wrong format, too; drop it */
+		g_debug("ignoring frame with a different format");
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	}
+
+	const unsigned blocksize = frame->header.blocksize;
+	job->output.resize(blocksize * pool.frame_size);
+	flac_convert(job->output.data(), frame->header.channels,
+		     (enum sample_format)pool.audio_format.format, buf,
+		     0, blocksize);
+	job->blocksize = blocksize;
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+gpointer
+FlacFrameWorker::ThreadFunc(gpointer ctx)
+{
+	FlacFrameWorker &worker = *(FlacFrameWorker *)ctx;
+	worker.Run();
+	return nullptr;
+}
+
+FLAC__StreamDecoderReadStatus
+FlacFrameWorker::ReadCallback(G_GNUC_UNUSED const FLAC__StreamDecoder *flac_decoder,
+			      FLAC__byte buffer[], size_t *bytes, void *ctx)
+{
+	FlacFrameWorker &worker = *(FlacFrameWorker *)ctx;
+	return worker.Read(buffer, bytes);
+}
+
+FLAC__StreamDecoderWriteStatus
+FlacFrameWorker::WriteCallback(G_GNUC_UNUSED const FLAC__StreamDecoder *flac_decoder,
+			       const FLAC__Frame *frame,
+			       const FLAC__int32 *const buf[], void *ctx)
+{
+	FlacFrameWorker &worker = *(FlacFrameWorker *)ctx;
+	return worker.Write(frame, buf);
+}
+
+void
+FlacFrameWorker::ErrorCallback(G_GNUC_UNUSED const FLAC__StreamDecoder *flac_decoder,
+			       FLAC__StreamDecoderErrorStatus status,
+			       G_GNUC_UNUSED void *ctx)
+{
+	g_debug("%s", FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+bool
+flac_parallel_decode(struct flac_data *data, FLAC__StreamDecoder *flac_dec,
+		     unsigned n_threads)
+{
+	assert(n_threads > 0);
+	assert(data->initialized);
+
+	struct decoder *decoder = data->decoder;
+	struct input_stream *input_stream = data->input_stream;
+
+	/* the worker decoders need the STREAMINFO block, and the
+	   scanner needs to seek back to the first frame, because
+	   libFLAC has already read past it */
+	if (!input_stream->seekable || data->stream_info.max_blocksize == 0)
+		return false;
+
+	FLAC__uint64 position;
+	if (!FLAC__stream_decoder_get_decode_position(flac_dec, &position))
+		return false;
+
+	FlacDecoderPool pool(data->stream_info, data->audio_format,
+			     data->frame_size);
+	if (!pool.Start(n_threads))
+		return false;
+
+	FlacFrameScanner scanner(decoder, input_stream);
+	scanner.Reset(position);
+
+	/* submit a few more frames than there are workers, so no
+	   worker has to wait for the scanner */
+	const size_t max_pending = n_threads * 2 + 1;
+	std::deque<FlacFrameJob *> pending;
+
+	/* the command returned by the last decoder_data() call; it
+	   may be a virtual one (DECODE_COMMAND_STOP at the end of a
+	   CUE track) which decoder_get_command() does not report */
+	enum decoder_command cmd = DECODE_COMMAND_NONE;
+
+	while (true) {
+		if (cmd == DECODE_COMMAND_NONE) {
+			if (data->tag != nullptr &&
+			    !tag_is_empty(data->tag)) {
+				cmd = decoder_tag(decoder, input_stream,
+						  data->tag);
+				tag_free(data->tag);
+				data->tag = tag_new();
+			} else
+				cmd = decoder_get_command(decoder);
+		}
+
+		if (cmd == DECODE_COMMAND_SEEK) {
+			/* where to resume if seeking fails */
+			const goffset resume = pending.empty()
+				? scanner.GetOffset()
+				: pending.front()->offset;
+			pool.Discard(pending);
+
+			/* let the serial decoder find the frame, and
+			   continue scanning after it */
+			FLAC__uint64 seek_sample =
+				decoder_seek_where(decoder) *
+				data->audio_format.sample_rate;
+			if (FLAC__stream_decoder_seek_absolute(flac_dec,
+							       seek_sample) &&
+			    FLAC__stream_decoder_get_decode_position(flac_dec,
+								     &position)) {
+				scanner.Reset(position);
+				data->next_frame = seek_sample;
+				data->position = 0;
+				decoder_command_finished(decoder);
+			} else {
+				FLAC__stream_decoder_flush(flac_dec);
+				scanner.Reset(resume);
+				decoder_seek_error(decoder);
+			}
+		} else if (cmd == DECODE_COMMAND_STOP)
+			break;
+
+		cmd = DECODE_COMMAND_NONE;
+
+		while (pending.size() < max_pending) {
+			FlacFrameJob *job = pool.Allocate();
+			job->offset = scanner.GetOffset();
+			if (!scanner.Read(job->input)) {
+				pool.Free(job);
+				break;
+			}
+
+			pool.Submit(job);
+			pending.push_back(job);
+		}
+
+		if (pending.empty()) {
+			if (decoder_get_command(decoder) == DECODE_COMMAND_NONE)
+				/* end of stream or error */
+				break;
+
+			/* the scanner was interrupted by a command */
+			continue;
+		}
+
+		FlacFrameJob *job = pending.front();
+		pending.pop_front();
+		pool.Wait(job);
+
+		if (job->blocksize > 0) {
+			const unsigned bit_rate =
+				(FLAC__uint64)job->input.size() * 8 *
+				data->audio_format.sample_rate /
+				(1000 * job->blocksize);
+			cmd = decoder_data(decoder, input_stream,
+					   job->output.data(),
+					   job->output.size(), bit_rate);
+			data->next_frame += job->blocksize;
+		}
+
+		pool.Free(job);
+	}
+
+	pool.Discard(pending);
+	return true;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Parallel decoding of native FLAC streams.  FLAC frames are
+ * independent of each other, so the decoder thread only locates the
+ * frame boundaries (by parsing the frame headers) and hands the
+ * encoded frames to a pool of worker threads, each with its own
+ * libFLAC decoder.  The decoded frames are submitted to
+ * decoder_data() in their original order.
+ */
+
+#ifndef MPD_FLAC_PARALLEL_HXX
+#define MPD_FLAC_PARALLEL_HXX
+
+#include "FLACCommon.hxx"
+
+/**
+ * The upper limit for the "threads" setting.
+ */
+static constexpr unsigned FLAC_PARALLEL_MAX_THREADS = 32;
+
+/**
+ * Decodes the remaining frames of a native FLAC stream with a pool
+ * of worker threads.
+ *
+ * The caller must have processed the metadata with #flac_dec; that
+ * decoder is used for seeking only.
+ *
+ * @param n_threads the number of worker threads
+ * @return false if the stream cannot be decoded in parallel (not
+ * seekable, no STREAMINFO, or the workers could not be set up); the
+ * caller should then fall back to the serial decoder loop, which can
+ * continue where it left off
+ */
+bool
+flac_parallel_decode(struct flac_data *data, FLAC__StreamDecoder *flac_dec,
+		     unsigned n_threads);
+
+#endif
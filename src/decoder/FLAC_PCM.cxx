@@ -20,46 +20,13 @@
 #include "config.h"
 #include "FLAC_PCM.hxx"
 
-#include <assert.h>
-
-static void flac_convert_stereo16(int16_t *dest,
-				  const FLAC__int32 * const buf[],
-				  unsigned int position, unsigned int end)
-{
-	for (; position < end; ++position) {
-		*dest++ = buf[0][position];
-		*dest++ = buf[1][position];
-	}
-}
-
-static void
-flac_convert_16(int16_t *dest,
-		unsigned int num_channels,
-		const FLAC__int32 * const buf[],
-		unsigned int position, unsigned int end)
-{
-	unsigned int c_chan;
-
-	for (; position < end; ++position)
-		for (c_chan = 0; c_chan < num_channels; c_chan++)
-			*dest++ = buf[c_chan][position];
+extern "C" {
+#include "pcm_simd.h"
 }
 
-/**
- * Note: this function also handles 24 bit files!
- */
-static void
-flac_convert_32(int32_t *dest,
-		unsigned int num_channels,
-		const FLAC__int32 * const buf[],
-		unsigned int position, unsigned int end)
-{
-	unsigned int c_chan;
+#include <FLAC/format.h>
 
-	for (; position < end; ++position)
-		for (c_chan = 0; c_chan < num_channels; c_chan++)
-			*dest++ = buf[c_chan][position];
-}
+#include <assert.h>
 
 static void
 flac_convert_8(int8_t *dest,
@@ -80,20 +47,25 @@ flac_convert(void *dest,
 	     const FLAC__int32 *const buf[],
 	     unsigned int position, unsigned int end)
 {
+	assert(num_channels <= FLAC__MAX_CHANNELS);
+
+	/* the SIMD kernels interleave from the start of each
+	   channel's buffer */
+	const int32_t *planes[FLAC__MAX_CHANNELS];
+	for (unsigned c = 0; c < num_channels; ++c)
+		planes[c] = buf[c] + position;
+
 	switch (sample_format) {
 	case SAMPLE_FORMAT_S16:
-		if (num_channels == 2)
-			flac_convert_stereo16((int16_t*)dest, buf,
-					      position, end);
-		else
-			flac_convert_16((int16_t*)dest, num_channels, buf,
-					position, end);
+		pcm_simd_interleave_16((int16_t *)dest, planes,
+				       num_channels, end - position);
 		break;
 
 	case SAMPLE_FORMAT_S24_P32:
 	case SAMPLE_FORMAT_S32:
-		flac_convert_32((int32_t*)dest, num_channels, buf,
-				position, end);
+		/* note: this also handles 24 bit files! */
+		pcm_simd_interleave_32((int32_t *)dest, planes,
+				       num_channels, end - position);
 		break;
 
 	case SAMPLE_FORMAT_S8:
@@ -23,6 +23,7 @@
 
 extern "C" {
 #include "audio_check.h"
+#include "pcm_simd.h"
 }
 
 #include "tag_handler.h"
@@ -74,13 +75,11 @@ format_samples_int(int bytes_per_sample, void *buffer, uint32_t count)
 		break;
 	}
 	case 2: {
-		uint16_t *dst = (uint16_t *)buffer;
+		int16_t *dst = (int16_t *)buffer;
 		static_assert(sizeof(*dst) <= sizeof(*src), "Wrong size");
 
 		/* pass through and align 16-bit samples */
-		while (count--) {
-			*dst++ = *src++;
-		}
+		pcm_simd_narrow_32_to_16(dst, src, count);
 		break;
 	}
 
@@ -611,6 +611,29 @@ ffmpeg_decode(struct decoder *decoder, struct input_stream *input)
 	mpd_ffmpeg_stream_close(stream);
 }
 
+/**
+ * Returns the duration announced by the container header, i.e.
+ * without reading any packets, or -1 if it is unknown.
+ */
+G_GNUC_PURE
+static int
+ffmpeg_header_duration(const AVFormatContext *f)
+{
+	int idx = ffmpeg_find_audio_stream(f);
+	if (idx < 0)
+		return -1;
+
+	if (f->duration != (int64_t)AV_NOPTS_VALUE)
+		return f->duration / AV_TIME_BASE;
+
+	const AVStream *av_stream = f->streams[idx];
+	if (av_stream->duration == (int64_t)AV_NOPTS_VALUE ||
+	    av_stream->duration < 0)
+		return -1;
+
+	return time_from_ffmpeg(av_stream->duration, av_stream->time_base);
+}
+
 //no tag reading in ffmpeg, check if playable
 static bool
 ffmpeg_scan_stream(struct input_stream *is,
@@ -631,25 +654,34 @@ ffmpeg_scan_stream(struct input_stream *is,
 		return false;
 	}
 
+	/* most containers declare their streams and the duration in
+	   the header; the stream info probe reads (and decodes)
+	   packets, which costs several hundred kilobytes per song, so
+	   it is only done for the others */
+	int duration = ffmpeg_header_duration(f);
+	if (duration < 0) {
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53,6,0)
-	const int find_result =
-		avformat_find_stream_info(f, NULL);
+		const int find_result =
+			avformat_find_stream_info(f, NULL);
 #else
-	const int find_result = av_find_stream_info(f);
+		const int find_result = av_find_stream_info(f);
 #endif
-	if (find_result < 0) {
+		if (find_result < 0) {
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53,17,0)
-		avformat_close_input(&f);
+			avformat_close_input(&f);
 #else
-		av_close_input_stream(f);
+			av_close_input_stream(f);
 #endif
-		mpd_ffmpeg_stream_close(stream);
-		return false;
+			mpd_ffmpeg_stream_close(stream);
+			return false;
+		}
+
+		if (f->duration != (int64_t)AV_NOPTS_VALUE)
+			duration = f->duration / AV_TIME_BASE;
 	}
 
-	if (f->duration != (int64_t)AV_NOPTS_VALUE)
-		tag_handler_invoke_duration(handler, handler_ctx,
-					    f->duration / AV_TIME_BASE);
+	if (duration >= 0)
+		tag_handler_invoke_duration(handler, handler_ctx, duration);
 
 #if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(52,101,0)
 	av_metadata_conv(f, NULL, f->iformat->metadata_conv);
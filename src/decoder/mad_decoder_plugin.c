@@ -24,6 +24,7 @@
 #include "tag_rva2.h"
 #include "tag_handler.h"
 #include "audio_check.h"
+#include "mp3_index.h"
 
 #include <assert.h>
 #include <unistd.h>
@@ -61,8 +62,26 @@ enum muteframe {
 
 #define DEFAULT_GAPLESS_MP3_PLAYBACK true
 
+/**
+ * The distance between two entries of the seek index
+ * [milliseconds].
+ */
+#define MP3_INDEX_INTERVAL 500
+
+/**
+ * Songs which are at least this long get a seek index during the
+ * database update, even if their duration is known [seconds].
+ */
+#define MP3_INDEX_MIN_DURATION 600
+
 static bool gapless_playback;
 
+/**
+ * The directory where seek indexes are cached, or NULL if the cache
+ * is disabled.
+ */
+static char *seek_index_cache;
+
 static inline int32_t
 mad_fixed_to_24_sample(mad_fixed_t sample)
 {
@@ -99,13 +118,28 @@ mad_fixed_to_24_buffer(int32_t *dest, const struct mad_synth *synth,
 }
 
 static bool
-mp3_plugin_init(G_GNUC_UNUSED const struct config_param *param)
+mp3_plugin_init(const struct config_param *param)
 {
 	gapless_playback = config_get_bool(CONF_GAPLESS_MP3_PLAYBACK,
 					   DEFAULT_GAPLESS_MP3_PLAYBACK);
+
+	GError *error = NULL;
+	seek_index_cache = config_dup_block_path(param, "seek_index_cache",
+						 &error);
+	if (error != NULL) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+
 	return true;
 }
 
+static void
+mp3_plugin_finish(void)
+{
+	g_free(seek_index_cache);
+}
+
 #define MP3_DATA_OUTPUT_BUFFER_SIZE 2048
 
 struct mp3_data {
@@ -130,12 +164,24 @@ struct mp3_data {
 	unsigned int drop_end_samples;
 	bool found_replay_gain;
 	bool found_xing;
+
+	/**
+	 * Does #max_frames contain the exact number of frames (from
+	 * the Xing header)?
+	 */
+	bool found_frame_count;
+
 	bool found_first_frame;
 	bool decoded_first_frame;
 	unsigned long bit_rate;
 	struct decoder *decoder;
 	struct input_stream *input_stream;
 	enum mad_layer layer;
+
+	/**
+	 * The seek index of this song, or NULL if there is none.
+	 */
+	struct mp3_index *index;
 };
 
 static void
@@ -154,11 +200,13 @@ mp3_data_init(struct mp3_data *data, struct decoder *decoder,
 	data->drop_end_samples = 0;
 	data->found_replay_gain = false;
 	data->found_xing = false;
+	data->found_frame_count = false;
 	data->found_first_frame = false;
 	data->decoded_first_frame = false;
 	data->decoder = decoder;
 	data->input_stream = input_stream;
 	data->layer = 0;
+	data->index = NULL;
 
 	mad_stream_init(&data->stream);
 	mad_stream_options(&data->stream, MAD_OPTION_IGNORECRC);
@@ -178,6 +226,19 @@ static bool mp3_seek(struct mp3_data *data, long offset)
 	return true;
 }
 
+static goffset
+mp3_this_frame_offset(const struct mp3_data *data)
+{
+	goffset offset = data->input_stream->offset;
+
+	if (data->stream.this_frame != NULL)
+		offset -= data->stream.bufend - data->stream.this_frame;
+	else
+		offset -= data->stream.bufend - data->stream.buffer;
+
+	return offset;
+}
+
 static bool
 mp3_fill_buffer(struct mp3_data *data)
 {
@@ -421,6 +482,24 @@ id3_tag_query(const void *p0, size_t length)
 }
 #endif /* !HAVE_ID3TAG */
 
+/**
+ * Skips an ID3 tag which is larger than the rest of the buffer by
+ * seeking over it, instead of reading it only to throw it away.
+ * Embedded pictures make such tags several hundred kilobytes large.
+ *
+ * @return false if the tag was not skipped, and the caller shall
+ * consume it with mad_stream_skip()
+ */
+static bool
+mp3_skip_id3(struct mp3_data *data, size_t tagsize)
+{
+	const size_t count = data->stream.bufend - data->stream.this_frame;
+	if (tagsize <= count || !data->input_stream->seekable)
+		return false;
+
+	return mp3_seek(data, mp3_this_frame_offset(data) + tagsize);
+}
+
 static enum mp3_action
 decode_next_frame_header(struct mp3_data *data, G_GNUC_UNUSED struct tag **tag)
 {
@@ -445,7 +524,8 @@ decode_next_frame_header(struct mp3_data *data, G_GNUC_UNUSED struct tag **tag)
 				if (tag && !(*tag)) {
 					mp3_parse_id3(data, (size_t)tagsize,
 						      tag);
-				} else {
+				} else if (!mp3_skip_id3(data,
+							 (size_t)tagsize)) {
 					mad_stream_skip(&(data->stream),
 							tagsize);
 				}
@@ -752,19 +832,6 @@ mp3_frame_duration(const struct mad_frame *frame)
 			       MAD_UNITS_MILLISECONDS) / 1000.0;
 }
 
-static goffset
-mp3_this_frame_offset(const struct mp3_data *data)
-{
-	goffset offset = data->input_stream->offset;
-
-	if (data->stream.this_frame != NULL)
-		offset -= data->stream.bufend - data->stream.this_frame;
-	else
-		offset -= data->stream.bufend - data->stream.buffer;
-
-	return offset;
-}
-
 static goffset
 mp3_rest_including_this_frame(const struct mp3_data *data)
 {
@@ -837,6 +904,7 @@ mp3_decode_first_frame(struct mp3_data *data, struct tag **tag)
 			mad_timer_multiply(&duration, xing.frames);
 			data->total_time = ((float)mad_timer_count(duration, MAD_UNITS_MILLISECONDS)) / 1000;
 			data->max_frames = xing.frames;
+			data->found_frame_count = true;
 		}
 
 		if (parse_lame(&lame, &ptr, &bitlen)) {
@@ -870,8 +938,12 @@ mp3_decode_first_frame(struct mp3_data *data, struct tag **tag)
 		return false;
 	}
 
-	data->frame_offsets = g_malloc(sizeof(long) * data->max_frames);
-	data->times = g_malloc(sizeof(mad_timer_t) * data->max_frames);
+	if (data->decoder != NULL) {
+		/* the frame tables are only needed for decoding; a
+		   tag scan doesn't need them */
+		data->frame_offsets = g_malloc(sizeof(long) * data->max_frames);
+		data->times = g_malloc(sizeof(mad_timer_t) * data->max_frames);
+	}
 
 	return true;
 }
@@ -884,6 +956,124 @@ static void mp3_data_finish(struct mp3_data *data)
 
 	g_free(data->frame_offsets);
 	g_free(data->times);
+
+	if (data->index != NULL)
+		mp3_index_free(data->index);
+}
+
+/**
+ * Returns the path which identifies the song in the seek index
+ * cache, or NULL if the cache is disabled or not applicable to this
+ * stream.  Only local files get an index, because building it reads
+ * the whole file.
+ */
+static const char *
+mp3_index_path(const struct input_stream *is)
+{
+	return seek_index_cache != NULL && is->seekable && is->size > 0 &&
+		g_path_is_absolute(is->uri)
+		? is->uri
+		: NULL;
+}
+
+/**
+ * Shall this song get a seek index?  That is the case if its
+ * duration is only an estimate, or if it is long.
+ */
+G_GNUC_PURE
+static bool
+mp3_index_wanted(const struct mp3_data *data)
+{
+	return !data->found_frame_count ||
+		data->total_time >= MP3_INDEX_MIN_DURATION;
+}
+
+/**
+ * Scans all frame headers of the stream, and builds a seek index.
+ * The frames are counted the same way mp3_read() counts them while
+ * skipping to a seek destination, and frame 0 is the one found by
+ * mp3_decode_first_frame(), like in mp3_update_timer_next_frame();
+ * this may be the Xing/Info frame.  Afterwards, the stream position
+ * is undefined.
+ */
+static struct mp3_index *
+mp3_index_build(struct input_stream *is)
+{
+	struct mp3_data data;
+	mp3_data_init(&data, NULL, is);
+
+	if (!mp3_seek(&data, 0) || !mp3_decode_first_frame(&data, NULL)) {
+		mp3_data_finish(&data);
+		return NULL;
+	}
+
+	struct mp3_index *index = mp3_index_new(MP3_INDEX_INTERVAL);
+	uint32_t frame = 0;
+
+	while (true) {
+		const struct mp3_index_entry entry = {
+			.offset = mp3_this_frame_offset(&data),
+			.frame = frame++,
+			.time_ms = mad_timer_count(data.timer,
+						   MAD_UNITS_MILLISECONDS),
+			.timer_seconds = data.timer.seconds,
+			.timer_fraction = data.timer.fraction,
+		};
+
+		mp3_index_add(index, &entry);
+		mad_timer_add(&data.timer, data.frame.header.duration);
+
+		enum mp3_action ret;
+		do {
+			ret = decode_next_frame_header(&data, NULL);
+		} while (ret == DECODE_CONT || ret == DECODE_SKIP);
+		if (ret == DECODE_BREAK)
+			break;
+	}
+
+	mp3_index_finish(index, frame,
+			 mad_timer_count(data.timer, MAD_UNITS_MILLISECONDS));
+	mp3_data_finish(&data);
+
+	return index;
+}
+
+/**
+ * Builds the seek index from the frame table, after all frames have
+ * been decoded, and stores it in the cache.
+ */
+static void
+mp3_index_save_frames(const struct mp3_data *data, const char *path)
+{
+	struct mp3_index *index = mp3_index_new(MP3_INDEX_INTERVAL);
+	mad_timer_t timer = mad_timer_zero;
+
+	for (unsigned long i = 0; i < data->highest_frame; ++i) {
+		const struct mp3_index_entry entry = {
+			.offset = data->frame_offsets[i],
+			.frame = i,
+			.time_ms = mad_timer_count(timer,
+						   MAD_UNITS_MILLISECONDS),
+			.timer_seconds = timer.seconds,
+			.timer_fraction = timer.fraction,
+		};
+
+		mp3_index_add(index, &entry);
+
+		/* data->times contains the end of each frame */
+		timer = data->times[i];
+	}
+
+	mp3_index_finish(index, data->highest_frame,
+			 mad_timer_count(timer, MAD_UNITS_MILLISECONDS));
+
+	GError *error = NULL;
+	if (!mp3_index_save(index, seek_index_cache, path, &error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+
+	mp3_index_free(index);
 }
 
 /* this is primarily used for getting total time for tags */
@@ -894,10 +1084,41 @@ mad_decoder_total_file_time(struct input_stream *is)
 	int ret;
 
 	mp3_data_init(&data, NULL, is);
-	if (!mp3_decode_first_frame(&data, NULL))
-		ret = -1;
-	else
-		ret = data.total_time + 0.5;
+	if (!mp3_decode_first_frame(&data, NULL)) {
+		mp3_data_finish(&data);
+		return -1;
+	}
+
+	ret = data.total_time + 0.5;
+
+	const char *path = mp3_index_path(is);
+	if (path != NULL) {
+		/* without a frame count, the duration is only an
+		   estimate; the seek index knows it exactly.  Building
+		   it reads the whole file, which is not worth it if the
+		   duration is known already; such songs get their index
+		   when they are played */
+		struct mp3_index *index =
+			mp3_index_load(seek_index_cache, path);
+		if (index == NULL && !data.found_frame_count) {
+			index = mp3_index_build(is);
+
+			GError *error = NULL;
+			if (index != NULL &&
+			    !mp3_index_save(index, seek_index_cache, path,
+					    &error)) {
+				g_warning("%s", error->message);
+				g_error_free(error);
+			}
+		}
+
+		if (index != NULL) {
+			if (!data.found_frame_count)
+				ret = mp3_index_duration(index) + 0.5;
+			mp3_index_free(index);
+		}
+	}
+
 	mp3_data_finish(&data);
 
 	return ret;
@@ -916,6 +1137,27 @@ mp3_open(struct input_stream *is, struct mp3_data *data,
 		return false;
 	}
 
+	const char *path = mp3_index_path(is);
+	if (path != NULL)
+		data->index = mp3_index_load(seek_index_cache, path);
+
+	if (data->index != NULL && !data->found_frame_count) {
+		/* the index knows the exact duration */
+		data->total_time = mp3_index_duration(data->index);
+
+		const unsigned long max_frames =
+			mp3_index_frames(data->index) + FRAMES_CUSHION;
+		if (max_frames > data->max_frames) {
+			data->max_frames = max_frames;
+			data->frame_offsets =
+				g_realloc(data->frame_offsets,
+					  sizeof(long) * max_frames);
+			data->times = g_realloc(data->times,
+						sizeof(mad_timer_t) *
+						max_frames);
+		}
+	}
+
 	return true;
 }
 
@@ -935,10 +1177,40 @@ mp3_time_to_frame(const struct mp3_data *data, double t)
 	return i;
 }
 
+/**
+ * Jumps to the seek index entry before the specified time.  The
+ * decoder then skips the frames up to the destination.
+ *
+ * @return false if the index does not help, i.e. the destination is
+ * not far ahead
+ */
+static bool
+mp3_seek_index(struct mp3_data *data, double t)
+{
+	const struct mp3_index_entry *entry =
+		mp3_index_lookup(data->index, t * 1000);
+	if (entry == NULL ||
+	    (entry->frame <= data->current_frame && t >= data->elapsed_time))
+		return false;
+
+	if (!mp3_seek(data, entry->offset))
+		return false;
+
+	data->current_frame = entry->frame;
+	data->timer.seconds = entry->timer_seconds;
+	data->timer.fraction = entry->timer_fraction;
+	return true;
+}
+
 static void
 mp3_update_timer_next_frame(struct mp3_data *data)
 {
-	if (data->current_frame >= data->highest_frame) {
+	if (data->current_frame > data->highest_frame) {
+		/* the seek index has skipped frames which have not
+		   been scanned yet; they cannot be recorded in the
+		   frame table */
+		mad_timer_add(&data->timer, (data->frame).header.duration);
+	} else if (data->current_frame == data->highest_frame) {
 		/* record this frame's properties in
 		   data->frame_offsets (for seeking) and
 		   data->times */
@@ -1093,8 +1365,16 @@ mp3_read(struct mp3_data *data)
 					decoder_seek_error(decoder);
 			} else {
 				data->seek_where = decoder_seek_where(decoder);
-				data->mute_frame = MUTEFRAME_SEEK;
-				decoder_command_finished(decoder);
+
+				if (data->index != NULL &&
+				    !mp3_seek_index(data, data->seek_where) &&
+				    data->seek_where < data->elapsed_time)
+					/* cannot skip backwards */
+					decoder_seek_error(decoder);
+				else {
+					data->mute_frame = MUTEFRAME_SEEK;
+					decoder_command_finished(decoder);
+				}
 			}
 		} else if (cmd != DECODE_COMMAND_NONE)
 			return false;
@@ -1172,6 +1452,17 @@ mp3_decode(struct decoder *decoder, struct input_stream *input_stream)
 
 	while (mp3_read(&data)) ;
 
+	const char *path = mp3_index_path(input_stream);
+	if (path != NULL && data.index == NULL && mp3_index_wanted(&data) &&
+	    decoder_get_command(decoder) == DECODE_COMMAND_NONE &&
+	    input_stream_lock_eof(input_stream) &&
+	    data.current_frame == data.highest_frame &&
+	    data.highest_frame < data.max_frames)
+		/* all frames have been decoded in order: the frame
+		   table is complete, and the next seek in this song
+		   can use an index */
+		mp3_index_save_frames(&data, path);
+
 	mp3_data_finish(&data);
 }
 
@@ -1195,6 +1486,7 @@ static const char *const mp3_mime_types[] = { "audio/mpeg", NULL };
 const struct decoder_plugin mad_decoder_plugin = {
 	.name = "mad",
 	.init = mp3_plugin_init,
+	.finish = mp3_plugin_finish,
 	.stream_decode = mp3_decode,
 	.scan_stream = mad_decoder_scan_stream,
 	.suffixes = mp3_suffixes,
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "mp3_index.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mp3_index"
+
+#define MP3_INDEX_MAGIC "MPDMP3IX"
+
+enum {
+	/**
+	 * Version 2: frame 0 is the first frame found by the
+	 * decoder, which may be the Xing/Info frame.
+	 */
+	MP3_INDEX_VERSION = 2,
+};
+
+struct mp3_index {
+	unsigned interval;
+
+	uint32_t frames;
+	uint32_t duration_ms;
+
+	/**
+	 * An array of #mp3_index_entry, sorted by time.
+	 */
+	GArray *entries;
+};
+
+/**
+ * The header of a cache file.  It is followed by the song's path
+ * (not null-terminated) and the entries.
+ */
+struct mp3_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t interval;
+	uint64_t mtime;
+	uint64_t size;
+	uint32_t frames;
+	uint32_t duration_ms;
+	uint32_t num_entries;
+	uint32_t path_length;
+};
+
+/**
+ * The quark used for GError.domain.
+ */
+static inline GQuark
+mp3_index_quark(void)
+{
+	return g_quark_from_static_string("mp3_index");
+}
+
+struct mp3_index *
+mp3_index_new(unsigned interval)
+{
+	struct mp3_index *index = g_new(struct mp3_index, 1);
+	index->interval = interval;
+	index->frames = 0;
+	index->duration_ms = 0;
+	index->entries = g_array_new(false, false,
+				     sizeof(struct mp3_index_entry));
+	return index;
+}
+
+void
+mp3_index_free(struct mp3_index *index)
+{
+	g_array_free(index->entries, true);
+	g_free(index);
+}
+
+void
+mp3_index_add(struct mp3_index *index, const struct mp3_index_entry *entry)
+{
+	if (index->entries->len > 0) {
+		const struct mp3_index_entry *last =
+			&g_array_index(index->entries, struct mp3_index_entry,
+				       index->entries->len - 1);
+		assert(entry->frame > last->frame);
+
+		if (entry->time_ms < last->time_ms + index->interval)
+			return;
+	}
+
+	g_array_append_val(index->entries, *entry);
+}
+
+void
+mp3_index_finish(struct mp3_index *index, uint32_t frames,
+		 uint32_t duration_ms)
+{
+	index->frames = frames;
+	index->duration_ms = duration_ms;
+}
+
+uint32_t
+mp3_index_frames(const struct mp3_index *index)
+{
+	return index->frames;
+}
+
+double
+mp3_index_duration(const struct mp3_index *index)
+{
+	return index->duration_ms / 1000.0;
+}
+
+const struct mp3_index_entry *
+mp3_index_lookup(const struct mp3_index *index, uint32_t time_ms)
+{
+	const struct mp3_index_entry *entries =
+		(const struct mp3_index_entry *)index->entries->data;
+	unsigned left = 0, right = index->entries->len;
+
+	if (right == 0)
+		return NULL;
+
+	/* binary search for the first entry after time_ms */
+	while (left < right) {
+		unsigned middle = (left + right) / 2;
+		if (entries[middle].time_ms <= time_ms)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+
+	return left > 0 ? &entries[left - 1] : &entries[0];
+}
+
+/**
+ * Are the entries sorted, as mp3_index_lookup() requires, and within
+ * the song?
+ */
+G_GNUC_PURE
+static bool
+mp3_index_valid(const struct mp3_index *index)
+{
+	const struct mp3_index_entry *entries =
+		(const struct mp3_index_entry *)index->entries->data;
+
+	for (unsigned i = 0; i < index->entries->len; ++i) {
+		if (entries[i].frame >= index->frames)
+			return false;
+
+		if (i > 0 &&
+		    (entries[i].offset <= entries[i - 1].offset ||
+		     entries[i].frame <= entries[i - 1].frame ||
+		     entries[i].time_ms <= entries[i - 1].time_ms))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Returns the name of the cache file for the specified song.  The
+ * return value must be freed with g_free().
+ */
+static char *
+mp3_index_cache_file(const char *cache_dir, const char *path)
+{
+	char *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, path, -1);
+	char *cache_file = g_build_filename(cache_dir, md5, NULL);
+	g_free(md5);
+	return cache_file;
+}
+
+struct mp3_index *
+mp3_index_load(const char *cache_dir, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) < 0)
+		return NULL;
+
+	char *cache_file = mp3_index_cache_file(cache_dir, path);
+	gchar *contents;
+	gsize length;
+	bool success = g_file_get_contents(cache_file, &contents, &length,
+					   NULL);
+	g_free(cache_file);
+	if (!success)
+		return NULL;
+
+	const size_t path_length = strlen(path);
+	const struct mp3_index_header *header =
+		(const struct mp3_index_header *)contents;
+	if (length < sizeof(*header) ||
+	    memcmp(header->magic, MP3_INDEX_MAGIC,
+		   sizeof(header->magic)) != 0 ||
+	    header->version != MP3_INDEX_VERSION ||
+	    header->path_length != path_length ||
+	    length != sizeof(*header) + path_length +
+	    (size_t)header->num_entries * sizeof(struct mp3_index_entry) ||
+	    memcmp(header + 1, path, path_length) != 0) {
+		g_debug("Ignoring invalid index of %s", path);
+		g_free(contents);
+		return NULL;
+	}
+
+	if (header->mtime != (uint64_t)st.st_mtime ||
+	    header->size != (uint64_t)st.st_size) {
+		/* the song has been modified */
+		g_free(contents);
+		return NULL;
+	}
+
+	struct mp3_index *index = mp3_index_new(header->interval);
+	mp3_index_finish(index, header->frames, header->duration_ms);
+
+	/* the entries may be unaligned in the buffer */
+	g_array_set_size(index->entries, header->num_entries);
+	memcpy(index->entries->data,
+	       contents + sizeof(*header) + path_length,
+	       (size_t)header->num_entries * sizeof(struct mp3_index_entry));
+
+	g_free(contents);
+
+	if (!mp3_index_valid(index)) {
+		g_debug("Ignoring corrupt index of %s", path);
+		mp3_index_free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+bool
+mp3_index_save(const struct mp3_index *index,
+	       const char *cache_dir, const char *path,
+	       GError **error_r)
+{
+	struct stat st;
+	if (stat(path, &st) < 0) {
+		g_set_error(error_r, mp3_index_quark(), 0,
+			    "Failed to stat %s: %s",
+			    path, g_strerror(errno));
+		return false;
+	}
+
+	const size_t path_length = strlen(path);
+
+	struct mp3_index_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MP3_INDEX_MAGIC, sizeof(header.magic));
+	header.version = MP3_INDEX_VERSION;
+	header.interval = index->interval;
+	header.mtime = st.st_mtime;
+	header.size = st.st_size;
+	header.frames = index->frames;
+	header.duration_ms = index->duration_ms;
+	header.num_entries = index->entries->len;
+	header.path_length = path_length;
+
+	GByteArray *buffer = g_byte_array_new();
+	g_byte_array_append(buffer, (const guint8 *)&header, sizeof(header));
+	g_byte_array_append(buffer, (const guint8 *)path, path_length);
+	g_byte_array_append(buffer, (const guint8 *)index->entries->data,
+			    index->entries->len *
+			    sizeof(struct mp3_index_entry));
+
+	/* g_file_set_contents() writes a temporary file and renames
+	   it, so a concurrent mp3_index_load() never sees a partial
+	   index */
+	char *cache_file = mp3_index_cache_file(cache_dir, path);
+	bool success = g_file_set_contents(cache_file,
+					   (const gchar *)buffer->data,
+					   buffer->len, error_r);
+	g_free(cache_file);
+	g_byte_array_free(buffer, true);
+
+	return success;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A seek index for MP3 files: the position of one frame every few
+ * hundred milliseconds, obtained by scanning all frame headers once.
+ * It allows seeking in VBR files without a Xing table of contents,
+ * and yields their exact duration.
+ *
+ * Indexes are cached in a directory, one file per song; the file
+ * name is the MD5 sum of the song's path, and an index is only used
+ * while the song's modification time and size are unchanged.  The
+ * cache files are in host byte order.
+ */
+
+#ifndef MPD_DECODER_MP3_INDEX_H
+#define MPD_DECODER_MP3_INDEX_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mp3_index_entry {
+	/**
+	 * The byte offset of the frame within the file.
+	 */
+	uint64_t offset;
+
+	/**
+	 * The number of the frame, counted from the first audio
+	 * frame.
+	 */
+	uint32_t frame;
+
+	/**
+	 * The start time of the frame [milliseconds].
+	 */
+	uint32_t time_ms;
+
+	/**
+	 * The exact start time of the frame, as the "seconds" and
+	 * "fraction" attributes of libmad's mad_timer_t.
+	 */
+	int32_t timer_seconds;
+	uint32_t timer_fraction;
+};
+
+struct mp3_index;
+
+/**
+ * Creates an empty index.
+ *
+ * @param interval the minimum distance between two entries
+ * [milliseconds]
+ */
+struct mp3_index *
+mp3_index_new(unsigned interval);
+
+void
+mp3_index_free(struct mp3_index *index);
+
+/**
+ * Adds a frame to the index.  Frames must be added in ascending
+ * order; a frame is ignored if it is too close to the previous entry.
+ */
+void
+mp3_index_add(struct mp3_index *index, const struct mp3_index_entry *entry);
+
+/**
+ * Records the total number of frames and the duration after the
+ * whole file has been scanned.
+ */
+void
+mp3_index_finish(struct mp3_index *index, uint32_t frames,
+		 uint32_t duration_ms);
+
+G_GNUC_PURE
+uint32_t
+mp3_index_frames(const struct mp3_index *index);
+
+/**
+ * Returns the duration of the song [seconds].
+ */
+G_GNUC_PURE
+double
+mp3_index_duration(const struct mp3_index *index);
+
+/**
+ * Finds the last entry which starts at or before the specified time.
+ *
+ * @param time_ms the seek destination [milliseconds]
+ * @return the entry, or NULL if the index is empty
+ */
+G_GNUC_PURE
+const struct mp3_index_entry *
+mp3_index_lookup(const struct mp3_index *index, uint32_t time_ms);
+
+/**
+ * Loads the index of a song from the cache.
+ *
+ * @param cache_dir the cache directory
+ * @param path the absolute path of the song
+ * @return the index, or NULL if there is none, or if the song has
+ * been modified since the index was saved
+ */
+struct mp3_index *
+mp3_index_load(const char *cache_dir, const char *path);
+
+/**
+ * Saves the index of a song in the cache.
+ *
+ * @param cache_dir the cache directory
+ * @param path the absolute path of the song
+ */
+bool
+mp3_index_save(const struct mp3_index *index,
+	       const char *cache_dir, const char *path,
+	       GError **error_r);
+
+#endif
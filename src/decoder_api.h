@@ -109,6 +109,21 @@ size_t
 decoder_read(struct decoder *decoder, struct input_stream *is,
 	     void *buffer, size_t length);
 
+/**
+ * Like decoder_read(), but returns a pointer to the data instead of
+ * copying it, see input_stream_read_mapped().
+ *
+ * @param length the maximum number of bytes to read
+ * @param nbytes_r the number of bytes available at the returned
+ * address (0 at the end of the stream)
+ * @return a pointer to the data, or NULL if the stream does not
+ * support this, or if a command was received; call decoder_read()
+ * then
+ */
+const void *
+decoder_read_mapped(struct decoder *decoder, struct input_stream *is,
+		    size_t length, size_t *nbytes_r);
+
 /**
  * Sets the time stamp for the next data chunk [seconds].  The MPD
  * core automatically counts it up, and a decoder plugin only needs to
@@ -135,6 +150,51 @@ decoder_data(struct decoder *decoder, struct input_stream *is,
 	     const void *data, size_t length,
 	     uint16_t kbit_rate);
 
+/**
+ * Obtains a buffer inside the music pipe, so the decoder plugin can
+ * decode directly into it instead of passing its own buffer to
+ * decoder_data(), which would copy it.  After writing, the plugin
+ * must call either decoder_data_commit() or decoder_data_abort(),
+ * before any other function of this API.
+ *
+ * This works only if no conversion is needed, i.e. if the decoder's
+ * audio format is the output format.
+ *
+ * @param decoder the decoder object
+ * @param is an input stream which is buffering while we are waiting
+ * for the player
+ * @param kbit_rate the current bit rate of the source
+ * @param max_length_r the size of the buffer is returned here; it
+ * is always a multiple of the frame size
+ * @return a writable buffer, or NULL if the data must be converted,
+ * or if a command is pending; call decoder_data() or
+ * decoder_get_command() then
+ */
+void *
+decoder_data_begin(struct decoder *decoder, struct input_stream *is,
+		   uint16_t kbit_rate, size_t *max_length_r);
+
+/**
+ * Appends data which was written to the buffer returned by
+ * decoder_data_begin() to the music pipe.
+ *
+ * @param decoder the decoder object
+ * @param length the number of bytes which were written; must be a
+ * multiple of the frame size, and may be 0
+ * @return the current command, or DECODE_COMMAND_NONE if there is no
+ * command pending
+ */
+enum decoder_command
+decoder_data_commit(struct decoder *decoder, size_t length);
+
+/**
+ * Discards the buffer returned by decoder_data_begin().
+ *
+ * @param decoder the decoder object
+ */
+void
+decoder_data_abort(struct decoder *decoder);
+
 /**
  * This function is called by the decoder plugin when it has
  * successfully decoded a tag.
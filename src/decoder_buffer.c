@@ -24,6 +24,7 @@
 #include <glib.h>
 
 #include <assert.h>
+#include <string.h>
 
 struct decoder_buffer {
 	struct decoder *decoder;
@@ -39,6 +40,13 @@ struct decoder_buffer {
 	    buffer */
 	size_t consumed;
 
+	/**
+	 * If not NULL, then the buffer contents are not in #data, but
+	 * at this address inside the input stream's memory map (see
+	 * decoder_read_mapped()), and no copy is made.
+	 */
+	const unsigned char *mapped;
+
 	/** the actual buffer (dynamic size) */
 	unsigned char data[sizeof(size_t)];
 };
@@ -58,6 +66,7 @@ decoder_buffer_new(struct decoder *decoder, struct input_stream *is,
 	buffer->size = size;
 	buffer->length = 0;
 	buffer->consumed = 0;
+	buffer->mapped = NULL;
 
 	return buffer;
 }
@@ -86,17 +95,99 @@ static void
 decoder_buffer_shift(struct decoder_buffer *buffer)
 {
 	assert(buffer->consumed > 0);
+	assert(buffer->mapped == NULL);
 
 	buffer->length -= buffer->consumed;
 	memmove(buffer->data, buffer->data + buffer->consumed, buffer->length);
 	buffer->consumed = 0;
 }
 
+/**
+ * Copies the unconsumed part of the mapped buffer to #data, and
+ * leaves the zero-copy mode.
+ */
+static void
+decoder_buffer_unmap(struct decoder_buffer *buffer)
+{
+	assert(buffer->mapped != NULL);
+
+	buffer->length -= buffer->consumed;
+	memcpy(buffer->data, buffer->mapped + buffer->consumed,
+	       buffer->length);
+	buffer->consumed = 0;
+	buffer->mapped = NULL;
+}
+
+/**
+ * Attempts to append data from the input stream's memory map,
+ * without copying it.
+ *
+ * @param success_r on success, receives the return value of
+ * decoder_buffer_fill()
+ * @return false if the stream does not support this, and the caller
+ * shall use decoder_read()
+ */
+static bool
+decoder_buffer_fill_mapped(struct decoder_buffer *buffer, bool *success_r)
+{
+	const size_t rest = buffer->length - buffer->consumed;
+	if (rest >= buffer->size) {
+		/* buffer is full */
+		*success_r = false;
+		return true;
+	}
+
+	size_t nbytes;
+	const unsigned char *p =
+		decoder_read_mapped(buffer->decoder, buffer->is,
+				    buffer->size - rest, &nbytes);
+	if (p == NULL)
+		return false;
+
+	if (nbytes == 0) {
+		/* end of file */
+		*success_r = false;
+		return true;
+	}
+
+	if (rest == 0) {
+		buffer->mapped = p;
+		buffer->length = nbytes;
+	} else if (buffer->mapped != NULL &&
+		   p == buffer->mapped + buffer->length) {
+		/* the new data follows the old data in the map */
+		buffer->mapped += buffer->consumed;
+		buffer->length = rest + nbytes;
+	} else {
+		/* not contiguous (the decoder has seeked, or the
+		   old data is in our own buffer): fall back to
+		   copying both */
+		const unsigned char *old = buffer->mapped != NULL
+			? buffer->mapped
+			: buffer->data;
+		memmove(buffer->data, old + buffer->consumed, rest);
+		memcpy(buffer->data + rest, p, nbytes);
+		buffer->mapped = NULL;
+		buffer->length = rest + nbytes;
+	}
+
+	buffer->consumed = 0;
+	*success_r = true;
+	return true;
+}
+
 bool
 decoder_buffer_fill(struct decoder_buffer *buffer)
 {
 	size_t nbytes;
 
+	bool success;
+	if (decoder_buffer_fill_mapped(buffer, &success))
+		return success;
+
+	if (buffer->mapped != NULL)
+		decoder_buffer_unmap(buffer);
+
 	if (buffer->consumed > 0)
 		decoder_buffer_shift(buffer);
 
@@ -126,7 +217,8 @@ decoder_buffer_read(const struct decoder_buffer *buffer, size_t *length_r)
 		return NULL;
 
 	*length_r = buffer->length - buffer->consumed;
-	return buffer->data + buffer->consumed;
+	return (buffer->mapped != NULL ? buffer->mapped : buffer->data) +
+		buffer->consumed;
 }
 
 void
@@ -211,3 +211,11 @@ filter_chain_append(struct filter *_chain, struct filter *filter)
 	chain->children = g_slist_append(chain->children, filter);
 }
 
+bool
+filter_chain_is_empty(const struct filter *_chain)
+{
+	const struct filter_chain *chain = (const struct filter_chain *)_chain;
+
+	return chain->children == NULL;
+}
+
@@ -27,6 +27,10 @@
 #ifndef MPD_FILTER_CHAIN_H
 #define MPD_FILTER_CHAIN_H
 
+#include "gcc.h"
+
+#include <stdbool.h>
+
 struct filter;
 
 /**
@@ -45,4 +49,13 @@ filter_chain_new(void);
 void
 filter_chain_append(struct filter *chain, struct filter *filter);
 
+/**
+ * Returns true if no filter has been appended to the chain yet.
+ *
+ * @param chain the filter chain created with filter_chain_new()
+ */
+gcc_pure
+bool
+filter_chain_is_empty(const struct filter *chain);
+
 #endif
@@ -23,6 +23,8 @@
 #include "conf.h"
 #include "tag.h"
 #include "IcyMetaDataParser.hxx"
+#include "HttpRangeCache.hxx"
+#include "thread/Mutex.hxx"
 
 extern "C" {
 #include "input_internal.h"
@@ -31,15 +33,10 @@ extern "C" {
 #include "event/Loop.hxx"
 #include "IOThread.hxx"
 #include "glib_compat.h"
+#include "glib_socket.h"
 
 #include <assert.h>
 
-#if defined(WIN32)
-	#include <winsock2.h>
-#else
-	#include <sys/select.h>
-#endif
-
 #include <string.h>
 #include <errno.h>
 
@@ -57,16 +54,30 @@ extern "C" {
 #define G_LOG_DOMAIN "input_curl"
 
 /**
- * Do not buffer more than this number of bytes.  It should be a
- * reasonable limit that doesn't make low-end machines suffer too
- * much, but doesn't cause stuttering on high-latency lines.
+ * The default initial buffer size.  It should be a reasonable limit
+ * that doesn't make low-end machines suffer too much, but doesn't
+ * cause stuttering on high-latency lines.
+ */
+static const size_t CURL_DEFAULT_BUFFER_SIZE = 512 * 1024;
+
+/**
+ * The default limit for growing the buffer after underruns.
  */
-static const size_t CURL_MAX_BUFFERED = 512 * 1024;
+static const size_t CURL_DEFAULT_MAX_BUFFER_SIZE = 4 * 1024 * 1024;
 
 /**
- * Resume the stream at this number of bytes after it has been paused.
+ * Do not buffer more than this number of bytes initially.  The limit
+ * of a stream is doubled (up to #curl_max_buffer_size) each time the
+ * client runs out of data.
  */
-static const size_t CURL_RESUME_AT = 384 * 1024;
+static size_t curl_buffer_size, curl_max_buffer_size;
+
+/**
+ * The cache for data of seekable resources; nullptr if disabled.
+ * Protected by #range_cache_mutex.
+ */
+static HttpRangeCache *range_cache;
+static Mutex range_cache_mutex;
 
 /**
  * Buffers created by input_curl_writefunction().
@@ -141,6 +152,56 @@ struct input_curl {
 	/** the curl handles */
 	CURL *easy;
 
+	/**
+	 * The stream offset of the next byte which will be received
+	 * from the server.
+	 */
+	goffset transfer_offset;
+
+	/**
+	 * Is the stream currently served from #range_cache, without
+	 * a HTTP request?  The next request is started when the
+	 * client reaches the end of the cached range.
+	 */
+	bool from_cache;
+
+	/**
+	 * Has this stream stored the size, the MIME type and the
+	 * validators in #range_cache?
+	 */
+	bool cached_info;
+
+	/**
+	 * Is the current request a conditional one, which asks the
+	 * server whether the copy in #range_cache is still valid?
+	 */
+	bool revalidating;
+
+	/**
+	 * Has the current response been checked whether its body
+	 * may be written to #range_cache?  That happens with the
+	 * first chunk of the body.
+	 */
+	bool response_checked;
+
+	/**
+	 * May the body of the current response be written to
+	 * #range_cache?
+	 */
+	bool response_cacheable;
+
+	/**
+	 * The first offset in the "Content-Range" header of the
+	 * current response, or -1 if there was none.
+	 */
+	goffset content_range_start;
+
+	/**
+	 * The validators of the current response: the "ETag" and
+	 * "Last-Modified" headers, or nullptr.
+	 */
+	char *etag, *last_modified;
+
 	/** list of buffers, where input_curl_writefunction() appends
 	    to, and input_curl_read() reads from them */
 	std::list<CurlInputBuffer> buffers;
@@ -152,6 +213,12 @@ struct input_curl {
 	 */
 	bool paused;
 
+	/**
+	 * Pause the connection when the buffer reaches this size.
+	 * It grows after underruns.
+	 */
+	size_t max_buffered;
+
 	/** error message provided by libcurl */
 	char error[CURL_ERROR_SIZE];
 
@@ -169,7 +236,13 @@ struct input_curl {
 
 	input_curl(const char *url, GMutex *mutex, GCond *cond)
 		:range(nullptr), request_headers(nullptr),
-		 paused(false),
+		 easy(nullptr), transfer_offset(0),
+		 from_cache(false), cached_info(false),
+		 revalidating(false),
+		 response_checked(false), response_cacheable(false),
+		 content_range_start(-1),
+		 etag(nullptr), last_modified(nullptr),
+		 paused(false), max_buffered(curl_buffer_size),
 		 meta_name(nullptr),
 		 tag(nullptr),
 		 postponed_error(nullptr) {
@@ -199,31 +272,10 @@ static struct {
 	std::forward_list<input_curl *> requests;
 
 	/**
-	 * The GMainLoop source used to poll all CURL file
-	 * descriptors.
-	 */
-	GSource *source;
-
-	/**
-	 * The source id of #source.
+	 * The timer requested by libcurl with
+	 * CURLMOPT_TIMERFUNCTION, or nullptr.
 	 */
-	guint source_id;
-
-	/** a linked list of all registered GPollFD objects */
-	std::forward_list<GPollFD> fds;
-
-	/**
-	 * Did CURL give us a timeout?  If yes, then we need to call
-	 * curl_multi_perform(), even if there was no event on any
-	 * file descriptor.
-	 */
-	bool timeout;
-
-	/**
-	 * The absolute time stamp when the timeout expires.  This is
-	 * used in the GSource method check().
-	 */
-	gint64 absolute_timeout;
+	GSource *timer;
 } curl;
 
 static inline GQuark
@@ -232,6 +284,22 @@ curl_quark(void)
 	return g_quark_from_static_string("curl");
 }
 
+/**
+ * A socket which libcurl has asked us to monitor with
+ * CURLMOPT_SOCKETFUNCTION.  It is registered as the "socketp"
+ * pointer with curl_multi_assign().
+ */
+struct curl_socket {
+	curl_socket_t fd;
+
+	GIOChannel *channel;
+
+	/**
+	 * The watch on #channel in the I/O thread, or nullptr.
+	 */
+	GSource *source;
+};
+
 /**
  * Find a request by its CURL "easy" handle.
  *
@@ -249,110 +317,6 @@ input_curl_find_request(CURL *easy)
 	return NULL;
 }
 
-static gpointer
-input_curl_resume(gpointer data)
-{
-	assert(io_thread_inside());
-
-	struct input_curl *c = (struct input_curl *)data;
-
-	if (c->paused) {
-		c->paused = false;
-		curl_easy_pause(c->easy, CURLPAUSE_CONT);
-	}
-
-	return NULL;
-}
-
-/**
- * Calculates the GLib event bit mask for one file descriptor,
- * obtained from three #fd_set objects filled by curl_multi_fdset().
- */
-static gushort
-input_curl_fd_events(int fd, fd_set *rfds, fd_set *wfds, fd_set *efds)
-{
-	gushort events = 0;
-
-	if (FD_ISSET(fd, rfds)) {
-		events |= G_IO_IN | G_IO_HUP | G_IO_ERR;
-		FD_CLR(fd, rfds);
-	}
-
-	if (FD_ISSET(fd, wfds)) {
-		events |= G_IO_OUT | G_IO_ERR;
-		FD_CLR(fd, wfds);
-	}
-
-	if (FD_ISSET(fd, efds)) {
-		events |= G_IO_HUP | G_IO_ERR;
-		FD_CLR(fd, efds);
-	}
-
-	return events;
-}
-
-/**
- * Updates all registered GPollFD objects, unregisters old ones,
- * registers new ones.
- *
- * Runs in the I/O thread.  No lock needed.
- */
-static void
-curl_update_fds(void)
-{
-	assert(io_thread_inside());
-
-	fd_set rfds, wfds, efds;
-
-	FD_ZERO(&rfds);
-	FD_ZERO(&wfds);
-	FD_ZERO(&efds);
-
-	int max_fd;
-	CURLMcode mcode = curl_multi_fdset(curl.multi, &rfds, &wfds,
-					   &efds, &max_fd);
-	if (mcode != CURLM_OK) {
-		g_warning("curl_multi_fdset() failed: %s\n",
-			  curl_multi_strerror(mcode));
-		return;
-	}
-
-	for (auto prev = curl.fds.before_begin(), end = curl.fds.end(),
-		     i = std::next(prev);
-	     i != end; i = std::next(prev)) {
-		const auto poll_fd = &*i;
-		assert(poll_fd->events != 0);
-
-		gushort events = input_curl_fd_events(poll_fd->fd, &rfds,
-						      &wfds, &efds);
-
-		if (events != poll_fd->events)
-			g_source_remove_poll(curl.source, poll_fd);
-
-		if (events != 0) {
-			if (events != poll_fd->events) {
-				poll_fd->events = events;
-				g_source_add_poll(curl.source, poll_fd);
-			}
-
-			prev = i;
-		} else {
-			curl.fds.erase_after(prev);
-		}
-	}
-
-	for (int fd = 0; fd <= max_fd; ++fd) {
-		gushort events = input_curl_fd_events(fd, &rfds, &wfds, &efds);
-		if (events != 0) {
-			curl.fds.push_front(GPollFD());
-			const auto poll_fd = &curl.fds.front();
-			poll_fd->fd = fd;
-			poll_fd->events = events;
-			g_source_add_poll(curl.source, poll_fd);
-		}
-	}
-}
-
 /**
  * Runs in the I/O thread.  No lock needed.
  */
@@ -374,8 +338,6 @@ input_curl_easy_add(struct input_curl *c, GError **error_r)
 		return false;
 	}
 
-	curl_update_fds();
-
 	return true;
 }
 
@@ -448,7 +410,6 @@ input_curl_easy_free_callback(gpointer data)
 	struct input_curl *c = (struct input_curl *)data;
 
 	input_curl_easy_free(c);
-	curl_update_fds();
 
 	return NULL;
 }
@@ -494,6 +455,12 @@ input_curl_abort_all_requests(GError *error)
 
 }
 
+static bool
+input_curl_open_cache(struct input_curl *c);
+
+static bool
+input_curl_easy_init(struct input_curl *c, GError **error_r);
+
 /**
  * A HTTP request is finished.
  *
@@ -509,7 +476,23 @@ input_curl_request_done(struct input_curl *c, CURLcode result, long status)
 
 	g_mutex_lock(c->base.mutex);
 
-	if (result != CURLE_OK) {
+	if (c->revalidating && result == CURLE_OK && status == 304) {
+		/* "Not Modified": serve the stream from the cache */
+		c->revalidating = false;
+
+		if (!input_curl_open_cache(c)) {
+			/* it has been evicted in the meantime; ask
+			   again, without the condition */
+			GError *error = NULL;
+			if (input_curl_easy_init(c, &error) &&
+			    input_curl_easy_add(c, &error)) {
+				g_mutex_unlock(c->base.mutex);
+				return;
+			}
+
+			c->postponed_error = error;
+		}
+	} else if (result != CURLE_OK) {
 		c->postponed_error = g_error_new(curl_quark(), result,
 						 "curl failed: %s",
 						 c->error);
@@ -558,12 +541,13 @@ input_curl_info_read(void)
 }
 
 /**
- * Give control to CURL.
+ * Give control to CURL: let it handle an event on a socket, or an
+ * expired timeout (fd=CURL_SOCKET_TIMEOUT).
  *
  * Runs in the I/O thread.  The caller must not hold locks.
  */
-static bool
-input_curl_perform(void)
+static void
+input_curl_socket_action(curl_socket_t fd, int ev_bitmask)
 {
 	assert(io_thread_inside());
 
@@ -571,109 +555,179 @@ input_curl_perform(void)
 
 	do {
 		int running_handles;
-		mcode = curl_multi_perform(curl.multi, &running_handles);
+		mcode = curl_multi_socket_action(curl.multi, fd, ev_bitmask,
+						 &running_handles);
 	} while (mcode == CURLM_CALL_MULTI_PERFORM);
 
-	if (mcode != CURLM_OK && mcode != CURLM_CALL_MULTI_PERFORM) {
+	if (mcode != CURLM_OK) {
 		GError *error = g_error_new(curl_quark(), mcode,
-					    "curl_multi_perform() failed: %s",
+					    "curl_multi_socket_action() failed: %s",
 					    curl_multi_strerror(mcode));
 		input_curl_abort_all_requests(error);
-		return false;
+		return;
 	}
 
-	return true;
+	input_curl_info_read();
 }
 
-/*
- * GSource methods
- *
- */
+static gpointer
+input_curl_resume(gpointer data)
+{
+	assert(io_thread_inside());
+
+	struct input_curl *c = (struct input_curl *)data;
+
+	if (c->paused) {
+		c->paused = false;
+		curl_easy_pause(c->easy, CURLPAUSE_CONT);
+
+		/* the socket of a paused transfer is not monitored,
+		   and libcurl may hold back data it has already
+		   received; let it register the socket again and
+		   deliver that data now */
+		input_curl_socket_action(CURL_SOCKET_TIMEOUT, 0);
+	}
+
+	return NULL;
+}
 
 /**
- * The GSource prepare() method implementation.
+ * The GIOChannel watch callback for a #curl_socket.
  */
 static gboolean
-input_curl_source_prepare(G_GNUC_UNUSED GSource *source, gint *timeout_r)
+input_curl_socket_event(G_GNUC_UNUSED GIOChannel *channel,
+			GIOCondition condition, gpointer data)
 {
-	curl_update_fds();
-
-	curl.timeout = false;
+	const struct curl_socket *cs = (const struct curl_socket *)data;
 
-	long timeout2;
-	CURLMcode mcode = curl_multi_timeout(curl.multi, &timeout2);
-	if (mcode == CURLM_OK) {
-		if (timeout2 >= 0)
-			curl.absolute_timeout = g_source_get_time(source)
-				+ timeout2 * 1000;
+	int ev_bitmask = 0;
+	if (condition & (G_IO_IN | G_IO_HUP))
+		ev_bitmask |= CURL_CSELECT_IN;
+	if (condition & G_IO_OUT)
+		ev_bitmask |= CURL_CSELECT_OUT;
+	if (condition & G_IO_ERR)
+		ev_bitmask |= CURL_CSELECT_ERR;
 
-		if (timeout2 >= 0 && timeout2 < 10)
-			/* CURL 7.21.1 likes to report "timeout=0",
-			   which means we're running in a busy loop.
-			   Quite a bad idea to waste so much CPU.
-			   Let's use a lower limit of 10ms. */
-			timeout2 = 10;
+	/* this may free the curl_socket object (CURL_POLL_REMOVE),
+	   which destroys this source; don't touch it afterwards */
+	input_curl_socket_action(cs->fd, ev_bitmask);
 
-		*timeout_r = timeout2;
+	return true;
+}
 
-		curl.timeout = timeout2 >= 0;
-	} else
-		g_warning("curl_multi_timeout() failed: %s\n",
-			  curl_multi_strerror(mcode));
+static void
+curl_socket_free(struct curl_socket *cs)
+{
+	if (cs->source != nullptr) {
+		g_source_destroy(cs->source);
+		g_source_unref(cs->source);
+	}
 
-	return false;
+	g_io_channel_unref(cs->channel);
+	g_free(cs);
 }
 
 /**
- * The GSource check() method implementation.
+ * The CURLMOPT_SOCKETFUNCTION callback: libcurl tells us which
+ * events to watch on a socket.  Only sockets of active transfers are
+ * registered, so each wakeup costs O(active sockets).
+ *
+ * Runs in the I/O thread (called by libcurl).
  */
-static gboolean
-input_curl_source_check(G_GNUC_UNUSED GSource *source)
+static int
+input_curl_socket_function(G_GNUC_UNUSED CURL *easy, curl_socket_t fd,
+			   int action, G_GNUC_UNUSED void *userp,
+			   void *socketp)
 {
-	if (curl.timeout) {
-		/* when a timeout has expired, we need to call
-		   curl_multi_perform(), even if there was no file
-		   descriptor event */
+	struct curl_socket *cs = (struct curl_socket *)socketp;
 
-		if (g_source_get_time(source) >= curl.absolute_timeout)
-			return true;
+	if (action == CURL_POLL_REMOVE) {
+		if (cs != nullptr)
+			curl_socket_free(cs);
+		return 0;
 	}
 
-	for (const auto &i : curl.fds)
-		if (i.revents != 0)
-			return true;
+	if (cs == nullptr) {
+		cs = g_new(struct curl_socket, 1);
+		cs->fd = fd;
+		cs->channel = g_io_channel_new_socket(fd);
+		cs->source = nullptr;
+		curl_multi_assign(curl.multi, fd, cs);
+	} else if (cs->source != nullptr) {
+		g_source_destroy(cs->source);
+		g_source_unref(cs->source);
+		cs->source = nullptr;
+	}
 
-	return false;
+	int condition = 0;
+	if (action == CURL_POLL_IN || action == CURL_POLL_INOUT)
+		condition |= G_IO_IN | G_IO_HUP | G_IO_ERR;
+	if (action == CURL_POLL_OUT || action == CURL_POLL_INOUT)
+		condition |= G_IO_OUT | G_IO_ERR;
+
+	if (condition != 0) {
+		cs->source = g_io_create_watch(cs->channel,
+					       GIOCondition(condition));
+		g_source_set_callback(cs->source,
+				      (GSourceFunc)input_curl_socket_event,
+				      cs, nullptr);
+		g_source_attach(cs->source, io_thread_get().GetContext());
+	}
+
+	return 0;
+}
+
+static void
+input_curl_cancel_timer(void)
+{
+	if (curl.timer != nullptr) {
+		g_source_destroy(curl.timer);
+		g_source_unref(curl.timer);
+		curl.timer = nullptr;
+	}
 }
 
-/**
- * The GSource dispatch() method implementation.  The callback isn't
- * used, because we're handling all events directly.
- */
 static gboolean
-input_curl_source_dispatch(G_GNUC_UNUSED GSource *source,
-			   G_GNUC_UNUSED GSourceFunc callback,
-			   G_GNUC_UNUSED gpointer user_data)
+input_curl_timer_event(G_GNUC_UNUSED gpointer data)
 {
-	if (input_curl_perform())
-		input_curl_info_read();
+	/* this is a one-shot timer; libcurl may install a new one
+	   from within curl_multi_socket_action() */
+	g_source_unref(curl.timer);
+	curl.timer = nullptr;
 
-	return true;
+	input_curl_socket_action(CURL_SOCKET_TIMEOUT, 0);
+
+	return false;
 }
 
 /**
- * The vtable for our GSource implementation.  Unfortunately, we
- * cannot declare it "const", because g_source_new() takes a non-const
- * pointer, for whatever reason.
+ * The CURLMOPT_TIMERFUNCTION callback: libcurl wants
+ * curl_multi_socket_action() to be called after the specified
+ * timeout, or never (-1).
+ *
+ * Runs in the I/O thread (called by libcurl).
  */
-static GSourceFuncs curl_source_funcs = {
-	input_curl_source_prepare,
-	input_curl_source_check,
-	input_curl_source_dispatch,
-	nullptr,
-	nullptr,
-	nullptr,
-};
+static int
+input_curl_timer_function(G_GNUC_UNUSED CURLM *multi, long timeout_ms,
+			  G_GNUC_UNUSED void *userp)
+{
+	input_curl_cancel_timer();
+
+	if (timeout_ms < 0)
+		return 0;
+
+	if (timeout_ms < 10)
+		/* CURL 7.21.1 likes to report "timeout=0", which
+		   means we're running in a busy loop.  Quite a bad
+		   idea to waste so much CPU.  Let's use a lower limit
+		   of 10ms. */
+		timeout_ms = 10;
+
+	curl.timer = io_thread_get().AddTimeout(timeout_ms,
+						input_curl_timer_event,
+						nullptr);
+	return 0;
+}
 
 /*
  * input_plugin methods
@@ -709,6 +763,27 @@ input_curl_init(const struct config_param *param,
 						   "");
 	}
 
+	curl_buffer_size = config_get_block_unsigned(param, "buffer_size",
+						     CURL_DEFAULT_BUFFER_SIZE / 1024)
+		* 1024;
+	if (curl_buffer_size == 0) {
+		g_set_error(error_r, curl_quark(), 0,
+			    "buffer_size must be positive");
+		return false;
+	}
+
+	curl_max_buffer_size =
+		config_get_block_unsigned(param, "max_buffer_size",
+					  CURL_DEFAULT_MAX_BUFFER_SIZE / 1024)
+		* 1024;
+	if (curl_max_buffer_size < curl_buffer_size)
+		curl_max_buffer_size = curl_buffer_size;
+
+	const size_t cache_size =
+		config_get_block_unsigned(param, "cache_size", 0) * 1024;
+	if (cache_size > 0)
+		range_cache = new HttpRangeCache(cache_size);
+
 	curl.multi = curl_multi_init();
 	if (curl.multi == NULL) {
 		g_set_error(error_r, curl_quark(), 0,
@@ -716,9 +791,10 @@ input_curl_init(const struct config_param *param,
 		return false;
 	}
 
-	curl.source = g_source_new(&curl_source_funcs, sizeof(*curl.source));
-	curl.source_id = g_source_attach(curl.source,
-					 io_thread_get().GetContext());
+	curl_multi_setopt(curl.multi, CURLMOPT_SOCKETFUNCTION,
+			  input_curl_socket_function);
+	curl_multi_setopt(curl.multi, CURLMOPT_TIMERFUNCTION,
+			  input_curl_timer_function);
 
 	return true;
 }
@@ -726,7 +802,11 @@ input_curl_init(const struct config_param *param,
 static gpointer
 curl_destroy_sources(G_GNUC_UNUSED gpointer data)
 {
-	g_source_destroy(curl.source);
+	input_curl_cancel_timer();
+
+	/* this closes the cached connections, and libcurl
+	   unregisters their sockets */
+	curl_multi_cleanup(curl.multi);
 
 	return NULL;
 }
@@ -738,10 +818,11 @@ input_curl_finish(void)
 
 	io_thread_call(curl_destroy_sources, NULL);
 
-	curl_multi_cleanup(curl.multi);
-
 	curl_slist_free_all(http_200_aliases);
 
+	delete range_cache;
+	range_cache = nullptr;
+
 	curl_global_cleanup();
 }
 
@@ -768,6 +849,8 @@ input_curl::~input_curl()
 	if (tag != NULL)
 		tag_free(tag);
 	g_free(meta_name);
+	g_free(etag);
+	g_free(last_modified);
 
 	input_curl_easy_free_indirect(this);
 
@@ -804,6 +887,18 @@ input_curl_tag(struct input_stream *is)
 static bool
 fill_buffer(struct input_curl *c, GError **error_r)
 {
+	if (c->easy != NULL && c->buffers.empty() && c->base.offset > 0 &&
+	    c->max_buffered < curl_max_buffer_size) {
+		/* the client has run out of data: allow the
+		   connection to buffer more */
+		c->max_buffered *= 2;
+		if (c->max_buffered > curl_max_buffer_size)
+			c->max_buffered = curl_max_buffer_size;
+
+		g_debug("buffer underrun in %s, growing the buffer to %zu kB",
+			c->base.uri, c->max_buffered / 1024);
+	}
+
 	while (c->easy != NULL && c->buffers.empty())
 		g_cond_wait(c->base.cond, c->base.mutex);
 
@@ -842,6 +937,9 @@ read_from_buffer(IcyMetaDataParser &icy, std::list<CurlInputBuffer> &buffers,
 				buffers.pop_front();
 				break;
 			}
+
+			if (length == 0)
+				break;
 		}
 
 		chunk = icy.Meta(buffer.Begin(), length);
@@ -877,12 +975,74 @@ copy_icy_tag(struct input_curl *c)
 	c->tag = tag;
 }
 
+/**
+ * Starts a new HTTP request at the current offset, and waits for the
+ * response.
+ *
+ * The caller must lock the mutex, and the previous request must have
+ * been freed.
+ */
+static bool
+input_curl_start(struct input_curl *c, GError **error_r)
+{
+	assert(c->easy == NULL);
+	assert(c->buffers.empty());
+
+	c->from_cache = false;
+	c->paused = false;
+
+	if (!input_curl_easy_init(c, error_r))
+		return false;
+
+	/* send the "Range" header */
+
+	if (c->base.offset > 0) {
+		c->range = g_strdup_printf("%lld-", (long long)c->base.offset);
+		curl_easy_setopt(c->easy, CURLOPT_RANGE, c->range);
+	}
+
+	c->transfer_offset = c->base.offset;
+	c->base.ready = false;
+
+	g_mutex_unlock(c->base.mutex);
+	bool success = input_curl_easy_add_indirect(c, error_r);
+	g_mutex_lock(c->base.mutex);
+
+	if (!success)
+		return false;
+
+	while (!c->base.ready)
+		g_cond_wait(c->base.cond, c->base.mutex);
+
+	if (c->postponed_error != NULL) {
+		g_propagate_error(error_r, c->postponed_error);
+		c->postponed_error = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Reads from #range_cache.
+ *
+ * @return the number of bytes read, 0 if the cached range has ended
+ */
+static size_t
+input_curl_read_cache(struct input_curl *c, void *ptr, size_t size)
+{
+	assert(c->from_cache);
+
+	const ScopeLock protect(range_cache_mutex);
+	return range_cache->Read(c->base.uri, c->base.offset, ptr, size);
+}
+
 static bool
 input_curl_available(struct input_stream *is)
 {
 	struct input_curl *c = (struct input_curl *)is;
 
-	return c->postponed_error != NULL || c->easy == NULL ||
+	return c->from_cache || c->postponed_error != NULL || c->easy == NULL ||
 		!c->buffers.empty();
 }
 
@@ -895,6 +1055,22 @@ input_curl_read(struct input_stream *is, void *ptr, size_t size,
 	size_t nbytes = 0;
 	char *dest = (char *)ptr;
 
+	if (c->from_cache) {
+		nbytes = input_curl_read_cache(c, ptr, size);
+		if (nbytes > 0) {
+			is->offset += (goffset)nbytes;
+			return nbytes;
+		}
+
+		if (is->size >= 0 && is->offset >= is->size)
+			return 0;
+
+		/* the cached range has ended: continue downloading
+		   from here */
+		if (!input_curl_start(c, error_r))
+			return 0;
+	}
+
 	do {
 		/* fill the buffer */
 
@@ -918,7 +1094,8 @@ input_curl_read(struct input_stream *is, void *ptr, size_t size,
 
 	is->offset += (goffset)nbytes;
 
-	if (c->paused && curl_total_buffer_size(c) < CURL_RESUME_AT) {
+	if (c->paused &&
+	    curl_total_buffer_size(c) < c->max_buffered / 4 * 3) {
 		g_mutex_unlock(c->base.mutex);
 		io_thread_call(input_curl_resume, c);
 		g_mutex_lock(c->base.mutex);
@@ -940,6 +1117,9 @@ input_curl_eof(G_GNUC_UNUSED struct input_stream *is)
 {
 	struct input_curl *c = (struct input_curl *)is;
 
+	if (c->from_cache)
+		return is->size >= 0 && is->offset >= is->size;
+
 	return c->easy == NULL && c->buffers.empty();
 }
 
@@ -955,6 +1135,17 @@ input_curl_headerfunction(void *ptr, size_t size, size_t nmemb, void *stream)
 	const char *header = (const char *)ptr;
 	const char *end = header + size;
 
+	if (size >= 5 && memcmp(header, "HTTP/", 5) == 0) {
+		/* the status line of a new response (maybe after a
+		   redirect): forget the previous one's headers */
+		g_free(c->etag);
+		c->etag = NULL;
+		g_free(c->last_modified);
+		c->last_modified = NULL;
+		c->content_range_start = -1;
+		return size;
+	}
+
 	const char *value = (const char *)memchr(header, ':', size);
 	if (value == NULL || (size_t)(value - header) >= sizeof(name))
 		return size;
@@ -988,6 +1179,19 @@ input_curl_headerfunction(void *ptr, size_t size, size_t nmemb, void *stream)
 		buffer[end - value] = 0;
 
 		c->base.size = c->base.offset + g_ascii_strtoull(buffer, NULL, 10);
+	} else if (g_ascii_strcasecmp(name, "content-range") == 0) {
+		/* "bytes START-END/TOTAL" */
+		if (end - value > 6 &&
+		    g_ascii_strncasecmp(value, "bytes ", 6) == 0 &&
+		    g_ascii_isdigit(value[6]))
+			c->content_range_start =
+				g_ascii_strtoull(value + 6, NULL, 10);
+	} else if (g_ascii_strcasecmp(name, "etag") == 0) {
+		g_free(c->etag);
+		c->etag = g_strndup(value, end - value);
+	} else if (g_ascii_strcasecmp(name, "last-modified") == 0) {
+		g_free(c->last_modified);
+		c->last_modified = g_strndup(value, end - value);
 	} else if (g_ascii_strcasecmp(name, "content-type") == 0) {
 		g_free(c->base.mime);
 		c->base.mime = g_strndup(value, end - value);
@@ -1028,6 +1232,44 @@ input_curl_headerfunction(void *ptr, size_t size, size_t nmemb, void *stream)
 	return size;
 }
 
+/**
+ * Determines whether the body of the current response may be
+ * written to #range_cache, and stores the resource information
+ * there.  Called with the first chunk of the body.
+ *
+ * The caller must lock the mutex and #range_cache_mutex.
+ */
+static bool
+input_curl_check_response(struct input_curl *c)
+{
+	if (!c->base.seekable || c->icy.IsDefined())
+		return false;
+
+	long status = 0;
+	curl_easy_getinfo(c->easy, CURLINFO_RESPONSE_CODE, &status);
+
+	/* the body must begin at the requested offset; a server
+	   which ignores the "Range" request header sends the whole
+	   resource with "200 OK" */
+	if (status == 206
+	    ? c->content_range_start != c->transfer_offset
+	    : status != 200 || c->transfer_offset != 0)
+		return false;
+
+	if (!c->cached_info && c->etag == NULL && c->last_modified == NULL)
+		/* without validators, there is no way to tell
+		   whether data cached by another stream belongs to
+		   the same version of the resource */
+		range_cache->Invalidate(c->base.uri);
+
+	/* this discards the cached data if the resource has
+	   changed */
+	range_cache->SetInfo(c->base.uri, c->base.size, c->base.mime,
+			     c->etag, c->last_modified);
+	c->cached_info = true;
+	return true;
+}
+
 /** called by curl when new data is available */
 static size_t
 input_curl_writefunction(void *ptr, size_t size, size_t nmemb, void *stream)
@@ -1040,13 +1282,28 @@ input_curl_writefunction(void *ptr, size_t size, size_t nmemb, void *stream)
 
 	g_mutex_lock(c->base.mutex);
 
-	if (curl_total_buffer_size(c) + size >= CURL_MAX_BUFFERED) {
+	if (curl_total_buffer_size(c) + size >= c->max_buffered) {
 		c->paused = true;
 		g_mutex_unlock(c->base.mutex);
 		return CURL_WRITEFUNC_PAUSE;
 	}
 
 	c->buffers.emplace_back(ptr, size);
+
+	if (range_cache != nullptr) {
+		const ScopeLock protect(range_cache_mutex);
+
+		if (!c->response_checked) {
+			c->response_cacheable = input_curl_check_response(c);
+			c->response_checked = true;
+		}
+
+		if (c->response_cacheable)
+			range_cache->Write(c->base.uri, c->transfer_offset,
+					   ptr, size);
+	}
+
+	c->transfer_offset += size;
 	c->base.ready = true;
 
 	g_cond_broadcast(c->base.cond);
@@ -1060,6 +1317,9 @@ input_curl_easy_init(struct input_curl *c, GError **error_r)
 {
 	CURLcode code;
 
+	c->response_checked = false;
+	c->response_cacheable = false;
+
 	c->easy = curl_easy_init();
 	if (c->easy == NULL) {
 		g_set_error(error_r, curl_quark(), 0,
@@ -1084,6 +1344,12 @@ input_curl_easy_init(struct input_curl *c, GError **error_r)
 	curl_easy_setopt(c->easy, CURLOPT_NOPROGRESS, 1l);
 	curl_easy_setopt(c->easy, CURLOPT_NOSIGNAL, 1l);
 	curl_easy_setopt(c->easy, CURLOPT_CONNECTTIMEOUT, 10l);
+#if LIBCURL_VERSION_NUM >= 0x071900
+	/* keep idle connections alive in the connection cache of
+	   the multi handle, so the next song from the same host
+	   doesn't need a new one */
+	curl_easy_setopt(c->easy, CURLOPT_TCP_KEEPALIVE, 1l);
+#endif
 
 	if (proxy != NULL)
 		curl_easy_setopt(c->easy, CURLOPT_PROXY, proxy);
@@ -1119,7 +1385,6 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 		GError **error_r)
 {
 	struct input_curl *c = (struct input_curl *)is;
-	bool ret;
 
 	assert(is->ready);
 
@@ -1173,14 +1438,26 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 	if (offset == is->offset)
 		return true;
 
-	/* close the old connection and open a new one */
+	/* close the old connection */
 
 	g_mutex_unlock(c->base.mutex);
-
 	input_curl_easy_free_indirect(c);
-	c->buffers.clear();
+	g_mutex_lock(c->base.mutex);
 
+	c->buffers.clear();
+	c->from_cache = false;
 	is->offset = offset;
+
+	if (range_cache != nullptr) {
+		const ScopeLock protect(range_cache_mutex);
+		if (range_cache->Contains(is->uri, offset)) {
+			/* no need for a new request before the client
+			   reaches the end of the cached range */
+			c->from_cache = true;
+			return true;
+		}
+	}
+
 	if (is->offset == is->size) {
 		/* seek to EOF: simulate empty result; avoid
 		   triggering a "416 Requested Range Not Satisfiable"
@@ -1188,34 +1465,87 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 		return true;
 	}
 
-	ret = input_curl_easy_init(c, error_r);
-	if (!ret)
+	return input_curl_start(c, error_r);
+}
+
+/**
+ * Serves the stream from #range_cache, after the server has
+ * confirmed that the cached copy is still valid.
+ *
+ * The caller must lock the mutex.
+ *
+ * @return false if the beginning of the resource is not cached
+ * (anymore)
+ */
+static bool
+input_curl_open_cache(struct input_curl *c)
+{
+	const ScopeLock protect(range_cache_mutex);
+
+	goffset size;
+	std::string mime, etag, last_modified;
+	if (!range_cache->GetInfo(c->base.uri, size, mime,
+				  etag, last_modified) ||
+	    !range_cache->Contains(c->base.uri, 0))
 		return false;
 
-	/* send the "Range" header */
+	/* the "304 Not Modified" response repeats the validators;
+	   they differ if another stream has cached a new version in
+	   the meantime */
+	if ((c->etag != NULL && etag != c->etag) ||
+	    (c->last_modified != NULL && last_modified != c->last_modified))
+		return false;
 
-	if (is->offset > 0) {
-		c->range = g_strdup_printf("%lld-", (long long)is->offset);
-		curl_easy_setopt(c->easy, CURLOPT_RANGE, c->range);
+	c->base.seekable = true;
+	c->base.size = size;
+	if (!mime.empty()) {
+		g_free(c->base.mime);
+		c->base.mime = g_strdup(mime.c_str());
 	}
 
-	c->base.ready = false;
-
-	if (!input_curl_easy_add_indirect(c, error_r))
-		return false;
+	c->from_cache = true;
+	c->cached_info = true;
+	return true;
+}
 
-	g_mutex_lock(c->base.mutex);
+/**
+ * If the beginning of the resource is cached, make the request
+ * conditional: the server answers "304 Not Modified" if the cached
+ * copy is still valid, and then the stream is served from
+ * #range_cache.  Resources without validators are never served
+ * from the cache of another stream.
+ */
+static void
+input_curl_add_validators(struct input_curl *c)
+{
+	const ScopeLock protect(range_cache_mutex);
+
+	goffset size;
+	std::string mime, etag, last_modified;
+	if (!range_cache->GetInfo(c->base.uri, size, mime,
+				  etag, last_modified) ||
+	    (etag.empty() && last_modified.empty()) ||
+	    !range_cache->Contains(c->base.uri, 0))
+		return;
 
-	while (!c->base.ready)
-		g_cond_wait(c->base.cond, c->base.mutex);
+	if (!etag.empty()) {
+		char *header = g_strconcat("If-None-Match: ",
+					   etag.c_str(), NULL);
+		c->request_headers = curl_slist_append(c->request_headers,
+						       header);
+		g_free(header);
+	}
 
-	if (c->postponed_error != NULL) {
-		g_propagate_error(error_r, c->postponed_error);
-		c->postponed_error = NULL;
-		return false;
+	if (!last_modified.empty()) {
+		char *header = g_strconcat("If-Modified-Since: ",
+					   last_modified.c_str(), NULL);
+		c->request_headers = curl_slist_append(c->request_headers,
+						       header);
+		g_free(header);
 	}
 
-	return true;
+	curl_easy_setopt(c->easy, CURLOPT_HTTPHEADER, c->request_headers);
+	c->revalidating = true;
 }
 
 static struct input_stream *
@@ -1235,6 +1565,9 @@ input_curl_open(const char *url, GMutex *mutex, GCond *cond,
 		return NULL;
 	}
 
+	if (range_cache != nullptr)
+		input_curl_add_validators(c);
+
 	if (!input_curl_easy_add_indirect(c, error_r)) {
 		delete c;
 		return NULL;
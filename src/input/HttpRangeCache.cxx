@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "HttpRangeCache.hxx"
+
+#include <iterator>
+
+#include <assert.h>
+#include <string.h>
+
+const HttpRangeCache::Resource *
+HttpRangeCache::Find(const char *url) const
+{
+	for (const auto &i : resources)
+		if (i.url == url)
+			return &i;
+
+	return nullptr;
+}
+
+HttpRangeCache::Resource *
+HttpRangeCache::Touch(const char *url)
+{
+	for (auto i = resources.begin(), end = resources.end(); i != end; ++i) {
+		if (i->url == url) {
+			if (i != resources.begin())
+				resources.splice(resources.begin(), resources, i);
+			return &resources.front();
+		}
+	}
+
+	return nullptr;
+}
+
+HttpRangeCache::Resource &
+HttpRangeCache::Make(const char *url)
+{
+	Resource *resource = Touch(url);
+	if (resource != nullptr)
+		return *resource;
+
+	resources.emplace_front(url);
+	return resources.front();
+}
+
+bool
+HttpRangeCache::MakeRoom(size_t length)
+{
+	/* never evict the front element: that's the one we're
+	   writing to */
+	while (total + length > max_size && resources.size() > 1) {
+		total -= resources.back().bytes;
+		resources.pop_back();
+	}
+
+	return total + length <= max_size;
+}
+
+std::map<goffset, std::string>::const_iterator
+HttpRangeCache::FindRange(const Resource &resource, goffset offset)
+{
+	auto i = resource.ranges.upper_bound(offset);
+	if (i == resource.ranges.begin())
+		return resource.ranges.end();
+
+	--i;
+	if (offset >= i->first + (goffset)i->second.size())
+		return resource.ranges.end();
+
+	return i;
+}
+
+void
+HttpRangeCache::SetInfo(const char *url, goffset size, const char *mime,
+			const char *etag, const char *last_modified)
+{
+	if (etag == nullptr)
+		etag = "";
+	if (last_modified == nullptr)
+		last_modified = "";
+
+	Resource &resource = Make(url);
+	if (resource.etag != etag || resource.last_modified != last_modified) {
+		/* the resource has changed on the server */
+		total -= resource.bytes;
+		resource.bytes = 0;
+		resource.ranges.clear();
+
+		resource.etag = etag;
+		resource.last_modified = last_modified;
+	}
+
+	resource.size = size;
+	resource.mime = mime != nullptr ? mime : "";
+}
+
+bool
+HttpRangeCache::GetInfo(const char *url, goffset &size_r,
+			std::string &mime_r,
+			std::string &etag_r, std::string &last_modified_r)
+{
+	const Resource *resource = Touch(url);
+	if (resource == nullptr || resource->size < 0)
+		return false;
+
+	size_r = resource->size;
+	mime_r = resource->mime;
+	etag_r = resource->etag;
+	last_modified_r = resource->last_modified;
+	return true;
+}
+
+void
+HttpRangeCache::Invalidate(const char *url)
+{
+	for (auto i = resources.begin(), end = resources.end(); i != end; ++i) {
+		if (i->url == url) {
+			total -= i->bytes;
+			resources.erase(i);
+			return;
+		}
+	}
+}
+
+void
+HttpRangeCache::Write(const char *url, goffset offset,
+		      const void *_data, size_t length)
+{
+	assert(offset >= 0);
+
+	if (length == 0 || length > max_size)
+		return;
+
+	const char *data = (const char *)_data;
+	const goffset end = offset + length;
+
+	Resource &resource = Make(url);
+	auto &ranges = resource.ranges;
+
+	/* append to the range which ends at (or after) the new data's
+	   start, or create a new range */
+
+	auto current = ranges.end();
+	auto i = ranges.upper_bound(offset);
+	if (i != ranges.begin()) {
+		auto previous = std::prev(i);
+		const goffset previous_end =
+			previous->first + previous->second.size();
+		if (previous_end >= end)
+			/* already cached */
+			return;
+
+		if (previous_end >= offset) {
+			const size_t skip = previous_end - offset;
+			if (!MakeRoom(length - skip))
+				return;
+
+			previous->second.append(data + skip, length - skip);
+			resource.bytes += length - skip;
+			total += length - skip;
+			current = previous;
+		}
+	}
+
+	if (current == ranges.end()) {
+		if (!MakeRoom(length))
+			return;
+
+		current = ranges.emplace(offset,
+					 std::string(data, length)).first;
+		resource.bytes += length;
+		total += length;
+	}
+
+	/* merge the following ranges which are now reached */
+
+	goffset current_end = current->first + current->second.size();
+	for (auto next = std::next(current);
+	     next != ranges.end() && next->first <= current_end;
+	     next = ranges.erase(next)) {
+		const goffset next_end = next->first + next->second.size();
+		size_t appended = 0;
+		if (next_end > current_end) {
+			appended = next_end - current_end;
+			current->second.append(next->second,
+					       current_end - next->first,
+					       appended);
+			current_end = next_end;
+		}
+
+		resource.bytes -= next->second.size() - appended;
+		total -= next->second.size() - appended;
+	}
+}
+
+size_t
+HttpRangeCache::Read(const char *url, goffset offset,
+		     void *dest, size_t length)
+{
+	const Resource *resource = Touch(url);
+	if (resource == nullptr)
+		return 0;
+
+	auto i = FindRange(*resource, offset);
+	if (i == resource->ranges.end())
+		return 0;
+
+	const size_t position = offset - i->first;
+	const size_t available = i->second.size() - position;
+	if (length > available)
+		length = available;
+
+	memcpy(dest, i->second.data() + position, length);
+	return length;
+}
+
+bool
+HttpRangeCache::Contains(const char *url, goffset offset) const
+{
+	const Resource *resource = Find(url);
+	return resource != nullptr &&
+		FindRange(*resource, offset) != resource->ranges.end();
+}
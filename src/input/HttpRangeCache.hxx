@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_INPUT_HTTP_RANGE_CACHE_HXX
+#define MPD_INPUT_HTTP_RANGE_CACHE_HXX
+
+#include "gcc.h"
+
+#include <glib.h>
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <stddef.h>
+
+/**
+ * A memory cache for the parts of HTTP resources which have already
+ * been downloaded.  Each resource is a sparse set of byte ranges,
+ * which are merged when they touch.  When the cache is full, the
+ * least recently used resources are evicted.
+ *
+ * Each resource remembers the validators ("ETag" and "Last-Modified")
+ * of the responses its data came from.  Data of a different version
+ * of the resource is never merged with it.
+ *
+ * This class is not thread-safe.
+ */
+class HttpRangeCache {
+	struct Resource {
+		std::string url;
+
+		/**
+		 * The total size of the resource, or -1 if unknown.
+		 */
+		goffset size;
+
+		std::string mime;
+
+		/**
+		 * The "ETag" and "Last-Modified" response headers;
+		 * empty if the server did not send them.
+		 */
+		std::string etag, last_modified;
+
+		/**
+		 * The downloaded ranges, indexed by their start
+		 * offset.  They never overlap or touch.
+		 */
+		std::map<goffset, std::string> ranges;
+
+		/**
+		 * The number of bytes in #ranges.
+		 */
+		size_t bytes;
+
+		Resource(const char *_url)
+			:url(_url), size(-1), bytes(0) {}
+	};
+
+	const size_t max_size;
+
+	/**
+	 * The total number of bytes in all resources.
+	 */
+	size_t total;
+
+	/**
+	 * All resources, the most recently used one first.
+	 */
+	std::list<Resource> resources;
+
+public:
+	explicit HttpRangeCache(size_t _max_size)
+		:max_size(_max_size), total(0) {}
+
+	HttpRangeCache(const HttpRangeCache &) = delete;
+	HttpRangeCache &operator=(const HttpRangeCache &) = delete;
+
+	size_t GetSize() const {
+		return total;
+	}
+
+	/**
+	 * Remembers the size, the MIME type and the validators of a
+	 * resource.  If the validators differ from the ones stored
+	 * before, the cached data belongs to another version of the
+	 * resource, and is discarded.
+	 *
+	 * @param etag the "ETag" response header, or nullptr
+	 * @param last_modified the "Last-Modified" response header,
+	 * or nullptr
+	 */
+	void SetInfo(const char *url, goffset size, const char *mime,
+		     const char *etag, const char *last_modified);
+
+	/**
+	 * Looks up the size, the MIME type and the validators of a
+	 * resource.  The validators are empty strings if the server
+	 * did not send them.
+	 *
+	 * @return false if the resource is not in the cache, or if
+	 * its size is unknown
+	 */
+	bool GetInfo(const char *url, goffset &size_r, std::string &mime_r,
+		     std::string &etag_r, std::string &last_modified_r);
+
+	/**
+	 * Removes a resource and all of its data from the cache.
+	 */
+	void Invalidate(const char *url);
+
+	/**
+	 * Adds downloaded data.  Data which is already cached is
+	 * ignored.  If there is not enough room, other resources are
+	 * evicted; if that is not enough, the data is discarded.
+	 */
+	void Write(const char *url, goffset offset,
+		   const void *data, size_t length);
+
+	/**
+	 * Copies cached data from the specified offset.
+	 *
+	 * @return the number of bytes copied; 0 if the byte at
+	 * #offset is not cached
+	 */
+	size_t Read(const char *url, goffset offset,
+		    void *dest, size_t length);
+
+	gcc_pure
+	bool Contains(const char *url, goffset offset) const;
+
+private:
+	gcc_pure
+	const Resource *Find(const char *url) const;
+
+	/**
+	 * Finds a resource, and marks it as the most recently used
+	 * one.
+	 */
+	Resource *Touch(const char *url);
+
+	/**
+	 * Like Touch(), but creates the resource if it does not
+	 * exist.
+	 */
+	Resource &Make(const char *url);
+
+	/**
+	 * Evicts the least recently used resources (except for the
+	 * most recently used one) until #length more bytes fit.
+	 *
+	 * @return false if there is still not enough room
+	 */
+	bool MakeRoom(size_t length);
+
+	/**
+	 * Returns the range containing the specified offset, or
+	 * end().
+	 */
+	gcc_pure
+	static std::map<goffset, std::string>::const_iterator
+	FindRange(const Resource &resource, goffset offset);
+};
+
+#endif
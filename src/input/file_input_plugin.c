@@ -21,6 +21,7 @@
 #include "input/file_input_plugin.h"
 #include "input_internal.h"
 #include "input_plugin.h"
+#include "conf.h"
 #include "fd_util.h"
 #include "open.h"
 #include "io_error.h"
@@ -29,17 +30,123 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <glib.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "input_file"
 
+enum {
+	/**
+	 * The default readahead window of memory mapped files.
+	 */
+	DEFAULT_READAHEAD = 1024 * 1024,
+};
+
+/**
+ * Shall files be memory mapped?
+ */
+static bool file_mmap;
+
+/**
+ * The size of the readahead window of memory mapped files [bytes].
+ */
+static size_t file_readahead;
+
 struct file_input_stream {
 	struct input_stream base;
 
 	int fd;
+
+	/**
+	 * The whole file mapped into memory, or NULL if this stream
+	 * uses read().
+	 */
+	const unsigned char *map;
+
+	/**
+	 * The end of the range which has been announced to the kernel
+	 * with #POSIX_MADV_WILLNEED.
+	 */
+	goffset readahead_end;
 };
 
+static bool
+input_file_init(const struct config_param *param,
+		G_GNUC_UNUSED GError **error_r)
+{
+	file_mmap = config_get_block_bool(param, "mmap", false);
+	file_readahead = config_get_block_unsigned(param, "readahead",
+						   DEFAULT_READAHEAD);
+	return true;
+}
+
+#ifdef HAVE_MMAP
+
+static void
+input_file_map(struct file_input_stream *fis)
+{
+	const struct input_stream *is = &fis->base;
+
+	if (is->size <= 0 || (guint64)is->size > SIZE_MAX)
+		return;
+
+	void *p = mmap(NULL, is->size, PROT_READ, MAP_SHARED, fis->fd, 0);
+	if (p == MAP_FAILED) {
+		g_debug("Failed to map \"%s\": %s",
+			is->uri, g_strerror(errno));
+		return;
+	}
+
+#ifdef POSIX_MADV_SEQUENTIAL
+	posix_madvise(p, is->size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	fis->map = p;
+}
+
+/**
+ * Asks the kernel to read the next window of the mapped file, when
+ * the current position has passed the middle of the previous one.
+ * This keeps page faults of the decoder thread out of the disk's
+ * latency.
+ */
+static void
+input_file_readahead(struct file_input_stream *fis)
+{
+#ifdef POSIX_MADV_WILLNEED
+	const struct input_stream *is = &fis->base;
+
+	if (file_readahead == 0 ||
+	    is->offset + (goffset)file_readahead / 2 < fis->readahead_end ||
+	    fis->readahead_end >= is->size)
+		return;
+
+	const goffset page_size = sysconf(_SC_PAGESIZE);
+	goffset start = is->offset - is->offset % page_size;
+	if (start < fis->readahead_end)
+		start = fis->readahead_end;
+
+	goffset end = is->offset + file_readahead;
+	if (end > is->size)
+		end = is->size;
+
+	if (end > start)
+		posix_madvise((void *)(fis->map + start), end - start,
+			      POSIX_MADV_WILLNEED);
+
+	fis->readahead_end = end;
+#else
+	(void)fis;
+#endif
+}
+
+#endif
+
 static struct input_stream *
 input_file_open(const char *filename,
 		GMutex *mutex, GCond *cond,
@@ -77,10 +184,6 @@ input_file_open(const char *filename,
 		return NULL;
 	}
 
-#ifdef POSIX_FADV_SEQUENTIAL
-	posix_fadvise(fd, (off_t)0, st.st_size, POSIX_FADV_SEQUENTIAL);
-#endif
-
 	fis = g_new(struct file_input_stream, 1);
 	input_stream_init(&fis->base, &input_plugin_file, filename,
 			  mutex, cond);
@@ -90,6 +193,18 @@ input_file_open(const char *filename,
 	fis->base.ready = true;
 
 	fis->fd = fd;
+	fis->map = NULL;
+	fis->readahead_end = 0;
+
+#ifdef HAVE_MMAP
+	if (file_mmap)
+		input_file_map(fis);
+#endif
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (fis->map == NULL)
+		posix_fadvise(fd, (off_t)0, st.st_size, POSIX_FADV_SEQUENTIAL);
+#endif
 
 	return &fis->base;
 }
@@ -100,6 +215,34 @@ input_file_seek(struct input_stream *is, goffset offset, int whence,
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+	if (fis->map != NULL) {
+		/* no system call: the next read() just uses a
+		   different part of the map */
+		switch (whence) {
+		case SEEK_CUR:
+			offset += is->offset;
+			break;
+
+		case SEEK_END:
+			offset += is->size;
+			break;
+		}
+
+		if (offset < 0) {
+			g_set_error(error_r, errno_quark(), EINVAL,
+				    "Failed to seek: %s",
+				    g_strerror(EINVAL));
+			return false;
+		}
+
+		is->offset = offset;
+
+		/* restart the readahead window at the new
+		   position */
+		fis->readahead_end = offset;
+		return true;
+	}
+
 	offset = (goffset)lseek(fis->fd, (off_t)offset, whence);
 	if (offset < 0) {
 		g_set_error(error_r, errno_quark(), errno,
@@ -111,6 +254,35 @@ input_file_seek(struct input_stream *is, goffset offset, int whence,
 	return true;
 }
 
+#ifdef HAVE_MMAP
+
+static const void *
+input_file_read_mapped(struct input_stream *is, size_t size,
+		       size_t *length_r)
+{
+	struct file_input_stream *fis = (struct file_input_stream *)is;
+
+	if (fis->map == NULL)
+		return NULL;
+
+	if (is->offset >= is->size) {
+		*length_r = 0;
+		return fis->map + is->size;
+	}
+
+	if ((goffset)size > is->size - is->offset)
+		size = is->size - is->offset;
+
+	const unsigned char *p = fis->map + is->offset;
+	is->offset += size;
+	input_file_readahead(fis);
+
+	*length_r = size;
+	return p;
+}
+
+#endif
+
 static size_t
 input_file_read(struct input_stream *is, void *ptr, size_t size,
 		GError **error_r)
@@ -118,6 +290,15 @@ input_file_read(struct input_stream *is, void *ptr, size_t size,
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 	ssize_t nbytes;
 
+#ifdef HAVE_MMAP
+	if (fis->map != NULL) {
+		size_t length;
+		const void *p = input_file_read_mapped(is, size, &length);
+		memcpy(ptr, p, length);
+		return length;
+	}
+#endif
+
 	nbytes = read(fis->fd, ptr, size);
 	if (nbytes < 0) {
 		g_set_error(error_r, errno_quark(), errno,
@@ -134,6 +315,11 @@ input_file_close(struct input_stream *is)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+#ifdef HAVE_MMAP
+	if (fis->map != NULL)
+		munmap((void *)fis->map, is->size);
+#endif
+
 	close(fis->fd);
 	input_stream_deinit(&fis->base);
 	g_free(fis);
@@ -147,9 +333,13 @@ input_file_eof(struct input_stream *is)
 
 const struct input_plugin input_plugin_file = {
 	.name = "file",
+	.init = input_file_init,
 	.open = input_file_open,
 	.close = input_file_close,
 	.read = input_file_read,
 	.eof = input_file_eof,
 	.seek = input_file_seek,
+#ifdef HAVE_MMAP
+	.read_mapped = input_file_read_mapped,
+#endif
 };
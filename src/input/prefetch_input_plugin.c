@@ -0,0 +1,673 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "input/prefetch_input_plugin.h"
+#include "input_internal.h"
+#include "input_plugin.h"
+#include "input_stream.h"
+#include "conf.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "input_prefetch"
+
+enum {
+	/**
+	 * The maximum size of one read from the file.  After each
+	 * chunk, the thread checks whether the file is still wanted.
+	 */
+	PREFETCH_CHUNK = 256 * 1024,
+};
+
+/**
+ * A file in the cache.  All attributes are protected by
+ * prefetch.mutex, except for the contents of #data beyond #filled,
+ * which only the prefetch thread may access.
+ */
+struct prefetch_entry {
+	char *path;
+
+	/**
+	 * The number of references: the cache, the queue of
+	 * #prefetch.pending (or the prefetch thread while it loads
+	 * this file), and each open stream.
+	 */
+	unsigned refcount;
+
+	/**
+	 * Has the prefetch thread begun loading this file?
+	 */
+	bool started;
+
+	/**
+	 * Loading has finished, successfully or with #error.
+	 */
+	bool done;
+
+	/**
+	 * The size of the file, or -1 if it is not yet known.
+	 */
+	goffset size;
+
+	unsigned char *data;
+
+	/**
+	 * The number of bytes accounted for #data in prefetch.used.
+	 * Unlike #size, this does not shrink when the file turns out
+	 * to be truncated.
+	 */
+	size_t allocated;
+
+	/**
+	 * The number of bytes in #data which have been loaded.
+	 */
+	size_t filled;
+
+	GError *error;
+
+	/**
+	 * The #prefetch_stream objects reading this file.  Each
+	 * receives a copy of #filled and #done with
+	 * prefetch_entry_publish().
+	 */
+	GList *streams;
+};
+
+static struct {
+	/**
+	 * Protects all attributes of this struct and all
+	 * #prefetch_entry objects.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Wakes up the prefetch thread, and prefetch_open() when the
+	 * size of a file is known or loading has failed.  Streams are
+	 * woken up with their own condition instead, see
+	 * prefetch_entry_publish().
+	 */
+	GCond *cond;
+
+	GThread *thread;
+
+	/**
+	 * The maximum total size of the files in the cache [bytes].
+	 * 0 means prefetching is disabled.
+	 */
+	size_t max_size;
+
+	/**
+	 * The total size of all #prefetch_entry buffers [bytes].
+	 * This includes files which have been evicted from the cache
+	 * but are still referenced by a stream, because their memory
+	 * is only freed with the last reference.
+	 */
+	size_t used;
+
+	unsigned max_songs;
+
+	/**
+	 * The cached #prefetch_entry objects, in the order passed to
+	 * prefetch_schedule().
+	 */
+	GList *entries;
+
+	/**
+	 * #prefetch_entry objects which have not been loaded yet.
+	 */
+	GQueue *pending;
+
+	bool quit;
+} prefetch;
+
+struct prefetch_stream {
+	struct input_stream base;
+
+	struct prefetch_entry *entry;
+
+	/**
+	 * Copies of prefetch_entry.filled and prefetch_entry.done,
+	 * protected by the stream's mutex instead of prefetch.mutex.
+	 * The methods of the stream are called with that mutex held,
+	 * and must not lock prefetch.mutex, because the prefetch
+	 * thread locks both in the opposite order.
+	 */
+	size_t filled;
+	bool done;
+};
+
+static inline GQuark
+prefetch_quark(void)
+{
+	return g_quark_from_static_string("input_prefetch");
+}
+
+static struct prefetch_entry *
+prefetch_entry_new(const char *path)
+{
+	struct prefetch_entry *e = g_new(struct prefetch_entry, 1);
+	e->path = g_strdup(path);
+	e->refcount = 1;
+	e->started = false;
+	e->done = false;
+	e->size = -1;
+	e->data = NULL;
+	e->allocated = 0;
+	e->filled = 0;
+	e->error = NULL;
+	e->streams = NULL;
+	return e;
+}
+
+/**
+ * The caller must hold prefetch.mutex.
+ */
+static void
+prefetch_entry_unref(struct prefetch_entry *e)
+{
+	assert(e->refcount > 0);
+
+	if (--e->refcount > 0)
+		return;
+
+	assert(e->streams == NULL);
+	assert(prefetch.used >= e->allocated);
+	prefetch.used -= e->allocated;
+
+	if (e->error != NULL)
+		g_error_free(e->error);
+	g_free(e->data);
+	g_free(e->path);
+	g_free(e);
+}
+
+static void
+prefetch_entry_unref_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	prefetch_entry_unref(data);
+}
+
+/**
+ * Finds a file in a list of #prefetch_entry objects.
+ */
+G_GNUC_PURE
+static GList *
+prefetch_find(GList *list, const char *path)
+{
+	for (; list != NULL; list = list->next) {
+		const struct prefetch_entry *e = list->data;
+		if (strcmp(e->path, path) == 0)
+			return list;
+	}
+
+	return NULL;
+}
+
+/**
+ * Passes the progress of the prefetch thread to all streams reading
+ * the file, and wakes up their clients.  The caller must hold
+ * prefetch.mutex.
+ */
+static void
+prefetch_entry_publish(struct prefetch_entry *e)
+{
+	for (GList *i = e->streams; i != NULL; i = i->next) {
+		struct prefetch_stream *s = i->data;
+
+		g_mutex_lock(s->base.mutex);
+		s->filled = e->filled;
+		s->done = e->done;
+		input_stream_signal_client(&s->base);
+		g_mutex_unlock(s->base.mutex);
+	}
+}
+
+/**
+ * Marks the file as loaded, and wakes up all streams which are
+ * waiting for it.  The caller must hold prefetch.mutex.
+ */
+static void
+prefetch_entry_done(struct prefetch_entry *e, GError *error)
+{
+	assert(e->error == NULL);
+
+	e->done = true;
+	e->error = error;
+	if (e->size > (goffset)e->filled)
+		e->size = e->filled;
+
+	g_cond_broadcast(prefetch.cond);
+	prefetch_entry_publish(e);
+}
+
+/**
+ * Opens the file, and determines its size.  Called by the prefetch
+ * thread without holding prefetch.mutex.
+ */
+static struct input_stream *
+prefetch_open_file(const char *path, GMutex *mutex, GCond *cond,
+		   GError **error_r)
+{
+	struct input_stream *is = input_stream_open(path, mutex, cond,
+						    error_r);
+	if (is == NULL)
+		return NULL;
+
+	g_mutex_lock(mutex);
+
+	input_stream_update(is);
+	while (!is->ready) {
+		g_cond_wait(cond, mutex);
+		input_stream_update(is);
+	}
+
+	if (!input_stream_check(is, error_r)) {
+		g_mutex_unlock(mutex);
+		input_stream_close(is);
+		return NULL;
+	}
+
+	if (is->size < 0) {
+		g_mutex_unlock(mutex);
+		input_stream_close(is);
+		g_set_error(error_r, prefetch_quark(), 0,
+			    "Unknown size of %s", path);
+		return NULL;
+	}
+
+	g_mutex_unlock(mutex);
+	return is;
+}
+
+/**
+ * Loads a file into memory.  Called by the prefetch thread without
+ * holding prefetch.mutex.
+ */
+static void
+prefetch_load(struct prefetch_entry *e)
+{
+	GMutex *mutex = g_mutex_new();
+	GCond *cond = g_cond_new();
+	GError *error = NULL;
+
+	struct input_stream *is = prefetch_open_file(e->path, mutex, cond,
+						     &error);
+	if (is == NULL) {
+		g_mutex_lock(prefetch.mutex);
+		prefetch_entry_done(e, error);
+		g_mutex_unlock(prefetch.mutex);
+
+		g_cond_free(cond);
+		g_mutex_free(mutex);
+		return;
+	}
+
+	g_mutex_lock(prefetch.mutex);
+
+	if (prefetch.used > prefetch.max_size ||
+	    (guint64)is->size > prefetch.max_size - prefetch.used ||
+	    /* allocate one extra byte, because g_try_malloc(0)
+	       returns NULL */
+	    (e->data = g_try_malloc(is->size + 1)) == NULL) {
+		g_set_error(&error, prefetch_quark(), 0,
+			    "Not enough room to prefetch %s", e->path);
+		prefetch_entry_done(e, error);
+		g_mutex_unlock(prefetch.mutex);
+
+		input_stream_close(is);
+		g_cond_free(cond);
+		g_mutex_free(mutex);
+		return;
+	}
+
+	e->allocated = is->size;
+	prefetch.used += e->allocated;
+	e->size = is->size;
+	g_cond_broadcast(prefetch.cond);
+
+	while ((goffset)e->filled < e->size) {
+		if (e->refcount == 1 || prefetch.quit) {
+			/* nobody wants this file anymore */
+			g_set_error(&error, prefetch_quark(), 0,
+				    "Prefetching %s was cancelled", e->path);
+			break;
+		}
+
+		size_t length = e->size - e->filled;
+		if (length > PREFETCH_CHUNK)
+			length = PREFETCH_CHUNK;
+
+		unsigned char *dest = e->data + e->filled;
+		g_mutex_unlock(prefetch.mutex);
+
+		g_mutex_lock(mutex);
+		const size_t nbytes = input_stream_read(is, dest, length,
+							&error);
+		const bool eof = nbytes == 0 && input_stream_eof(is);
+		g_mutex_unlock(mutex);
+
+		g_mutex_lock(prefetch.mutex);
+
+		if (nbytes == 0) {
+			if (error == NULL && !eof)
+				g_set_error(&error, prefetch_quark(), 0,
+					    "Failed to read %s", e->path);
+			/* on EOF, the file has been truncated since it
+			   was opened; prefetch_entry_done() adjusts the
+			   size */
+			break;
+		}
+
+		e->filled += nbytes;
+		prefetch_entry_publish(e);
+	}
+
+	if (error == NULL)
+		g_debug("prefetched %s (%lu kB)", e->path,
+			(unsigned long)(e->filled / 1024));
+
+	prefetch_entry_done(e, error);
+	g_mutex_unlock(prefetch.mutex);
+
+	input_stream_close(is);
+	g_cond_free(cond);
+	g_mutex_free(mutex);
+}
+
+static gpointer
+prefetch_thread(G_GNUC_UNUSED gpointer data)
+{
+	g_mutex_lock(prefetch.mutex);
+
+	while (true) {
+		while (!prefetch.quit && g_queue_is_empty(prefetch.pending))
+			g_cond_wait(prefetch.cond, prefetch.mutex);
+
+		if (prefetch.quit)
+			break;
+
+		struct prefetch_entry *e = g_queue_pop_head(prefetch.pending);
+		if (e->refcount > 1) {
+			e->started = true;
+
+			g_mutex_unlock(prefetch.mutex);
+			prefetch_load(e);
+			g_mutex_lock(prefetch.mutex);
+
+			if (e->error != NULL)
+				g_debug("%s", e->error->message);
+		}
+
+		/* release the reference of the pending queue */
+		prefetch_entry_unref(e);
+	}
+
+	g_mutex_unlock(prefetch.mutex);
+	return NULL;
+}
+
+bool
+prefetch_global_init(GError **error_r)
+{
+	prefetch.max_size =
+		(size_t)config_get_unsigned(CONF_PREFETCH_SIZE, 0) * 1024;
+	if (prefetch.max_size == 0)
+		return true;
+
+	prefetch.max_songs = config_get_positive(CONF_PREFETCH_SONGS, 2);
+
+	prefetch.mutex = g_mutex_new();
+	prefetch.cond = g_cond_new();
+	prefetch.entries = NULL;
+	prefetch.used = 0;
+	prefetch.pending = g_queue_new();
+	prefetch.quit = false;
+
+	prefetch.thread = g_thread_create(prefetch_thread, NULL, true,
+					  error_r);
+	if (prefetch.thread == NULL) {
+		g_queue_free(prefetch.pending);
+		g_cond_free(prefetch.cond);
+		g_mutex_free(prefetch.mutex);
+		prefetch.max_size = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void
+prefetch_global_finish(void)
+{
+	if (prefetch.max_size == 0)
+		return;
+
+	g_mutex_lock(prefetch.mutex);
+	prefetch.quit = true;
+	g_cond_broadcast(prefetch.cond);
+	g_mutex_unlock(prefetch.mutex);
+
+	g_thread_join(prefetch.thread);
+
+	g_queue_foreach(prefetch.pending, prefetch_entry_unref_callback, NULL);
+	g_queue_free(prefetch.pending);
+	g_list_foreach(prefetch.entries, prefetch_entry_unref_callback, NULL);
+	g_list_free(prefetch.entries);
+
+	g_cond_free(prefetch.cond);
+	g_mutex_free(prefetch.mutex);
+	prefetch.max_size = 0;
+}
+
+unsigned
+prefetch_max_songs(void)
+{
+	return prefetch.max_size > 0 ? prefetch.max_songs : 0;
+}
+
+void
+prefetch_schedule(const char *const*paths, unsigned n)
+{
+	if (prefetch.max_size == 0)
+		return;
+
+	g_mutex_lock(prefetch.mutex);
+
+	GList *old = prefetch.entries;
+	GList *entries = NULL;
+
+	for (unsigned i = 0; i < n; ++i) {
+		if (prefetch_find(entries, paths[i]) != NULL)
+			/* duplicate, e.g. in "single" mode */
+			continue;
+
+		GList *link = prefetch_find(old, paths[i]);
+		if (link != NULL) {
+			/* move the existing entry to the new list */
+			old = g_list_remove_link(old, link);
+			entries = g_list_concat(entries, link);
+			continue;
+		}
+
+		struct prefetch_entry *e = prefetch_entry_new(paths[i]);
+		++e->refcount;
+		g_queue_push_tail(prefetch.pending, e);
+		entries = g_list_append(entries, e);
+	}
+
+	prefetch.entries = entries;
+
+	/* evict the files which are not wanted anymore; if they are
+	   still being loaded, the prefetch thread notices that it
+	   holds the last reference */
+	g_list_foreach(old, prefetch_entry_unref_callback, NULL);
+	g_list_free(old);
+
+	g_cond_broadcast(prefetch.cond);
+	g_mutex_unlock(prefetch.mutex);
+}
+
+static void
+prefetch_stream_close(struct input_stream *is)
+{
+	struct prefetch_stream *s = (struct prefetch_stream *)is;
+
+	g_mutex_lock(prefetch.mutex);
+	s->entry->streams = g_list_remove(s->entry->streams, s);
+	prefetch_entry_unref(s->entry);
+	g_mutex_unlock(prefetch.mutex);
+
+	input_stream_deinit(&s->base);
+	g_free(s);
+}
+
+static bool
+prefetch_stream_available(struct input_stream *is)
+{
+	struct prefetch_stream *s = (struct prefetch_stream *)is;
+
+	return is->offset < (goffset)s->filled || s->done;
+}
+
+static size_t
+prefetch_stream_read(struct input_stream *is, void *ptr, size_t size,
+		     GError **error_r)
+{
+	struct prefetch_stream *s = (struct prefetch_stream *)is;
+	struct prefetch_entry *e = s->entry;
+
+	/* decoder_read() waits with input_stream_available(), so it
+	   can be cancelled; this is only for other callers */
+	while (!prefetch_stream_available(is))
+		g_cond_wait(is->cond, is->mutex);
+
+	if (is->offset >= (goffset)s->filled) {
+		/* e->error is not modified after e->done has been
+		   set */
+		if (e->error != NULL)
+			g_propagate_error(error_r, g_error_copy(e->error));
+		return 0;
+	}
+
+	const size_t available = s->filled - is->offset;
+	if (size > available)
+		size = available;
+
+	/* the prefetch thread does not modify the data below
+	   s->filled anymore */
+	memcpy(ptr, e->data + is->offset, size);
+
+	is->offset += size;
+	return size;
+}
+
+static bool
+prefetch_stream_eof(struct input_stream *is)
+{
+	struct prefetch_stream *s = (struct prefetch_stream *)is;
+
+	return s->done && is->offset >= (goffset)s->filled;
+}
+
+static bool
+prefetch_stream_seek(struct input_stream *is, goffset offset, int whence,
+		     G_GNUC_UNUSED GError **error_r)
+{
+	switch (whence) {
+	case SEEK_CUR:
+		offset += is->offset;
+		break;
+
+	case SEEK_END:
+		offset += is->size;
+		break;
+	}
+
+	if (offset < 0 || offset > is->size)
+		return false;
+
+	is->offset = offset;
+	return true;
+}
+
+static const struct input_plugin prefetch_input_plugin = {
+	.close = prefetch_stream_close,
+	.available = prefetch_stream_available,
+	.read = prefetch_stream_read,
+	.eof = prefetch_stream_eof,
+	.seek = prefetch_stream_seek,
+};
+
+struct input_stream *
+prefetch_open(const char *path, GMutex *mutex, GCond *cond)
+{
+	assert(path != NULL);
+	assert(mutex != NULL);
+	assert(cond != NULL);
+
+	if (prefetch.max_size == 0)
+		return NULL;
+
+	g_mutex_lock(prefetch.mutex);
+
+	GList *link = prefetch_find(prefetch.entries, path);
+	if (link == NULL) {
+		g_mutex_unlock(prefetch.mutex);
+		return NULL;
+	}
+
+	struct prefetch_entry *e = link->data;
+	if (!e->started) {
+		/* the prefetch thread is busy with another file;
+		   don't wait for it */
+		g_mutex_unlock(prefetch.mutex);
+		return NULL;
+	}
+
+	while (e->size < 0 && !e->done)
+		g_cond_wait(prefetch.cond, prefetch.mutex);
+
+	if (e->done && e->error != NULL) {
+		g_mutex_unlock(prefetch.mutex);
+		return NULL;
+	}
+
+	struct prefetch_stream *s = g_new(struct prefetch_stream, 1);
+	input_stream_init(&s->base, &prefetch_input_plugin, path,
+			  mutex, cond);
+	s->base.ready = true;
+	s->base.seekable = true;
+	s->base.size = e->size;
+	s->entry = e;
+	s->filled = e->filled;
+	s->done = e->done;
+
+	++e->refcount;
+	e->streams = g_list_prepend(e->streams, s);
+	g_mutex_unlock(prefetch.mutex);
+
+	g_debug("opened %s from the prefetch cache", path);
+	return &s->base;
+}
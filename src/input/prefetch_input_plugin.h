@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A RAM cache for the songs which will be played next.  A separate
+ * thread reads each of them completely into memory, so the disk may
+ * go to sleep during playback, and song transitions don't wait for
+ * it to spin up.  The decoder thread consults the cache with
+ * prefetch_open() before opening a file.
+ */
+
+#ifndef MPD_INPUT_PREFETCH_H
+#define MPD_INPUT_PREFETCH_H
+
+#include "check.h"
+
+#include <glib.h>
+
+#include <stdbool.h>
+
+struct input_stream;
+
+/**
+ * Reads the configuration and starts the prefetch thread if it is
+ * enabled.  Call this after daemonizing.
+ */
+bool
+prefetch_global_init(GError **error_r);
+
+void
+prefetch_global_finish(void);
+
+/**
+ * Returns the configured number of songs which shall be prefetched,
+ * or 0 if prefetching is disabled.
+ */
+G_GNUC_PURE
+unsigned
+prefetch_max_songs(void);
+
+/**
+ * Replaces the set of cached files.  Files which are not in the new
+ * set are evicted (streams which are still reading them are not
+ * affected); new files are loaded in the specified order, as long as
+ * they fit into the cache.
+ *
+ * This function is called by the main thread.
+ *
+ * @param paths the file system paths of the upcoming songs
+ * @param n the number of paths
+ */
+void
+prefetch_schedule(const char *const*paths, unsigned n);
+
+/**
+ * Opens a file from the cache.  If it is still being loaded, the
+ * stream blocks on reads beyond the data loaded so far.
+ *
+ * @return a new stream, or NULL if the file is not in the cache
+ */
+struct input_stream *
+prefetch_open(const char *path, GMutex *mutex, GCond *cond);
+
+#endif
@@ -0,0 +1,616 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "input/readahead_input_plugin.h"
+#include "input_internal.h"
+#include "input_plugin.h"
+#include "input_stream.h"
+#include "tag.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "input_readahead"
+
+enum {
+	/**
+	 * The maximum size of one read from the underlying stream.
+	 */
+	READAHEAD_CHUNK = 64 * 1024,
+
+	/**
+	 * How often the thread checks for commands while it waits
+	 * for the underlying stream [milliseconds].
+	 */
+	READAHEAD_POLL_MS = 100,
+};
+
+/**
+ * A tag received from the underlying stream, which will be returned
+ * to the client when it reaches the corresponding position.
+ */
+struct readahead_tag {
+	goffset offset;
+
+	struct tag *tag;
+};
+
+struct input_readahead {
+	struct input_stream base;
+
+	/**
+	 * The underlying stream.  It has its own mutex and cond, so
+	 * the thread can wait for it without blocking the client.
+	 */
+	struct input_stream *input;
+	GMutex *input_mutex;
+	GCond *input_cond;
+
+	GThread *thread;
+
+	/**
+	 * Wakes up the thread; used with base.mutex, which protects
+	 * all of the following attributes.
+	 */
+	GCond *thread_cond;
+
+	unsigned char *buffer;
+	size_t size;
+
+	/**
+	 * The stream offsets of the oldest byte and of the end of the
+	 * data in #buffer.  The byte at offset X is stored in
+	 * buffer[X % size].  base.offset is always between these two.
+	 */
+	goffset window_start, window_end;
+
+	/**
+	 * A queue of #readahead_tag objects, ordered by offset.
+	 */
+	GQueue *tags;
+
+	/**
+	 * If true, then the client waits for the thread to seek the
+	 * underlying stream to #seek_offset.
+	 */
+	bool seek_pending;
+	goffset seek_offset;
+
+	/**
+	 * The error of the last seek, to be returned to the client.
+	 */
+	GError *seek_error;
+
+	/**
+	 * The underlying stream has reached its end at
+	 * #window_end.
+	 */
+	bool eof;
+
+	/**
+	 * An error which occurred while reading the underlying
+	 * stream.  Reading stops then.
+	 */
+	GError *error;
+
+	/**
+	 * Has the client run out of data since the buffer was last
+	 * filled?  Used to count #underruns only once.
+	 */
+	bool starving;
+
+	unsigned underruns;
+
+	bool quit;
+};
+
+static inline GQuark
+readahead_quark(void)
+{
+	return g_quark_from_static_string("input_readahead");
+}
+
+static void
+readahead_tag_free(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct readahead_tag *t = data;
+
+	tag_free(t->tag);
+	g_free(t);
+}
+
+static void
+readahead_clear_tags(struct input_readahead *r)
+{
+	g_queue_foreach(r->tags, readahead_tag_free, NULL);
+	g_queue_clear(r->tags);
+}
+
+/**
+ * Waits for the underlying stream, but not longer than
+ * #READAHEAD_POLL_MS.  The caller must hold input_mutex.
+ */
+static void
+readahead_wait_input(struct input_readahead *r)
+{
+	GTimeVal tv;
+	g_get_current_time(&tv);
+	g_time_val_add(&tv, READAHEAD_POLL_MS * 1000);
+	(void)g_cond_timed_wait(r->input_cond, r->input_mutex, &tv);
+}
+
+static bool
+readahead_lock_quit(struct input_readahead *r)
+{
+	g_mutex_lock(r->base.mutex);
+	const bool quit = r->quit;
+	g_mutex_unlock(r->base.mutex);
+	return quit;
+}
+
+/**
+ * Waits until the underlying stream is ready, and copies its
+ * attributes.
+ *
+ * @return false if the thread shall quit
+ */
+static bool
+readahead_wait_ready(struct input_readahead *r)
+{
+	while (true) {
+		g_mutex_lock(r->input_mutex);
+		input_stream_update(r->input);
+		if (r->input->ready)
+			break;
+
+		readahead_wait_input(r);
+		g_mutex_unlock(r->input_mutex);
+
+		if (readahead_lock_quit(r))
+			return false;
+	}
+
+	GError *error = NULL;
+	if (!input_stream_check(r->input, &error))
+		assert(error != NULL);
+
+	const bool seekable = r->input->seekable;
+	const goffset size = r->input->size;
+	char *mime = g_strdup(r->input->mime);
+	g_mutex_unlock(r->input_mutex);
+
+	g_mutex_lock(r->base.mutex);
+	r->base.seekable = seekable;
+	r->base.size = size;
+	r->base.mime = mime;
+	r->base.ready = true;
+	r->error = error;
+	input_stream_signal_client(&r->base);
+	g_mutex_unlock(r->base.mutex);
+
+	return true;
+}
+
+/**
+ * Seeks the underlying stream on behalf of the client.  The caller
+ * must hold base.mutex.
+ */
+static void
+readahead_seek(struct input_readahead *r)
+{
+	const goffset offset = r->seek_offset;
+	g_mutex_unlock(r->base.mutex);
+
+	GError *error = NULL;
+	g_mutex_lock(r->input_mutex);
+	bool success = input_stream_seek(r->input, offset, SEEK_SET, &error);
+	g_mutex_unlock(r->input_mutex);
+
+	g_mutex_lock(r->base.mutex);
+
+	if (success) {
+		r->window_start = r->window_end = r->base.offset = offset;
+		r->eof = false;
+		r->starving = false;
+
+		if (r->error != NULL) {
+			/* try again at the new position */
+			g_error_free(r->error);
+			r->error = NULL;
+		}
+
+		readahead_clear_tags(r);
+	} else {
+		if (error == NULL)
+			error = g_error_new(readahead_quark(), 0,
+					    "Failed to seek");
+		r->seek_error = error;
+	}
+
+	r->seek_pending = false;
+	input_stream_signal_client(&r->base);
+}
+
+/**
+ * Reads one chunk from the underlying stream into the buffer.  The
+ * caller must hold base.mutex; it is released while reading.
+ */
+static void
+readahead_fill(struct input_readahead *r)
+{
+	const size_t ahead = r->window_end - r->base.offset;
+	assert(ahead < r->size);
+
+	/* the largest contiguous free part of the buffer; data which
+	   has already been consumed may be overwritten */
+	const size_t index = r->window_end % r->size;
+	size_t length = r->size - ahead;
+	if (length > r->size - index)
+		length = r->size - index;
+	if (length > READAHEAD_CHUNK)
+		length = READAHEAD_CHUNK;
+
+	if (r->window_end + (goffset)length - r->window_start >
+	    (goffset)r->size)
+		/* no buffered seek into the part which is about to
+		   be overwritten */
+		r->window_start = r->window_end + length - r->size;
+	assert(r->window_start <= r->base.offset);
+
+	const goffset offset = r->window_end;
+	g_mutex_unlock(r->base.mutex);
+
+	GError *error = NULL;
+	struct tag *tag = NULL;
+	size_t nbytes = 0;
+	bool eof = false;
+
+	g_mutex_lock(r->input_mutex);
+	if (input_stream_available(r->input)) {
+		nbytes = input_stream_read(r->input, r->buffer + index,
+					   length, &error);
+		if (nbytes == 0 && error == NULL) {
+			eof = input_stream_eof(r->input);
+			if (!eof)
+				/* nothing yet, don't spin */
+				readahead_wait_input(r);
+		}
+
+		tag = input_stream_tag(r->input);
+	} else
+		readahead_wait_input(r);
+	g_mutex_unlock(r->input_mutex);
+
+	g_mutex_lock(r->base.mutex);
+
+	if (r->seek_pending || offset != r->window_end) {
+		/* the client has seeked meanwhile; this data belongs
+		   to the old position */
+		if (tag != NULL)
+			tag_free(tag);
+		if (error != NULL)
+			g_error_free(error);
+		return;
+	}
+
+	if (tag != NULL) {
+		struct readahead_tag *t = g_new(struct readahead_tag, 1);
+		t->offset = offset;
+		t->tag = tag;
+		g_queue_push_tail(r->tags, t);
+	}
+
+	r->window_end += nbytes;
+	if (nbytes > 0)
+		r->starving = false;
+
+	if (error != NULL)
+		r->error = error;
+	else if (eof)
+		r->eof = true;
+
+	if (nbytes > 0 || error != NULL || eof)
+		input_stream_signal_client(&r->base);
+}
+
+static gpointer
+readahead_thread(gpointer data)
+{
+	struct input_readahead *r = data;
+
+	if (!readahead_wait_ready(r))
+		return NULL;
+
+	g_mutex_lock(r->base.mutex);
+
+	while (!r->quit) {
+		if (r->seek_pending)
+			readahead_seek(r);
+		else if (r->eof || r->error != NULL ||
+			 r->window_end - r->base.offset >= (goffset)r->size)
+			g_cond_wait(r->thread_cond, r->base.mutex);
+		else
+			readahead_fill(r);
+	}
+
+	g_mutex_unlock(r->base.mutex);
+	return NULL;
+}
+
+static void
+input_readahead_close(struct input_stream *is)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+
+	g_mutex_lock(is->mutex);
+	r->quit = true;
+	g_cond_signal(r->thread_cond);
+	g_mutex_unlock(is->mutex);
+
+	g_thread_join(r->thread);
+
+	if (r->underruns > 0)
+		g_debug("%u underruns in %s", r->underruns, is->uri);
+
+	input_stream_close(r->input);
+	g_cond_free(r->input_cond);
+	g_mutex_free(r->input_mutex);
+	g_cond_free(r->thread_cond);
+
+	readahead_clear_tags(r);
+	g_queue_free(r->tags);
+
+	if (r->seek_error != NULL)
+		g_error_free(r->seek_error);
+	if (r->error != NULL)
+		g_error_free(r->error);
+
+	g_free(r->buffer);
+	input_stream_deinit(&r->base);
+	g_free(r);
+}
+
+static bool
+input_readahead_check(struct input_stream *is, GError **error_r)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+
+	/* report an error only after the data before it has been
+	   consumed */
+	if (r->error != NULL && is->offset >= r->window_end) {
+		g_propagate_error(error_r, g_error_copy(r->error));
+		return false;
+	}
+
+	return true;
+}
+
+static struct tag *
+input_readahead_tag(struct input_stream *is)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+	struct tag *tag = NULL;
+
+	/* return the most recent tag which has been reached */
+	struct readahead_tag *t;
+	while ((t = g_queue_peek_head(r->tags)) != NULL &&
+	       t->offset <= is->offset) {
+		g_queue_pop_head(r->tags);
+
+		if (tag != NULL)
+			tag_free(tag);
+		tag = t->tag;
+		g_free(t);
+	}
+
+	return tag;
+}
+
+static bool
+input_readahead_available(struct input_stream *is)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+
+	if (is->offset < r->window_end || r->eof || r->error != NULL)
+		return true;
+
+	if (!r->starving && r->window_end > r->window_start) {
+		/* the client has consumed everything which was read
+		   since the last seek: the underlying stream is too
+		   slow */
+		r->starving = true;
+		++r->underruns;
+		g_debug("buffer underrun in %s", is->uri);
+	}
+
+	return false;
+}
+
+static size_t
+input_readahead_read(struct input_stream *is, void *ptr, size_t size,
+		     GError **error_r)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+
+	while (!input_readahead_available(is))
+		g_cond_wait(is->cond, is->mutex);
+
+	if (is->offset >= r->window_end) {
+		if (r->error != NULL)
+			g_propagate_error(error_r, g_error_copy(r->error));
+		return 0;
+	}
+
+	const size_t ahead = r->window_end - is->offset;
+	if (size > ahead)
+		size = ahead;
+
+	const size_t index = is->offset % r->size;
+	if (size > r->size - index)
+		/* wrap around */
+		size = r->size - index;
+
+	memcpy(ptr, r->buffer + index, size);
+	is->offset += size;
+
+	/* there's free space now */
+	g_cond_signal(r->thread_cond);
+
+	return size;
+}
+
+static bool
+input_readahead_eof(struct input_stream *is)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+
+	return r->eof && is->offset >= r->window_end;
+}
+
+static bool
+input_readahead_seek(struct input_stream *is, goffset offset, int whence,
+		     GError **error_r)
+{
+	struct input_readahead *r = (struct input_readahead *)is;
+
+	assert(is->ready);
+
+	switch (whence) {
+	case SEEK_CUR:
+		offset += is->offset;
+		break;
+
+	case SEEK_END:
+		if (is->size < 0)
+			return false;
+
+		offset += is->size;
+		break;
+	}
+
+	if (offset >= r->window_start && offset <= r->window_end) {
+		/* buffered seek */
+		is->offset = offset;
+		g_cond_signal(r->thread_cond);
+		return true;
+	}
+
+	if (!is->seekable)
+		return false;
+
+	r->seek_offset = offset;
+	r->seek_pending = true;
+	g_cond_signal(r->thread_cond);
+
+	while (r->seek_pending)
+		g_cond_wait(is->cond, is->mutex);
+
+	if (r->seek_error != NULL) {
+		g_propagate_error(error_r, r->seek_error);
+		r->seek_error = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static const struct input_plugin readahead_input_plugin = {
+	.close = input_readahead_close,
+	.check = input_readahead_check,
+	.tag = input_readahead_tag,
+	.available = input_readahead_available,
+	.read = input_readahead_read,
+	.eof = input_readahead_eof,
+	.seek = input_readahead_seek,
+};
+
+struct input_stream *
+input_readahead_open(const char *uri, GMutex *mutex, GCond *cond,
+		     size_t buffer_size, GError **error_r)
+{
+	assert(mutex != NULL);
+	assert(cond != NULL);
+	assert(buffer_size > 0);
+
+	GMutex *input_mutex = g_mutex_new();
+	GCond *input_cond = g_cond_new();
+
+	struct input_stream *input =
+		input_stream_open(uri, input_mutex, input_cond, error_r);
+	if (input == NULL) {
+		g_cond_free(input_cond);
+		g_mutex_free(input_mutex);
+		return NULL;
+	}
+
+	struct input_readahead *r = g_new(struct input_readahead, 1);
+	input_stream_init(&r->base, &readahead_input_plugin, uri,
+			  mutex, cond);
+
+	r->input = input;
+	r->input_mutex = input_mutex;
+	r->input_cond = input_cond;
+	r->thread_cond = g_cond_new();
+	r->buffer = g_malloc(buffer_size);
+	r->size = buffer_size;
+	r->window_start = r->window_end = 0;
+	r->tags = g_queue_new();
+	r->seek_pending = false;
+	r->seek_error = NULL;
+	r->eof = false;
+	r->error = NULL;
+	r->starving = false;
+	r->underruns = 0;
+	r->quit = false;
+
+	r->thread = g_thread_create(readahead_thread, r, true, error_r);
+	if (r->thread == NULL) {
+		input_stream_close(input);
+		g_cond_free(input_cond);
+		g_mutex_free(input_mutex);
+		g_cond_free(r->thread_cond);
+		g_queue_free(r->tags);
+		g_free(r->buffer);
+		input_stream_deinit(&r->base);
+		g_free(r);
+		return NULL;
+	}
+
+	return &r->base;
+}
+
+bool
+input_readahead_get_fill(const struct input_stream *is,
+			 size_t *buffered_r, size_t *size_r)
+{
+	if (is->plugin != &readahead_input_plugin)
+		return false;
+
+	const struct input_readahead *r = (const struct input_readahead *)is;
+	*buffered_r = r->window_end > is->offset
+		? (size_t)(r->window_end - is->offset)
+		: 0;
+	*size_r = r->size;
+	return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A wrapper for an input_stream object which reads ahead into a
+ * large buffer in a separate thread.  The decoder thread reads from
+ * the buffer, so a slow disk (spinning up, or a busy NAS) doesn't
+ * stall decoding as long as the buffer lasts.  Seeking within the
+ * buffered data (including data which has already been read, but
+ * not yet overwritten) doesn't touch the underlying stream.
+ */
+
+#ifndef MPD_INPUT_READAHEAD_H
+#define MPD_INPUT_READAHEAD_H
+
+#include "check.h"
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct input_stream;
+
+/**
+ * Opens the specified URI with input_stream_open(), and wraps it in
+ * a read-ahead buffer.
+ *
+ * @param mutex the mutex of the returned stream; the underlying
+ * stream gets its own
+ * @param cond the cond of the returned stream; it is signalled
+ * whenever new data has been buffered
+ * @param buffer_size the size of the read-ahead buffer [bytes]
+ */
+struct input_stream *
+input_readahead_open(const char *uri, GMutex *mutex, GCond *cond,
+		     size_t buffer_size, GError **error_r);
+
+/**
+ * Determines the fill level of a read-ahead stream.  The caller must
+ * lock the stream's mutex.
+ *
+ * @param buffered_r receives the number of bytes which have been
+ * read ahead of the current position
+ * @param size_r receives the size of the buffer
+ * @return false if the stream was not created by
+ * input_readahead_open()
+ */
+bool
+input_readahead_get_fill(const struct input_stream *is,
+			 size_t *buffered_r, size_t *size_r);
+
+#endif
@@ -84,6 +84,19 @@ struct input_plugin {
 	bool (*eof)(struct input_stream *is);
 	bool (*seek)(struct input_stream *is, goffset offset, int whence,
 		     GError **error_r);
+
+	/**
+	 * Like read(), but returns a pointer to the data instead of
+	 * copying it.  The data remains valid until the stream is
+	 * closed.  May be NULL if the plugin never supports this.
+	 *
+	 * @param length_r the number of bytes available at the
+	 * returned address (0 at the end of the stream)
+	 * @return NULL if this stream does not support this; the
+	 * caller should use read() then
+	 */
+	const void *(*read_mapped)(struct input_stream *is, size_t size,
+				   size_t *length_r);
 };
 
 #endif
@@ -266,6 +266,26 @@ size_t
 input_stream_read(struct input_stream *is, void *ptr, size_t size,
 		  GError **error_r);
 
+/**
+ * Like input_stream_read(), but returns a pointer to the data
+ * instead of copying it ("zero-copy"), if the stream supports that
+ * (e.g. a memory mapped file).  The data remains valid until the
+ * stream is closed.
+ *
+ * The caller must lock the mutex.
+ *
+ * @param is the input_stream object
+ * @param size the maximum number of bytes to read
+ * @param length_r the number of bytes available at the returned
+ * address (0 at the end of the stream)
+ * @return a pointer to the data, or NULL if the stream does not
+ * support this; use input_stream_read() then
+ */
+gcc_nonnull(1, 3)
+const void *
+input_stream_read_mapped(struct input_stream *is, size_t size,
+			 size_t *length_r);
+
 /**
  * Wrapper for input_stream_tag() which locks and unlocks the
  * mutex; the caller must not be holding it already.
@@ -684,6 +684,7 @@ alsa_recover(struct alsa_data *ad, int err)
 {
 	if (err == -EPIPE) {
 		g_debug("Underrun on ALSA device \"%s\"\n", alsa_device(ad));
+		output_stats_underrun(&ad->base.stats);
 	} else if (err == -ESTRPIPE) {
 		g_debug("ALSA device \"%s\" was suspended\n", alsa_device(ad));
 	}
@@ -21,6 +21,7 @@
 #include "fifo_output_plugin.h"
 #include "output_api.h"
 #include "timer.h"
+#include "pipe_writer.h"
 #include "fd_util.h"
 #include "open.h"
 
@@ -45,6 +46,18 @@ struct fifo_data {
 	int output;
 	bool created;
 	struct timer *timer;
+
+	/**
+	 * The configured size of the ring buffer [bytes]; 0 means
+	 * the output thread writes to the FIFO directly.
+	 */
+	size_t buffer_size;
+
+	/**
+	 * Writes to the FIFO on behalf of the output thread, if
+	 * #buffer_size is set.
+	 */
+	struct pipe_writer *writer;
 };
 
 /**
@@ -66,6 +79,7 @@ static struct fifo_data *fifo_data_new(void)
 	ret->input = -1;
 	ret->output = -1;
 	ret->created = false;
+	ret->writer = NULL;
 
 	return ret;
 }
@@ -196,6 +210,8 @@ fifo_output_init(const struct config_param *param,
 
 	fd = fifo_data_new();
 	fd->path = path;
+	fd->buffer_size =
+		config_get_block_unsigned(param, "buffer_size", 0) * 1024;
 
 	if (!ao_base_init(&fd->base, &fifo_output_plugin, param, error_r)) {
 		fifo_data_free(fd);
@@ -227,6 +243,15 @@ fifo_output_open(struct audio_output *ao, struct audio_format *audio_format,
 {
 	struct fifo_data *fd = (struct fifo_data *)ao;
 
+	if (fd->buffer_size > 0) {
+		/* a reader which does not keep up loses data, just
+		   like in unbuffered mode */
+		fd->writer = pipe_writer_new(fd->output, fd->input,
+					     fd->buffer_size, error);
+		if (fd->writer == NULL)
+			return false;
+	}
+
 	fd->timer = timer_new(audio_format);
 
 	return true;
@@ -237,6 +262,11 @@ fifo_output_close(struct audio_output *ao)
 {
 	struct fifo_data *fd = (struct fifo_data *)ao;
 
+	if (fd->writer != NULL) {
+		pipe_writer_free(fd->writer);
+		fd->writer = NULL;
+	}
+
 	timer_free(fd->timer);
 }
 
@@ -249,6 +279,9 @@ fifo_output_cancel(struct audio_output *ao)
 
 	timer_reset(fd->timer);
 
+	if (fd->writer != NULL)
+		pipe_writer_cancel(fd->writer);
+
 	while (bytes > 0 && errno != EINTR)
 		bytes = read(fd->input, buf, FIFO_BUFFER_SIZE);
 
@@ -279,6 +312,11 @@ fifo_output_play(struct audio_output *ao, const void *chunk, size_t size,
 		timer_start(fd->timer);
 	timer_add(fd->timer, size);
 
+	if (fd->writer != NULL)
+		return pipe_writer_append(fd->writer, chunk, size, error)
+			? size
+			: 0;
+
 	while (true) {
 		bytes = write(fd->output, chunk, size);
 		if (bytes > 0)
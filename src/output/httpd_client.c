@@ -20,18 +20,35 @@
 #include "config.h"
 #include "httpd_client.h"
 #include "httpd_internal.h"
+#include "encoder_plugin.h"
 #include "fifo_buffer.h"
 #include "page.h"
 #include "icy_server.h"
-#include "glib_socket.h"
+#include "fd_util.h"
+#include "resolver.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <poll.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "httpd_output"
 
+enum {
+	/**
+	 * The maximum number of buffers passed to one writev() call.
+	 */
+	HTTPD_CLIENT_IOV_MAX = 64,
+};
+
 struct httpd_client {
 	/**
 	 * The httpd output object this client is connected to.
@@ -39,22 +56,49 @@ struct httpd_client {
 	struct httpd_output *httpd;
 
 	/**
-	 * The TCP socket.
+	 * The stream requested by the client.  NULL until the
+	 * request line has been parsed.
+	 */
+	struct httpd_mount *mount;
+
+	/**
+	 * A playlist or segment requested by the client (HTTP Live
+	 * Streaming), instead of the live stream of a mount.  It is
+	 * moved to #pages when the response begins.
+	 */
+	struct page *file;
+
+	/**
+	 * The MIME type of #file.
 	 */
-	GIOChannel *channel;
+	const char *file_type;
 
 	/**
-	 * The GLib main loop source id for reading from the socket,
-	 * and to detect errors.
+	 * True if #file is the playlist, false if it is a segment.
 	 */
-	guint read_source_id;
+	bool file_playlist;
 
 	/**
-	 * The GLib main loop source id for writing to the socket.  If
-	 * 0, then there is no event source currently (because there
-	 * are no queued pages).
+	 * True if the client is serving a #file (state RESPONSE) or
+	 * has requested one.  The ring is not used then.
 	 */
-	guint write_source_id;
+	bool file_response;
+
+	/**
+	 * Shall the connection be kept open for the next request
+	 * after a #file has been sent?
+	 */
+	bool keep_alive;
+
+	/**
+	 * The non-blocking TCP socket.
+	 */
+	int fd;
+
+	/**
+	 * The address of the peer, for the statistics.  May be NULL.
+	 */
+	char *address;
 
 	/**
 	 * For buffered reading.  This pointer is only valid while the
@@ -77,20 +121,52 @@ struct httpd_client {
 	} state;
 
 	/**
-	 * A queue of #page objects to be sent to the client.
+	 * True if the socket buffer is full; the I/O thread waits for
+	 * POLLOUT before trying to write again.
 	 */
-	GQueue *pages;
+	bool blocked;
 
 	/**
-	 * The #page which is currently being sent to the client.
+	 * The HTTP response headers, as long as they have not been
+	 * sent completely.
 	 */
-	struct page *current_page;
+	struct page *response;
 
 	/**
 	 * The amount of bytes which were already sent from
-	 * #current_page.
+	 * #response.
 	 */
-	size_t current_position;
+	size_t response_position;
+
+	/**
+	 * A queue of #page objects which are sent before the ring
+	 * pages, i.e. the encoder header, or a partially sent ring
+	 * page which is being skipped (see httpd_client_cancel()).
+	 */
+	GQueue *pages;
+
+	/**
+	 * The sequence number of the next ring page to be sent.
+	 */
+	unsigned cursor;
+
+	/**
+	 * The amount of bytes which were already sent from the first
+	 * page, i.e. the head of #pages, or the ring page #cursor.
+	 */
+	size_t position;
+
+	/**
+	 * The number of bytes which were sent to this client.
+	 */
+	uint64_t sent;
+
+	/**
+	 * How often was this client too slow, and how many bytes of
+	 * audio data were dropped because of that?
+	 */
+	unsigned drops;
+	uint64_t dropped;
 
         /**
          * If DLNA streaming was an option.
@@ -110,33 +186,44 @@ struct httpd_client {
 	 */
 	bool metadata_requested;
 
-	/**
-	 * If the current metadata was already sent to the client.
-	 */
-	bool metadata_sent;
-
 	/**
 	 * The amount of streaming data between each metadata block
 	 */
 	guint metaint;
 
 	/**
-	 * The metadata as #page which is currently being sent to the client.
+	 * The metadata as #page which will be sent (or is currently
+	 * being sent) in the next metadata block.  NULL if the client
+	 * is up to date; it gets an empty metadata block then.
 	 */
 	struct page *metadata;
 
+	/**
+	 * New metadata which has arrived while #metadata was being
+	 * sent.
+	 */
+	struct page *metadata_pending;
+
 	/*
-	 * The amount of bytes which were already sent from the metadata.
+	 * The amount of bytes which were already sent from the
+	 * current metadata block.
 	 */
 	size_t metadata_current_position;
 
 	/**
-	 * The amount of streaming data sent to the client
-	 * since the last icy information was sent.
+	 * The amount of streaming data sent to the client since the
+	 * last metadata block.  If this equals #metaint, the next
+	 * metadata block is due.
 	 */
 	guint metadata_fill;
 };
 
+/**
+ * The metadata block which is sent when the metadata has not
+ * changed: a zero length byte.
+ */
+static const unsigned char httpd_client_empty_metadata = 0;
+
 static void
 httpd_client_unref_page(gpointer data, G_GNUC_UNUSED gpointer user_data)
 {
@@ -151,39 +238,139 @@ httpd_client_free(struct httpd_client *client)
 	assert(client != NULL);
 
 	if (client->state == RESPONSE) {
-		if (client->write_source_id != 0)
-			g_source_remove(client->write_source_id);
-
-		if (client->current_page != NULL)
-			page_unref(client->current_page);
+		if (client->response != NULL)
+			page_unref(client->response);
 
 		g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
 		g_queue_free(client->pages);
-	} else
+	} else {
+		if (client->file != NULL)
+			page_unref(client->file);
+
 		fifo_buffer_free(client->input);
+	}
 
 	if (client->metadata)
 		page_unref (client->metadata);
+	if (client->metadata_pending != NULL)
+		page_unref(client->metadata_pending);
 
-	g_source_remove(client->read_source_id);
-	g_io_channel_unref(client->channel);
+	close_socket(client->fd);
+	g_free(client->address);
 	g_free(client);
 }
 
+int
+httpd_client_get_fd(const struct httpd_client *client)
+{
+	return client->fd;
+}
+
+short
+httpd_client_poll_events(const struct httpd_client *client)
+{
+	/* always poll for input, to detect disconnected clients */
+	return client->blocked ? POLLIN|POLLOUT : POLLIN;
+}
+
+/**
+ * Generates the status line and response headers.
+ */
+static struct page *
+httpd_client_make_response(const struct httpd_client *client)
+{
+	char buffer[1024];
+
+	if (client->dlna_streaming_requested) {
+		g_snprintf(buffer, sizeof(buffer),
+			   "HTTP/1.1 206 OK\r\n"
+			   "Content-Type: %s\r\n"
+			   "Content-Length: 10000\r\n"
+			   "Content-RangeX: 0-1000000/1000000\r\n"
+			   "transferMode.dlna.org: Streaming\r\n"
+			   "Accept-Ranges: bytes\r\n"
+			   "Connection: close\r\n"
+			   "realTimeInfo.dlna.org: DLNA.ORG_TLAG=*\r\n"
+			   "contentFeatures.dlna.org: DLNA.ORG_OP=01;DLNA.ORG_CI=0\r\n"
+			   "\r\n",
+			   client->mount->content_type);
+
+	} else if (client->metadata_requested) {
+		gchar *metadata_header;
+
+		metadata_header = icy_server_metadata_header(
+			client->httpd->name,
+			client->httpd->genre,
+			client->httpd->website,
+			client->mount->content_type,
+			client->metaint);
+
+		g_strlcpy(buffer, metadata_header, sizeof(buffer));
+
+		g_free(metadata_header);
+
+       } else { /* revert to a normal HTTP request */
+		g_snprintf(buffer, sizeof(buffer),
+			   "HTTP/1.1 200 OK\r\n"
+			   "Content-Type: %s\r\n"
+			   "Connection: close\r\n"
+			   "Pragma: no-cache\r\n"
+			   "Cache-Control: no-cache, no-store\r\n"
+			   "\r\n",
+			   client->mount->content_type);
+	}
+
+	return page_new_copy(buffer, strlen(buffer));
+}
+
 /**
- * Frees the client and removes it from the server's client list.
+ * Generates the response headers for a #file.
+ */
+static struct page *
+httpd_client_make_file_response(const struct httpd_client *client)
+{
+	char buffer[512];
+
+	g_snprintf(buffer, sizeof(buffer),
+		   "HTTP/1.1 200 OK\r\n"
+		   "Content-Type: %s\r\n"
+		   "Content-Length: %u\r\n"
+		   "Cache-Control: %s\r\n"
+		   "Access-Control-Allow-Origin: *\r\n"
+		   "Connection: %s\r\n"
+		   "\r\n",
+		   client->file_type, (unsigned)client->file->size,
+		   /* segments never change, but the playlist does */
+		   client->file_playlist ? "no-cache" : "max-age=60",
+		   client->keep_alive ? "keep-alive" : "close");
+
+	return page_new_copy(buffer, strlen(buffer));
+}
+
+/**
+ * Switch the client to the "RESPONSE" state for sending a #file.
  */
 static void
-httpd_client_close(struct httpd_client *client)
+httpd_client_begin_file_response(struct httpd_client *client)
 {
-	assert(client != NULL);
+	assert(client->file != NULL);
 
-	httpd_output_remove_client(client->httpd, client);
-	httpd_client_free(client);
+	client->state = RESPONSE;
+	client->blocked = false;
+	client->response = httpd_client_make_file_response(client);
+	client->response_position = 0;
+	client->pages = g_queue_new();
+	client->position = 0;
+
+	g_queue_push_tail(client->pages, client->file);
+	client->file = NULL;
 }
 
 /**
- * Switch the client to the "RESPONSE" state.
+ * Switch the client to the "RESPONSE" state.  The response headers
+ * and the encoder header are queued, and the client starts
+ * streaming at the beginning of the burst backlog (which is the
+ * head of the page ring if the backlog is disabled).
  */
 static void
 httpd_client_begin_response(struct httpd_client *client)
@@ -191,12 +378,41 @@ httpd_client_begin_response(struct httpd_client *client)
 	assert(client != NULL);
 	assert(client->state != RESPONSE);
 
+	if (client->file_response) {
+		httpd_client_begin_file_response(client);
+		return;
+	}
+
 	client->state = RESPONSE;
-	client->write_source_id = 0;
+	client->blocked = false;
+	client->response = httpd_client_make_response(client);
+	client->response_position = 0;
 	client->pages = g_queue_new();
-	client->current_page = NULL;
+	client->cursor = client->mount->burst_seq;
+	client->position = 0;
 
-	httpd_output_send_header(client->httpd, client);
+	struct page *header =
+		httpd_output_get_header(client->httpd, client->mount);
+	if (header != NULL)
+		g_queue_push_tail(client->pages, header);
+}
+
+/**
+ * Sends a "404 Not Found" response.  This is done with a single
+ * non-blocking send() call; the client is closed afterwards anyway.
+ */
+static void
+httpd_client_not_found(struct httpd_client *client)
+{
+	static const char response[] =
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Type: text/plain\r\n"
+		"Connection: close\r\n"
+		"\r\n"
+		"404 Not Found\r\n";
+
+	G_GNUC_UNUSED ssize_t nbytes =
+		send(client->fd, response, sizeof(response) - 1, 0);
 }
 
 /**
@@ -214,7 +430,46 @@ httpd_client_handle_line(struct httpd_client *client, const char *line)
 			return false;
 		}
 
-		line = strchr(line + 5, ' ');
+		/* the path selects a file or a mount; the query
+		   string is ignored */
+		const char *path = line + 4;
+		line = strchr(path, ' ');
+
+		char *p = g_strndup(path, strcspn(path, " ?"));
+
+		struct page *file;
+		if (httpd_output_find_file(client->httpd, p, &file,
+					   &client->file_playlist,
+					   &client->file_type)) {
+			if (file == NULL) {
+				g_debug("no such file: %s", p);
+				g_free(p);
+				httpd_client_not_found(client);
+				return false;
+			}
+
+			g_free(p);
+
+			client->file = file;
+			client->file_response = true;
+			client->keep_alive = line != NULL &&
+				strncmp(line + 1, "HTTP/1.1", 8) == 0;
+		} else {
+			client->mount = httpd_output_find_mount(client->httpd,
+								p);
+			if (client->mount == NULL) {
+				g_debug("no such mount: %s", p);
+				g_free(p);
+				httpd_client_not_found(client);
+				return false;
+			}
+
+			g_free(p);
+
+			client->metadata_supported =
+				client->mount->encoder->plugin->tag == NULL;
+		}
+
 		if (line == NULL || strncmp(line + 1, "HTTP/", 5) != 0) {
 			/* HTTP/0.9 without request headers */
 			httpd_client_begin_response(client);
@@ -231,6 +486,16 @@ httpd_client_handle_line(struct httpd_client *client, const char *line)
 			return true;
 		}
 
+		if (g_ascii_strncasecmp(line, "Connection: close", 17) == 0) {
+			client->keep_alive = false;
+			return true;
+		}
+
+		if (g_ascii_strncasecmp(line, "Connection: keep-alive", 22) == 0) {
+			client->keep_alive = client->file_response;
+			return true;
+		}
+
 		if (g_ascii_strncasecmp(line, "Icy-MetaData: 1", 15) == 0) {
 			/* Send icy metadata */
 			client->metadata_requested =
@@ -284,89 +549,6 @@ httpd_client_read_line(struct httpd_client *client)
 	return g_strchomp(line);
 }
 
-/**
- * Sends the status line and response headers to the client.
- */
-static bool
-httpd_client_send_response(struct httpd_client *client)
-{
-	char buffer[1024];
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
-
-	assert(client != NULL);
-	assert(client->state == RESPONSE);
-
-	if (client->dlna_streaming_requested) {
-		g_snprintf(buffer, sizeof(buffer),
-			   "HTTP/1.1 206 OK\r\n"
-			   "Content-Type: %s\r\n"
-			   "Content-Length: 10000\r\n"
-			   "Content-RangeX: 0-1000000/1000000\r\n"
-			   "transferMode.dlna.org: Streaming\r\n"
-			   "Accept-Ranges: bytes\r\n"
-			   "Connection: close\r\n"
-			   "realTimeInfo.dlna.org: DLNA.ORG_TLAG=*\r\n"
-			   "contentFeatures.dlna.org: DLNA.ORG_OP=01;DLNA.ORG_CI=0\r\n"
-			   "\r\n",
-			   client->httpd->content_type);
-
-	} else if (client->metadata_requested) {
-		gchar *metadata_header;
-
-		metadata_header = icy_server_metadata_header(
-			client->httpd->name,
-			client->httpd->genre,
-			client->httpd->website,
-			client->httpd->content_type,
-			client->metaint);
-
-		g_strlcpy(buffer, metadata_header, sizeof(buffer));
-
-		g_free(metadata_header);
-
-       } else { /* revert to a normal HTTP request */
-		g_snprintf(buffer, sizeof(buffer),
-			   "HTTP/1.1 200 OK\r\n"
-			   "Content-Type: %s\r\n"
-			   "Connection: close\r\n"
-			   "Pragma: no-cache\r\n"
-			   "Cache-Control: no-cache, no-store\r\n"
-			   "\r\n",
-			   client->httpd->content_type);
-	}
-
-	status = g_io_channel_write_chars(client->channel,
-					  buffer, strlen(buffer),
-					  &bytes_written, &error);
-
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-	case G_IO_STATUS_AGAIN:
-		return true;
-
-	case G_IO_STATUS_EOF:
-		/* client has disconnected */
-
-		httpd_client_close(client);
-		return false;
-
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
-
-		g_warning("failed to write to client: %s", error->message);
-		g_error_free(error);
-
-		httpd_client_close(client);
-		return false;
-	}
-
-	/* unreachable */
-	httpd_client_close(client);
-	return false;
-}
-
 /**
  * Data has been received from the client and it is appended to the
  * input buffer.
@@ -395,32 +577,30 @@ httpd_client_received(struct httpd_client *client)
 			}
 
 			fifo_buffer_free(client->input);
-
-			return httpd_client_send_response(client);
+			return true;
 		}
 	}
 
 	return true;
 }
 
-static bool
+bool
 httpd_client_read(struct httpd_client *client)
 {
 	char *p;
 	size_t max_length;
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_read;
+	ssize_t nbytes;
 
 	if (client->state == RESPONSE) {
 		/* the client has already sent the request, and he
 		   must not send more */
 		char buffer[1];
 
-		status = g_io_channel_read_chars(client->channel, buffer,
-						 sizeof(buffer), &bytes_read,
-						 NULL);
-		if (status == G_IO_STATUS_NORMAL)
+		nbytes = recv(client->fd, buffer, sizeof(buffer), 0);
+		if (nbytes < 0 && (errno == EAGAIN || errno == EINTR))
+			return true;
+
+		if (nbytes > 0)
 			g_warning("unexpected input from client");
 
 		return false;
@@ -432,333 +612,544 @@ httpd_client_read(struct httpd_client *client)
 		return false;
 	}
 
-	status = g_io_channel_read_chars(client->channel, p, max_length,
-					 &bytes_read, &error);
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		fifo_buffer_append(client->input, bytes_read);
+	nbytes = recv(client->fd, p, max_length, 0);
+	if (nbytes > 0) {
+		fifo_buffer_append(client->input, nbytes);
 		return httpd_client_received(client);
+	}
 
-	case G_IO_STATUS_AGAIN:
-		/* try again later, after select() */
-		return true;
-
-	case G_IO_STATUS_EOF:
+	if (nbytes == 0)
 		/* peer disconnected */
 		return false;
 
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
-		g_warning("failed to read from client: %s",
-			  error->message);
-		g_error_free(error);
-		return false;
-	}
+	if (errno == EAGAIN || errno == EINTR)
+		/* try again later, after poll() */
+		return true;
 
-	/* unreachable */
+	g_warning("failed to read from client: %s", g_strerror(errno));
 	return false;
 }
 
-static gboolean
-httpd_client_in_event(G_GNUC_UNUSED GIOChannel *source, GIOCondition condition,
-		      gpointer data)
+/**
+ * Determines the address of the peer.
+ *
+ * @return the address (to be freed with g_free()), or NULL on error
+ */
+static char *
+httpd_client_peer_address(int fd)
 {
-	struct httpd_client *client = data;
-	struct httpd_output *httpd = client->httpd;
-	bool ret;
-
-	g_mutex_lock(httpd->mutex);
-
-	if (condition == G_IO_IN && httpd_client_read(client)) {
-		ret = true;
-	} else {
-		httpd_client_close(client);
-		ret = false;
-	}
+	struct sockaddr_storage address;
+	socklen_t address_length = sizeof(address);
 
-	g_mutex_unlock(httpd->mutex);
+	if (getpeername(fd, (struct sockaddr *)&address,
+			&address_length) < 0)
+		return NULL;
 
-	return ret;
+	return sockaddr_to_string((const struct sockaddr *)&address,
+				  address_length, NULL);
 }
 
 struct httpd_client *
-httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported)
+httpd_client_new(struct httpd_output *httpd, int fd)
 {
 	struct httpd_client *client = g_new(struct httpd_client, 1);
 
 	client->httpd = httpd;
-
-	client->channel = g_io_channel_new_socket(fd);
-
-	/* GLib is responsible for closing the file descriptor */
-	g_io_channel_set_close_on_unref(client->channel, true);
-	/* NULL encoding means the stream is binary safe */
-	g_io_channel_set_encoding(client->channel, NULL, NULL);
-	/* we prefer to do buffering */
-	g_io_channel_set_buffered(client->channel, false);
-
-	client->read_source_id = g_io_add_watch(client->channel,
-						G_IO_IN|G_IO_ERR|G_IO_HUP,
-						httpd_client_in_event, client);
+	client->mount = NULL;
+	client->file = NULL;
+	client->file_response = false;
+	client->keep_alive = false;
+	client->fd = fd;
+	client->address = httpd_client_peer_address(fd);
+	client->sent = 0;
+	client->drops = 0;
+	client->dropped = 0;
 
 	client->input = fifo_buffer_new(4096);
 	client->state = REQUEST;
+	client->blocked = false;
 
 	client->dlna_streaming_requested = false;
-	client->metadata_supported = metadata_supported;
+	client->metadata_supported = false;
 	client->metadata_requested = false;
-	client->metadata_sent = true;
 	client->metaint = 8192; /*TODO: just a std value */
 	client->metadata = NULL;
+	client->metadata_pending = NULL;
 	client->metadata_current_position = 0;
 	client->metadata_fill = 0;
 
 	return client;
 }
 
-static void
-httpd_client_add_page_size(gpointer data, gpointer user_data)
+struct httpd_mount *
+httpd_client_get_mount(const struct httpd_client *client)
 {
-	struct page *page = data;
-	size_t *size = user_data;
+	return client->mount;
+}
 
-	*size += page->size;
+unsigned
+httpd_client_cursor(const struct httpd_client *client)
+{
+	assert(client->mount != NULL);
+
+	return client->state == RESPONSE
+		? client->cursor
+		: client->mount->head;
 }
 
-size_t
-httpd_client_queue_size(const struct httpd_client *client)
+uint64_t
+httpd_client_lag(const struct httpd_client *client)
 {
-	size_t size = 0;
+	if (client->state != RESPONSE || client->mount == NULL)
+		return 0;
 
-	if (client->state != RESPONSE)
+	const unsigned head = client->mount->head;
+	if (client->cursor == head)
 		return 0;
 
-	g_queue_foreach(client->pages, httpd_client_add_page_size, &size);
-	return size;
+	const struct httpd_ring *ring = &client->mount->ring;
+	uint64_t offset = httpd_ring_offset(ring, client->cursor);
+	if (g_queue_is_empty(client->pages))
+		offset += client->position;
+
+	return httpd_ring_end_offset(ring, head) - offset;
 }
 
 void
-httpd_client_cancel(struct httpd_client *client)
+httpd_client_cancel(struct httpd_client *client, unsigned seq)
 {
-	if (client->state != RESPONSE)
+	if (client->state != RESPONSE || client->mount == NULL ||
+	    (int)(seq - client->cursor) <= 0)
 		return;
 
-	g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
-	g_queue_clear(client->pages);
-
-	if (client->write_source_id != 0 && client->current_page == NULL) {
-		g_source_remove(client->write_source_id);
-		client->write_source_id = 0;
+	if (g_queue_is_empty(client->pages) && client->position > 0) {
+		/* in the middle of a ring page: it must be completed
+		   to keep the stream intact, but the client must not
+		   hold back the ring tail (the peer may have stopped
+		   reading); move a reference to the private queue */
+		struct page *page = httpd_ring_get(&client->mount->ring,
+						   client->cursor);
+		page_ref(page);
+		g_queue_push_tail(client->pages, page);
 	}
+
+	client->cursor = seq;
 }
 
-static GIOStatus
-write_page_to_channel(GIOChannel *channel,
-		      const struct page *page, size_t position,
-		      gsize *bytes_written_r, GError **error)
+void
+httpd_client_check_queue(struct httpd_client *client,
+			 uint64_t max_lag, uint64_t target_lag,
+			 unsigned max_pages, unsigned target_pages)
 {
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
+	assert(target_lag <= max_lag);
+	assert(target_pages <= max_pages);
+
+	if (client->state != RESPONSE || client->mount == NULL)
+		return;
+
+	const unsigned head = client->mount->head;
+	if (httpd_client_lag(client) <= max_lag &&
+	    head - client->cursor <= max_pages)
+		return;
+
+	const struct httpd_ring *ring = &client->mount->ring;
+	const uint64_t end = httpd_ring_end_offset(ring, head);
 
-	return g_io_channel_write_chars(channel,
-					(const gchar*)page->data + position,
-					page->size - position,
-					bytes_written_r, error);
+	/* the page which is being sent is always completed */
+	unsigned start = client->cursor;
+	if (g_queue_is_empty(client->pages) && client->position > 0)
+		++start;
+
+	/* find the oldest frame boundary which is recent enough; if
+	   there is none, everything is dropped */
+	unsigned seq = start;
+	while (seq != head) {
+		const struct httpd_ring_slot *slot = httpd_ring_slot(ring, seq);
+		if (slot->sync && end - slot->offset <= target_lag &&
+		    head - seq <= target_pages)
+			break;
+
+		++seq;
+	}
+
+	if (seq == start)
+		return;
+
+	const uint64_t dropped = (seq != head
+				  ? httpd_ring_offset(ring, seq)
+				  : end) - httpd_ring_offset(ring, start);
+
+	g_debug("client %s is too slow, dropping %" G_GUINT64_FORMAT
+		" bytes", client->address != NULL ? client->address : "",
+		dropped);
+
+	++client->drops;
+	client->dropped += dropped;
+	httpd_client_cancel(client, seq);
+}
+
+void
+httpd_client_stats(const struct httpd_client *client, GString *dest)
+{
+	g_string_append_printf(dest,
+			       "listener: %s\n"
+			       "listener_mount: %s\n"
+			       "listener_queue: %" G_GUINT64_FORMAT "\n"
+			       "listener_sent: %" G_GUINT64_FORMAT "\n"
+			       "listener_drops: %u\n"
+			       "listener_dropped: %" G_GUINT64_FORMAT "\n",
+			       client->address != NULL
+			       ? client->address : "unknown",
+			       client->mount != NULL
+			       ? client->mount->path : "",
+			       httpd_client_lag(client),
+			       client->sent,
+			       client->drops, client->dropped);
 }
 
-static GIOStatus
-write_n_bytes_to_channel(GIOChannel *channel, const struct page *page,
-			 size_t position, gint n,
-			 gsize *bytes_written_r, GError **error)
+void
+httpd_client_writable(struct httpd_client *client)
 {
-	GIOStatus status;
+	client->blocked = false;
+}
 
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
+/**
+ * Helper for assembling the I/O vector of one writev() call, which
+ * interleaves the audio data with ICY metadata blocks.
+ */
+struct httpd_client_iov {
+	struct iovec *iov;
+	unsigned n, max;
 
-	if (n == -1) {
-		status =  write_page_to_channel (channel, page, position,
-						 bytes_written_r, error);
-	} else {
-		status = g_io_channel_write_chars(channel,
-						  (const gchar*)page->data + position,
-						  n, bytes_written_r, error);
-	}
+	/**
+	 * The number of audio bytes until the next metadata block
+	 * is due, or SIZE_MAX if the client has not requested ICY
+	 * metadata.
+	 */
+	size_t until_metadata;
+
+	/**
+	 * The next metadata block.  NULL if it is not known yet: the
+	 * block after #metadata is only determined by
+	 * httpd_client_metadata_done(), which may promote
+	 * #metadata_pending; the writev() call ends there.
+	 */
+	const unsigned char *metadata;
+	size_t metadata_size;
+
+	/**
+	 * Are all blocks after the first one empty?  This is true
+	 * if the client has no #metadata, because new metadata is
+	 * never submitted while a writev() call is assembled.
+	 */
+	bool repeat_empty;
 
-	return status;
+	guint metaint;
+};
+
+static void
+httpd_client_iov_add(struct httpd_client_iov *v,
+		     const void *data, size_t length)
+{
+	assert(v->n < v->max);
+
+	v->iov[v->n].iov_base = (void *)data;
+	v->iov[v->n].iov_len = length;
+	++v->n;
 }
 
-static gint
-bytes_left_till_metadata (struct httpd_client *client)
+static void
+httpd_client_iov_metadata(struct httpd_client_iov *v)
 {
-	assert(client != NULL);
+	assert(v->until_metadata == 0);
+	assert(v->metadata != NULL);
 
-	if (client->metadata_requested &&
-	    client->current_page->size - client->current_position
-	    > client->metaint - client->metadata_fill)
-		return client->metaint - client->metadata_fill;
+	httpd_client_iov_add(v, v->metadata, v->metadata_size);
+	v->until_metadata = v->metaint;
 
-	return -1;
+	if (v->repeat_empty) {
+		v->metadata = &httpd_client_empty_metadata;
+		v->metadata_size = sizeof(httpd_client_empty_metadata);
+	} else
+		v->metadata = NULL;
 }
 
-static gboolean
-httpd_client_out_event(GIOChannel *source,
-		       G_GNUC_UNUSED GIOCondition condition, gpointer data)
+static void
+httpd_client_iov_audio(struct httpd_client_iov *v,
+		       const unsigned char *data, size_t length)
 {
-	struct httpd_client *client = data;
-	struct httpd_output *httpd = client->httpd;
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
-	gint bytes_to_write;
+	while (length > 0 && v->n < v->max) {
+		if (v->until_metadata == 0) {
+			if (v->metadata == NULL) {
+				/* the next block is not known yet:
+				   this I/O vector is complete */
+				v->max = v->n;
+				break;
+			}
 
-	g_mutex_lock(httpd->mutex);
+			httpd_client_iov_metadata(v);
+			continue;
+		}
 
-	assert(condition == G_IO_OUT);
-	assert(client->state == RESPONSE);
+		size_t chunk = MIN(length, v->until_metadata);
+		httpd_client_iov_add(v, data, chunk);
+		data += chunk;
+		length -= chunk;
 
-	if (client->write_source_id == 0) {
-		/* another thread has removed the event source while
-		   this thread was waiting for httpd->mutex */
-		g_mutex_unlock(httpd->mutex);
-		return false;
+		if (v->until_metadata != SIZE_MAX)
+			v->until_metadata -= chunk;
 	}
+}
 
-	if (client->current_page == NULL) {
-		client->current_page = g_queue_pop_head(client->pages);
-		client->current_position = 0;
+/**
+ * Returns the metadata block which is due after #metaint bytes:
+ * #metadata or the static empty block.
+ */
+static const unsigned char *
+httpd_client_metadata_block(const struct httpd_client *client,
+			    size_t *size_r)
+{
+	if (client->metadata != NULL) {
+		*size_r = client->metadata->size;
+		return client->metadata->data;
 	}
 
-	bytes_to_write = bytes_left_till_metadata(client);
-
-	if (bytes_to_write == 0) {
-		gint metadata_to_write;
+	*size_r = sizeof(httpd_client_empty_metadata);
+	return &httpd_client_empty_metadata;
+}
 
-		metadata_to_write = client->metadata_current_position;
+/**
+ * Fills the I/O vector with pending data: the response headers,
+ * the private pages, then the ring pages, with ICY metadata blocks
+ * in between.
+ *
+ * @return the number of vector elements
+ */
+static unsigned
+httpd_client_collect(const struct httpd_client *client,
+		     struct iovec *iov, unsigned max_iov)
+{
+	struct httpd_client_iov v = {
+		.iov = iov,
+		.max = max_iov,
+		.until_metadata = SIZE_MAX,
+		.metaint = client->metaint,
+		.repeat_empty = client->metadata == NULL,
+	};
+
+	if (client->response != NULL)
+		httpd_client_iov_add(&v, client->response->data +
+				     client->response_position,
+				     client->response->size -
+				     client->response_position);
+
+	if (client->metadata_requested) {
+		v.until_metadata = client->metaint - client->metadata_fill;
+
+		/* the first block may have been sent partially */
+		v.metadata = httpd_client_metadata_block(client,
+							 &v.metadata_size);
+		v.metadata += client->metadata_current_position;
+		v.metadata_size -= client->metadata_current_position;
+	}
 
-		if (!client->metadata_sent) {
-			status = write_page_to_channel(source,
-						       client->metadata,
-						       metadata_to_write,
-						       &bytes_written, &error);
+	size_t position = client->position;
 
-			client->metadata_current_position += bytes_written;
+	for (GList *i = client->pages->head; i != NULL; i = i->next) {
+		const struct page *page = i->data;
+		httpd_client_iov_audio(&v, page->data + position,
+				       page->size - position);
+		position = 0;
+	}
 
-			if (client->metadata->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
-				client->metadata_current_position = 0;
-				client->metadata_sent = true;
-			}
-		} else {
-			struct page *empty_meta;
-			guchar empty_data = 0;
+	if (client->file_response)
+		return v.n;
 
-			empty_meta = page_new_copy(&empty_data, 1);
+	const unsigned head = client->mount->head;
+	const struct httpd_ring *ring = &client->mount->ring;
 
-			status = write_page_to_channel(source,
-						       empty_meta,
-						       metadata_to_write,
-						       &bytes_written, &error);
+	for (unsigned seq = client->cursor;
+	     seq != head && v.n < v.max; ++seq) {
+		const struct page *page = httpd_ring_get(ring, seq);
+		httpd_client_iov_audio(&v, page->data + position,
+				       page->size - position);
+		position = 0;
+	}
 
-			client->metadata_current_position += bytes_written;
+	return v.n;
+}
 
-			if (empty_meta->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
-				client->metadata_current_position = 0;
-			}
-		}
+/**
+ * Called after the current metadata block has been sent
+ * completely.
+ */
+static void
+httpd_client_metadata_done(struct httpd_client *client)
+{
+	client->metadata_fill = 0;
+	client->metadata_current_position = 0;
 
-		bytes_written = 0;
-	} else {
-		status = write_n_bytes_to_channel(source, client->current_page,
-						  client->current_position, bytes_to_write,
-						  &bytes_written, &error);
+	if (client->metadata != NULL) {
+		page_unref(client->metadata);
+		client->metadata = client->metadata_pending;
+		client->metadata_pending = NULL;
 	}
+}
 
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		client->current_position += bytes_written;
-		assert(client->current_position <= client->current_page->size);
-
-		if (client->metadata_requested)
-			client->metadata_fill += bytes_written;
+/**
+ * Marks data as sent, walking the same way as
+ * httpd_client_collect().
+ */
+static void
+httpd_client_consume(struct httpd_client *client, size_t nbytes)
+{
+	if (client->response != NULL) {
+		size_t rest = client->response->size -
+			client->response_position;
+		if (nbytes < rest) {
+			client->response_position += nbytes;
+			return;
+		}
 
-		if (client->current_position >= client->current_page->size) {
-			page_unref(client->current_page);
-			client->current_page = NULL;
+		nbytes -= rest;
+		page_unref(client->response);
+		client->response = NULL;
+	}
 
-			if (g_queue_is_empty(client->pages)) {
-				/* all pages are sent: remove the
-				   event source */
-				client->write_source_id = 0;
+	while (nbytes > 0) {
+		if (client->metadata_requested &&
+		    client->metadata_fill == client->metaint) {
+			size_t size;
+			httpd_client_metadata_block(client, &size);
 
-				g_mutex_unlock(httpd->mutex);
-				return false;
+			size_t rest = size - client->metadata_current_position;
+			if (nbytes < rest) {
+				client->metadata_current_position += nbytes;
+				return;
 			}
+
+			nbytes -= rest;
+			httpd_client_metadata_done(client);
+			continue;
 		}
 
-		g_mutex_unlock(httpd->mutex);
-		return true;
+		bool ring_page = g_queue_is_empty(client->pages);
+		const struct page *page = ring_page
+			? httpd_ring_get(&client->mount->ring, client->cursor)
+			: g_queue_peek_head(client->pages);
 
-	case G_IO_STATUS_AGAIN:
-		g_mutex_unlock(httpd->mutex);
-		return true;
+		size_t length = MIN(nbytes, page->size - client->position);
+		if (client->metadata_requested)
+			length = MIN(length,
+				     client->metaint - client->metadata_fill);
 
-	case G_IO_STATUS_EOF:
-		/* client has disconnected */
+		client->position += length;
+		nbytes -= length;
+		if (client->metadata_requested)
+			client->metadata_fill += length;
 
-		httpd_client_close(client);
-		g_mutex_unlock(httpd->mutex);
-		return false;
+		if (client->position == page->size) {
+			client->position = 0;
 
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
+			if (ring_page)
+				++client->cursor;
+			else
+				page_unref(g_queue_pop_head(client->pages));
+		}
+	}
+}
 
-		g_warning("failed to write to client: %s", error->message);
-		g_error_free(error);
+/**
+ * A #file has been sent completely.  Prepare for the next request on
+ * the same connection.
+ */
+static void
+httpd_client_file_done(struct httpd_client *client)
+{
+	assert(client->state == RESPONSE);
+	assert(client->file_response);
+	assert(client->response == NULL);
+	assert(g_queue_is_empty(client->pages));
 
-		httpd_client_close(client);
-		g_mutex_unlock(httpd->mutex);
-		return false;
-	}
+	g_queue_free(client->pages);
 
-	/* unreachable */
-	httpd_client_close(client);
-	g_mutex_unlock(httpd->mutex);
-	return false;
+	client->input = fifo_buffer_new(4096);
+	client->state = REQUEST;
+	client->file_response = false;
+	client->keep_alive = false;
 }
 
-void
-httpd_client_send(struct httpd_client *client, struct page *page)
+bool
+httpd_client_write(struct httpd_client *client)
 {
 	if (client->state != RESPONSE)
 		/* the client is still writing the HTTP request */
-		return;
+		return true;
 
-	page_ref(page);
-	g_queue_push_tail(client->pages, page);
+	while (!client->blocked) {
+		struct iovec iov[HTTPD_CLIENT_IOV_MAX];
+		const unsigned n = httpd_client_collect(client, iov,
+							G_N_ELEMENTS(iov));
 
-	if (client->write_source_id == 0)
-		client->write_source_id =
-			g_io_add_watch(client->channel, G_IO_OUT,
-				       httpd_client_out_event, client);
+		size_t total = 0;
+		for (unsigned i = 0; i < n; ++i)
+			total += iov[i].iov_len;
+
+		if (total == 0) {
+			if (!client->file_response)
+				/* nothing to send */
+				return true;
+
+			/* the file is complete */
+			if (!client->keep_alive)
+				return false;
+
+			httpd_client_file_done(client);
+			return true;
+		}
+
+		ssize_t nbytes = writev(client->fd, iov, n);
+		if (nbytes < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				client->blocked = true;
+				return true;
+			}
+
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EPIPE && errno != ECONNRESET)
+				g_warning("failed to write to client: %s",
+					  g_strerror(errno));
+			return false;
+		}
+
+		client->sent += nbytes;
+		httpd_client_consume(client, nbytes);
+
+		if ((size_t)nbytes < total)
+			/* the socket buffer is full; wait for POLLOUT
+			   instead of trying again right away */
+			client->blocked = true;
+	}
+
+	return true;
 }
 
 void
 httpd_client_send_metadata(struct httpd_client *client, struct page *page)
 {
-	if (client->metadata) {
-		page_unref(client->metadata);
-		client->metadata = NULL;
-	}
-
 	g_return_if_fail (page);
 
 	page_ref(page);
-	client->metadata = page;
-	client->metadata_sent = false;
+
+	/* don't replace a metadata block which is being sent right
+	   now */
+	struct page **p = client->metadata_current_position > 0
+		? &client->metadata_pending
+		: &client->metadata;
+
+	if (*p != NULL)
+		page_unref(*p);
+	*p = page;
 }
@@ -20,46 +20,126 @@
 #ifndef MPD_OUTPUT_HTTPD_CLIENT_H
 #define MPD_OUTPUT_HTTPD_CLIENT_H
 
+#include <glib.h>
+
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct httpd_client;
 struct httpd_output;
+struct httpd_mount;
 struct page;
 
 /**
- * Creates a new #httpd_client object
+ * Creates a new #httpd_client object.  All httpd_client functions
+ * must be called from the httpd I/O thread.
  *
  * @param httpd the HTTP output device
  * @param fd the socket file descriptor
  */
 struct httpd_client *
-httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported);
+httpd_client_new(struct httpd_output *httpd, int fd);
 
 /**
- * Frees memory and resources allocated by the #httpd_client object.
- * This does not remove it from the #httpd_output object.
+ * Frees memory and resources allocated by the #httpd_client object,
+ * and closes the socket.
  */
 void
 httpd_client_free(struct httpd_client *client);
 
+G_GNUC_PURE
+int
+httpd_client_get_fd(const struct httpd_client *client);
+
+/**
+ * Returns the poll() events this client is interested in.
+ */
+G_GNUC_PURE
+short
+httpd_client_poll_events(const struct httpd_client *client);
+
+/**
+ * The socket has become readable (or an error has occurred).
+ *
+ * @return false if the client shall be closed
+ */
+bool
+httpd_client_read(struct httpd_client *client);
+
+/**
+ * The socket has become writable after httpd_client_write() was
+ * blocked.
+ */
+void
+httpd_client_writable(struct httpd_client *client);
+
+/**
+ * Sends as much pending data as the socket accepts, with as few
+ * system calls as possible.  Pages up to httpd_mount::head are
+ * considered.
+ *
+ * @return false if the client shall be closed
+ */
+bool
+httpd_client_write(struct httpd_client *client);
+
+/**
+ * Returns the stream requested by the client, or NULL if the
+ * request line has not been received yet.
+ */
+G_GNUC_PURE
+struct httpd_mount *
+httpd_client_get_mount(const struct httpd_client *client);
+
+/**
+ * Returns the sequence number of the oldest ring page this client
+ * still needs.  The client must have a mount.
+ */
+G_GNUC_PURE
+unsigned
+httpd_client_cursor(const struct httpd_client *client);
+
 /**
- * Returns the total size of this client's page queue.
+ * Returns the number of bytes in the ring which have not yet been
+ * sent to this client.
  */
-size_t
-httpd_client_queue_size(const struct httpd_client *client);
+G_GNUC_PURE
+uint64_t
+httpd_client_lag(const struct httpd_client *client);
 
 /**
- * Clears the page queue.
+ * Skips all ring pages before the specified sequence number.  The
+ * page which is currently being sent is completed first, so the
+ * stream remains intact; the client keeps a private reference to
+ * it, and releases the ring pages right away.
+ */
+void
+httpd_client_cancel(struct httpd_client *client, unsigned seq);
+
+/**
+ * Checks whether the client lags too far behind.  If so, whole
+ * pages are dropped, up to a page which begins at a frame boundary,
+ * until the lag is back at the target.
+ *
+ * @param max_lag the maximum number of unsent bytes
+ * @param target_lag the number of unsent bytes after dropping
+ * @param max_pages the maximum number of unsent ring pages; this
+ * keeps the ring from filling up with many small pages
+ * @param target_pages the number of unsent ring pages after
+ * dropping
  */
 void
-httpd_client_cancel(struct httpd_client *client);
+httpd_client_check_queue(struct httpd_client *client,
+			 uint64_t max_lag, uint64_t target_lag,
+			 unsigned max_pages, unsigned target_pages);
 
 /**
- * Appends a page to the client's queue.
+ * Appends the statistics of this client to the string, as
+ * "name: value" lines.
  */
 void
-httpd_client_send(struct httpd_client *client, struct page *page);
+httpd_client_stats(const struct httpd_client *client, GString *dest);
 
 /**
  * Sends the passed metadata.
@@ -26,6 +26,8 @@
 #define MPD_OUTPUT_HTTPD_INTERNAL_H
 
 #include "output_internal.h"
+#include "httpd_ring.h"
+#include "httpd_segment.h"
 #include "timer.h"
 
 #include <glib.h>
@@ -34,20 +36,83 @@
 
 struct httpd_client;
 
-struct httpd_output {
-	struct audio_output base;
+enum {
+	/**
+	 * The number of pages in the #httpd_ring.  At most half of it
+	 * is used for the burst backlog.
+	 */
+	HTTPD_RING_CAPACITY = 4096,
 
 	/**
-	 * True if the audio output is open and accepts client
-	 * connections.
+	 * The default value of httpd_output::max_client_queue.
 	 */
-	bool open;
+	HTTPD_DEFAULT_MAX_CLIENT_QUEUE = 256 * 1024,
+};
+
+/**
+ * How to find frame boundaries in the encoded stream, see
+ * httpd_ring_slot::sync.
+ */
+enum httpd_sync {
+	/**
+	 * Every page begins at a frame boundary.
+	 */
+	HTTPD_SYNC_ANY,
+
+	/**
+	 * MPEG audio: the page begins with a frame sync word.
+	 */
+	HTTPD_SYNC_MPEG,
+
+	/**
+	 * Ogg: the page begins with an Ogg page ("OggS").
+	 */
+	HTTPD_SYNC_OGG,
+
+	/**
+	 * FLAC: the page begins with a frame sync code.
+	 */
+	HTTPD_SYNC_FLAC,
+};
+
+/**
+ * One encoded stream of the httpd output, available at its own
+ * request path.  All mounts encode the same audio data.
+ */
+struct httpd_mount {
+	/**
+	 * The request path, e.g. "/high".
+	 */
+	char *path;
+
+	/**
+	 * The encoder configuration, derived from the audio_output
+	 * block.  NULL if the block is used directly.
+	 */
+	struct config_param *param;
 
 	/**
 	 * The configured encoder plugin.
 	 */
 	struct encoder *encoder;
 
+	/**
+	 * The MIME type produced by the #encoder.
+	 */
+	const char *content_type;
+
+	/**
+	 * How to detect frame boundaries in the #encoder output;
+	 * derived from #content_type.
+	 */
+	enum httpd_sync sync;
+
+	/**
+	 * Converts from the audio format of the output to the one
+	 * requested by the #encoder, or NULL if both are equal.
+	 */
+	struct filter *convert;
+
 	/**
 	 * Number of bytes which were fed into the encoder, without
 	 * ever receiving new output.  This is used to estimate
@@ -57,13 +122,111 @@ struct httpd_output {
 	size_t unflushed_input;
 
 	/**
-	 * The MIME type produced by the #encoder.
+	 * The header page, which is sent to every client on connect.
+	 * Protected by httpd_output::mutex.
 	 */
-	const char *content_type;
+	struct page *header;
+
+	/**
+	 * The encoded pages, published by the output thread and sent
+	 * by the I/O thread.
+	 */
+	struct httpd_ring ring;
+
+	/**
+	 * The number of pages which were discarded because the ring
+	 * was full.  Only accessed by the output thread.
+	 */
+	unsigned ring_overruns;
+
+	/**
+	 * httpd_output_cancel() sets this to the current ring head;
+	 * the I/O thread then discards all older pages from the
+	 * clients.  Protected by httpd_output::mutex.
+	 */
+	unsigned skip_to;
+
+	/**
+	 * The sequence number of the first page of the current
+	 * stream; the burst backlog never reaches back beyond it.
+	 * Set by httpd_output_cancel() and when a new encoder header
+	 * is published.  Protected by httpd_output::mutex.
+	 */
+	unsigned stream_start;
+
+	/**
+	 * Cuts the stream into segments for HTTP Live Streaming.
+	 * Only used if httpd_output::segment_ms is non-zero; the
+	 * segment list is protected by httpd_output::mutex.
+	 */
+	struct httpd_segmenter segmenter;
+
+	/**
+	 * The first page of the burst backlog, which is where new
+	 * clients start.  The I/O thread keeps all pages from here
+	 * on.  Only accessed by the I/O thread.
+	 */
+	unsigned burst_seq;
+
+	/**
+	 * The ring head seen by the I/O thread in its current
+	 * iteration; pages up to here are sent to the clients.  Only
+	 * accessed by the I/O thread.
+	 */
+	unsigned head;
+};
+
+struct httpd_output {
+	struct audio_output base;
+
+	/**
+	 * True if the audio output is open and accepts client
+	 * connections.
+	 */
+	bool open;
+
+	/**
+	 * The configured streams.  There is at least one; the first
+	 * one is also served for the path "/".
+	 */
+	struct httpd_mount *mounts;
+	unsigned num_mounts;
 
 	/**
-	 * This mutex protects the listener socket and the client
-	 * list.
+	 * The configured duration [milliseconds] of the burst
+	 * backlog: new clients receive this much recent audio data
+	 * right after connecting, to fill their buffer quickly.  0
+	 * disables the backlog.
+	 */
+	unsigned burst_ms;
+
+	/**
+	 * The configured segment duration [milliseconds] for HTTP Live
+	 * Streaming.  0 disables segmenting.
+	 */
+	unsigned segment_ms;
+
+	/**
+	 * The configured maximum number of unsent bytes per client
+	 * (not counting the burst backlog).  If a client lags
+	 * further behind, audio data is dropped until its queue is
+	 * half as large.
+	 */
+	size_t max_client_queue;
+
+	/**
+	 * The number of bytes which were passed to the encoders
+	 * since the output was opened, and the input data rate
+	 * [bytes per second]; used to calculate
+	 * httpd_ring_slot::time.  Only accessed by the output thread.
+	 */
+	uint64_t stream_bytes;
+	unsigned input_rate;
+
+	/**
+	 * This mutex protects the listener socket, the headers, the
+	 * #metadata and the I/O thread's control variables.  It is
+	 * not held while pages are published or sent.
 	 */
 	GMutex *mutex;
 
@@ -79,14 +242,15 @@ struct httpd_output {
 	struct server_socket *server_socket;
 
 	/**
-	 * The header page, which is sent to every client on connect.
+	 * The metadata, which is sent to every client.
 	 */
-	struct page *header;
+	struct page *metadata;
 
 	/**
-	 * The metadata, which is sent to every client.
+	 * Incremented each time #metadata is replaced, to notify the
+	 * I/O thread.
 	 */
-	struct page *metadata;
+	unsigned metadata_serial;
 
 	/**
 	 * The configured name.
@@ -102,10 +266,59 @@ struct httpd_output {
 	char const *website;
 
 	/**
-	 * A linked list containing all clients which are currently
-	 * connected.
+	 * The I/O thread which sends the pages to all clients.
+	 */
+	GThread *thread;
+
+	/**
+	 * A non-blocking pipe which wakes up the I/O thread.
+	 */
+	int wake_fds[2];
+
+	/**
+	 * Set by the I/O thread before it blocks in poll().  The
+	 * output thread writes to #wake_fds only if this is set.
+	 */
+	volatile gint sleeping;
+
+	/**
+	 * Tells the I/O thread to exit.  Protected by #mutex.
+	 */
+	bool quit;
+
+	/**
+	 * Sockets accepted by the listener (GINT_TO_POINTER), which
+	 * have not yet been adopted by the I/O thread.  Protected by
+	 * #mutex.
+	 */
+	GSList *pending;
+
+	/**
+	 * Incremented by httpd_output_cancel(), see
+	 * httpd_mount::skip_to.  Protected by #mutex.
+	 */
+	unsigned skip_serial;
+
+	/**
+	 * All clients which are currently connected.  Only accessed
+	 * by the I/O thread.
+	 */
+	GPtrArray *clients;
+
+	/**
+	 * Signalled by the I/O thread when it has answered a
+	 * statistics request.
 	 */
-	GList *clients;
+	GCond *cond;
+
+	/**
+	 * Set by httpd_output_stats() to ask the I/O thread for the
+	 * statistics of all clients; the I/O thread stores them in
+	 * #stats, clears this flag and signals #cond.  Both are
+	 * protected by #mutex.
+	 */
+	bool stats_requested;
+	char *stats;
 
 	/**
 	 * A temporary buffer for the httpd_output_read_page()
@@ -115,24 +328,70 @@ struct httpd_output {
 
 	/**
 	 * The maximum and current number of clients connected
-	 * at the same time.
+	 * at the same time.  #clients_cnt includes the #pending
+	 * sockets, and is modified atomically.
 	 */
-	guint clients_max, clients_cnt;
+	guint clients_max;
+	volatile gint clients_cnt;
 };
 
 /**
- * Removes a client from the httpd_output.clients linked list.
+ * Looks up the stream for the specified request path (without the
+ * query string).
+ *
+ * @return the mount, or NULL if there is no such stream
+ */
+G_GNUC_PURE
+struct httpd_mount *
+httpd_output_find_mount(struct httpd_output *httpd, const char *path);
+
+/**
+ * Looks up a playlist or a segment for HTTP Live Streaming.
+ *
+ * @param page_r on success, a new reference to the file, or NULL if
+ * it does not exist (anymore)
+ * @param playlist_r true if the playlist was requested
+ * @param content_type_r the MIME type of the file
+ * @return false if the path is not a HTTP Live Streaming path
+ */
+bool
+httpd_output_find_file(struct httpd_output *httpd, const char *path,
+		       struct page **page_r, bool *playlist_r,
+		       const char **content_type_r);
+
+/**
+ * Returns a new reference to the encoder header page of the mount
+ * (or NULL), which is sent to every client right after the response
+ * headers.
+ */
+struct page *
+httpd_output_get_header(struct httpd_output *httpd,
+			const struct httpd_mount *mount);
+
+/**
+ * Starts the I/O thread.
+ */
+bool
+httpd_thread_start(struct httpd_output *httpd, GError **error_r);
+
+/**
+ * Stops the I/O thread, and disconnects all clients.
+ */
+void
+httpd_thread_stop(struct httpd_output *httpd);
+
+/**
+ * Wakes up the I/O thread after a new page has been published.  This
+ * is cheap if the I/O thread is busy anyway.
  */
 void
-httpd_output_remove_client(struct httpd_output *httpd,
-			   struct httpd_client *client);
+httpd_thread_wake(struct httpd_output *httpd);
 
 /**
- * Sends the encoder header to the client.  This is called right after
- * the response headers have been sent.
+ * Wakes up the I/O thread unconditionally, after its control
+ * variables were modified.
  */
 void
-httpd_output_send_header(struct httpd_output *httpd,
-			 struct httpd_client *client);
+httpd_thread_kick(struct httpd_output *httpd);
 
 #endif
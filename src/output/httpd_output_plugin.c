@@ -29,8 +29,13 @@
 #include "icy_server.h"
 #include "fd_util.h"
 #include "server_socket.h"
+#include "audio_format.h"
+#include "filter_plugin.h"
+#include "filter_registry.h"
+#include "filter/convert_filter_plugin.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -55,33 +60,76 @@ httpd_output_quark(void)
 
 /**
  * Check whether there is at least one client.
- *
- * Caller must lock the mutex.
  */
 G_GNUC_PURE
 static bool
 httpd_output_has_clients(const struct httpd_output *httpd)
 {
-	return httpd->clients != NULL;
+	return g_atomic_int_get(&httpd->clients_cnt) > 0;
 }
 
 /**
- * Check whether there is at least one client.
+ * Shall the audio data be encoded?  With HTTP Live Streaming, the
+ * segments must be available before clients request them, and the
+ * clients are connected only while downloading.
  */
 G_GNUC_PURE
 static bool
-httpd_output_lock_has_clients(const struct httpd_output *httpd)
+httpd_output_is_live(const struct httpd_output *httpd)
 {
-	g_mutex_lock(httpd->mutex);
-	bool result = httpd_output_has_clients(httpd);
-	g_mutex_unlock(httpd->mutex);
-	return result;
+	return httpd->segment_ms > 0 || httpd_output_has_clients(httpd);
 }
 
 static void
 httpd_listen_in_event(int fd, const struct sockaddr *address,
 		      size_t address_length, int uid, void *ctx);
 
+/**
+ * Determines how to find frame boundaries in a stream of the
+ * specified MIME type.
+ */
+G_GNUC_PURE
+static enum httpd_sync
+httpd_sync_from_mime_type(const char *mime_type)
+{
+	if (strcmp(mime_type, "audio/mpeg") == 0)
+		return HTTPD_SYNC_MPEG;
+	else if (strcmp(mime_type, "audio/ogg") == 0 ||
+		 strcmp(mime_type, "application/ogg") == 0)
+		return HTTPD_SYNC_OGG;
+	else if (strcmp(mime_type, "audio/flac") == 0)
+		return HTTPD_SYNC_FLAC;
+	else
+		return HTTPD_SYNC_ANY;
+}
+
+/**
+ * Does the page begin at a frame boundary?
+ */
+G_GNUC_PURE
+static bool
+httpd_page_is_sync(enum httpd_sync sync, const struct page *page)
+{
+	const unsigned char *p = page->data;
+
+	switch (sync) {
+	case HTTPD_SYNC_ANY:
+		return true;
+
+	case HTTPD_SYNC_MPEG:
+		return page->size >= 2 && p[0] == 0xff && (p[1] & 0xe0) == 0xe0;
+
+	case HTTPD_SYNC_OGG:
+		return page->size >= 4 && memcmp(p, "OggS", 4) == 0;
+
+	case HTTPD_SYNC_FLAC:
+		return page->size >= 2 && p[0] == 0xff && (p[1] & 0xfe) == 0xf8;
+	}
+
+	assert(false);
+	return false;
+}
+
 static bool
 httpd_output_bind(struct httpd_output *httpd, GError **error_r)
 {
@@ -104,6 +152,223 @@ httpd_output_unbind(struct httpd_output *httpd)
 	g_mutex_unlock(httpd->mutex);
 }
 
+/**
+ * Is this a valid mount name?  It becomes part of the request path
+ * and of the configuration option names.
+ */
+G_GNUC_PURE
+static bool
+httpd_mount_name_valid(const char *name)
+{
+	if (*name == 0)
+		return false;
+
+	for (const char *p = name; *p != 0; ++p)
+		if (!g_ascii_isalnum(*p) && *p != '-' && *p != '.')
+			return false;
+
+	return true;
+}
+
+/**
+ * Looks up a block parameter without marking it as used.
+ */
+G_GNUC_PURE
+static struct block_param *
+httpd_config_find(const struct config_param *param, const char *name)
+{
+	for (unsigned i = 0; i < param->num_block_params; ++i)
+		if (strcmp(param->block_params[i].name, name) == 0)
+			return &param->block_params[i];
+
+	return NULL;
+}
+
+/**
+ * Creates the configuration of a mount: all options with the prefix
+ * "NAME_" override the options of the audio_output block.
+ */
+static struct config_param *
+httpd_mount_config(const struct config_param *param, const char *name)
+{
+	struct config_param *mp = config_new_param(NULL, param->line);
+	char *prefix = g_strconcat(name, "_", NULL);
+	const size_t prefix_length = strlen(prefix);
+
+	for (unsigned i = 0; i < param->num_block_params; ++i) {
+		const struct block_param *bp = &param->block_params[i];
+
+		if (g_str_has_prefix(bp->name, prefix))
+			config_add_block_param(mp, bp->name + prefix_length,
+					       bp->value, bp->line);
+	}
+
+	for (unsigned i = 0; i < param->num_block_params; ++i) {
+		const struct block_param *bp = &param->block_params[i];
+
+		if (!g_str_has_prefix(bp->name, prefix) &&
+		    httpd_config_find(mp, bp->name) == NULL)
+			config_add_block_param(mp, bp->name, bp->value,
+					       bp->line);
+	}
+
+	g_free(prefix);
+	return mp;
+}
+
+/**
+ * Marks the options of the audio_output block which were used by
+ * the encoder of a mount, to suppress the "not recognized" warning.
+ */
+static void
+httpd_mount_config_used(const struct config_param *param,
+			const struct config_param *mp, const char *name)
+{
+	for (unsigned i = 0; i < mp->num_block_params; ++i) {
+		const struct block_param *bp = &mp->block_params[i];
+		if (!bp->used)
+			continue;
+
+		char *prefixed = g_strconcat(name, "_", bp->name, NULL);
+		struct block_param *used = httpd_config_find(param, prefixed);
+		if (used == NULL)
+			used = httpd_config_find(param, bp->name);
+		g_free(prefixed);
+
+		if (used != NULL)
+			used->used = true;
+	}
+}
+
+/**
+ * Initializes the encoder of a mount.
+ *
+ * @param param the encoder configuration; it is owned by the mount
+ * afterwards, even on failure
+ */
+static bool
+httpd_mount_init(struct httpd_mount *mount, char *path,
+		 struct config_param *param,
+		 const struct config_param *block, GError **error)
+{
+	mount->path = path;
+	mount->param = param;
+	mount->convert = NULL;
+	mount->unflushed_input = 0;
+	mount->header = NULL;
+	mount->skip_to = mount->stream_start = 0;
+	mount->encoder = NULL;
+
+	const char *encoder_name =
+		config_get_block_string(param != NULL ? param : block,
+					"encoder", "vorbis");
+	const struct encoder_plugin *encoder_plugin =
+		encoder_plugin_get(encoder_name);
+	if (encoder_plugin == NULL) {
+		g_set_error(error, httpd_output_quark(), 0,
+			    "No such encoder: %s", encoder_name);
+		return false;
+	}
+
+	mount->encoder = encoder_init(encoder_plugin,
+				      param != NULL ? param : block, error);
+	if (mount->encoder == NULL)
+		return false;
+
+	if (param != NULL)
+		httpd_mount_config_used(block, param, path + 1);
+
+	/* determine content type */
+	mount->content_type = encoder_get_mime_type(mount->encoder);
+	if (mount->content_type == NULL) {
+		mount->content_type = "application/octet-stream";
+	}
+
+	mount->sync = httpd_sync_from_mime_type(mount->content_type);
+	return true;
+}
+
+static void
+httpd_mount_finish(struct httpd_mount *mount)
+{
+	if (mount->encoder != NULL)
+		encoder_finish(mount->encoder);
+	if (mount->param != NULL)
+		config_param_free(mount->param);
+	g_free(mount->path);
+}
+
+static void
+httpd_output_finish_mounts(struct httpd_output *httpd)
+{
+	for (unsigned i = 0; i < httpd->num_mounts; ++i)
+		httpd_mount_finish(&httpd->mounts[i]);
+
+	g_free(httpd->mounts);
+}
+
+/**
+ * Creates the mounts listed in the "mounts" option, or a single
+ * mount serving all request paths if there is no such option.
+ */
+static bool
+httpd_output_init_mounts(struct httpd_output *httpd,
+			 const struct config_param *param, GError **error)
+{
+	const char *value = config_get_block_string(param, "mounts", NULL);
+	if (value == NULL) {
+		httpd->mounts = g_new(struct httpd_mount, 1);
+		httpd->num_mounts = 1;
+
+		if (!httpd_mount_init(&httpd->mounts[0], g_strdup("/"), NULL,
+				      param, error)) {
+			httpd_output_finish_mounts(httpd);
+			return false;
+		}
+
+		return true;
+	}
+
+	char **names = g_strsplit_set(value, " \t", 0);
+	httpd->mounts = g_new(struct httpd_mount, g_strv_length(names));
+	httpd->num_mounts = 0;
+
+	bool success = true;
+	for (char **name = names; success && *name != NULL; ++name) {
+		if (**name == 0)
+			continue;
+
+		char *path = g_strconcat("/", *name, NULL);
+		if (!httpd_mount_name_valid(*name) ||
+		    httpd_output_find_mount(httpd, path) != NULL) {
+			g_set_error(error, httpd_output_quark(), 0,
+				    "Invalid or duplicate mount name: %s",
+				    *name);
+			g_free(path);
+			success = false;
+			break;
+		}
+
+		struct httpd_mount *mount =
+			&httpd->mounts[httpd->num_mounts++];
+		success = httpd_mount_init(mount, path,
+					   httpd_mount_config(param, *name),
+					   param, error);
+	}
+
+	if (success && httpd->num_mounts == 0) {
+		g_set_error(error, httpd_output_quark(), 0,
+			    "No mounts configured");
+		success = false;
+	}
+
+	if (!success)
+		httpd_output_finish_mounts(httpd);
+
+	g_strfreev(names);
+	return success;
+}
+
 static struct audio_output *
 httpd_output_init(const struct config_param *param,
 		  GError **error)
@@ -124,19 +389,32 @@ httpd_output_init(const struct config_param *param,
 
 	guint port = config_get_block_unsigned(param, "port", 8000);
 
-	const char *encoder_name =
-		config_get_block_string(param, "encoder", "vorbis");
-	const struct encoder_plugin *encoder_plugin =
-		encoder_plugin_get(encoder_name);
-	if (encoder_plugin == NULL) {
+	httpd->clients_max = config_get_block_unsigned(param,"max_clients", 0);
+
+	httpd->burst_ms = config_get_block_unsigned(param, "burst", 0) * 1000;
+
+	httpd->segment_ms =
+		config_get_block_unsigned(param, "segment_duration", 0) * 1000;
+
+	httpd->max_client_queue =
+		config_get_block_unsigned(param, "max_client_queue",
+					  HTTPD_DEFAULT_MAX_CLIENT_QUEUE / 1024)
+		* 1024;
+	if (httpd->max_client_queue == 0) {
 		g_set_error(error, httpd_output_quark(), 0,
-			    "No such encoder: %s", encoder_name);
+			    "max_client_queue must not be zero");
 		ao_base_finish(&httpd->base);
 		g_free(httpd);
 		return NULL;
 	}
 
-	httpd->clients_max = config_get_block_unsigned(param,"max_clients", 0);
+	/* initialize the encoders */
+
+	if (!httpd_output_init_mounts(httpd, param, error)) {
+		ao_base_finish(&httpd->base);
+		g_free(httpd);
+		return NULL;
+	}
 
 	/* set up bind_to_address */
 
@@ -150,6 +428,8 @@ httpd_output_init(const struct config_param *param,
 					 port, error)
 		: server_socket_add_port(httpd->server_socket, port, error);
 	if (!success) {
+		server_socket_free(httpd->server_socket);
+		httpd_output_finish_mounts(httpd);
 		ao_base_finish(&httpd->base);
 		g_free(httpd);
 		return NULL;
@@ -157,24 +437,15 @@ httpd_output_init(const struct config_param *param,
 
 	/* initialize metadata */
 	httpd->metadata = NULL;
-	httpd->unflushed_input = 0;
-
-	/* initialize encoder */
-
-	httpd->encoder = encoder_init(encoder_plugin, param, error);
-	if (httpd->encoder == NULL) {
-		ao_base_finish(&httpd->base);
-		g_free(httpd);
-		return NULL;
-	}
+	httpd->metadata_serial = 0;
 
-	/* determine content type */
-	httpd->content_type = encoder_get_mime_type(httpd->encoder);
-	if (httpd->content_type == NULL) {
-		httpd->content_type = "application/octet-stream";
-	}
+	httpd->thread = NULL;
+	httpd->clients_cnt = 0;
+	httpd->skip_serial = 0;
 
 	httpd->mutex = g_mutex_new();
+	httpd->cond = g_cond_new();
+	httpd->stats = NULL;
 
 	return &httpd->base;
 }
@@ -187,30 +458,27 @@ httpd_output_finish(struct audio_output *ao)
 	if (httpd->metadata)
 		page_unref(httpd->metadata);
 
-	encoder_finish(httpd->encoder);
+	httpd_output_finish_mounts(httpd);
 	server_socket_free(httpd->server_socket);
+	g_free(httpd->stats);
+	g_cond_free(httpd->cond);
 	g_mutex_free(httpd->mutex);
 	ao_base_finish(&httpd->base);
 	g_free(httpd);
 }
 
 /**
- * Creates a new #httpd_client object and adds it into the
- * httpd_output.clients linked list.
+ * Hands a new connection over to the I/O thread, which creates the
+ * #httpd_client object.  Caller must lock the mutex.
  */
 static void
 httpd_client_add(struct httpd_output *httpd, int fd)
 {
-	struct httpd_client *client =
-		httpd_client_new(httpd, fd,
-				 httpd->encoder->plugin->tag == NULL);
+	httpd->pending = g_slist_prepend(httpd->pending,
+					 GINT_TO_POINTER(fd));
+	g_atomic_int_add(&httpd->clients_cnt, 1);
 
-	httpd->clients = g_list_prepend(httpd->clients, client);
-	httpd->clients_cnt++;
-
-	/* pass metadata to client */
-	if (httpd->metadata)
-		httpd_client_send_metadata(client, httpd->metadata);
+	httpd_thread_kick(httpd);
 }
 
 static void
@@ -255,7 +523,8 @@ httpd_listen_in_event(int fd, const struct sockaddr *address,
 		/* can we allow additional client */
 		if (httpd->open &&
 		    (httpd->clients_max == 0 ||
-		     httpd->clients_cnt < httpd->clients_max))
+		     (guint)g_atomic_int_get(&httpd->clients_cnt) <
+		     httpd->clients_max))
 			httpd_client_add(httpd, fd);
 		else
 			close_socket(fd);
@@ -271,25 +540,25 @@ httpd_listen_in_event(int fd, const struct sockaddr *address,
  * as a new #page object.
  */
 static struct page *
-httpd_output_read_page(struct httpd_output *httpd)
+httpd_output_read_page(struct httpd_output *httpd, struct httpd_mount *mount)
 {
-	if (httpd->unflushed_input >= 65536) {
+	if (mount->unflushed_input >= 65536) {
 		/* we have fed a lot of input into the encoder, but it
 		   didn't give anything back yet - flush now to avoid
 		   buffer underruns */
-		encoder_flush(httpd->encoder, NULL);
-		httpd->unflushed_input = 0;
+		encoder_flush(mount->encoder, NULL);
+		mount->unflushed_input = 0;
 	}
 
 	size_t size = 0;
 	do {
-		size_t nbytes = encoder_read(httpd->encoder,
+		size_t nbytes = encoder_read(mount->encoder,
 					     httpd->buffer + size,
 					     sizeof(httpd->buffer) - size);
 		if (nbytes == 0)
 			break;
 
-		httpd->unflushed_input = 0;
+		mount->unflushed_input = 0;
 
 		size += nbytes;
 	} while (size < sizeof(httpd->buffer));
@@ -302,22 +571,106 @@ httpd_output_read_page(struct httpd_output *httpd)
 
 static bool
 httpd_output_encoder_open(struct httpd_output *httpd,
+			  struct httpd_mount *mount,
 			  struct audio_format *audio_format,
 			  GError **error)
 {
-	if (!encoder_open(httpd->encoder, audio_format, error))
+	if (!encoder_open(mount->encoder, audio_format, error))
 		return false;
 
 	/* we have to remember the encoder header, i.e. the first
 	   bytes of encoder output after opening it, because it has to
 	   be sent to every new client */
-	httpd->header = httpd_output_read_page(httpd);
+	mount->header = httpd_output_read_page(httpd, mount);
+
+	mount->unflushed_input = 0;
+
+	return true;
+}
+
+static void
+httpd_mount_close(struct httpd_mount *mount)
+{
+	if (mount->header != NULL) {
+		page_unref(mount->header);
+		mount->header = NULL;
+	}
+
+	if (mount->convert != NULL) {
+		filter_close(mount->convert);
+		filter_free(mount->convert);
+		mount->convert = NULL;
+	}
+
+	encoder_close(mount->encoder);
+}
+
+/**
+ * Opens the encoder of a mount other than the first one.  If the
+ * encoder wants a different audio format than the first one, a
+ * convert filter is set up, so the filter chain of the output still
+ * runs only once.
+ */
+static bool
+httpd_mount_open(struct httpd_output *httpd, struct httpd_mount *mount,
+		 const struct audio_format *audio_format, GError **error)
+{
+	struct audio_format mount_format = *audio_format;
+	if (!httpd_output_encoder_open(httpd, mount, &mount_format, error))
+		return false;
+
+	if (audio_format_equals(&mount_format, audio_format))
+		return true;
+
+	mount->convert = filter_new(&convert_filter_plugin, NULL, error);
+	if (mount->convert == NULL) {
+		httpd_mount_close(mount);
+		return false;
+	}
+
+	struct audio_format in = *audio_format;
+	if (filter_open(mount->convert, &in, error) == NULL) {
+		filter_free(mount->convert);
+		mount->convert = NULL;
+		httpd_mount_close(mount);
+		return false;
+	}
+
+	convert_filter_set(mount->convert, &mount_format);
+	return true;
+}
+
+/**
+ * Opens the encoders of all mounts.  The first one determines the
+ * audio format of the output.  Caller must lock the mutex.
+ */
+static bool
+httpd_output_open_mounts(struct httpd_output *httpd,
+			 struct audio_format *audio_format, GError **error)
+{
+	if (!httpd_output_encoder_open(httpd, &httpd->mounts[0],
+				       audio_format, error))
+		return false;
 
-	httpd->unflushed_input = 0;
+	for (unsigned i = 1; i < httpd->num_mounts; ++i) {
+		if (!httpd_mount_open(httpd, &httpd->mounts[i],
+				      audio_format, error)) {
+			while (i-- > 0)
+				httpd_mount_close(&httpd->mounts[i]);
+			return false;
+		}
+	}
 
 	return true;
 }
 
+static void
+httpd_output_close_mounts(struct httpd_output *httpd)
+{
+	for (unsigned i = 0; i < httpd->num_mounts; ++i)
+		httpd_mount_close(&httpd->mounts[i]);
+}
+
 static bool
 httpd_output_enable(struct audio_output *ao, GError **error_r)
 {
@@ -334,6 +687,27 @@ httpd_output_disable(struct audio_output *ao)
 	httpd_output_unbind(httpd);
 }
 
+/**
+ * Sets up HTTP Live Streaming for a mount: the playlist of the
+ * mount "/low" is "/low.m3u8"; without the "mounts" option, it is
+ * "/index.m3u8".
+ */
+static void
+httpd_mount_segmenter_init(const struct httpd_output *httpd,
+			   struct httpd_mount *mount)
+{
+	httpd_segmenter_init(&mount->segmenter,
+			     mount->param != NULL ? mount->path + 1 : "index",
+			     httpd_segment_suffix(mount->content_type),
+			     httpd->segment_ms);
+
+	unsigned duration;
+	G_GNUC_UNUSED struct page *segment =
+		httpd_segmenter_set_header(&mount->segmenter, mount->header,
+					   0, &duration);
+	assert(segment == NULL);
+}
+
 static bool
 httpd_output_open(struct audio_output *ao, struct audio_format *audio_format,
 		  GError **error)
@@ -342,31 +716,50 @@ httpd_output_open(struct audio_output *ao, struct audio_format *audio_format,
 
 	g_mutex_lock(httpd->mutex);
 
-	/* open the encoder */
+	/* open the encoders */
 
-	if (!httpd_output_encoder_open(httpd, audio_format, error)) {
+	if (!httpd_output_open_mounts(httpd, audio_format, error)) {
 		g_mutex_unlock(httpd->mutex);
 		return false;
 	}
 
+	g_mutex_unlock(httpd->mutex);
+
 	/* initialize other attributes */
 
-	httpd->clients = NULL;
-	httpd->clients_cnt = 0;
+	for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+		struct httpd_mount *mount = &httpd->mounts[i];
+
+		httpd_ring_init(&mount->ring, HTTPD_RING_CAPACITY);
+		mount->ring_overruns = 0;
+		mount->stream_start = 0;
+
+		if (httpd->segment_ms > 0)
+			httpd_mount_segmenter_init(httpd, mount);
+	}
+
+	httpd->stream_bytes = 0;
+	httpd->input_rate = audio_format_frame_size(audio_format) *
+		audio_format->sample_rate;
+
+	if (!httpd_thread_start(httpd, error)) {
+		for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+			httpd_ring_deinit(&httpd->mounts[i].ring);
+			if (httpd->segment_ms > 0)
+				httpd_segmenter_deinit(&httpd->mounts[i].segmenter);
+		}
+
+		httpd_output_close_mounts(httpd);
+		return false;
+	}
+
 	httpd->timer = timer_new(audio_format);
 
+	g_mutex_lock(httpd->mutex);
 	httpd->open = true;
-
 	g_mutex_unlock(httpd->mutex);
-	return true;
-}
-
-static void
-httpd_client_delete(gpointer data, G_GNUC_UNUSED gpointer user_data)
-{
-	struct httpd_client *client = data;
 
-	httpd_client_free(client);
+	return true;
 }
 
 static void
@@ -375,39 +768,87 @@ httpd_output_close(struct audio_output *ao)
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
 	g_mutex_lock(httpd->mutex);
-
 	httpd->open = false;
+	g_mutex_unlock(httpd->mutex);
+
+	/* this disconnects all clients */
+	httpd_thread_stop(httpd);
+
+	for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+		struct httpd_mount *mount = &httpd->mounts[i];
+
+		httpd_ring_deinit(&mount->ring);
+
+		if (httpd->segment_ms > 0)
+			httpd_segmenter_deinit(&mount->segmenter);
+
+		if (mount->ring_overruns > 0)
+			g_debug("%u pages of %s were discarded because the ring was full",
+				mount->ring_overruns, mount->path);
+	}
 
 	timer_free(httpd->timer);
 
-	g_list_foreach(httpd->clients, httpd_client_delete, NULL);
-	g_list_free(httpd->clients);
+	httpd_output_close_mounts(httpd);
+}
 
-	if (httpd->header != NULL)
-		page_unref(httpd->header);
+bool
+httpd_output_find_file(struct httpd_output *httpd, const char *path,
+		       struct page **page_r, bool *playlist_r,
+		       const char **content_type_r)
+{
+	if (httpd->segment_ms == 0 || *path != '/')
+		return false;
+
+	bool found = false;
+
+	g_mutex_lock(httpd->mutex);
 
-	encoder_close(httpd->encoder);
+	for (unsigned i = 0; i < httpd->num_mounts && !found; ++i) {
+		const struct httpd_mount *mount = &httpd->mounts[i];
+
+		found = httpd_segmenter_lookup(&mount->segmenter, path + 1,
+					       page_r, playlist_r);
+		if (found)
+			*content_type_r = *playlist_r
+				? "application/vnd.apple.mpegurl"
+				: mount->content_type;
+	}
 
 	g_mutex_unlock(httpd->mutex);
+
+	return found;
 }
 
-void
-httpd_output_remove_client(struct httpd_output *httpd,
-			   struct httpd_client *client)
+struct page *
+httpd_output_get_header(struct httpd_output *httpd,
+			const struct httpd_mount *mount)
 {
-	assert(httpd != NULL);
-	assert(client != NULL);
+	g_mutex_lock(httpd->mutex);
+	struct page *header = mount->header;
+	if (header != NULL)
+		page_ref(header);
+	g_mutex_unlock(httpd->mutex);
 
-	httpd->clients = g_list_remove(httpd->clients, client);
-	httpd->clients_cnt--;
+	return header;
 }
 
-void
-httpd_output_send_header(struct httpd_output *httpd,
-			 struct httpd_client *client)
+struct httpd_mount *
+httpd_output_find_mount(struct httpd_output *httpd, const char *path)
 {
-	if (httpd->header != NULL)
-		httpd_client_send(client, httpd->header);
+	if (httpd->num_mounts == 0)
+		return NULL;
+
+	if (httpd->mounts[0].param == NULL || strcmp(path, "/") == 0)
+		/* without the "mounts" option, the stream is
+		   available at any path */
+		return &httpd->mounts[0];
+
+	for (unsigned i = 0; i < httpd->num_mounts; ++i)
+		if (strcmp(httpd->mounts[i].path, path) == 0)
+			return &httpd->mounts[i];
+
+	return NULL;
 }
 
 static unsigned
@@ -415,7 +856,7 @@ httpd_output_delay(struct audio_output *ao)
 {
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
-	if (!httpd_output_lock_has_clients(httpd) && httpd->base.pause) {
+	if (!httpd_output_is_live(httpd) && httpd->base.pause) {
 		/* if there's no client and this output is paused,
 		   then httpd_output_pause() will not do anything, it
 		   will not fill the buffer and it will not update the
@@ -433,67 +874,108 @@ httpd_output_delay(struct audio_output *ao)
 		: 0;
 }
 
+/**
+ * Passes a page to the segmenter of the mount, and publishes the
+ * segment which was finished by it.
+ *
+ * @param header true if the page is a new encoder header
+ */
 static void
-httpd_client_check_queue(gpointer data, G_GNUC_UNUSED gpointer user_data)
-{
-	struct httpd_client *client = data;
-
-	if (httpd_client_queue_size(client) > 256 * 1024) {
-		g_debug("client is too slow, flushing its queue");
-		httpd_client_cancel(client);
-	}
-}
-
-static void
-httpd_client_send_page(gpointer data, gpointer user_data)
+httpd_output_segment_page(struct httpd_output *httpd,
+			  struct httpd_mount *mount, struct page *page,
+			  uint64_t time, bool sync, bool header)
 {
-	struct httpd_client *client = data;
-	struct page *page = user_data;
+	unsigned duration;
+	struct page *segment = header
+		? httpd_segmenter_set_header(&mount->segmenter, page,
+					     time, &duration)
+		: httpd_segmenter_append(&mount->segmenter, page,
+					 time, sync, &duration);
+	if (segment == NULL)
+		return;
 
-	httpd_client_send(client, page);
+	g_mutex_lock(httpd->mutex);
+	httpd_segmenter_push(&mount->segmenter, segment, duration);
+	g_mutex_unlock(httpd->mutex);
 }
 
 /**
- * Broadcasts a page struct to all clients.
+ * Broadcasts a page struct to all clients of a mount: it is
+ * published in the ring, and the I/O thread is woken up.  This
+ * function takes over the caller's reference.
+ *
+ * @param header true if the page is a new encoder header
  */
 static void
-httpd_output_broadcast_page(struct httpd_output *httpd, struct page *page)
+httpd_output_broadcast_page(struct httpd_output *httpd,
+			    struct httpd_mount *mount, struct page *page,
+			    bool header)
 {
 	assert(page != NULL);
 
-	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_send_page, page);
-	g_mutex_unlock(httpd->mutex);
+	const uint64_t time = httpd->stream_bytes * 1000 / httpd->input_rate;
+	const bool sync = httpd_page_is_sync(mount->sync, page);
+
+	if (httpd->segment_ms > 0)
+		httpd_output_segment_page(httpd, mount, page, time, sync,
+					  header);
+
+	if (!httpd_ring_push(&mount->ring, page, time, sync)) {
+		/* the I/O thread is stuck; this should never
+		   happen, because slow clients are skipped long
+		   before the ring fills up */
+		++mount->ring_overruns;
+		page_unref(page);
+		return;
+	}
+
+	httpd_thread_wake(httpd);
 }
 
 /**
- * Broadcasts data from the encoder to all clients.
+ * Broadcasts data from the encoder to all clients of the mount.
  */
 static void
-httpd_output_encoder_to_clients(struct httpd_output *httpd)
+httpd_output_encoder_to_clients(struct httpd_output *httpd,
+				struct httpd_mount *mount)
 {
 	struct page *page;
 
-	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_check_queue, NULL);
-	g_mutex_unlock(httpd->mutex);
+	while ((page = httpd_output_read_page(httpd, mount)) != NULL)
+		httpd_output_broadcast_page(httpd, mount, page, false);
+}
 
-	while ((page = httpd_output_read_page(httpd)) != NULL) {
-		httpd_output_broadcast_page(httpd, page);
-		page_unref(page);
+static bool
+httpd_mount_encode(struct httpd_output *httpd, struct httpd_mount *mount,
+		   const void *chunk, size_t size, GError **error)
+{
+	if (mount->convert != NULL) {
+		chunk = filter_filter(mount->convert, chunk, size, &size,
+				      error);
+		if (chunk == NULL)
+			return false;
 	}
+
+	if (!encoder_write(mount->encoder, chunk, size, error))
+		return false;
+
+	mount->unflushed_input += size;
+
+	httpd_output_encoder_to_clients(httpd, mount);
+
+	return true;
 }
 
 static bool
 httpd_output_encode_and_play(struct httpd_output *httpd,
 			     const void *chunk, size_t size, GError **error)
 {
-	if (!encoder_write(httpd->encoder, chunk, size, error))
-		return false;
-
-	httpd->unflushed_input += size;
+	httpd->stream_bytes += size;
 
-	httpd_output_encoder_to_clients(httpd);
+	for (unsigned i = 0; i < httpd->num_mounts; ++i)
+		if (!httpd_mount_encode(httpd, &httpd->mounts[i],
+					chunk, size, error))
+			return false;
 
 	return true;
 }
@@ -504,7 +986,7 @@ httpd_output_play(struct audio_output *ao, const void *chunk, size_t size,
 {
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
-	if (httpd_output_lock_has_clients(httpd)) {
+	if (httpd_output_is_live(httpd)) {
 		if (!httpd_output_encode_and_play(httpd, chunk, size, error_r))
 			return 0;
 	}
@@ -521,7 +1003,7 @@ httpd_output_pause(struct audio_output *ao)
 {
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
-	if (httpd_output_lock_has_clients(httpd)) {
+	if (httpd_output_is_live(httpd)) {
 		static const char silence[1020];
 		return httpd_output_play(ao, silence, sizeof(silence),
 					 NULL) > 0;
@@ -530,13 +1012,43 @@ httpd_output_pause(struct audio_output *ao)
 	}
 }
 
+/**
+ * Embeds the tag in the stream of a mount whose encoder supports
+ * tags.
+ */
 static void
-httpd_send_metadata(gpointer data, gpointer user_data)
+httpd_mount_tag(struct httpd_output *httpd, struct httpd_mount *mount,
+		const struct tag *tag)
 {
-	struct httpd_client *client = data;
-	struct page *icy_metadata = user_data;
+	/* flush the current stream, and end it */
 
-	httpd_client_send_metadata(client, icy_metadata);
+	encoder_pre_tag(mount->encoder, NULL);
+	httpd_output_encoder_to_clients(httpd, mount);
+
+	/* send the tag to the encoder - which starts a new
+	   stream now */
+
+	encoder_tag(mount->encoder, tag, NULL);
+
+	/* the first page generated by the encoder will now be
+	   used as the new "header" page, which is sent to all
+	   new clients */
+
+	struct page *page = httpd_output_read_page(httpd, mount);
+	if (page != NULL) {
+		page_ref(page);
+
+		httpd_output_broadcast_page(httpd, mount, page, true);
+
+		/* new clients get the new header, and must not
+		   receive a burst of the previous stream */
+		g_mutex_lock(httpd->mutex);
+		if (mount->header != NULL)
+			page_unref(mount->header);
+		mount->header = page;
+		mount->stream_start = httpd_ring_head(&mount->ring);
+		g_mutex_unlock(httpd->mutex);
+	}
 }
 
 static void
@@ -546,65 +1058,89 @@ httpd_output_tag(struct audio_output *ao, const struct tag *tag)
 
 	assert(tag != NULL);
 
-	if (httpd->encoder->plugin->tag != NULL) {
-		/* embed encoder tags */
-
-		/* flush the current stream, and end it */
-
-		encoder_pre_tag(httpd->encoder, NULL);
-		httpd_output_encoder_to_clients(httpd);
+	bool icy = false;
+	for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+		struct httpd_mount *mount = &httpd->mounts[i];
 
-		/* send the tag to the encoder - which starts a new
-		   stream now */
+		if (mount->encoder->plugin->tag != NULL)
+			/* embed encoder tags */
+			httpd_mount_tag(httpd, mount, tag);
+		else
+			icy = true;
+	}
 
-		encoder_tag(httpd->encoder, tag, NULL);
+	if (icy) {
+		/* use Icy-Metadata */
 
-		/* the first page generated by the encoder will now be
-		   used as the new "header" page, which is sent to all
-		   new clients */
+		struct page *metadata =
+			icy_server_metadata_page(tag, TAG_ALBUM,
+						 TAG_ARTIST, TAG_TITLE,
+						 TAG_NUM_OF_ITEM_TYPES);
 
-		struct page *page = httpd_output_read_page(httpd);
-		if (page != NULL) {
-			if (httpd->header != NULL)
-				page_unref(httpd->header);
-			httpd->header = page;
-			httpd_output_broadcast_page(httpd, page);
-		}
-	} else {
-		/* use Icy-Metadata */
+		g_mutex_lock(httpd->mutex);
 
 		if (httpd->metadata != NULL)
 			page_unref (httpd->metadata);
 
-		httpd->metadata =
-			icy_server_metadata_page(tag, TAG_ALBUM,
-						 TAG_ARTIST, TAG_TITLE,
-						 TAG_NUM_OF_ITEM_TYPES);
-		if (httpd->metadata != NULL) {
-			g_mutex_lock(httpd->mutex);
-			g_list_foreach(httpd->clients,
-				       httpd_send_metadata, httpd->metadata);
-			g_mutex_unlock(httpd->mutex);
-		}
+		httpd->metadata = metadata;
+		++httpd->metadata_serial;
+
+		g_mutex_unlock(httpd->mutex);
+
+		if (metadata != NULL)
+			httpd_thread_kick(httpd);
 	}
 }
 
 static void
-httpd_client_cancel_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
+httpd_output_cancel(struct audio_output *ao)
 {
-	struct httpd_client *client = data;
+	struct httpd_output *httpd = (struct httpd_output *)ao;
 
-	httpd_client_cancel(client);
+	/* let the I/O thread discard all pages which were published
+	   until now */
+	g_mutex_lock(httpd->mutex);
+
+	for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+		struct httpd_mount *mount = &httpd->mounts[i];
+
+		mount->skip_to = mount->stream_start =
+			httpd_ring_head(&mount->ring);
+	}
+
+	++httpd->skip_serial;
+	g_mutex_unlock(httpd->mutex);
+
+	httpd_thread_kick(httpd);
 }
 
-static void
-httpd_output_cancel(struct audio_output *ao)
+/**
+ * Obtains the statistics of all clients from the I/O thread.
+ */
+static char *
+httpd_output_stats(struct audio_output *ao)
 {
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
 	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_cancel_callback, NULL);
+
+	if (!httpd->open) {
+		g_mutex_unlock(httpd->mutex);
+		return NULL;
+	}
+
+	httpd->stats_requested = true;
+	httpd_thread_kick(httpd);
+
+	while (httpd->stats_requested)
+		g_cond_wait(httpd->cond, httpd->mutex);
+
+	char *stats = httpd->stats;
+	httpd->stats = NULL;
+
 	g_mutex_unlock(httpd->mutex);
+
+	return stats;
 }
 
 const struct audio_output_plugin httpd_output_plugin = {
@@ -620,4 +1156,5 @@ const struct audio_output_plugin httpd_output_plugin = {
 	.play = httpd_output_play,
 	.pause = httpd_output_pause,
 	.cancel = httpd_output_cancel,
+	.stats = httpd_output_stats,
 };
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "httpd_ring.h"
+#include "page.h"
+
+#include <assert.h>
+
+void
+httpd_ring_init(struct httpd_ring *ring, unsigned capacity)
+{
+	assert(capacity > 0);
+
+	ring->capacity = 1;
+	while (ring->capacity < capacity)
+		ring->capacity <<= 1;
+
+	ring->slots = g_new0(struct httpd_ring_slot, ring->capacity);
+	ring->head = 0;
+	ring->tail = 0;
+	ring->next_offset = 0;
+}
+
+void
+httpd_ring_deinit(struct httpd_ring *ring)
+{
+	httpd_ring_release(ring, httpd_ring_head(ring));
+
+	g_free(ring->slots);
+}
+
+bool
+httpd_ring_push(struct httpd_ring *ring, struct page *page,
+		uint64_t time, bool sync)
+{
+	const unsigned head = (unsigned)ring->head;
+	if (head - httpd_ring_tail(ring) >= ring->capacity)
+		return false;
+
+	struct httpd_ring_slot *slot =
+		&ring->slots[head & (ring->capacity - 1)];
+	assert(slot->page == NULL);
+
+	slot->page = page;
+	slot->offset = ring->next_offset;
+	slot->time = time;
+	slot->sync = sync;
+	ring->next_offset += page->size;
+
+	/* this is a full memory barrier: the consumer sees the new
+	   slot contents before the new head */
+	g_atomic_int_set(&ring->head, (gint)(head + 1));
+	return true;
+}
+
+uint64_t
+httpd_ring_end_offset(const struct httpd_ring *ring, unsigned head)
+{
+	if (head == httpd_ring_tail(ring))
+		/* unknown, but nobody can be behind an empty ring */
+		return 0;
+
+	const struct page *last = httpd_ring_get(ring, head - 1);
+	return httpd_ring_offset(ring, head - 1) + last->size;
+}
+
+void
+httpd_ring_release(struct httpd_ring *ring, unsigned new_tail)
+{
+	unsigned tail = (unsigned)ring->tail;
+	assert(new_tail - tail <= httpd_ring_head(ring) - tail);
+
+	while (tail != new_tail) {
+		struct httpd_ring_slot *slot =
+			&ring->slots[tail & (ring->capacity - 1)];
+		page_unref(slot->page);
+		slot->page = NULL;
+		++tail;
+	}
+
+	g_atomic_int_set(&ring->tail, (gint)tail);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A ring of encoded #page objects shared by all clients of the httpd
+ * output.  It has exactly one producer (the output thread), which
+ * appends pages, and one consumer (the httpd I/O thread), which reads
+ * them on behalf of all clients and releases them when no client
+ * needs them anymore.  Both sides communicate only through the two
+ * atomic sequence numbers #head and #tail; no lock is needed.
+ *
+ * Sequence numbers are free-running unsigned integers; comparisons
+ * must be done on differences, which makes wraparound harmless.
+ */
+
+#ifndef MPD_OUTPUT_HTTPD_RING_H
+#define MPD_OUTPUT_HTTPD_RING_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct page;
+
+struct httpd_ring_slot {
+	struct page *page;
+
+	/**
+	 * The stream offset [bytes] of the page.  Used to calculate
+	 * how far a client lags behind.
+	 */
+	uint64_t offset;
+
+	/**
+	 * The stream time [milliseconds] of the page, i.e. the
+	 * duration of the audio data which was passed to the encoder
+	 * before.
+	 */
+	uint64_t time;
+
+	/**
+	 * Does the page begin at a frame boundary?  Only such pages
+	 * may be the first page sent to a new client.
+	 */
+	bool sync;
+};
+
+struct httpd_ring {
+	/**
+	 * The number of slots; a power of two.
+	 */
+	unsigned capacity;
+
+	struct httpd_ring_slot *slots;
+
+	/**
+	 * The sequence number of the next page to be pushed.  Only
+	 * modified by the producer.
+	 */
+	volatile gint head;
+
+	/**
+	 * The sequence number of the oldest page still in the ring.
+	 * Only modified by the consumer.
+	 */
+	volatile gint tail;
+
+	/**
+	 * The stream offset of the next page.  Only used by the
+	 * producer.
+	 */
+	uint64_t next_offset;
+};
+
+/**
+ * @param capacity the maximum number of pages; rounded up to the next
+ * power of two
+ */
+void
+httpd_ring_init(struct httpd_ring *ring, unsigned capacity);
+
+/**
+ * Frees all pages.  Neither the producer nor the consumer may use
+ * the ring anymore.
+ */
+void
+httpd_ring_deinit(struct httpd_ring *ring);
+
+static inline unsigned
+httpd_ring_head(const struct httpd_ring *ring)
+{
+	return (unsigned)g_atomic_int_get(&ring->head);
+}
+
+static inline unsigned
+httpd_ring_tail(const struct httpd_ring *ring)
+{
+	return (unsigned)g_atomic_int_get(&ring->tail);
+}
+
+/**
+ * Producer: appends a page, and publishes it to the consumer.  The
+ * ring takes over the caller's reference.
+ *
+ * @param time the stream time of the page, see httpd_ring_slot::time
+ * @param sync true if the page begins at a frame boundary
+ * @return false if the ring is full (the page is not consumed and
+ * the caller still owns it)
+ */
+bool
+httpd_ring_push(struct httpd_ring *ring, struct page *page,
+		uint64_t time, bool sync);
+
+static inline const struct httpd_ring_slot *
+httpd_ring_slot(const struct httpd_ring *ring, unsigned seq)
+{
+	return &ring->slots[seq & (ring->capacity - 1)];
+}
+
+/**
+ * Consumer: returns the page with the specified sequence number,
+ * which must be between #tail (inclusive) and #head (exclusive).  The
+ * page remains valid until the consumer releases it.
+ */
+static inline struct page *
+httpd_ring_get(const struct httpd_ring *ring, unsigned seq)
+{
+	return httpd_ring_slot(ring, seq)->page;
+}
+
+/**
+ * Consumer: returns the stream offset of the specified page; see
+ * httpd_ring_get().
+ */
+static inline uint64_t
+httpd_ring_offset(const struct httpd_ring *ring, unsigned seq)
+{
+	return httpd_ring_slot(ring, seq)->offset;
+}
+
+/**
+ * Consumer: returns the stream offset behind the last page which
+ * was published before #head was read.
+ */
+uint64_t
+httpd_ring_end_offset(const struct httpd_ring *ring, unsigned head);
+
+/**
+ * Consumer: releases all pages before the specified sequence number,
+ * which must be between #tail and #head.
+ */
+void
+httpd_ring_release(struct httpd_ring *ring, unsigned new_tail);
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "httpd_segment.h"
+#include "page.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+const char *
+httpd_segment_suffix(const char *mime_type)
+{
+	if (strcmp(mime_type, "audio/mpeg") == 0)
+		return ".mp3";
+	else if (strcmp(mime_type, "audio/aac") == 0 ||
+		 strcmp(mime_type, "audio/aacp") == 0)
+		return ".aac";
+	else if (strcmp(mime_type, "audio/ogg") == 0 ||
+		 strcmp(mime_type, "application/ogg") == 0)
+		return ".ogg";
+	else if (strcmp(mime_type, "audio/flac") == 0)
+		return ".flac";
+	else if (strcmp(mime_type, "audio/wav") == 0)
+		return ".wav";
+	else
+		return ".bin";
+}
+
+void
+httpd_segmenter_init(struct httpd_segmenter *s, const char *name,
+		     const char *suffix, unsigned target_duration)
+{
+	assert(target_duration > 0);
+
+	s->name = g_strdup(name);
+	s->suffix = suffix;
+	s->target_duration = target_duration;
+	s->header = NULL;
+	s->buffer = g_byte_array_new();
+	s->active = false;
+	s->num_segments = 0;
+	s->next_seq = 0;
+	s->playlist = NULL;
+}
+
+void
+httpd_segmenter_deinit(struct httpd_segmenter *s)
+{
+	for (unsigned i = 0; i < s->num_segments; ++i)
+		page_unref(s->segments[i].page);
+
+	if (s->playlist != NULL)
+		page_unref(s->playlist);
+
+	if (s->header != NULL)
+		page_unref(s->header);
+
+	g_byte_array_free(s->buffer, true);
+	g_free(s->name);
+}
+
+/**
+ * Finishes the current segment.
+ */
+static struct page *
+httpd_segmenter_finish(struct httpd_segmenter *s, uint64_t time,
+		       unsigned *duration_r)
+{
+	if (!s->active)
+		return NULL;
+
+	s->active = false;
+
+	*duration_r = time - s->start_time;
+	struct page *page = page_new_copy(s->buffer->data, s->buffer->len);
+	g_byte_array_set_size(s->buffer, 0);
+	return page;
+}
+
+struct page *
+httpd_segmenter_set_header(struct httpd_segmenter *s, struct page *header,
+			   uint64_t time, unsigned *duration_r)
+{
+	struct page *segment = httpd_segmenter_finish(s, time, duration_r);
+
+	if (header != NULL)
+		page_ref(header);
+	if (s->header != NULL)
+		page_unref(s->header);
+	s->header = header;
+
+	return segment;
+}
+
+struct page *
+httpd_segmenter_append(struct httpd_segmenter *s, const struct page *page,
+		       uint64_t time, bool sync, unsigned *duration_r)
+{
+	struct page *segment = NULL;
+
+	if (s->active && sync && time - s->start_time >= s->target_duration)
+		segment = httpd_segmenter_finish(s, time, duration_r);
+
+	if (!s->active) {
+		if (!sync)
+			/* a segment must begin at a frame boundary */
+			return segment;
+
+		s->active = true;
+		s->start_time = time;
+
+		if (s->header != NULL)
+			g_byte_array_append(s->buffer, s->header->data,
+					    s->header->size);
+	}
+
+	g_byte_array_append(s->buffer, page->data, page->size);
+	return segment;
+}
+
+/**
+ * Generates the playlist listing the most recent segments.
+ */
+static struct page *
+httpd_segmenter_make_playlist(const struct httpd_segmenter *s)
+{
+	assert(s->num_segments > 0);
+
+	const unsigned first = s->num_segments > HTTPD_PLAYLIST_SEGMENTS
+		? s->num_segments - HTTPD_PLAYLIST_SEGMENTS
+		: 0;
+
+	unsigned max_duration = 0;
+	for (unsigned i = first; i < s->num_segments; ++i)
+		max_duration = MAX(max_duration, s->segments[i].duration);
+
+	/* the rounded segment durations must not exceed the target
+	   duration */
+	const unsigned target = MAX((max_duration + 500) / 1000, 1u);
+
+	GString *p = g_string_new(NULL);
+	g_string_append_printf(p,
+			       "#EXTM3U\n"
+			       "#EXT-X-VERSION:3\n"
+			       "#EXT-X-TARGETDURATION:%u\n"
+			       "#EXT-X-MEDIA-SEQUENCE:%u\n",
+			       target,
+			       s->segments[first].seq);
+
+	for (unsigned i = first; i < s->num_segments; ++i) {
+		const struct httpd_segment *segment = &s->segments[i];
+
+		g_string_append_printf(p, "#EXTINF:%u.%03u,\n%s-%u%s\n",
+				       segment->duration / 1000,
+				       segment->duration % 1000,
+				       s->name, segment->seq, s->suffix);
+	}
+
+	struct page *page = page_new_copy(p->str, p->len);
+	g_string_free(p, true);
+	return page;
+}
+
+void
+httpd_segmenter_push(struct httpd_segmenter *s, struct page *page,
+		     unsigned duration)
+{
+	assert(page != NULL);
+
+	if (s->num_segments == HTTPD_SEGMENTS) {
+		/* clients which are still downloading the oldest
+		   segment hold their own reference */
+		page_unref(s->segments[0].page);
+		memmove(s->segments, s->segments + 1,
+			sizeof(s->segments[0]) * (HTTPD_SEGMENTS - 1));
+		--s->num_segments;
+	}
+
+	struct httpd_segment *segment = &s->segments[s->num_segments++];
+	segment->seq = s->next_seq++;
+	segment->duration = duration;
+	segment->page = page;
+
+	if (s->playlist != NULL)
+		page_unref(s->playlist);
+	s->playlist = httpd_segmenter_make_playlist(s);
+}
+
+bool
+httpd_segmenter_lookup(const struct httpd_segmenter *s, const char *name,
+		       struct page **page_r, bool *playlist_r)
+{
+	const size_t name_length = strlen(s->name);
+	if (strncmp(name, s->name, name_length) != 0)
+		return false;
+
+	name += name_length;
+
+	if (strcmp(name, ".m3u8") == 0) {
+		*playlist_r = true;
+		*page_r = s->playlist;
+		if (*page_r != NULL)
+			page_ref(*page_r);
+		return true;
+	}
+
+	if (*name != '-' || !g_ascii_isdigit(name[1]))
+		return false;
+
+	char *endptr;
+	const unsigned long seq = strtoul(name + 1, &endptr, 10);
+	if (strcmp(endptr, s->suffix) != 0)
+		return false;
+
+	*playlist_r = false;
+	*page_r = NULL;
+
+	for (unsigned i = 0; i < s->num_segments; ++i) {
+		if (s->segments[i].seq == seq) {
+			*page_r = s->segments[i].page;
+			page_ref(*page_r);
+			break;
+		}
+	}
+
+	return true;
+}
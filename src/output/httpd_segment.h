@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Cuts the encoded stream of a httpd mount into segments of a few
+ * seconds, for HTTP Live Streaming.  Finished segments and the
+ * playlist are immutable #page objects, which are shared by all
+ * clients requesting them.
+ *
+ * The output thread feeds pages with httpd_segmenter_append() and
+ * httpd_segmenter_set_header(); the functions which access the
+ * segment list must be called while the caller holds the lock which
+ * protects the segmenter (httpd_output::mutex).
+ */
+
+#ifndef MPD_OUTPUT_HTTPD_SEGMENT_H
+#define MPD_OUTPUT_HTTPD_SEGMENT_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct page;
+
+enum {
+	/**
+	 * The number of finished segments which are kept.
+	 */
+	HTTPD_SEGMENTS = 8,
+
+	/**
+	 * The number of segments listed in the playlist.  The older
+	 * ones are kept for a while, for clients which are still
+	 * working with a previous playlist.
+	 */
+	HTTPD_PLAYLIST_SEGMENTS = 5,
+};
+
+struct httpd_segment {
+	/**
+	 * The media sequence number.
+	 */
+	unsigned seq;
+
+	/**
+	 * The duration [milliseconds].
+	 */
+	unsigned duration;
+
+	struct page *page;
+};
+
+struct httpd_segmenter {
+	/**
+	 * The name of the playlist and the segment files, without
+	 * slash and suffix, e.g. "low" for "/low.m3u8" and
+	 * "/low-42.mp3".
+	 */
+	char *name;
+
+	/**
+	 * The file name suffix of the segments, e.g. ".mp3".
+	 */
+	const char *suffix;
+
+	/**
+	 * The configured segment duration [milliseconds].
+	 */
+	unsigned target_duration;
+
+	/**
+	 * The encoder header, which is prepended to each segment, so
+	 * every segment can be decoded on its own.  May be NULL.
+	 * Only accessed by the output thread.
+	 */
+	struct page *header;
+
+	/**
+	 * The segment being assembled, and the stream time
+	 * [milliseconds] of its beginning.  Only accessed by the
+	 * output thread.
+	 */
+	GByteArray *buffer;
+	bool active;
+	uint64_t start_time;
+
+	/**
+	 * The finished segments, oldest first.
+	 */
+	struct httpd_segment segments[HTTPD_SEGMENTS];
+	unsigned num_segments;
+
+	/**
+	 * The sequence number of the next segment.  Only accessed by
+	 * the output thread.
+	 */
+	unsigned next_seq;
+
+	/**
+	 * The current playlist, or NULL if there is no segment yet.
+	 */
+	struct page *playlist;
+};
+
+/**
+ * Returns the segment file name suffix for the specified MIME
+ * type.
+ */
+G_GNUC_PURE
+const char *
+httpd_segment_suffix(const char *mime_type);
+
+void
+httpd_segmenter_init(struct httpd_segmenter *s, const char *name,
+		     const char *suffix, unsigned target_duration);
+
+void
+httpd_segmenter_deinit(struct httpd_segmenter *s);
+
+/**
+ * Replaces the encoder header (the caller's reference is not
+ * consumed).  A new encoder stream begins, therefore the current
+ * segment is finished.
+ *
+ * @param time the current stream time [milliseconds]
+ * @param duration_r the duration of the finished segment
+ * @return the finished segment, to be passed to
+ * httpd_segmenter_push(), or NULL
+ */
+struct page *
+httpd_segmenter_set_header(struct httpd_segmenter *s, struct page *header,
+			   uint64_t time, unsigned *duration_r);
+
+/**
+ * Appends an encoded page.  A segment is finished at the first frame
+ * boundary after the target duration, and the next one begins with
+ * this page.
+ *
+ * @param time the stream time of the page [milliseconds]
+ * @param sync true if the page begins at a frame boundary
+ * @param duration_r the duration of the finished segment
+ * @return the finished segment, to be passed to
+ * httpd_segmenter_push(), or NULL
+ */
+struct page *
+httpd_segmenter_append(struct httpd_segmenter *s, const struct page *page,
+		       uint64_t time, bool sync, unsigned *duration_r);
+
+/**
+ * Publishes a finished segment, and updates the playlist.  Takes
+ * over the caller's reference.  Caller must hold the lock.
+ */
+void
+httpd_segmenter_push(struct httpd_segmenter *s, struct page *page,
+		     unsigned duration);
+
+/**
+ * Looks up the playlist or a segment by its file name (without the
+ * leading slash).  Caller must hold the lock.
+ *
+ * @param page_r on success, a new reference to the page, or NULL if
+ * the segment does not exist (anymore)
+ * @param playlist_r true if the playlist was requested
+ * @return false if the name does not belong to this segmenter
+ */
+bool
+httpd_segmenter_lookup(const struct httpd_segmenter *s, const char *name,
+		       struct page **page_r, bool *playlist_r);
+
+#endif
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * The I/O thread of the httpd output.  It accepts the sockets handed
+ * over by the listener, parses the HTTP requests, and sends the pages
+ * of the #httpd_ring to all clients.  The output thread never waits
+ * for it: it only publishes pages and wakes it up.
+ */
+
+#include "config.h"
+#include "httpd_internal.h"
+#include "httpd_client.h"
+#include "fd_util.h"
+#include "page.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <poll.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "httpd_output"
+
+void
+httpd_thread_kick(struct httpd_output *httpd)
+{
+	static const char dummy = 0;
+	G_GNUC_UNUSED ssize_t nbytes = write(httpd->wake_fds[1], &dummy, 1);
+}
+
+void
+httpd_thread_wake(struct httpd_output *httpd)
+{
+	if (g_atomic_int_compare_and_exchange(&httpd->sleeping, 1, 0))
+		httpd_thread_kick(httpd);
+}
+
+static void
+httpd_thread_drain(struct httpd_output *httpd)
+{
+	char buffer[256];
+	while (read(httpd->wake_fds[0], buffer, sizeof(buffer)) > 0) {}
+}
+
+static void
+httpd_thread_close_client(struct httpd_output *httpd, unsigned i)
+{
+	struct httpd_client *client = g_ptr_array_index(httpd->clients, i);
+
+	g_ptr_array_remove_index_fast(httpd->clients, i);
+	httpd_client_free(client);
+	g_atomic_int_add(&httpd->clients_cnt, -1);
+}
+
+static void
+httpd_thread_close_all(struct httpd_output *httpd)
+{
+	while (httpd->clients->len > 0)
+		httpd_thread_close_client(httpd, httpd->clients->len - 1);
+}
+
+/**
+ * Advances httpd_mount::burst_seq to the oldest page at a frame
+ * boundary which is within the configured burst duration.
+ */
+static void
+httpd_thread_update_burst(const struct httpd_output *httpd,
+			  struct httpd_mount *mount, unsigned stream_start)
+{
+	const struct httpd_ring *ring = &mount->ring;
+	const unsigned head = mount->head;
+	unsigned seq = mount->burst_seq;
+
+	if ((int)(stream_start - seq) > 0)
+		seq = stream_start;
+
+	if (httpd->burst_ms == 0 || (int)(head - seq) <= 0) {
+		mount->burst_seq = head;
+		return;
+	}
+
+	const uint64_t now = httpd_ring_slot(ring, head - 1)->time;
+
+	/* leave enough room in the ring for the clients which are
+	   behind the backlog */
+	const unsigned max_pages = ring->capacity / 2;
+
+	for (; seq != head; ++seq) {
+		const struct httpd_ring_slot *slot =
+			httpd_ring_slot(ring, seq);
+
+		if (slot->sync && now - slot->time <= httpd->burst_ms &&
+		    head - seq <= max_pages)
+			break;
+	}
+
+	mount->burst_seq = seq;
+}
+
+/**
+ * Returns the size of the burst backlog of the mount [bytes].
+ */
+G_GNUC_PURE
+static uint64_t
+httpd_thread_burst_size(const struct httpd_mount *mount)
+{
+	if (mount->burst_seq == mount->head)
+		return 0;
+
+	return httpd_ring_end_offset(&mount->ring, mount->head) -
+		httpd_ring_offset(&mount->ring, mount->burst_seq);
+}
+
+/**
+ * Releases all ring pages of the mount which neither a client nor
+ * the burst backlog needs anymore.
+ */
+static void
+httpd_thread_release(struct httpd_output *httpd, struct httpd_mount *mount)
+{
+	unsigned tail = mount->burst_seq;
+
+	for (unsigned i = 0; i < httpd->clients->len; ++i) {
+		const struct httpd_client *client =
+			g_ptr_array_index(httpd->clients, i);
+		if (httpd_client_get_mount(client) != mount)
+			continue;
+
+		unsigned cursor = httpd_client_cursor(client);
+		if ((int)(cursor - tail) < 0)
+			tail = cursor;
+	}
+
+	if (tail != httpd_ring_tail(&mount->ring))
+		httpd_ring_release(&mount->ring, tail);
+}
+
+/**
+ * Sends pending data to all clients.
+ *
+ * @param skip_to the httpd_mount::skip_to values of all mounts, or
+ * NULL if nothing needs to be skipped
+ */
+static void
+httpd_thread_flush(struct httpd_output *httpd, const unsigned *skip_to,
+		   struct page *metadata)
+{
+	/* iterate backwards, because httpd_thread_close_client()
+	   moves the last client to the current position */
+	for (unsigned i = httpd->clients->len; i-- > 0;) {
+		struct httpd_client *client =
+			g_ptr_array_index(httpd->clients, i);
+		const struct httpd_mount *mount =
+			httpd_client_get_mount(client);
+
+		if (metadata != NULL)
+			httpd_client_send_metadata(client, metadata);
+
+		if (mount != NULL) {
+			if (skip_to != NULL)
+				httpd_client_cancel(client,
+						    skip_to[mount - httpd->mounts]);
+
+			/* clients which are still receiving the burst
+			   backlog are not considered slow; the page
+			   limit (the backlog uses at most half of the
+			   ring) keeps a quarter of the ring free, so
+			   slow clients never make it overflow */
+			const uint64_t burst_size =
+				httpd_thread_burst_size(mount);
+			const unsigned burst_pages =
+				mount->head - mount->burst_seq;
+			const unsigned capacity = mount->ring.capacity;
+			httpd_client_check_queue(client,
+						 httpd->max_client_queue +
+						 burst_size,
+						 httpd->max_client_queue / 2 +
+						 burst_size,
+						 burst_pages + capacity / 4,
+						 burst_pages + capacity / 8);
+		}
+
+		if (!httpd_client_write(client))
+			httpd_thread_close_client(httpd, i);
+	}
+
+	for (unsigned i = 0; i < httpd->num_mounts; ++i)
+		httpd_thread_release(httpd, &httpd->mounts[i]);
+}
+
+/**
+ * Answers a request from httpd_output_stats().
+ */
+static void
+httpd_thread_stats(struct httpd_output *httpd)
+{
+	GString *s = g_string_new(NULL);
+
+	g_string_append_printf(s, "listeners: %u\n", httpd->clients->len);
+
+	for (unsigned i = 0; i < httpd->clients->len; ++i)
+		httpd_client_stats(g_ptr_array_index(httpd->clients, i), s);
+
+	g_mutex_lock(httpd->mutex);
+	g_free(httpd->stats);
+	httpd->stats = g_string_free(s, false);
+	httpd->stats_requested = false;
+	g_cond_broadcast(httpd->cond);
+	g_mutex_unlock(httpd->mutex);
+}
+
+/**
+ * Has the output thread published pages which were not yet seen in
+ * this iteration?
+ */
+G_GNUC_PURE
+static bool
+httpd_thread_has_new_pages(const struct httpd_output *httpd)
+{
+	for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+		const struct httpd_mount *mount = &httpd->mounts[i];
+
+		if (httpd_ring_head(&mount->ring) != mount->head)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Waits for socket events, and handles them.
+ */
+static void
+httpd_thread_poll(struct httpd_output *httpd, GArray *pollfds)
+{
+	GPtrArray *clients = httpd->clients;
+
+	g_array_set_size(pollfds, 1 + clients->len);
+	struct pollfd *pfd = &g_array_index(pollfds, struct pollfd, 0);
+
+	pfd[0].fd = httpd->wake_fds[0];
+	pfd[0].events = POLLIN;
+
+	for (unsigned i = 0; i < clients->len; ++i) {
+		const struct httpd_client *client =
+			g_ptr_array_index(clients, i);
+
+		pfd[i + 1].fd = httpd_client_get_fd(client);
+		pfd[i + 1].events = httpd_client_poll_events(client);
+	}
+
+	/* announce that we're going to sleep; if the output thread
+	   has published a page meanwhile, don't sleep at all */
+	g_atomic_int_set(&httpd->sleeping, 1);
+	const int timeout = httpd_thread_has_new_pages(httpd) ? 0 : -1;
+
+	int ret = poll(pfd, pollfds->len, timeout);
+	g_atomic_int_set(&httpd->sleeping, 0);
+
+	if (ret < 0) {
+		if (errno != EINTR)
+			g_warning("poll() failed: %s", g_strerror(errno));
+		return;
+	}
+
+	if (pfd[0].revents != 0)
+		httpd_thread_drain(httpd);
+
+	for (unsigned i = clients->len; i-- > 0;) {
+		struct httpd_client *client = g_ptr_array_index(clients, i);
+		const short revents = pfd[i + 1].revents;
+
+		if (revents & POLLOUT)
+			httpd_client_writable(client);
+
+		if ((revents & (POLLIN|POLLERR|POLLHUP)) != 0 &&
+		    !httpd_client_read(client))
+			httpd_thread_close_client(httpd, i);
+	}
+}
+
+static gpointer
+httpd_thread(gpointer data)
+{
+	struct httpd_output *httpd = data;
+	GArray *pollfds = g_array_new(false, false, sizeof(struct pollfd));
+
+	/* copies of httpd_mount::skip_to and
+	   httpd_mount::stream_start, made while the mutex is held */
+	unsigned *skip_to = g_new(unsigned, httpd->num_mounts);
+	unsigned *stream_start = g_new(unsigned, httpd->num_mounts);
+
+	g_mutex_lock(httpd->mutex);
+	unsigned skip_serial = httpd->skip_serial;
+	unsigned metadata_serial = httpd->metadata_serial;
+	g_mutex_unlock(httpd->mutex);
+
+	while (true) {
+		g_mutex_lock(httpd->mutex);
+
+		if (httpd->quit) {
+			/* don't let httpd_output_stats() wait
+			   forever */
+			httpd->stats_requested = false;
+			g_cond_broadcast(httpd->cond);
+
+			g_mutex_unlock(httpd->mutex);
+			break;
+		}
+
+		const bool stats_requested = httpd->stats_requested;
+
+		GSList *pending = httpd->pending;
+		httpd->pending = NULL;
+
+		const bool skip = httpd->skip_serial != skip_serial;
+		skip_serial = httpd->skip_serial;
+
+		for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+			skip_to[i] = httpd->mounts[i].skip_to;
+			stream_start[i] = httpd->mounts[i].stream_start;
+		}
+
+		/* the metadata is passed to new clients, and to all
+		   clients when it has changed */
+		struct page *metadata = NULL;
+		const bool metadata_changed =
+			httpd->metadata_serial != metadata_serial;
+		metadata_serial = httpd->metadata_serial;
+		if (httpd->metadata != NULL &&
+		    (metadata_changed || pending != NULL)) {
+			metadata = httpd->metadata;
+			page_ref(metadata);
+		}
+
+		g_mutex_unlock(httpd->mutex);
+
+		for (GSList *i = pending; i != NULL; i = i->next) {
+			struct httpd_client *client =
+				httpd_client_new(httpd,
+						 GPOINTER_TO_INT(i->data));
+			if (metadata != NULL && !metadata_changed)
+				httpd_client_send_metadata(client, metadata);
+
+			g_ptr_array_add(httpd->clients, client);
+		}
+
+		g_slist_free(pending);
+
+		for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+			struct httpd_mount *mount = &httpd->mounts[i];
+
+			mount->head = httpd_ring_head(&mount->ring);
+			httpd_thread_update_burst(httpd, mount,
+						  stream_start[i]);
+		}
+
+		httpd_thread_flush(httpd, skip ? skip_to : NULL,
+				   metadata_changed ? metadata : NULL);
+
+		if (metadata != NULL)
+			page_unref(metadata);
+
+		if (stats_requested)
+			httpd_thread_stats(httpd);
+
+		httpd_thread_poll(httpd, pollfds);
+	}
+
+	httpd_thread_close_all(httpd);
+	g_free(stream_start);
+	g_free(skip_to);
+	g_array_free(pollfds, true);
+	return NULL;
+}
+
+bool
+httpd_thread_start(struct httpd_output *httpd, GError **error_r)
+{
+	assert(httpd->thread == NULL);
+
+	if (pipe_cloexec_nonblock(httpd->wake_fds) < 0) {
+		g_set_error(error_r, g_file_error_quark(), errno,
+			    "Failed to create pipe: %s", g_strerror(errno));
+		return false;
+	}
+
+	httpd->quit = false;
+	httpd->stats_requested = false;
+	httpd->sleeping = 0;
+	httpd->pending = NULL;
+	httpd->clients = g_ptr_array_new();
+
+	for (unsigned i = 0; i < httpd->num_mounts; ++i) {
+		struct httpd_mount *mount = &httpd->mounts[i];
+
+		mount->head = mount->burst_seq =
+			httpd_ring_head(&mount->ring);
+	}
+
+	httpd->thread = g_thread_create(httpd_thread, httpd, true, error_r);
+	if (httpd->thread == NULL) {
+		g_ptr_array_free(httpd->clients, true);
+		close(httpd->wake_fds[0]);
+		close(httpd->wake_fds[1]);
+		return false;
+	}
+
+	return true;
+}
+
+void
+httpd_thread_stop(struct httpd_output *httpd)
+{
+	assert(httpd->thread != NULL);
+
+	g_mutex_lock(httpd->mutex);
+	httpd->quit = true;
+	g_mutex_unlock(httpd->mutex);
+
+	httpd_thread_kick(httpd);
+	g_thread_join(httpd->thread);
+	httpd->thread = NULL;
+
+	/* close the sockets which were accepted while the thread was
+	   shutting down */
+	for (GSList *i = httpd->pending; i != NULL; i = i->next) {
+		close_socket(GPOINTER_TO_INT(i->data));
+		g_atomic_int_add(&httpd->clients_cnt, -1);
+	}
+
+	g_slist_free(httpd->pending);
+	httpd->pending = NULL;
+
+	g_ptr_array_free(httpd->clients, true);
+	close(httpd->wake_fds[0]);
+	close(httpd->wake_fds[1]);
+}
@@ -21,6 +21,10 @@
 #include "pipe_output_plugin.h"
 #include "output_api.h"
 
+#ifndef WIN32
+#include "pipe_writer.h"
+#endif
+
 #include <stdio.h>
 #include <errno.h>
 
@@ -29,6 +33,20 @@ struct pipe_output {
 
 	char *cmd;
 	FILE *fh;
+
+#ifndef WIN32
+	/**
+	 * The configured size of the ring buffer [bytes]; 0 means
+	 * the output thread writes to the pipe directly.
+	 */
+	size_t buffer_size;
+
+	/**
+	 * Writes to the pipe on behalf of the output thread, if
+	 * #buffer_size is set.
+	 */
+	struct pipe_writer *writer;
+#endif
 };
 
 /**
@@ -58,6 +76,12 @@ pipe_output_init(const struct config_param *param,
 		return NULL;
 	}
 
+#ifndef WIN32
+	pd->buffer_size =
+		config_get_block_unsigned(param, "buffer_size", 0) * 1024;
+	pd->writer = NULL;
+#endif
+
 	return &pd->base;
 }
 
@@ -86,6 +110,19 @@ pipe_output_open(struct audio_output *ao,
 		return false;
 	}
 
+#ifndef WIN32
+	if (pd->buffer_size > 0) {
+		/* the command gets all data; if it is too slow,
+		   pipe_output_play() waits for room in the ring */
+		pd->writer = pipe_writer_new(fileno(pd->fh), -1,
+					     pd->buffer_size, error);
+		if (pd->writer == NULL) {
+			pclose(pd->fh);
+			return false;
+		}
+	}
+#endif
+
 	return true;
 }
 
@@ -94,15 +131,46 @@ pipe_output_close(struct audio_output *ao)
 {
 	struct pipe_output *pd = (struct pipe_output *)ao;
 
+#ifndef WIN32
+	if (pd->writer != NULL) {
+		GError *error = NULL;
+		if (!pipe_writer_drain(pd->writer, &error)) {
+			g_warning("%s", error->message);
+			g_error_free(error);
+		}
+
+		pipe_writer_free(pd->writer);
+		pd->writer = NULL;
+	}
+#endif
+
 	pclose(pd->fh);
 }
 
+#ifndef WIN32
+static void
+pipe_output_cancel(struct audio_output *ao)
+{
+	struct pipe_output *pd = (struct pipe_output *)ao;
+
+	if (pd->writer != NULL)
+		pipe_writer_cancel(pd->writer);
+}
+#endif
+
 static size_t
 pipe_output_play(struct audio_output *ao, const void *chunk, size_t size, GError **error)
 {
 	struct pipe_output *pd = (struct pipe_output *)ao;
 	size_t ret;
 
+#ifndef WIN32
+	if (pd->writer != NULL)
+		return pipe_writer_append(pd->writer, chunk, size, error)
+			? size
+			: 0;
+#endif
+
 	ret = fwrite(chunk, 1, size, pd->fh);
 	if (ret == 0)
 		g_set_error(error, pipe_output_quark(), errno,
@@ -118,4 +186,7 @@ const struct audio_output_plugin pipe_output_plugin = {
 	.open = pipe_output_open,
 	.close = pipe_output_close,
 	.play = pipe_output_play,
+#ifndef WIN32
+	.cancel = pipe_output_cancel,
+#endif
 };
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_VMSPLICE
+#define _GNU_SOURCE 1
+#endif
+
+#include "pipe_writer.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#ifdef HAVE_VMSPLICE
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "pipe_writer"
+
+/**
+ * The pipe capacity which is assumed if the kernel cannot tell
+ * (Linux >= 2.6.11).
+ */
+#define PIPE_WRITER_DEFAULT_PIPE_SIZE 65536
+
+/**
+ * How often the writer thread checks for commands while the pipe is
+ * full [milliseconds].
+ */
+#define PIPE_WRITER_POLL_INTERVAL 100
+
+struct pipe_writer {
+	int fd;
+
+	/**
+	 * The read end of the pipe, for dropping stale data; -1 if
+	 * the writer shall never drop data.
+	 */
+	int drain_fd;
+
+	unsigned char *buffer;
+	size_t size;
+
+	/**
+	 * The capacity of the pipe [bytes].
+	 */
+	size_t pipe_size;
+
+	GThread *thread;
+
+	/**
+	 * Protects all of the following attributes.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Signalled whenever #head or #tail has moved, or a command
+	 * was given to the writer thread.
+	 */
+	GCond *cond;
+
+	/**
+	 * Is vmsplice() being used?  It is disabled when the kernel
+	 * rejects it for this file descriptor.
+	 */
+	bool splice;
+
+	/**
+	 * The number of bytes copied into the ring, and the number of
+	 * bytes written to the pipe (or discarded).  The ring
+	 * position is the stream position modulo #size.
+	 */
+	uint64_t head, tail;
+
+	/**
+	 * Commands to the writer thread: discard the data which has
+	 * not been written yet; additionally read stale data from the
+	 * pipe; exit.
+	 */
+	bool discard, overflow, quit;
+
+	/**
+	 * Set by the writer thread when writing has failed.
+	 */
+	GError *error;
+
+	uint64_t dropped;
+};
+
+/**
+ * The quark used for GError.domain.
+ */
+static inline GQuark
+pipe_writer_quark(void)
+{
+	return g_quark_from_static_string("pipe_writer");
+}
+
+/**
+ * Returns the number of bytes which may be copied into the ring now.
+ * Caller must hold the lock.
+ */
+G_GNUC_PURE
+static size_t
+pipe_writer_available(const struct pipe_writer *w)
+{
+	uint64_t released = w->tail;
+
+	if (w->splice)
+		/* the pipe may still refer to the most recent
+		   pipe_size bytes */
+		released = released > w->pipe_size
+			? released - w->pipe_size
+			: 0;
+
+	assert(w->head - released <= w->size);
+
+	return w->size - (size_t)(w->head - released);
+}
+
+/**
+ * Writes a portion of the ring to the pipe.  Sets *splice_r to false
+ * if vmsplice() is not supported for this file descriptor.
+ */
+static ssize_t
+pipe_writer_write(int fd, const void *data, size_t length,
+		  bool *splice_r)
+{
+#ifdef HAVE_VMSPLICE
+	if (*splice_r) {
+		struct iovec iov = {
+			.iov_base = (void *)data,
+			.iov_len = length,
+		};
+
+		ssize_t nbytes = vmsplice(fd, &iov, 1, SPLICE_F_NONBLOCK);
+		if (nbytes >= 0 || (errno != EINVAL && errno != ENOSYS))
+			return nbytes;
+
+		/* not a pipe, or not supported by the kernel */
+		*splice_r = false;
+	}
+#else
+	(void)splice_r;
+#endif
+
+	return write(fd, data, length);
+}
+
+/**
+ * Reads everything which is in the pipe, because the reader does not
+ * keep up with the stream.
+ */
+static void
+pipe_writer_flush_pipe(const struct pipe_writer *w)
+{
+	char buffer[16384];
+	ssize_t nbytes;
+
+	do {
+		nbytes = read(w->drain_fd, buffer, sizeof(buffer));
+	} while (nbytes > 0 || (nbytes < 0 && errno == EINTR));
+
+	if (nbytes < 0 && errno != EAGAIN)
+		g_warning("Flush of pipe failed: %s", g_strerror(errno));
+}
+
+static gpointer
+pipe_writer_thread(gpointer data)
+{
+	struct pipe_writer *w = data;
+
+	g_mutex_lock(w->mutex);
+
+	while (!w->quit) {
+		if (w->overflow) {
+			w->overflow = false;
+			w->discard = true;
+
+			g_mutex_unlock(w->mutex);
+			pipe_writer_flush_pipe(w);
+			g_mutex_lock(w->mutex);
+		}
+
+		if (w->discard) {
+			w->discard = false;
+			w->tail = w->head;
+			g_cond_broadcast(w->cond);
+		}
+
+		if (w->error != NULL || w->tail == w->head) {
+			g_cond_wait(w->cond, w->mutex);
+			continue;
+		}
+
+		/* the data between tail and head is not modified by
+		   the producer, so it is written without holding the
+		   lock */
+		const size_t offset = w->tail % w->size;
+		const size_t length = MIN(w->head - w->tail, w->size - offset);
+		bool splice = w->splice;
+
+		g_mutex_unlock(w->mutex);
+
+		ssize_t nbytes = pipe_writer_write(w->fd, w->buffer + offset,
+						   length, &splice);
+		const int e = errno;
+		if (nbytes < 0 && e == EAGAIN) {
+			/* the pipe is full: wait for the reader */
+			struct pollfd pfd = {
+				.fd = w->fd,
+				.events = POLLOUT,
+			};
+
+			poll(&pfd, 1, PIPE_WRITER_POLL_INTERVAL);
+			nbytes = 0;
+		}
+
+		g_mutex_lock(w->mutex);
+
+		w->splice = splice;
+
+		if (nbytes < 0) {
+			if (e != EINTR)
+				g_set_error(&w->error, pipe_writer_quark(), e,
+					    "Failed to write to pipe: %s",
+					    g_strerror(e));
+			g_cond_broadcast(w->cond);
+			continue;
+		}
+
+		if (nbytes > 0) {
+			w->tail += nbytes;
+			g_cond_broadcast(w->cond);
+		}
+	}
+
+	g_mutex_unlock(w->mutex);
+	return NULL;
+}
+
+struct pipe_writer *
+pipe_writer_new(int fd, int drain_fd, size_t size, GError **error_r)
+{
+	assert(fd >= 0);
+	assert(size > 0);
+
+	struct pipe_writer *w = g_new(struct pipe_writer, 1);
+	w->fd = fd;
+	w->drain_fd = drain_fd;
+	w->pipe_size = PIPE_WRITER_DEFAULT_PIPE_SIZE;
+
+#ifdef HAVE_VMSPLICE
+	w->splice = true;
+
+#ifdef F_GETPIPE_SZ
+	int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+	if (pipe_size > 0)
+		w->pipe_size = pipe_size;
+#endif
+
+	if (size < 2 * w->pipe_size)
+		size = 2 * w->pipe_size;
+
+	/* the pages may outlive this object, as long as the pipe
+	   refers to them; unlike malloc(), munmap() never passes
+	   them to somebody else */
+	w->buffer = mmap(NULL, size, PROT_READ|PROT_WRITE,
+			 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (w->buffer == MAP_FAILED) {
+		g_set_error(error_r, pipe_writer_quark(), errno,
+			    "Failed to allocate the pipe buffer: %s",
+			    g_strerror(errno));
+		g_free(w);
+		return NULL;
+	}
+#else
+	w->splice = false;
+	w->buffer = g_malloc(size);
+#endif
+
+	w->size = size;
+	w->head = w->tail = 0;
+	w->discard = w->overflow = w->quit = false;
+	w->error = NULL;
+	w->dropped = 0;
+
+	/* the writer thread waits with poll(), so it notices commands
+	   while the pipe is full */
+	const int flags = fcntl(fd, F_GETFL);
+	if (flags >= 0)
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+	w->mutex = g_mutex_new();
+	w->cond = g_cond_new();
+
+	w->thread = g_thread_create(pipe_writer_thread, w, true, error_r);
+	if (w->thread == NULL) {
+		g_cond_free(w->cond);
+		g_mutex_free(w->mutex);
+#ifdef HAVE_VMSPLICE
+		munmap(w->buffer, w->size);
+#else
+		g_free(w->buffer);
+#endif
+		g_free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+void
+pipe_writer_free(struct pipe_writer *w)
+{
+	g_mutex_lock(w->mutex);
+	w->quit = true;
+	g_cond_broadcast(w->cond);
+	g_mutex_unlock(w->mutex);
+
+	g_thread_join(w->thread);
+
+	if (w->error != NULL)
+		g_error_free(w->error);
+
+	g_cond_free(w->cond);
+	g_mutex_free(w->mutex);
+#ifdef HAVE_VMSPLICE
+	munmap(w->buffer, w->size);
+#else
+	g_free(w->buffer);
+#endif
+	g_free(w);
+}
+
+/**
+ * Copies data into the free part of the ring, which is not accessed
+ * by the writer thread.
+ */
+static void
+pipe_writer_copy(struct pipe_writer *w, uint64_t position,
+		 const unsigned char *data, size_t length)
+{
+	const size_t offset = position % w->size;
+	const size_t first = MIN(length, w->size - offset);
+
+	memcpy(w->buffer + offset, data, first);
+	memcpy(w->buffer, data + first, length - first);
+}
+
+bool
+pipe_writer_append(struct pipe_writer *w, const void *data, size_t length,
+		   GError **error_r)
+{
+	const unsigned char *p = data;
+
+	g_mutex_lock(w->mutex);
+
+	while (length > 0) {
+		if (w->error != NULL) {
+			g_propagate_error(error_r, g_error_copy(w->error));
+			g_mutex_unlock(w->mutex);
+			return false;
+		}
+
+		size_t n = pipe_writer_available(w);
+		if (n < length && w->drain_fd >= 0) {
+			/* the reader does not keep up: drop this
+			   chunk, and let the writer thread start
+			   over with fresh data */
+			w->overflow = true;
+			w->dropped += length;
+			g_cond_broadcast(w->cond);
+			break;
+		}
+
+		if (n == 0) {
+			g_cond_wait(w->cond, w->mutex);
+			continue;
+		}
+
+		if (n > length)
+			n = length;
+
+		const uint64_t position = w->head;
+		g_mutex_unlock(w->mutex);
+		pipe_writer_copy(w, position, p, n);
+		g_mutex_lock(w->mutex);
+
+		w->head += n;
+		g_cond_broadcast(w->cond);
+
+		p += n;
+		length -= n;
+	}
+
+	g_mutex_unlock(w->mutex);
+	return true;
+}
+
+bool
+pipe_writer_drain(struct pipe_writer *w, GError **error_r)
+{
+	g_mutex_lock(w->mutex);
+
+	while (w->tail != w->head && w->error == NULL)
+		g_cond_wait(w->cond, w->mutex);
+
+	const bool success = w->error == NULL;
+	if (!success)
+		g_propagate_error(error_r, g_error_copy(w->error));
+
+	g_mutex_unlock(w->mutex);
+	return success;
+}
+
+void
+pipe_writer_cancel(struct pipe_writer *w)
+{
+	g_mutex_lock(w->mutex);
+	w->discard = true;
+	g_cond_broadcast(w->cond);
+	g_mutex_unlock(w->mutex);
+}
+
+uint64_t
+pipe_writer_dropped(struct pipe_writer *w)
+{
+	g_mutex_lock(w->mutex);
+	const uint64_t dropped = w->dropped;
+	g_mutex_unlock(w->mutex);
+	return dropped;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A ring buffer with a dedicated writer thread, which feeds a pipe
+ * or a FIFO.  The output thread copies PCM data into the ring, and
+ * returns immediately as long as there is room; a slow reader on the
+ * other end of the pipe does not delay it.
+ *
+ * Where available, the writer thread uses vmsplice(), which passes
+ * the pages of the ring to the pipe instead of copying them.  The
+ * pipe keeps referring to these pages until the reader has consumed
+ * them, therefore the most recent pipe-size bytes of the ring are
+ * not reused before more data has been written after them.
+ */
+
+#ifndef MPD_OUTPUT_PIPE_WRITER_H
+#define MPD_OUTPUT_PIPE_WRITER_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct pipe_writer;
+
+/**
+ * Creates the ring and starts the writer thread.  The file
+ * descriptor is switched to non-blocking mode; it remains owned by
+ * the caller.
+ *
+ * @param fd the write end of the pipe
+ * @param drain_fd if this is a valid file descriptor (the read end
+ * of the pipe), then the writer drops data instead of waiting for a
+ * reader: when the ring overflows, everything which was not read yet
+ * is discarded, and stale data is read from the pipe; pass -1 to let
+ * pipe_writer_append() wait for room instead
+ * @param size the size of the ring [bytes]; it is enlarged to at
+ * least twice the pipe size if vmsplice() is used
+ */
+struct pipe_writer *
+pipe_writer_new(int fd, int drain_fd, size_t size, GError **error_r);
+
+/**
+ * Stops the writer thread, and frees the ring.  Data which has not
+ * been written yet is discarded.
+ */
+void
+pipe_writer_free(struct pipe_writer *w);
+
+/**
+ * Copies data into the ring.  If there is not enough room, this
+ * either waits for the writer thread, or drops the data (see
+ * pipe_writer_new()).
+ *
+ * @return false if the writer thread has failed
+ */
+bool
+pipe_writer_append(struct pipe_writer *w, const void *data, size_t length,
+		   GError **error_r);
+
+/**
+ * Waits until all data in the ring has been written to the pipe.
+ *
+ * @return false if the writer thread has failed
+ */
+bool
+pipe_writer_drain(struct pipe_writer *w, GError **error_r);
+
+/**
+ * Discards all data which has not been written to the pipe yet.
+ */
+void
+pipe_writer_cancel(struct pipe_writer *w);
+
+/**
+ * Returns the number of bytes which were dropped because the ring
+ * overflowed.
+ */
+uint64_t
+pipe_writer_dropped(struct pipe_writer *w);
+
+#endif
@@ -18,22 +18,96 @@
  */
 
 #include "config.h"
+
+#ifdef HAVE_FALLOCATE
+#define _GNU_SOURCE 1
+#endif
+
 #include "recorder_output_plugin.h"
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
 #include "fd_util.h"
 #include "open.h"
+#include "page.h"
+#include "clock.h"
 
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "recorder"
 
+/**
+ * The default value of the "max_queue" setting [bytes].
+ */
+#define RECORDER_DEFAULT_MAX_QUEUE (4 * 1024 * 1024)
+
+/**
+ * The writer thread collects queued data into chunks of up to this
+ * size before it calls write() [bytes].
+ */
+#define RECORDER_WRITE_SIZE (256 * 1024)
+
+/**
+ * An item in the queue between the output thread and the writer
+ * thread.
+ */
+struct recorder_block {
+	/**
+	 * Encoded data which is appended to the current file, or NULL
+	 * if the writer thread shall switch to a new file.
+	 */
+	struct page *page;
+
+	/**
+	 * The name of the new file if #page is NULL.  Allocated with
+	 * g_malloc().
+	 */
+	char *path;
+};
+
+/**
+ * The file which is being written by the writer thread.
+ */
+struct recorder_file {
+	int fd;
+
+	/**
+	 * The file name, for error messages.  Allocated with
+	 * g_malloc().
+	 */
+	char *path;
+
+	/**
+	 * The number of bytes written to this file.
+	 */
+	uint64_t position;
+
+	/**
+	 * The end of the disk space which was reserved with
+	 * fallocate().
+	 */
+	uint64_t allocated;
+
+	/**
+	 * Has data been written since the last fdatasync()?
+	 */
+	bool dirty;
+
+	/**
+	 * When shall the next fdatasync() be called [monotonic
+	 * milliseconds]?  Only valid if #dirty is set.
+	 */
+	unsigned sync_at;
+};
+
 struct recorder_output {
 	struct audio_output base;
 
@@ -43,14 +117,130 @@ struct recorder_output {
 	struct encoder *encoder;
 
 	/**
-	 * The destination file name.
+	 * The destination file name.  It may contain strftime()
+	 * conversions, which are expanded whenever a file is created.
 	 */
 	const char *path;
 
 	/**
-	 * The destination file descriptor.
+	 * Start a new file at every multiple of this duration since
+	 * the epoch [seconds]; 0 disables time based rotation.
 	 */
-	int fd;
+	unsigned rotate_time;
+
+	/**
+	 * Start a new file when the current one has reached this size
+	 * [bytes]; 0 disables size based rotation.
+	 */
+	uint64_t rotate_size;
+
+	/**
+	 * Flush written data to the disk at most this often [seconds];
+	 * 0 leaves this to the kernel.
+	 */
+	unsigned sync_interval;
+
+	/**
+	 * Reserve disk space in steps of this size [bytes]; 0
+	 * disables preallocation.
+	 */
+	size_t preallocate;
+
+	/**
+	 * The maximum amount of encoded data which may wait for the
+	 * writer thread [bytes].  When the disk does not keep up,
+	 * new data is dropped.
+	 */
+	size_t max_queue;
+
+	/**
+	 * The audio format negotiated with the encoder.  It is needed
+	 * for reopening the encoder when a new file is started.
+	 */
+	struct audio_format audio_format;
+
+	/**
+	 * Is the encoder open?  This is false after reopening it
+	 * during a rotation has failed.
+	 */
+	bool encoder_open;
+
+	/**
+	 * The current rotation period, i.e. the time divided by
+	 * #rotate_time.
+	 */
+	time_t period;
+
+	/**
+	 * The name of the current file, as expanded by the output
+	 * thread.
+	 */
+	char *file_path;
+
+	/**
+	 * The number of bytes passed to the writer thread for the
+	 * current file.
+	 */
+	uint64_t file_size;
+
+	/**
+	 * The writer thread's file.  It is owned by the writer thread
+	 * while it runs.
+	 */
+	struct recorder_file file;
+
+	GThread *thread;
+
+	/**
+	 * Protects all of the following attributes.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Signalled when the queue has grown, or when the writer
+	 * thread shall exit.
+	 */
+	GCond *cond;
+
+	/**
+	 * A queue of #recorder_block objects.
+	 */
+	GQueue *queue;
+
+	/**
+	 * The total size of all pages in #queue, including the pages
+	 * which are currently being written [bytes].
+	 */
+	size_t queue_size;
+
+	/**
+	 * Tells the writer thread to exit after the queue has been
+	 * written.
+	 */
+	bool quit;
+
+	/**
+	 * Set by the writer thread when writing to the file has
+	 * failed.  It is reported by the next play() call.
+	 */
+	GError *error;
+
+	/**
+	 * Is the queue full?  Used to count each overflow only once.
+	 */
+	bool overflow;
+
+	/**
+	 * The number of files created since the output was opened.
+	 */
+	unsigned files;
+
+	/**
+	 * How often has the queue overflowed, and how many bytes
+	 * were dropped?
+	 */
+	unsigned drops;
+	uint64_t dropped;
 
 	/**
 	 * The buffer for encoder_read().
@@ -96,12 +286,48 @@ recorder_output_init(const struct config_param *param, GError **error_r)
 		goto failure;
 	}
 
+	recorder->rotate_time =
+		config_get_block_unsigned(param, "rotate_time", 0);
+	recorder->rotate_size = (uint64_t)
+		config_get_block_unsigned(param, "rotate_size", 0) * 1024;
+
+	if ((recorder->rotate_time > 0 || recorder->rotate_size > 0) &&
+	    strchr(recorder->path, '%') == NULL) {
+		g_set_error(error_r, recorder_output_quark(), 0,
+			    "'path' must contain strftime() conversions "
+			    "when 'rotate_time' or 'rotate_size' is set");
+		goto failure;
+	}
+
+	recorder->sync_interval =
+		config_get_block_unsigned(param, "sync_interval", 0);
+	recorder->preallocate =
+		config_get_block_unsigned(param, "preallocate", 0) * 1024;
+
+	recorder->max_queue =
+		config_get_block_unsigned(param, "max_queue",
+					  RECORDER_DEFAULT_MAX_QUEUE / 1024)
+		* 1024;
+	if (recorder->max_queue == 0) {
+		g_set_error(error_r, recorder_output_quark(), 0,
+			    "max_queue must not be zero");
+		goto failure;
+	}
+
 	/* initialize encoder */
 
 	recorder->encoder = encoder_init(encoder_plugin, param, error_r);
 	if (recorder->encoder == NULL)
 		goto failure;
 
+	recorder->mutex = g_mutex_new();
+	recorder->cond = g_cond_new();
+	recorder->queue = g_queue_new();
+	recorder->queue_size = 0;
+	recorder->files = 0;
+	recorder->drops = 0;
+	recorder->dropped = 0;
+
 	return &recorder->base;
 
 failure:
@@ -115,20 +341,46 @@ recorder_output_finish(struct audio_output *ao)
 {
 	struct recorder_output *recorder = (struct recorder_output *)ao;
 
+	g_queue_free(recorder->queue);
+	g_cond_free(recorder->cond);
+	g_mutex_free(recorder->mutex);
+
 	encoder_finish(recorder->encoder);
 	ao_base_finish(&recorder->base);
 	g_free(recorder);
 }
 
+/**
+ * Expands the strftime() conversions in the configured path.
+ *
+ * @return the file name, to be freed with g_free()
+ */
+static char *
+recorder_format_path(const struct recorder_output *recorder, time_t t)
+{
+#ifdef G_OS_WIN32
+	const struct tm *tm2 = localtime(&t);
+#else
+	struct tm tm;
+	const struct tm *tm2 = localtime_r(&t, &tm);
+#endif
+	if (tm2 == NULL)
+		return g_strdup(recorder->path);
+
+	char buffer[4096];
+	if (strftime(buffer, sizeof(buffer), recorder->path, tm2) == 0)
+		return g_strdup(recorder->path);
+
+	return g_strdup(buffer);
+}
+
 static bool
-recorder_write_to_file(struct recorder_output *recorder,
+recorder_write_to_file(int fd, const char *path,
 		       const void *_data, size_t length,
 		       GError **error_r)
 {
 	assert(length > 0);
 
-	const int fd = recorder->fd;
-
 	const uint8_t *data = (const uint8_t *)_data, *end = data + length;
 
 	while (true) {
@@ -145,35 +397,414 @@ recorder_write_to_file(struct recorder_output *recorder,
 		} else if (errno != EINTR) {
 			g_set_error(error_r, recorder_output_quark(), 0,
 				    "Failed to write to '%s': %s",
-				    recorder->path, g_strerror(errno));
+				    path, g_strerror(errno));
 			return false;
 		}
 	}
 }
 
 /**
- * Writes pending data from the encoder to the output file.
+ * Flushes the file contents to the disk.  Called by the writer
+ * thread.
+ */
+static void
+recorder_file_sync(struct recorder_file *file)
+{
+#ifndef G_OS_WIN32
+#ifdef HAVE_FDATASYNC
+	if (fdatasync(file->fd) < 0)
+#else
+	if (fsync(file->fd) < 0)
+#endif
+		g_warning("Failed to sync '%s': %s",
+			  file->path, g_strerror(errno));
+#endif
+
+	file->dirty = false;
+}
+
+/**
+ * Reserves disk space for the data which is about to be written, so
+ * the file does not get fragmented.  FALLOC_FL_KEEP_SIZE leaves the
+ * file size alone, i.e. the file is still valid if MPD stops
+ * unexpectedly.
+ */
+static void
+recorder_file_preallocate(struct recorder_file *file, size_t step,
+			  size_t length)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	if (step == 0 || file->position + length <= file->allocated)
+		return;
+
+	if (step < file->position + length - file->allocated)
+		step = file->position + length - file->allocated;
+
+	if (fallocate(file->fd, FALLOC_FL_KEEP_SIZE,
+		      file->allocated, step) == 0)
+		file->allocated += step;
+	else
+		/* not supported by this file system: don't try
+		   again */
+		file->allocated = UINT64_MAX;
+#else
+	(void)file;
+	(void)step;
+	(void)length;
+#endif
+}
+
+/**
+ * Writes a chunk to the current file.  Called by the writer thread.
+ */
+static bool
+recorder_file_write(struct recorder_output *recorder,
+		    const void *data, size_t length, GError **error_r)
+{
+	struct recorder_file *file = &recorder->file;
+
+	recorder_file_preallocate(file, recorder->preallocate, length);
+
+	if (!recorder_write_to_file(file->fd, file->path, data, length,
+				    error_r))
+		return false;
+
+	file->position += length;
+
+	if (!file->dirty) {
+		file->dirty = true;
+		file->sync_at = monotonic_clock_ms() +
+			recorder->sync_interval * 1000;
+	}
+
+	return true;
+}
+
+/**
+ * Closes the current file.  Called by the writer thread.
  */
+static void
+recorder_file_close(struct recorder_output *recorder)
+{
+	struct recorder_file *file = &recorder->file;
+
+	if (file->fd >= 0) {
+		if (recorder->sync_interval > 0 && file->dirty)
+			recorder_file_sync(file);
+
+		close(file->fd);
+		file->fd = -1;
+	}
+
+	g_free(file->path);
+	file->path = NULL;
+}
+
 static bool
-recorder_output_encoder_to_file(struct recorder_output *recorder,
-				GError **error_r)
+recorder_file_open(struct recorder_file *file, char *path, GError **error_r)
+{
+	assert(file->fd < 0);
+	assert(file->path == NULL);
+
+	file->path = path;
+	file->position = 0;
+	file->allocated = 0;
+	file->dirty = false;
+
+	file->fd = open_cloexec(path, O_CREAT|O_WRONLY|O_TRUNC|O_BINARY,
+				0666);
+	if (file->fd < 0) {
+		g_set_error(error_r, recorder_output_quark(), 0,
+			    "Failed to create '%s': %s",
+			    path, g_strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Stores the first error of the writer thread, and closes the file;
+ * the data which is still in the queue is discarded.  Caller must
+ * hold the lock.
+ */
+static void
+recorder_thread_error(struct recorder_output *recorder, GError *error)
+{
+	if (recorder->error == NULL)
+		recorder->error = error;
+	else
+		g_error_free(error);
+
+	if (recorder->file.fd >= 0) {
+		close(recorder->file.fd);
+		recorder->file.fd = -1;
+	}
+}
+
+/**
+ * Moves data pages from the head of the queue into the buffer, until
+ * a new file is requested or the buffer is full.  Caller must hold
+ * the lock.
+ *
+ * @return the number of bytes copied
+ */
+static size_t
+recorder_collect(struct recorder_output *recorder, unsigned char *buffer)
+{
+	size_t length = 0;
+	struct recorder_block *block;
+
+	while ((block = g_queue_peek_head(recorder->queue)) != NULL &&
+	       block->page != NULL &&
+	       length + block->page->size <= RECORDER_WRITE_SIZE) {
+		g_queue_pop_head(recorder->queue);
+
+		memcpy(buffer + length, block->page->data, block->page->size);
+		length += block->page->size;
+
+		page_unref(block->page);
+		g_free(block);
+	}
+
+	return length;
+}
+
+static gpointer
+recorder_thread(gpointer data)
+{
+	struct recorder_output *recorder = data;
+	struct recorder_file *file = &recorder->file;
+	unsigned char *buffer = g_malloc(RECORDER_WRITE_SIZE);
+
+	g_mutex_lock(recorder->mutex);
+
+	while (true) {
+		if (recorder->sync_interval > 0 && file->dirty &&
+		    (int)(file->sync_at - monotonic_clock_ms()) <= 0) {
+			/* the fdatasync() calls are batched, so the
+			   disk is not kept busy with small writes */
+			g_mutex_unlock(recorder->mutex);
+			recorder_file_sync(file);
+			g_mutex_lock(recorder->mutex);
+		}
+
+		struct recorder_block *block =
+			g_queue_peek_head(recorder->queue);
+		if (block == NULL) {
+			if (recorder->quit)
+				break;
+
+			if (recorder->sync_interval > 0 && file->dirty) {
+				int ms = file->sync_at - monotonic_clock_ms();
+				GTimeVal tv;
+				g_get_current_time(&tv);
+				g_time_val_add(&tv, (glong)MAX(ms, 0) * 1000);
+				(void)g_cond_timed_wait(recorder->cond,
+							recorder->mutex, &tv);
+			} else
+				g_cond_wait(recorder->cond, recorder->mutex);
+			continue;
+		}
+
+		if (block->page == NULL) {
+			/* rotation: continue with a new file */
+			g_queue_pop_head(recorder->queue);
+			g_mutex_unlock(recorder->mutex);
+
+			recorder_file_close(recorder);
+
+			GError *error = NULL;
+			bool success = recorder_file_open(file, block->path,
+							  &error);
+			g_free(block);
+
+			g_mutex_lock(recorder->mutex);
+			if (!success)
+				recorder_thread_error(recorder, error);
+			continue;
+		}
+
+		const size_t length = recorder_collect(recorder, buffer);
+		assert(length > 0);
+
+		if (file->fd < 0) {
+			/* after an error: discard */
+			recorder->queue_size -= length;
+			continue;
+		}
+
+		g_mutex_unlock(recorder->mutex);
+
+		GError *error = NULL;
+		bool success = recorder_file_write(recorder, buffer, length,
+						   &error);
+
+		g_mutex_lock(recorder->mutex);
+
+		recorder->queue_size -= length;
+		if (!success)
+			recorder_thread_error(recorder, error);
+	}
+
+	g_mutex_unlock(recorder->mutex);
+
+	recorder_file_close(recorder);
+	g_free(buffer);
+	return NULL;
+}
+
+/**
+ * Appends encoded data to the queue, and wakes up the writer thread.
+ * If the queue is full, the data is dropped.
+ */
+static void
+recorder_push_data(struct recorder_output *recorder,
+		   const void *data, size_t size)
+{
+	g_mutex_lock(recorder->mutex);
+
+	if (recorder->queue_size + size > recorder->max_queue) {
+		const bool warn = !recorder->overflow;
+		if (warn) {
+			recorder->overflow = true;
+			++recorder->drops;
+		}
+
+		recorder->dropped += size;
+		g_mutex_unlock(recorder->mutex);
+
+		if (warn)
+			g_warning("Disk does not keep up with '%s', "
+				  "dropping data", recorder->file_path);
+		return;
+	}
+
+	recorder->overflow = false;
+	recorder->queue_size += size;
+	g_mutex_unlock(recorder->mutex);
+
+	struct recorder_block *block = g_new(struct recorder_block, 1);
+	block->page = page_new_copy(data, size);
+	block->path = NULL;
+
+	g_mutex_lock(recorder->mutex);
+	g_queue_push_tail(recorder->queue, block);
+	g_cond_signal(recorder->cond);
+	g_mutex_unlock(recorder->mutex);
+
+	recorder->file_size += size;
+}
+
+/**
+ * Tells the writer thread to continue with a new file.
+ *
+ * @param path the file name; this function takes over ownership
+ */
+static void
+recorder_push_file(struct recorder_output *recorder, char *path)
 {
-	assert(recorder->fd >= 0);
+	struct recorder_block *block = g_new(struct recorder_block, 1);
+	block->page = NULL;
+	block->path = path;
+
+	g_mutex_lock(recorder->mutex);
+	g_queue_push_tail(recorder->queue, block);
+	++recorder->files;
+	g_cond_signal(recorder->cond);
+	g_mutex_unlock(recorder->mutex);
+}
 
+/**
+ * Passes pending data from the encoder to the writer thread.
+ */
+static void
+recorder_output_encoder_to_queue(struct recorder_output *recorder)
+{
 	while (true) {
 		/* read from the encoder */
 
 		size_t size = encoder_read(recorder->encoder, recorder->buffer,
 					   sizeof(recorder->buffer));
 		if (size == 0)
-			return true;
+			return;
 
-		/* write everything into the file */
+		/* let the writer thread write it into the file */
 
-		if (!recorder_write_to_file(recorder, recorder->buffer, size,
-					    error_r))
-			return false;
+		recorder_push_data(recorder, recorder->buffer, size);
+	}
+}
+
+/**
+ * Returns the error of the writer thread, if there is one.
+ */
+static bool
+recorder_check_error(struct recorder_output *recorder, GError **error_r)
+{
+	g_mutex_lock(recorder->mutex);
+	const bool success = recorder->error == NULL;
+	if (!success)
+		g_propagate_error(error_r, g_error_copy(recorder->error));
+	g_mutex_unlock(recorder->mutex);
+
+	return success;
+}
+
+G_GNUC_PURE
+static bool
+recorder_must_rotate(const struct recorder_output *recorder, time_t now)
+{
+	return (recorder->rotate_time > 0 &&
+		now / (time_t)recorder->rotate_time != recorder->period) ||
+		(recorder->rotate_size > 0 &&
+		 recorder->file_size >= recorder->rotate_size);
+}
+
+/**
+ * Finishes the encoder stream, and starts a new one in a new file.
+ * The file is created by the writer thread, therefore a slow disk
+ * does not block the output thread.
+ */
+static bool
+recorder_output_rotate(struct recorder_output *recorder, time_t now,
+		       GError **error_r)
+{
+	if (recorder->rotate_time > 0)
+		recorder->period = now / (time_t)recorder->rotate_time;
+	recorder->file_size = 0;
+
+	char *path = recorder_format_path(recorder, now);
+	if (strcmp(path, recorder->file_path) == 0) {
+		/* the configured path does not have enough
+		   resolution; don't overwrite the current file */
+		g_free(path);
+		return true;
 	}
+
+	/* finish the current file */
+
+	if (!encoder_end(recorder->encoder, error_r))
+		return false;
+
+	recorder_output_encoder_to_queue(recorder);
+	encoder_close(recorder->encoder);
+	recorder->encoder_open = false;
+
+	g_free(recorder->file_path);
+	recorder->file_path = g_strdup(path);
+	recorder_push_file(recorder, path);
+
+	/* start a new encoder stream with the same format */
+
+	struct audio_format audio_format = recorder->audio_format;
+	if (!encoder_open(recorder->encoder, &audio_format, error_r))
+		return false;
+
+	assert(audio_format_equals(&audio_format, &recorder->audio_format));
+
+	recorder->encoder_open = true;
+	recorder_output_encoder_to_queue(recorder);
+	return true;
 }
 
 static bool
@@ -183,33 +814,56 @@ recorder_output_open(struct audio_output *ao,
 {
 	struct recorder_output *recorder = (struct recorder_output *)ao;
 
-	/* create the output file */
+	/* create the output file; this is done here, not in the
+	   writer thread, to report errors immediately */
 
-	recorder->fd = open_cloexec(recorder->path,
-				    O_CREAT|O_WRONLY|O_TRUNC|O_BINARY,
-				    0666);
-	if (recorder->fd < 0) {
-		g_set_error(error_r, recorder_output_quark(), 0,
-			    "Failed to create '%s': %s",
-			    recorder->path, g_strerror(errno));
+	const time_t now = time(NULL);
+	if (recorder->rotate_time > 0)
+		recorder->period = now / (time_t)recorder->rotate_time;
+
+	char *path = recorder_format_path(recorder, now);
+
+	recorder->file.fd = -1;
+	recorder->file.path = NULL;
+	if (!recorder_file_open(&recorder->file, path, error_r)) {
+		g_free(path);
 		return false;
 	}
 
 	/* open the encoder */
 
 	if (!encoder_open(recorder->encoder, audio_format, error_r)) {
-		close(recorder->fd);
-		unlink(recorder->path);
+		close(recorder->file.fd);
+		unlink(path);
+		g_free(path);
 		return false;
 	}
 
-	if (!recorder_output_encoder_to_file(recorder, error_r)) {
+	recorder->audio_format = *audio_format;
+	recorder->encoder_open = true;
+	recorder->file_path = g_strdup(path);
+	recorder->file_size = 0;
+
+	assert(g_queue_is_empty(recorder->queue));
+	recorder->quit = false;
+	recorder->error = NULL;
+	recorder->overflow = false;
+	recorder->files = 1;
+	recorder->drops = 0;
+	recorder->dropped = 0;
+
+	recorder->thread = g_thread_create(recorder_thread, recorder, true,
+					   error_r);
+	if (recorder->thread == NULL) {
+		g_free(recorder->file_path);
 		encoder_close(recorder->encoder);
-		close(recorder->fd);
-		unlink(recorder->path);
+		close(recorder->file.fd);
+		unlink(path);
+		g_free(path);
 		return false;
 	}
 
+	recorder_output_encoder_to_queue(recorder);
 	return true;
 }
 
@@ -218,16 +872,32 @@ recorder_output_close(struct audio_output *ao)
 {
 	struct recorder_output *recorder = (struct recorder_output *)ao;
 
-	/* flush the encoder and write the rest to the file */
+	/* flush the encoder and pass the rest to the writer thread */
 
-	if (encoder_end(recorder->encoder, NULL))
-		recorder_output_encoder_to_file(recorder, NULL);
+	if (recorder->encoder_open) {
+		if (encoder_end(recorder->encoder, NULL))
+			recorder_output_encoder_to_queue(recorder);
 
-	/* now really close everything */
+		encoder_close(recorder->encoder);
+	}
 
-	encoder_close(recorder->encoder);
+	/* wait until the writer thread has written everything and
+	   closed the file */
+
+	g_mutex_lock(recorder->mutex);
+	recorder->quit = true;
+	g_cond_signal(recorder->cond);
+	g_mutex_unlock(recorder->mutex);
 
-	close(recorder->fd);
+	g_thread_join(recorder->thread);
+
+	assert(g_queue_is_empty(recorder->queue));
+	assert(recorder->queue_size == 0);
+
+	if (recorder->error != NULL)
+		g_error_free(recorder->error);
+
+	g_free(recorder->file_path);
 }
 
 static size_t
@@ -236,9 +906,39 @@ recorder_output_play(struct audio_output *ao, const void *chunk, size_t size,
 {
 	struct recorder_output *recorder = (struct recorder_output *)ao;
 
-	return encoder_write(recorder->encoder, chunk, size, error_r) &&
-		recorder_output_encoder_to_file(recorder, error_r)
-		? size : 0;
+	if (!recorder_check_error(recorder, error_r))
+		return 0;
+
+	if (recorder->rotate_time > 0 || recorder->rotate_size > 0) {
+		const time_t now = time(NULL);
+		if (recorder_must_rotate(recorder, now) &&
+		    !recorder_output_rotate(recorder, now, error_r))
+			return 0;
+	}
+
+	if (!encoder_write(recorder->encoder, chunk, size, error_r))
+		return 0;
+
+	recorder_output_encoder_to_queue(recorder);
+	return size;
+}
+
+static char *
+recorder_output_stats(struct audio_output *ao)
+{
+	struct recorder_output *recorder = (struct recorder_output *)ao;
+
+	g_mutex_lock(recorder->mutex);
+	char *stats = g_strdup_printf("recorder_files: %u\n"
+				      "recorder_queue: %lu\n"
+				      "recorder_drops: %u\n"
+				      "recorder_dropped: %" G_GUINT64_FORMAT "\n",
+				      recorder->files,
+				      (unsigned long)recorder->queue_size,
+				      recorder->drops, recorder->dropped);
+	g_mutex_unlock(recorder->mutex);
+
+	return stats;
 }
 
 const struct audio_output_plugin recorder_output_plugin = {
@@ -248,4 +948,5 @@ const struct audio_output_plugin recorder_output_plugin = {
 	.open = recorder_output_open,
 	.close = recorder_output_close,
 	.play = recorder_output_play,
+	.stats = recorder_output_stats,
 };
@@ -23,6 +23,9 @@
 #include "encoder_plugin.h"
 #include "encoder_list.h"
 #include "mpd_error.h"
+#include "page.h"
+#include "timer.h"
+#include "clock.h"
 
 #include <shout/shout.h>
 #include <glib.h>
@@ -30,12 +33,42 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "shout"
 
 #define DEFAULT_CONN_TIMEOUT  2
 
+/**
+ * The default value of the "max_queue" setting [bytes].
+ */
+#define DEFAULT_MAX_QUEUE (512 * 1024)
+
+/**
+ * The default value of the "reconnect_interval" setting [seconds].
+ */
+#define DEFAULT_RECONNECT_INTERVAL 5
+
+/**
+ * How often the network thread checks a pending connection or a
+ * congested socket [milliseconds].
+ */
+#define SHOUT_POLL_INTERVAL 10
+
+enum shout_state {
+	SHOUT_STATE_DISCONNECTED,
+	SHOUT_STATE_CONNECTING,
+	SHOUT_STATE_CONNECTED,
+};
+
+/*
+ * The output thread encodes into a bounded queue of pages; a network
+ * thread owns the (nonblocking) libshout connection and sends them.
+ * If the server is slow or unreachable, the oldest frames are
+ * dropped, and the network thread reconnects in the background; the
+ * output thread never waits for the server.
+ */
 struct shout_data {
 	struct audio_output base;
 
@@ -49,6 +82,83 @@ struct shout_data {
 
 	int timeout;
 
+	/**
+	 * Does the encoded stream consist of MPEG frames (or else Ogg
+	 * pages)?  Used to find frame boundaries.
+	 */
+	bool mpeg;
+
+	/**
+	 * The configured maximum size of #queue [bytes].
+	 */
+	size_t max_queue;
+
+	/**
+	 * The configured delay between two connection attempts
+	 * [milliseconds].
+	 */
+	unsigned reconnect_interval;
+
+	/**
+	 * Paces the output thread, because the server does not.
+	 */
+	struct timer *timer;
+
+	GThread *thread;
+
+	/**
+	 * Protects the following attributes, which are shared with
+	 * the network thread.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Signalled when a page is queued, new metadata is available,
+	 * or the network thread shall quit.
+	 */
+	GCond *cond;
+
+	/**
+	 * The encoded #page objects to be sent, oldest first.
+	 */
+	GQueue *queue;
+
+	/**
+	 * The total size of all pages in #queue [bytes].
+	 */
+	size_t queue_size;
+
+	/**
+	 * The encoder header, i.e. the first page of the current
+	 * encoder stream.  It is sent again after a reconnect.  May be
+	 * NULL.
+	 */
+	struct page *header;
+
+	/**
+	 * The "song" metadata which the network thread shall submit
+	 * to the server, or NULL.
+	 */
+	char *song;
+
+	/**
+	 * Pages were discarded; the next queued page must begin at a
+	 * frame boundary.
+	 */
+	bool resync;
+
+	bool quit;
+
+	/**
+	 * The connection state of the network thread; only read by
+	 * others for statistics.
+	 */
+	enum shout_state state;
+
+	/* statistics */
+	unsigned connects, drops;
+	uint64_t dropped;
+
 	uint8_t buffer[32768];
 };
 
@@ -83,12 +193,25 @@ static struct shout_data *new_shout_data(void)
 	ret->bitrate = -1;
 	ret->quality = -2.0;
 	ret->timeout = DEFAULT_CONN_TIMEOUT;
+	ret->mutex = g_mutex_new();
+	ret->cond = g_cond_new();
+	ret->queue = g_queue_new();
+	ret->queue_size = 0;
+	ret->header = NULL;
+	ret->song = NULL;
+	ret->state = SHOUT_STATE_DISCONNECTED;
+	ret->connects = ret->drops = 0;
+	ret->dropped = 0;
 
 	return ret;
 }
 
 static void free_shout_data(struct shout_data *sd)
 {
+	g_queue_free(sd->queue);
+	g_cond_free(sd->cond);
+	g_mutex_free(sd->mutex);
+
 	if (sd->shout_meta)
 		shout_metadata_free(sd->shout_meta);
 	if (sd->shout_conn)
@@ -199,6 +322,8 @@ my_shout_configure(struct shout_data *sd, const struct config_param *param,
 	else
 		shout_format = SHOUT_FORMAT_OGG;
 
+	sd->mpeg = shout_format == SHOUT_FORMAT_MP3;
+
 	unsigned protocol;
 	value = config_get_block_string(param, "protocol", NULL);
 	if (value != NULL) {
@@ -235,7 +360,8 @@ my_shout_configure(struct shout_data *sd, const struct config_param *param,
 	    shout_set_format(sd->shout_conn, shout_format)
 	    != SHOUTERR_SUCCESS ||
 	    shout_set_protocol(sd->shout_conn, protocol) != SHOUTERR_SUCCESS ||
-	    shout_set_agent(sd->shout_conn, "MPD") != SHOUTERR_SUCCESS) {
+	    shout_set_agent(sd->shout_conn, "MPD") != SHOUTERR_SUCCESS ||
+	    shout_set_nonblocking(sd->shout_conn, 1) != SHOUTERR_SUCCESS) {
 		g_set_error(error, shout_output_quark(), 0,
 			    "%s", shout_get_error(sd->shout_conn));
 		return false;
@@ -245,6 +371,19 @@ my_shout_configure(struct shout_data *sd, const struct config_param *param,
 	sd->timeout = config_get_block_unsigned(param, "timeout",
 						DEFAULT_CONN_TIMEOUT);
 
+	sd->max_queue = config_get_block_unsigned(param, "max_queue",
+						  DEFAULT_MAX_QUEUE / 1024)
+		* 1024;
+	if (sd->max_queue == 0) {
+		g_set_error(error, shout_output_quark(), 0,
+			    "max_queue must not be zero");
+		return false;
+	}
+
+	sd->reconnect_interval =
+		config_get_block_unsigned(param, "reconnect_interval",
+					  DEFAULT_RECONNECT_INTERVAL) * 1000;
+
 	value = config_get_block_string(param, "genre", NULL);
 	if (value != NULL && shout_set_genre(sd->shout_conn, value)) {
 		g_set_error(error, shout_output_quark(), 0,
@@ -315,67 +454,381 @@ my_shout_init_driver(const struct config_param *param,
 	return &sd->base;
 }
 
+
+/**
+ * Does the page begin at a frame boundary?
+ */
+G_GNUC_PURE
+static bool
+shout_page_is_sync(const struct shout_data *sd, const struct page *page)
+{
+	const unsigned char *p = page->data;
+
+	return sd->mpeg
+		? page->size >= 2 && p[0] == 0xff && (p[1] & 0xe0) == 0xe0
+		: page->size >= 4 && memcmp(p, "OggS", 4) == 0;
+}
+
+/**
+ * Removes the oldest page from the queue, and returns it.  Caller
+ * must hold the lock.
+ */
+static struct page *
+shout_queue_pop(struct shout_data *sd)
+{
+	struct page *page = g_queue_pop_head(sd->queue);
+	if (page != NULL) {
+		assert(sd->queue_size >= page->size);
+		sd->queue_size -= page->size;
+	}
+
+	return page;
+}
+
+/**
+ * Discards the oldest page.  Caller must hold the lock.
+ */
+static void
+shout_queue_drop(struct shout_data *sd)
+{
+	struct page *page = shout_queue_pop(sd);
+	assert(page != NULL);
+
+	sd->dropped += page->size;
+	page_unref(page);
+}
+
+static void
+shout_queue_clear(struct shout_data *sd)
+{
+	struct page *page;
+	while ((page = shout_queue_pop(sd)) != NULL)
+		page_unref(page);
+}
+
+/**
+ * Appends a page to the queue, and wakes up the network thread.  If
+ * the queue is full, whole frames are dropped from its beginning
+ * until it is half as large.  Takes over the caller's reference.
+ */
+static void
+shout_queue_push(struct shout_data *sd, struct page *page)
+{
+	const bool sync = shout_page_is_sync(sd, page);
+
+	g_mutex_lock(sd->mutex);
+
+	if (sd->queue_size + page->size > sd->max_queue) {
+		++sd->drops;
+
+		while (!g_queue_is_empty(sd->queue) &&
+		       (sd->queue_size + page->size > sd->max_queue / 2 ||
+			!shout_page_is_sync(sd,
+					    g_queue_peek_head(sd->queue))))
+			shout_queue_drop(sd);
+
+		if (g_queue_is_empty(sd->queue))
+			sd->resync = true;
+	}
+
+	if (sd->resync) {
+		if (!sync) {
+			/* the stream must continue at a frame
+			   boundary */
+			sd->dropped += page->size;
+			g_mutex_unlock(sd->mutex);
+			page_unref(page);
+			return;
+		}
+
+		sd->resync = false;
+	}
+
+	g_queue_push_tail(sd->queue, page);
+	sd->queue_size += page->size;
+
+	g_cond_signal(sd->cond);
+	g_mutex_unlock(sd->mutex);
+}
+
+/**
+ * Waits until the network thread is woken up, but not longer than
+ * the specified duration.  Caller must hold the lock.
+ */
+static void
+shout_thread_wait(struct shout_data *sd, unsigned ms)
+{
+	GTimeVal tv;
+	g_get_current_time(&tv);
+	g_time_val_add(&tv, ms * 1000);
+	(void)g_cond_timed_wait(sd->cond, sd->mutex, &tv);
+}
+
+/**
+ * Closes the connection after an error, and schedules the next
+ * connection attempt.  Caller must hold the lock.
+ */
+static void
+shout_thread_disconnect(struct shout_data *sd, unsigned *reconnect_at_r)
+{
+	g_mutex_unlock(sd->mutex);
+	shout_close(sd->shout_conn);
+	g_mutex_lock(sd->mutex);
+
+	sd->state = SHOUT_STATE_DISCONNECTED;
+	*reconnect_at_r = monotonic_clock_ms() + sd->reconnect_interval;
+}
+
+/**
+ * Evaluates the result of shout_open() or shout_get_connected().
+ * Caller must hold the lock.
+ *
+ * @return true if the connection has just been established
+ */
 static bool
-handle_shout_error(struct shout_data *sd, int err, GError **error)
+shout_thread_connect_result(struct shout_data *sd, int err,
+			    unsigned deadline, unsigned *reconnect_at_r)
 {
 	switch (err) {
 	case SHOUTERR_SUCCESS:
-		break;
+	case SHOUTERR_CONNECTED:
+		sd->state = SHOUT_STATE_CONNECTED;
+		++sd->connects;
+		return true;
 
-	case SHOUTERR_UNCONNECTED:
-	case SHOUTERR_SOCKET:
-		g_set_error(error, shout_output_quark(), err,
-			    "Lost shout connection to %s:%i: %s",
-			    shout_get_host(sd->shout_conn),
-			    shout_get_port(sd->shout_conn),
-			    shout_get_error(sd->shout_conn));
-		return false;
+	case SHOUTERR_BUSY:
+		if ((int)(monotonic_clock_ms() - deadline) < 0) {
+			sd->state = SHOUT_STATE_CONNECTING;
+			shout_thread_wait(sd, SHOUT_POLL_INTERVAL);
+			return false;
+		}
+
+		g_warning("timeout connecting to shout server %s:%i",
+			  shout_get_host(sd->shout_conn),
+			  shout_get_port(sd->shout_conn));
+		break;
 
 	default:
-		g_set_error(error, shout_output_quark(), err,
-			    "connection to %s:%i error: %s",
-			    shout_get_host(sd->shout_conn),
-			    shout_get_port(sd->shout_conn),
-			    shout_get_error(sd->shout_conn));
-		return false;
+		g_warning("problem opening connection to shout server %s:%i: %s",
+			  shout_get_host(sd->shout_conn),
+			  shout_get_port(sd->shout_conn),
+			  shout_get_error(sd->shout_conn));
+		break;
 	}
 
-	return true;
+	shout_thread_disconnect(sd, reconnect_at_r);
+	return false;
 }
 
-static bool
-write_page(struct shout_data *sd, GError **error)
+/**
+ * A new connection begins with the encoder header.  Pages queued
+ * before the current header belong to the previous encoder stream,
+ * and are discarded.  Caller must hold the lock.
+ *
+ * @return a new reference to the header, or NULL
+ */
+static struct page *
+shout_thread_header(struct shout_data *sd)
 {
-	assert(sd->encoder != NULL);
-
-	while (true) {
-		size_t nbytes = encoder_read(sd->encoder,
-					     sd->buffer, sizeof(sd->buffer));
-		if (nbytes == 0)
-			return true;
+	if (sd->header == NULL)
+		return NULL;
 
-		int err = shout_send(sd->shout_conn, sd->buffer, nbytes);
-		if (!handle_shout_error(sd, err, error))
-			return false;
+	if (g_queue_index(sd->queue, sd->header) >= 0) {
+		struct page *page;
+		while ((page = shout_queue_pop(sd)) != sd->header)
+			page_unref(page);
+		page_unref(page);
 	}
 
-	return true;
+	page_ref(sd->header);
+	return sd->header;
 }
 
-static void close_shout_conn(struct shout_data * sd)
+static void
+shout_thread_lost(struct shout_data *sd, int err, unsigned *reconnect_at_r)
 {
-	if (sd->encoder != NULL) {
-		if (encoder_end(sd->encoder, NULL))
-			write_page(sd, NULL);
+	g_warning("Lost shout connection to %s:%i: %s (error %d)",
+		  shout_get_host(sd->shout_conn),
+		  shout_get_port(sd->shout_conn),
+		  shout_get_error(sd->shout_conn), err);
 
-		encoder_close(sd->encoder);
+	shout_thread_disconnect(sd, reconnect_at_r);
+}
+
+/**
+ * The network thread: owns the libshout connection, which is in
+ * nonblocking mode, sends the queued pages and the metadata, and
+ * reconnects after errors.
+ */
+static gpointer
+shout_thread(gpointer data)
+{
+	struct shout_data *sd = data;
+	unsigned reconnect_at = monotonic_clock_ms(), deadline = 0;
+	int err;
+
+	g_mutex_lock(sd->mutex);
+
+	while (!sd->quit) {
+		struct page *page = NULL;
+
+		switch (sd->state) {
+		case SHOUT_STATE_DISCONNECTED: {
+			const unsigned now = monotonic_clock_ms();
+			if ((int)(reconnect_at - now) > 0) {
+				shout_thread_wait(sd, reconnect_at - now);
+				continue;
+			}
+
+			deadline = now + sd->timeout * 1000;
+
+			g_mutex_unlock(sd->mutex);
+			err = shout_open(sd->shout_conn);
+			g_mutex_lock(sd->mutex);
+
+			if (shout_thread_connect_result(sd, err, deadline,
+							&reconnect_at))
+				page = shout_thread_header(sd);
+			else
+				continue;
+			break;
+		}
+
+		case SHOUT_STATE_CONNECTING:
+			g_mutex_unlock(sd->mutex);
+			err = shout_get_connected(sd->shout_conn);
+			g_mutex_lock(sd->mutex);
+
+			if (shout_thread_connect_result(sd, err, deadline,
+							&reconnect_at))
+				page = shout_thread_header(sd);
+			else
+				continue;
+			break;
+
+		case SHOUT_STATE_CONNECTED:
+			break;
+		}
+
+		if (page == NULL && sd->song != NULL) {
+			/* this is a separate HTTP request, which
+			   blocks only this thread */
+			char *song = sd->song;
+			sd->song = NULL;
+
+			g_mutex_unlock(sd->mutex);
+			shout_metadata_add(sd->shout_meta, "song", song);
+			if (shout_set_metadata(sd->shout_conn, sd->shout_meta)
+			    != SHOUTERR_SUCCESS)
+				g_warning("error setting shout metadata\n");
+			g_mutex_lock(sd->mutex);
+
+			g_free(song);
+			continue;
+		}
+
+		if (page == NULL && shout_queuelen(sd->shout_conn) > 0) {
+			/* the socket is congested; try to send the data
+			   which libshout has buffered before
+			   submitting more */
+			g_mutex_unlock(sd->mutex);
+			err = shout_send_raw(sd->shout_conn, NULL, 0);
+			g_mutex_lock(sd->mutex);
+
+			if (err < 0 && err != SHOUTERR_BUSY)
+				shout_thread_lost(sd, err, &reconnect_at);
+			else if (shout_queuelen(sd->shout_conn) > 0)
+				shout_thread_wait(sd, SHOUT_POLL_INTERVAL);
+			continue;
+		}
+
+		if (page == NULL) {
+			page = shout_queue_pop(sd);
+			if (page == NULL) {
+				g_cond_wait(sd->cond, sd->mutex);
+				continue;
+			}
+		}
+
+		/* in nonblocking mode, libshout buffers the portion
+		   which cannot be sent right now */
+		g_mutex_unlock(sd->mutex);
+		err = shout_send(sd->shout_conn, page->data, page->size);
+		page_unref(page);
+		g_mutex_lock(sd->mutex);
+
+		if (err != SHOUTERR_SUCCESS && err != SHOUTERR_BUSY)
+			shout_thread_lost(sd, err, &reconnect_at);
+	}
+
+	if (sd->state == SHOUT_STATE_CONNECTED) {
+		/* submit the end of the stream, as far as this is
+		   possible without waiting */
+		struct page *page;
+		while ((page = shout_queue_pop(sd)) != NULL) {
+			shout_send(sd->shout_conn, page->data, page->size);
+			page_unref(page);
+		}
 	}
 
-	if (shout_get_connected(sd->shout_conn) != SHOUTERR_UNCONNECTED &&
-	    shout_close(sd->shout_conn) != SHOUTERR_SUCCESS) {
+	const bool connected = sd->state != SHOUT_STATE_DISCONNECTED;
+	sd->state = SHOUT_STATE_DISCONNECTED;
+	g_mutex_unlock(sd->mutex);
+
+	if (connected && shout_close(sd->shout_conn) != SHOUTERR_SUCCESS)
 		g_warning("problem closing connection to shout server: %s\n",
 			  shout_get_error(sd->shout_conn));
-	}
+
+	return NULL;
+}
+
+/**
+ * Reads all available encoder output into a new page.  Returns NULL
+ * if there is none.
+ */
+static struct page *
+shout_read_page(struct shout_data *sd)
+{
+	assert(sd->encoder != NULL);
+
+	size_t size = 0;
+	do {
+		size_t nbytes = encoder_read(sd->encoder, sd->buffer + size,
+					     sizeof(sd->buffer) - size);
+		if (nbytes == 0)
+			break;
+
+		size += nbytes;
+	} while (size < sizeof(sd->buffer));
+
+	if (size == 0)
+		return NULL;
+
+	return page_new_copy(sd->buffer, size);
+}
+
+/**
+ * Moves all available encoder output to the queue.
+ */
+static void
+shout_encoder_to_queue(struct shout_data *sd)
+{
+	struct page *page;
+	while ((page = shout_read_page(sd)) != NULL)
+		shout_queue_push(sd, page);
+}
+
+/**
+ * Replaces the encoder header.  Takes over the caller's reference.
+ */
+static void
+shout_set_header(struct shout_data *sd, struct page *header)
+{
+	g_mutex_lock(sd->mutex);
+	if (sd->header != NULL)
+		page_unref(sd->header);
+	sd->header = header;
+	g_mutex_unlock(sd->mutex);
 }
 
 static void
@@ -397,10 +850,12 @@ my_shout_finish_driver(struct audio_output *ao)
 static void
 my_shout_drop_buffered_audio(struct audio_output *ao)
 {
-	G_GNUC_UNUSED
 	struct shout_data *sd = (struct shout_data *)ao;
 
-	/* needs to be implemented for shout */
+	g_mutex_lock(sd->mutex);
+	shout_queue_clear(sd);
+	sd->resync = true;
+	g_mutex_unlock(sd->mutex);
 }
 
 static void
@@ -408,25 +863,23 @@ my_shout_close_device(struct audio_output *ao)
 {
 	struct shout_data *sd = (struct shout_data *)ao;
 
-	close_shout_conn(sd);
-}
+	if (encoder_end(sd->encoder, NULL))
+		shout_encoder_to_queue(sd);
 
-static bool
-shout_connect(struct shout_data *sd, GError **error)
-{
-	switch (shout_open(sd->shout_conn)) {
-	case SHOUTERR_SUCCESS:
-	case SHOUTERR_CONNECTED:
-		return true;
+	g_mutex_lock(sd->mutex);
+	sd->quit = true;
+	g_cond_signal(sd->cond);
+	g_mutex_unlock(sd->mutex);
 
-	default:
-		g_set_error(error, shout_output_quark(), 0,
-			    "problem opening connection to shout server %s:%i: %s",
-			    shout_get_host(sd->shout_conn),
-			    shout_get_port(sd->shout_conn),
-			    shout_get_error(sd->shout_conn));
-		return false;
-	}
+	g_thread_join(sd->thread);
+
+	shout_queue_clear(sd);
+	shout_set_header(sd, NULL);
+	g_free(sd->song);
+	sd->song = NULL;
+
+	timer_free(sd->timer);
+	encoder_close(sd->encoder);
 }
 
 static bool
@@ -435,17 +888,25 @@ my_shout_open_device(struct audio_output *ao, struct audio_format *audio_format,
 {
 	struct shout_data *sd = (struct shout_data *)ao;
 
-	if (!shout_connect(sd, error))
-		return false;
-
-	if (!encoder_open(sd->encoder, audio_format, error)) {
-		shout_close(sd->shout_conn);
+	if (!encoder_open(sd->encoder, audio_format, error))
 		return false;
-	}
 
-	if (!write_page(sd, error)) {
+	/* the first bytes of encoder output are the header, which is
+	   sent after each (re)connect */
+	sd->header = shout_read_page(sd);
+
+	sd->resync = false;
+	sd->quit = false;
+	sd->state = SHOUT_STATE_DISCONNECTED;
+	sd->timer = timer_new(audio_format);
+
+	/* the connection is established by the network thread, which
+	   keeps retrying while MPD plays */
+	sd->thread = g_thread_create(shout_thread, sd, true, error);
+	if (sd->thread == NULL) {
+		timer_free(sd->timer);
+		shout_set_header(sd, NULL);
 		encoder_close(sd->encoder);
-		shout_close(sd->shout_conn);
 		return false;
 	}
 
@@ -457,11 +918,9 @@ my_shout_delay(struct audio_output *ao)
 {
 	struct shout_data *sd = (struct shout_data *)ao;
 
-	int delay = shout_delay(sd->shout_conn);
-	if (delay < 0)
-		delay = 0;
-
-	return delay;
+	return sd->timer->started
+		? timer_delay(sd->timer)
+		: 0;
 }
 
 static size_t
@@ -470,10 +929,16 @@ my_shout_play(struct audio_output *ao, const void *chunk, size_t size,
 {
 	struct shout_data *sd = (struct shout_data *)ao;
 
-	return encoder_write(sd->encoder, chunk, size, error) &&
-		write_page(sd, error)
-		? size
-		: 0;
+	if (!encoder_write(sd->encoder, chunk, size, error))
+		return 0;
+
+	shout_encoder_to_queue(sd);
+
+	if (!sd->timer->started)
+		timer_start(sd->timer);
+	timer_add(sd->timer, size);
+
+	return size;
 }
 
 static bool
@@ -525,26 +990,55 @@ static void my_shout_set_tag(struct audio_output *ao,
 			return;
 		}
 
-		if (!write_page(sd, NULL))
-			return;
+		shout_encoder_to_queue(sd);
 
 		if (!encoder_tag(sd->encoder, tag, &error)) {
 			g_warning("%s", error->message);
 			g_error_free(error);
 		}
+
+		/* the first page of the new encoder stream is its
+		   header */
+		struct page *header = shout_read_page(sd);
+		if (header != NULL) {
+			page_ref(header);
+			shout_set_header(sd, header);
+			shout_queue_push(sd, header);
+		}
 	} else {
-		/* no stream tag support: fall back to icy-metadata */
+		/* no stream tag support: fall back to icy-metadata,
+		   which is submitted by the network thread */
 		char song[1024];
 		shout_tag_to_metadata(tag, song, sizeof(song));
 
-		shout_metadata_add(sd->shout_meta, "song", song);
-		if (SHOUTERR_SUCCESS != shout_set_metadata(sd->shout_conn,
-							   sd->shout_meta)) {
-			g_warning("error setting shout metadata\n");
-		}
+		g_mutex_lock(sd->mutex);
+		g_free(sd->song);
+		sd->song = g_strdup(song);
+		g_cond_signal(sd->cond);
+		g_mutex_unlock(sd->mutex);
 	}
 
-	write_page(sd, NULL);
+	shout_encoder_to_queue(sd);
+}
+
+static char *
+my_shout_stats(struct audio_output *ao)
+{
+	struct shout_data *sd = (struct shout_data *)ao;
+
+	g_mutex_lock(sd->mutex);
+	char *stats = g_strdup_printf("shout_connected: %d\n"
+				      "shout_connects: %u\n"
+				      "shout_queue: %lu\n"
+				      "shout_drops: %u\n"
+				      "shout_dropped: %" G_GUINT64_FORMAT "\n",
+				      sd->state == SHOUT_STATE_CONNECTED,
+				      sd->connects,
+				      (unsigned long)sd->queue_size,
+				      sd->drops, sd->dropped);
+	g_mutex_unlock(sd->mutex);
+
+	return stats;
 }
 
 const struct audio_output_plugin shout_output_plugin = {
@@ -558,4 +1052,5 @@ const struct audio_output_plugin shout_output_plugin = {
 	.cancel = my_shout_drop_buffered_audio,
 	.close = my_shout_close_device,
 	.send_tag = my_shout_set_tag,
+	.stats = my_shout_stats,
 };
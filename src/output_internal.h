@@ -22,12 +22,14 @@
 
 #include "audio_format.h"
 #include "pcm_buffer.h"
+#include "output_stats.h"
 
 #include <glib.h>
 
 #include <time.h>
 
 struct config_param;
+struct output_filter_group;
 
 enum audio_output_command {
 	AO_COMMAND_NONE = 0,
@@ -191,6 +193,20 @@ struct audio_output {
 	 */
 	struct filter *convert_filter;
 
+	/**
+	 * May this output share the conversion result with other
+	 * outputs (see OutputFilterCache.hxx)?  This is true if the
+	 * filter chain contains nothing but #convert_filter, and
+	 * replay gain is not applied with a hardware mixer.
+	 */
+	bool share_filter;
+
+	/**
+	 * The group this output shares its conversion with, or NULL
+	 * if it converts on its own.  Only used by the output thread.
+	 */
+	struct output_filter_group *filter_group;
+
 	/**
 	 * The thread handle, or NULL if the output thread isn't
 	 * running.
@@ -237,6 +253,12 @@ struct audio_output {
 	 * Has the output finished playing #chunk?
 	 */
 	bool chunk_finished;
+
+	/**
+	 * Performance counters.  Protected by #mutex, except for
+	 * output_stats::underruns.
+	 */
+	struct output_stats stats;
 };
 
 /**
@@ -149,6 +149,16 @@ struct audio_output_plugin {
 	 */
 	bool (*pause)(struct audio_output *data);
 
+	/**
+	 * Returns plugin specific performance counters for the
+	 * "outputstats" command, as "name: value" lines (newly
+	 * allocated).  This is called by the main thread, and must
+	 * not block on the output thread.
+	 *
+	 * @return the counters, or NULL if there are none
+	 */
+	char *(*stats)(struct audio_output *data);
+
 	/**
 	 * The mixer plugin associated with this output plugin.  This
 	 * may be NULL if no mixer plugin is implemented.  When
@@ -208,4 +218,8 @@ ao_plugin_cancel(struct audio_output *ao);
 bool
 ao_plugin_pause(struct audio_output *ao);
 
+gcc_malloc
+char *
+ao_plugin_stats(struct audio_output *ao);
+
 #endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "output_stats.h"
+#include "clock.h"
+
+void
+output_histogram_add(struct output_histogram *histogram, uint64_t value)
+{
+	unsigned bucket = 0;
+	while (bucket < OUTPUT_HISTOGRAM_BUCKETS - 1 &&
+	       value >= output_histogram_limit(bucket))
+		++bucket;
+
+	++histogram->buckets[bucket];
+	++histogram->count;
+	histogram->sum += value;
+	if (value > histogram->max)
+		histogram->max = value;
+}
+
+void
+output_stats_open(struct output_stats *stats)
+{
+	++stats->opens;
+	stats->open_time = monotonic_clock_us();
+	stats->open_bytes = stats->bytes;
+}
+
+void
+output_stats_chunk(struct output_stats *stats, unsigned queue_depth,
+		   uint64_t push_time, uint64_t filter_time)
+{
+	++stats->chunks;
+
+	stats->queue_depth = queue_depth;
+	stats->queue_depth_sum += queue_depth;
+	if (queue_depth > stats->queue_depth_max)
+		stats->queue_depth_max = queue_depth;
+
+	if (push_time > 0) {
+		const uint64_t now = monotonic_clock_us();
+		if (now >= push_time)
+			output_histogram_add(&stats->queue_time,
+					     now - push_time);
+	}
+
+	output_histogram_add(&stats->filter_time, filter_time);
+}
+
+unsigned
+output_stats_rate(const struct output_stats *stats)
+{
+	if (stats->open_time == 0)
+		return 0;
+
+	const uint64_t duration = monotonic_clock_us() - stats->open_time;
+	if (duration == 0)
+		return 0;
+
+	return (stats->bytes - stats->open_bytes) * 1000000 / duration;
+}
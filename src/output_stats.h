@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Performance counters of an audio output, see the "outputstats"
+ * protocol command.
+ */
+
+#ifndef MPD_OUTPUT_STATS_H
+#define MPD_OUTPUT_STATS_H
+
+#include <glib.h>
+
+#include <stdint.h>
+#include <string.h>
+
+enum {
+	/**
+	 * The number of histogram buckets.  Bucket i counts durations
+	 * below (64 << i) microseconds; the last bucket counts all
+	 * longer durations (above 1 second).
+	 */
+	OUTPUT_HISTOGRAM_BUCKETS = 16,
+};
+
+/**
+ * A logarithmic histogram of durations.
+ */
+struct output_histogram {
+	unsigned count;
+
+	/**
+	 * The sum and the maximum of all values [microseconds].
+	 */
+	uint64_t sum, max;
+
+	unsigned buckets[OUTPUT_HISTOGRAM_BUCKETS];
+};
+
+struct output_stats {
+	/**
+	 * How often was the device opened, and how often was it
+	 * reopened because the audio format has changed?
+	 */
+	unsigned opens, reopens;
+
+	/**
+	 * The number of buffer underruns reported by the plugin.
+	 * This is incremented with output_stats_underrun(), which may
+	 * be called without holding the output's mutex.
+	 */
+	volatile gint underruns;
+
+	/**
+	 * The monotonic time [microseconds] of the last open, and the
+	 * value of #bytes at that time; used to calculate the data
+	 * rate.
+	 */
+	uint64_t open_time, open_bytes;
+
+	/**
+	 * The number of chunks and bytes (in the output format)
+	 * which were passed to the plugin.
+	 */
+	uint64_t chunks, bytes;
+
+	/**
+	 * The number of chunks in the music pipe when a chunk was
+	 * picked up by this output.
+	 */
+	unsigned queue_depth, queue_depth_max;
+	uint64_t queue_depth_sum;
+
+	/**
+	 * How long did chunks wait in the music pipe before this
+	 * output started playing them?
+	 */
+	struct output_histogram queue_time;
+
+	/**
+	 * The duration of the plugin's play() calls.
+	 */
+	struct output_histogram play_time;
+
+	/**
+	 * The time spent in the filter chain (replay gain,
+	 * cross-fading and format conversion) per chunk.
+	 */
+	struct output_histogram filter_time;
+};
+
+static inline void
+output_stats_init(struct output_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+/**
+ * Called by the output plugin when it has detected a buffer
+ * underrun.  This function is thread-safe.
+ */
+static inline void
+output_stats_underrun(struct output_stats *stats)
+{
+	g_atomic_int_inc(&stats->underruns);
+}
+
+void
+output_histogram_add(struct output_histogram *histogram, uint64_t value);
+
+/**
+ * Returns the bucket boundary of the specified histogram bucket
+ * [microseconds].
+ */
+static inline uint64_t
+output_histogram_limit(unsigned bucket)
+{
+	return (uint64_t)64 << bucket;
+}
+
+void
+output_stats_open(struct output_stats *stats);
+
+static inline void
+output_stats_reopen(struct output_stats *stats)
+{
+	++stats->reopens;
+}
+
+/**
+ * Record that a chunk has been picked up by the output.
+ *
+ * @param queue_depth the number of chunks in the music pipe
+ * @param push_time the time the chunk was added to the music pipe
+ * (0 if unknown)
+ * @param filter_time the time spent in the filter chain
+ */
+void
+output_stats_chunk(struct output_stats *stats, unsigned queue_depth,
+		   uint64_t push_time, uint64_t filter_time);
+
+/**
+ * Record one call to the plugin's play() method.
+ */
+static inline void
+output_stats_play(struct output_stats *stats, size_t nbytes,
+		  uint64_t duration)
+{
+	stats->bytes += nbytes;
+	output_histogram_add(&stats->play_time, duration);
+}
+
+/**
+ * Returns the average data rate since the device was opened
+ * [bytes per second].
+ */
+G_GNUC_PURE
+unsigned
+output_stats_rate(const struct output_stats *stats);
+
+#endif
@@ -21,6 +21,7 @@
 #include "pcm_channels.h"
 #include "pcm_buffer.h"
 #include "pcm_utils.h"
+#include "pcm_simd.h"
 
 #include <assert.h>
 
@@ -105,12 +106,10 @@ pcm_convert_channels_24_1_to_2(int32_t *restrict dest,
 			       const int32_t *restrict src,
 			       const int32_t *restrict src_end)
 {
-	while (src < src_end) {
-		int32_t value = *src++;
-
-		*dest++ = value;
-		*dest++ = value;
-	}
+	/* duplicating the channel is interleaving the same plane
+	   twice */
+	const int32_t *const planes[2] = { src, src };
+	pcm_simd_interleave_32(dest, planes, 2, src_end - src);
 }
 
 static void
@@ -23,6 +23,7 @@
 #include "pcm_buffer.h"
 #include "pcm_pack.h"
 #include "pcm_utils.h"
+#include "pcm_simd.h"
 
 static void
 pcm_convert_8_to_16(int16_t *out, const int8_t *in, const int8_t *in_end)
@@ -49,13 +50,7 @@ pcm_convert_32_to_16(struct pcm_dither *dither,
 static void
 pcm_convert_float_to_16(int16_t *out, const float *in, const float *in_end)
 {
-	const unsigned OUT_BITS = 16;
-	const float factor = 1 << (OUT_BITS - 1);
-
-	while (in < in_end) {
-		int sample = *in++ * factor;
-		*out++ = pcm_clamp_16(sample);
-	}
+	pcm_simd_float_to_16(out, in, in_end - in);
 }
 
 static int16_t *
@@ -157,8 +152,7 @@ pcm_convert_8_to_24(int32_t *out, const int8_t *in, const int8_t *in_end)
 static void
 pcm_convert_16_to_24(int32_t *out, const int16_t *in, const int16_t *in_end)
 {
-	while (in < in_end)
-		*out++ = *in++ << 8;
+	pcm_simd_shift_16_to_32(out, in, in_end - in, 8);
 }
 
 static void
@@ -166,20 +160,13 @@ pcm_convert_32_to_24(int32_t *restrict out,
 		     const int32_t *restrict in,
 		     const int32_t *restrict in_end)
 {
-	while (in < in_end)
-		*out++ = *in++ >> 8;
+	pcm_simd_shift_32_to_24(out, in, in_end - in);
 }
 
 static void
 pcm_convert_float_to_24(int32_t *out, const float *in, const float *in_end)
 {
-	const unsigned OUT_BITS = 24;
-	const float factor = 1 << (OUT_BITS - 1);
-
-	while (in < in_end) {
-		int sample = *in++ * factor;
-		*out++ = pcm_clamp_24(sample);
-	}
+	pcm_simd_float_to_24(out, in, in_end - in);
 }
 
 static int32_t *
@@ -272,17 +259,13 @@ pcm_convert_8_to_32(int32_t *out, const int8_t *in, const int8_t *in_end)
 static void
 pcm_convert_16_to_32(int32_t *out, const int16_t *in, const int16_t *in_end)
 {
-	while (in < in_end)
-		*out++ = *in++ << 16;
+	pcm_simd_shift_16_to_32(out, in, in_end - in, 16);
 }
 
 static void
-pcm_convert_24_to_32(int32_t *restrict out,
-		     const int32_t *restrict in,
-		     const int32_t *restrict in_end)
+pcm_convert_24_to_32(int32_t *out, const int32_t *in, const int32_t *in_end)
 {
-	while (in < in_end)
-		*out++ = *in++ << 8;
+	pcm_simd_shift_24_to_32(out, in, in_end - in);
 }
 
 static int32_t *
@@ -383,8 +366,7 @@ pcm_convert_16_to_float(float *out, const int16_t *in, const int16_t *in_end)
 {
 	enum { in_bits = sizeof(*in) * 8 };
 	static const float factor = 2.0f / (1 << in_bits);
-	while (in < in_end)
-		*out++ = (float)*in++ * factor;
+	pcm_simd_16_to_float(out, in, in_end - in, factor);
 }
 
 static void
@@ -392,8 +374,7 @@ pcm_convert_24_to_float(float *out, const int32_t *in, const int32_t *in_end)
 {
 	enum { in_bits = 24 };
 	static const float factor = 2.0f / (1 << in_bits);
-	while (in < in_end)
-		*out++ = (float)*in++ * factor;
+	pcm_simd_32_to_float(out, in, in_end - in, factor);
 }
 
 static void
@@ -401,8 +382,7 @@ pcm_convert_32_to_float(float *out, const int32_t *in, const int32_t *in_end)
 {
 	enum { in_bits = sizeof(*in) * 8 };
 	static const float factor = 0.5f / (1 << (in_bits - 2));
-	while (in < in_end)
-		*out++ = (float)*in++ * factor;
+	pcm_simd_32_to_float(out, in, in_end - in, factor);
 }
 
 static float *
@@ -21,6 +21,7 @@
 #include "pcm_mix.h"
 #include "pcm_volume.h"
 #include "pcm_utils.h"
+#include "pcm_simd.h"
 #include "audio_format.h"
 
 #include <glib.h>
@@ -51,16 +52,19 @@ static void
 pcm_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
 	       unsigned num_samples, int volume1, int volume2)
 {
-	while (num_samples > 0) {
-		int32_t sample1 = *buffer1;
-		int32_t sample2 = *buffer2++;
-
-		sample1 = ((sample1 * volume1 + sample2 * volume2) +
-			   pcm_volume_dither() + PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
+	int32_t dither[PCM_SIMD_BLOCK];
 
-		*buffer1++ = pcm_range(sample1, 16);
-		--num_samples;
+	while (num_samples > 0) {
+		unsigned n = num_samples;
+		if (n > PCM_SIMD_BLOCK)
+			n = PCM_SIMD_BLOCK;
+
+		pcm_volume_fill_dither(dither, n);
+		pcm_simd_add_vol_16(buffer1, buffer2, n,
+				    volume1, volume2, dither);
+		buffer1 += n;
+		buffer2 += n;
+		num_samples -= n;
 	}
 }
 
@@ -68,16 +72,19 @@ static void
 pcm_add_vol_24(int32_t *buffer1, const int32_t *buffer2,
 	       unsigned num_samples, unsigned volume1, unsigned volume2)
 {
-	while (num_samples > 0) {
-		int64_t sample1 = *buffer1;
-		int64_t sample2 = *buffer2++;
-
-		sample1 = ((sample1 * volume1 + sample2 * volume2) +
-			   pcm_volume_dither() + PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
+	int32_t dither[PCM_SIMD_BLOCK];
 
-		*buffer1++ = pcm_range(sample1, 24);
-		--num_samples;
+	while (num_samples > 0) {
+		unsigned n = num_samples;
+		if (n > PCM_SIMD_BLOCK)
+			n = PCM_SIMD_BLOCK;
+
+		pcm_volume_fill_dither(dither, n);
+		pcm_simd_add_vol_24(buffer1, buffer2, n,
+				    volume1, volume2, dither);
+		buffer1 += n;
+		buffer2 += n;
+		num_samples -= n;
 	}
 }
 
@@ -85,16 +92,19 @@ static void
 pcm_add_vol_32(int32_t *buffer1, const int32_t *buffer2,
 	       unsigned num_samples, unsigned volume1, unsigned volume2)
 {
-	while (num_samples > 0) {
-		int64_t sample1 = *buffer1;
-		int64_t sample2 = *buffer2++;
+	int32_t dither[PCM_SIMD_BLOCK];
 
-		sample1 = ((sample1 * volume1 + sample2 * volume2) +
-			   pcm_volume_dither() + PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
-
-		*buffer1++ = pcm_range_64(sample1, 32);
-		--num_samples;
+	while (num_samples > 0) {
+		unsigned n = num_samples;
+		if (n > PCM_SIMD_BLOCK)
+			n = PCM_SIMD_BLOCK;
+
+		pcm_volume_fill_dither(dither, n);
+		pcm_simd_add_vol_32(buffer1, buffer2, n,
+				    volume1, volume2, dither);
+		buffer1 += n;
+		buffer2 += n;
+		num_samples -= n;
 	}
 }
 
@@ -19,71 +19,124 @@
 
 #include "config.h"
 #include "pcm_resample_internal.h"
-
-#ifdef HAVE_LIBSAMPLERATE
 #include "conf.h"
-#endif
 
 #include <string.h>
 
+enum pcm_resample_backend {
+	/**
+	 * The nearest-neighbour resampler ("internal").
+	 */
+	PCM_RESAMPLE_FALLBACK,
+
+	/**
+	 * The built-in polyphase FIR resampler.
+	 */
+	PCM_RESAMPLE_POLYPHASE,
+
 #ifdef HAVE_LIBSAMPLERATE
-static bool lsr_enabled;
+	PCM_RESAMPLE_LSR,
 #endif
+};
 
-#ifdef HAVE_LIBSAMPLERATE
-static bool
-pcm_resample_lsr_enabled(void)
+static enum pcm_resample_backend pcm_resample_backend =
+	PCM_RESAMPLE_POLYPHASE;
+
+static inline GQuark
+pcm_resample_quark(void)
 {
-	return lsr_enabled;
+	return g_quark_from_static_string("pcm_resample");
 }
-#endif
 
 bool
 pcm_resample_global_init(GError **error_r)
 {
-#ifdef HAVE_LIBSAMPLERATE
 	const char *converter =
 		config_get_string(CONF_SAMPLERATE_CONVERTER, "");
+	enum pcm_polyphase_quality quality;
+
+	if (strcmp(converter, "internal") == 0) {
+		pcm_resample_backend = PCM_RESAMPLE_FALLBACK;
+		return true;
+	}
 
-	lsr_enabled = strcmp(converter, "internal") != 0;
-	if (lsr_enabled)
-		return pcm_resample_lsr_global_init(converter, error_r);
-	else
+	if (pcm_resample_polyphase_parse(converter, &quality)) {
+		pcm_resample_backend = PCM_RESAMPLE_POLYPHASE;
+		pcm_resample_polyphase_global_init(quality);
 		return true;
+	}
+
+#ifdef HAVE_LIBSAMPLERATE
+	pcm_resample_backend = PCM_RESAMPLE_LSR;
+	return pcm_resample_lsr_global_init(converter, error_r);
 #else
-	(void)error_r;
-	return true;
+	if (*converter == 0) {
+		pcm_resample_backend = PCM_RESAMPLE_POLYPHASE;
+		pcm_resample_polyphase_global_init(PCM_POLYPHASE_MEDIUM);
+		return true;
+	}
+
+	g_set_error(error_r, pcm_resample_quark(), 0,
+		    "unknown samplerate converter '%s'", converter);
+	return false;
 #endif
 }
 
 void pcm_resample_init(struct pcm_resample_state *state)
 {
+	switch (pcm_resample_backend) {
+	case PCM_RESAMPLE_FALLBACK:
+		pcm_resample_fallback_init(state);
+		break;
+
+	case PCM_RESAMPLE_POLYPHASE:
+		pcm_resample_polyphase_init(state);
+		break;
+
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		pcm_resample_lsr_init(state);
-	else
+		break;
 #endif
-		pcm_resample_fallback_init(state);
+	}
 }
 
 void pcm_resample_deinit(struct pcm_resample_state *state)
 {
+	switch (pcm_resample_backend) {
+	case PCM_RESAMPLE_FALLBACK:
+		pcm_resample_fallback_deinit(state);
+		break;
+
+	case PCM_RESAMPLE_POLYPHASE:
+		pcm_resample_polyphase_deinit(state);
+		break;
+
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		pcm_resample_lsr_deinit(state);
-	else
+		break;
 #endif
-		pcm_resample_fallback_deinit(state);
+	}
 }
 
 void
 pcm_resample_reset(struct pcm_resample_state *state)
 {
+	switch (pcm_resample_backend) {
+	case PCM_RESAMPLE_FALLBACK:
+		break;
+
+	case PCM_RESAMPLE_POLYPHASE:
+		pcm_resample_polyphase_reset(state);
+		break;
+
 #ifdef HAVE_LIBSAMPLERATE
-	pcm_resample_lsr_reset(state);
-#else
-	(void)state;
+	case PCM_RESAMPLE_LSR:
+		pcm_resample_lsr_reset(state);
+		break;
 #endif
+	}
 }
 
 const float *
@@ -94,15 +147,26 @@ pcm_resample_float(struct pcm_resample_state *state,
 		   unsigned dest_rate, size_t *dest_size_r,
 		   GError **error_r)
 {
+	switch (pcm_resample_backend) {
+	case PCM_RESAMPLE_FALLBACK:
+		break;
+
+	case PCM_RESAMPLE_POLYPHASE:
+		return pcm_resample_polyphase_float(state, channels,
+						    src_rate, src_buffer,
+						    src_size,
+						    dest_rate, dest_size_r);
+
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		return pcm_resample_lsr_float(state, channels,
 					      src_rate, src_buffer, src_size,
 					      dest_rate, dest_size_r,
 					      error_r);
-#else
-	(void)error_r;
 #endif
+	}
+
+	(void)error_r;
 
 	/* sizeof(float)==sizeof(int32_t); the fallback resampler does
 	   not do any math on the sample values, so this hack is
@@ -121,15 +185,25 @@ pcm_resample_16(struct pcm_resample_state *state,
 		unsigned dest_rate, size_t *dest_size_r,
 		GError **error_r)
 {
+	switch (pcm_resample_backend) {
+	case PCM_RESAMPLE_FALLBACK:
+		break;
+
+	case PCM_RESAMPLE_POLYPHASE:
+		return pcm_resample_polyphase_16(state, channels,
+						 src_rate, src_buffer, src_size,
+						 dest_rate, dest_size_r);
+
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		return pcm_resample_lsr_16(state, channels,
 					   src_rate, src_buffer, src_size,
 					   dest_rate, dest_size_r,
 					   error_r);
-#else
-	(void)error_r;
 #endif
+	}
+
+	(void)error_r;
 
 	return pcm_resample_fallback_16(state, channels,
 					src_rate, src_buffer, src_size,
@@ -143,17 +217,48 @@ pcm_resample_32(struct pcm_resample_state *state,
 		unsigned dest_rate, size_t *dest_size_r,
 		GError **error_r)
 {
+	switch (pcm_resample_backend) {
+	case PCM_RESAMPLE_FALLBACK:
+		break;
+
+	case PCM_RESAMPLE_POLYPHASE:
+		return pcm_resample_polyphase_32(state, channels,
+						 src_rate, src_buffer, src_size,
+						 dest_rate, 32, dest_size_r);
+
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		return pcm_resample_lsr_32(state, channels,
 					   src_rate, src_buffer, src_size,
 					   dest_rate, dest_size_r,
 					   error_r);
-#else
-	(void)error_r;
 #endif
+	}
+
+	(void)error_r;
 
 	return pcm_resample_fallback_32(state, channels,
 					src_rate, src_buffer, src_size,
 					dest_rate, dest_size_r);
 }
+
+const int32_t *
+pcm_resample_24(struct pcm_resample_state *state,
+		unsigned channels,
+		unsigned src_rate, const int32_t *src_buffer, size_t src_size,
+		unsigned dest_rate, size_t *dest_size_r,
+		GError **error_r)
+{
+	if (pcm_resample_backend == PCM_RESAMPLE_POLYPHASE)
+		/* the polyphase resampler needs to know the range
+		   for clipping */
+		return pcm_resample_polyphase_32(state, channels,
+						 src_rate, src_buffer, src_size,
+						 dest_rate, 24, dest_size_r);
+
+	/* reuse the 32 bit code - the other resamplers don't care if
+	   the upper 8 bits are actually used */
+	return pcm_resample_32(state, channels,
+			       src_rate, src_buffer, src_size,
+			       dest_rate, dest_size_r, error_r);
+}
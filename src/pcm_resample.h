@@ -51,6 +51,68 @@ struct pcm_resample_state {
 	int error;
 #endif
 
+	/**
+	 * State of the built-in polyphase FIR resampler, see
+	 * pcm_resample_polyphase.c.
+	 */
+	struct {
+		/**
+		 * The filter coefficients: #phases + 1 rows of #taps
+		 * floats each.  The last row is the filter for the
+		 * next input frame, i.e. a fractional position of 1.
+		 */
+		float *filter;
+
+		/**
+		 * Same as #filter, but in double precision; only
+		 * allocated if #precise is set.
+		 */
+		double *filter_double;
+
+		unsigned taps, phases;
+
+		/**
+		 * The conversion ratio dest_rate/src_rate reduced to
+		 * lowest terms (#up/#down).
+		 */
+		unsigned up, down;
+
+		/**
+		 * The current fractional position in units of
+		 * 1/#up input frames.
+		 */
+		unsigned phase;
+
+		/**
+		 * Are #history and #out in double precision instead
+		 * of float?  This is used for 24 and 32 bit samples,
+		 * which do not fit into a float's mantissa.
+		 */
+		bool precise;
+
+		/**
+		 * Non-interleaved input history, #capacity frames per
+		 * channel, of which the first #frames are valid.  The
+		 * samples are floats, or doubles if #precise is set.
+		 */
+		void *history;
+		unsigned capacity, frames;
+
+		/**
+		 * The index of the input frame in #history the next
+		 * output frame will be centered on.
+		 */
+		unsigned position;
+
+		struct pcm_buffer out;
+
+		struct {
+			unsigned src_rate;
+			unsigned dest_rate;
+			unsigned channels;
+		} prev;
+	} polyphase;
+
 	struct pcm_buffer buffer;
 };
 
@@ -146,19 +208,12 @@ pcm_resample_32(struct pcm_resample_state *state,
  * @param dest_size_r returns the number of bytes of the destination buffer
  * @return the destination buffer
  */
-static inline const int32_t *
+const int32_t *
 pcm_resample_24(struct pcm_resample_state *state,
 		unsigned channels,
 		unsigned src_rate,
 		const int32_t *src_buffer, size_t src_size,
 		unsigned dest_rate, size_t *dest_size_r,
-		GError **error_r)
-{
-	/* reuse the 32 bit code - the resampler code doesn't care if
-	   the upper 8 bits are actually used */
-	return pcm_resample_32(state, channels,
-			       src_rate, src_buffer, src_size,
-			       dest_rate, dest_size_r, error_r);
-}
+		GError **error_r);
 
 #endif
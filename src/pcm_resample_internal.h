@@ -94,4 +94,60 @@ pcm_resample_fallback_32(struct pcm_resample_state *state,
 			 unsigned dest_rate,
 			 size_t *dest_size_r);
 
+enum pcm_polyphase_quality {
+	PCM_POLYPHASE_FAST,
+	PCM_POLYPHASE_MEDIUM,
+	PCM_POLYPHASE_BEST,
+};
+
+/**
+ * Parses a "samplerate_converter" value which selects the polyphase
+ * resampler ("polyphase", "polyphase-fast", "polyphase-medium",
+ * "polyphase-best").
+ *
+ * @return false if the name does not refer to the polyphase
+ * resampler
+ */
+bool
+pcm_resample_polyphase_parse(const char *name,
+			     enum pcm_polyphase_quality *quality_r);
+
+void
+pcm_resample_polyphase_global_init(enum pcm_polyphase_quality quality);
+
+void
+pcm_resample_polyphase_init(struct pcm_resample_state *state);
+
+void
+pcm_resample_polyphase_deinit(struct pcm_resample_state *state);
+
+void
+pcm_resample_polyphase_reset(struct pcm_resample_state *state);
+
+const float *
+pcm_resample_polyphase_float(struct pcm_resample_state *state,
+			     unsigned channels,
+			     unsigned src_rate,
+			     const float *src_buffer, size_t src_size,
+			     unsigned dest_rate, size_t *dest_size_r);
+
+const int16_t *
+pcm_resample_polyphase_16(struct pcm_resample_state *state,
+			  unsigned channels,
+			  unsigned src_rate,
+			  const int16_t *src_buffer, size_t src_size,
+			  unsigned dest_rate, size_t *dest_size_r);
+
+/**
+ * @param bits the sample resolution (24 or 32); the result is
+ * clamped to this range
+ */
+const int32_t *
+pcm_resample_polyphase_32(struct pcm_resample_state *state,
+			  unsigned channels,
+			  unsigned src_rate,
+			  const int32_t *src_buffer, size_t src_size,
+			  unsigned dest_rate, unsigned bits,
+			  size_t *dest_size_r);
+
 #endif
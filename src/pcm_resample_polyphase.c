@@ -0,0 +1,611 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A polyphase FIR resampler.  The conversion ratio is reduced to a
+ * fraction up/down, and a Kaiser windowed sinc low-pass filter is
+ * precomputed for each of the "up" fractional positions between two
+ * input frames.  Each output sample is then a single dot product of
+ * one filter phase with the input history (see pcm_simd_dot_float()).
+ * 24 and 32 bit samples are resampled in double precision instead.
+ */
+
+#include "config.h"
+#include "pcm_resample_internal.h"
+#include "pcm_simd.h"
+#include "pcm_utils.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "pcm"
+
+enum {
+	/**
+	 * The maximum number of filter phases.  Ratios with a larger
+	 * numerator round to the nearest precomputed phase.
+	 */
+	MAX_PHASES = 1024,
+
+	/**
+	 * The number of filter taps is rounded up to a multiple of
+	 * this, to make the vectorized dot product loops efficient.
+	 */
+	TAP_ALIGN = 16,
+};
+
+static const struct polyphase_preset {
+	const char *name;
+
+	/**
+	 * The number of filter taps when upsampling; downsampling
+	 * scales this by src_rate/dest_rate.
+	 */
+	unsigned taps;
+
+	/**
+	 * The stop band attenuation [dB].
+	 */
+	double attenuation;
+} polyphase_presets[] = {
+	[PCM_POLYPHASE_FAST] = { "fast", 24, 70 },
+	[PCM_POLYPHASE_MEDIUM] = { "medium", 64, 90 },
+	[PCM_POLYPHASE_BEST] = { "best", 160, 120 },
+};
+
+static enum pcm_polyphase_quality polyphase_quality = PCM_POLYPHASE_MEDIUM;
+
+bool
+pcm_resample_polyphase_parse(const char *name,
+			     enum pcm_polyphase_quality *quality_r)
+{
+	if (!g_str_has_prefix(name, "polyphase"))
+		return false;
+
+	name += 9;
+	if (*name == 0) {
+		*quality_r = PCM_POLYPHASE_MEDIUM;
+		return true;
+	}
+
+	if (*name++ != '-')
+		return false;
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(polyphase_presets); ++i) {
+		if (strcmp(name, polyphase_presets[i].name) == 0) {
+			*quality_r = (enum pcm_polyphase_quality)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void
+pcm_resample_polyphase_global_init(enum pcm_polyphase_quality quality)
+{
+	assert((unsigned)quality < G_N_ELEMENTS(polyphase_presets));
+
+	polyphase_quality = quality;
+
+	g_debug("polyphase resampler quality '%s'",
+		polyphase_presets[quality].name);
+}
+
+void
+pcm_resample_polyphase_init(struct pcm_resample_state *state)
+{
+	memset(&state->polyphase, 0, sizeof(state->polyphase));
+	pcm_buffer_init(&state->polyphase.out);
+	pcm_buffer_init(&state->buffer);
+}
+
+void
+pcm_resample_polyphase_deinit(struct pcm_resample_state *state)
+{
+	g_free(state->polyphase.filter);
+	g_free(state->polyphase.filter_double);
+	g_free(state->polyphase.history);
+	pcm_buffer_deinit(&state->polyphase.out);
+	pcm_buffer_deinit(&state->buffer);
+}
+
+/**
+ * The size of one sample in the history and in the output buffer.
+ */
+static size_t
+polyphase_sample_size(const struct pcm_resample_state *state)
+{
+	return state->polyphase.precise ? sizeof(double) : sizeof(float);
+}
+
+/**
+ * Prefill the history with silence, so the first output frame is
+ * aligned with the first input frame.
+ */
+static void
+polyphase_clear_history(struct pcm_resample_state *state)
+{
+	unsigned half = state->polyphase.taps / 2;
+
+	state->polyphase.phase = 0;
+	state->polyphase.position = half - 1;
+	state->polyphase.frames = half - 1;
+
+	if (state->polyphase.history != NULL)
+		memset(state->polyphase.history, 0,
+		       state->polyphase.capacity * state->polyphase.prev.channels *
+		       polyphase_sample_size(state));
+}
+
+void
+pcm_resample_polyphase_reset(struct pcm_resample_state *state)
+{
+	if (state->polyphase.filter != NULL)
+		polyphase_clear_history(state);
+}
+
+static unsigned
+gcd(unsigned a, unsigned b)
+{
+	while (b != 0) {
+		unsigned t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * The zeroth order modified Bessel function of the first kind, used
+ * by the Kaiser window.
+ */
+static double
+bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	const double q = x * x / 4;
+
+	for (unsigned k = 1; k < 64; ++k) {
+		term *= q / ((double)k * k);
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+static double
+sinc(double x)
+{
+	return fabs(x) < 1e-9 ? 1 : sin(M_PI * x) / (M_PI * x);
+}
+
+/**
+ * Design the filter for the given ratio.  The cutoff frequency is
+ * chosen so that the Kaiser transition band ends at the lower one of
+ * both Nyquist frequencies.
+ */
+static void
+polyphase_design(struct pcm_resample_state *state,
+		 unsigned up, unsigned down)
+{
+	const struct polyphase_preset *preset =
+		&polyphase_presets[polyphase_quality];
+
+	/* bandwidth relative to the input Nyquist frequency */
+	const double scale = up < down ? (double)up / down : 1.0;
+
+	unsigned taps = preset->taps / scale;
+	taps = (taps + TAP_ALIGN - 1) / TAP_ALIGN * TAP_ALIGN;
+
+	const double a = preset->attenuation;
+	const double beta = a > 50
+		? 0.1102 * (a - 8.7)
+		: 0.5842 * pow(a - 21, 0.4) + 0.07886 * (a - 21);
+	/* Kaiser's transition band estimate, relative to Nyquist */
+	const double transition = (a - 8) / (2.285 * M_PI * (taps - 1)) / scale;
+	const double cutoff = scale * (1 - transition / 2);
+
+	const unsigned phases = up <= MAX_PHASES ? up : MAX_PHASES;
+	const unsigned half = taps / 2;
+	const double i0_beta = bessel_i0(beta);
+
+	/* one more row for the fractional position 1, which the
+	   phase rounding in polyphase_run() may select */
+	double *filter = g_new(double, (phases + 1) * taps);
+
+	for (unsigned p = 0; p <= phases; ++p) {
+		const double frac = (double)p / phases;
+		double *row = filter + p * taps;
+		double sum = 0;
+
+		for (unsigned j = 0; j < taps; ++j) {
+			/* distance of input frame j from the output
+			   position, in input frames */
+			double t = (double)j - (half - 1) - frac;
+			double w = t / half;
+			w = fabs(w) < 1
+				? bessel_i0(beta * sqrt(1 - w * w)) / i0_beta
+				: 0;
+
+			double h = cutoff * sinc(cutoff * t) * w;
+			row[j] = h;
+			sum += h;
+		}
+
+		/* normalize each phase to unity gain at DC */
+		for (unsigned j = 0; j < taps; ++j)
+			row[j] /= sum;
+	}
+
+	float *filter_float = g_new(float, (phases + 1) * taps);
+	for (unsigned i = 0; i < (phases + 1) * taps; ++i)
+		filter_float[i] = filter[i];
+
+	g_free(state->polyphase.filter);
+	state->polyphase.filter = filter_float;
+
+	g_free(state->polyphase.filter_double);
+	if (state->polyphase.precise)
+		state->polyphase.filter_double = filter;
+	else {
+		state->polyphase.filter_double = NULL;
+		g_free(filter);
+	}
+
+	state->polyphase.taps = taps;
+	state->polyphase.phases = phases;
+
+	g_debug("polyphase resampler: ratio %u/%u, %u phases, %u taps",
+		up, down, phases, taps);
+}
+
+/**
+ * @param precise resample in double precision (for 24 and 32 bit
+ * samples)?
+ */
+static void
+polyphase_set(struct pcm_resample_state *state, bool precise,
+	      unsigned channels, unsigned src_rate, unsigned dest_rate)
+{
+	if (state->polyphase.filter != NULL &&
+	    precise == state->polyphase.precise &&
+	    channels == state->polyphase.prev.channels &&
+	    src_rate == state->polyphase.prev.src_rate &&
+	    dest_rate == state->polyphase.prev.dest_rate)
+		return;
+
+	const unsigned divisor = gcd(src_rate, dest_rate);
+	const unsigned up = dest_rate / divisor;
+	const unsigned down = src_rate / divisor;
+
+	const bool precise_changed = precise != state->polyphase.precise;
+	state->polyphase.precise = precise;
+
+	if (state->polyphase.filter == NULL || precise_changed ||
+	    up != state->polyphase.up || down != state->polyphase.down)
+		polyphase_design(state, up, down);
+
+	if (channels != state->polyphase.prev.channels || precise_changed) {
+		/* the history layout depends on the number of
+		   channels and the sample size; reallocate it on the
+		   next call */
+		g_free(state->polyphase.history);
+		state->polyphase.history = NULL;
+		state->polyphase.capacity = 0;
+	}
+
+	state->polyphase.up = up;
+	state->polyphase.down = down;
+	state->polyphase.prev.channels = channels;
+	state->polyphase.prev.src_rate = src_rate;
+	state->polyphase.prev.dest_rate = dest_rate;
+
+	polyphase_clear_history(state);
+}
+
+/**
+ * Make room for the specified number of new frames in the history.
+ */
+static void *
+polyphase_grow(struct pcm_resample_state *state, unsigned channels,
+	       unsigned new_frames)
+{
+	const unsigned needed = state->polyphase.frames + new_frames;
+
+	if (needed > state->polyphase.capacity) {
+		const size_t sample_size = polyphase_sample_size(state);
+		const unsigned old_capacity = state->polyphase.capacity;
+		const unsigned capacity = needed + needed / 2;
+		char *history = g_malloc0(capacity * channels * sample_size);
+		const char *old_history = state->polyphase.history;
+
+		for (unsigned c = 0; c < channels && old_capacity > 0; ++c)
+			memcpy(history + c * capacity * sample_size,
+			       old_history + c * old_capacity * sample_size,
+			       state->polyphase.frames * sample_size);
+
+		g_free(state->polyphase.history);
+		state->polyphase.history = history;
+		state->polyphase.capacity = capacity;
+	}
+
+	return state->polyphase.history;
+}
+
+/**
+ * Append the interleaved input to the (non-interleaved) history,
+ * converting it to float.
+ */
+static void
+polyphase_append_float(struct pcm_resample_state *state, unsigned channels,
+		       const float *src, unsigned n_frames)
+{
+	assert(!state->polyphase.precise);
+
+	float *history = polyphase_grow(state, channels, n_frames);
+	const unsigned capacity = state->polyphase.capacity;
+
+	for (unsigned c = 0; c < channels; ++c) {
+		float *dest = history + c * capacity + state->polyphase.frames;
+		for (unsigned i = 0; i < n_frames; ++i)
+			dest[i] = src[i * channels + c];
+	}
+
+	state->polyphase.frames += n_frames;
+}
+
+static void
+polyphase_append_16(struct pcm_resample_state *state, unsigned channels,
+		    const int16_t *src, unsigned n_frames)
+{
+	assert(!state->polyphase.precise);
+
+	float *history = polyphase_grow(state, channels, n_frames);
+	const unsigned capacity = state->polyphase.capacity;
+
+	for (unsigned c = 0; c < channels; ++c) {
+		float *dest = history + c * capacity + state->polyphase.frames;
+		for (unsigned i = 0; i < n_frames; ++i)
+			dest[i] = src[i * channels + c];
+	}
+
+	state->polyphase.frames += n_frames;
+}
+
+/**
+ * Like polyphase_append_float(), but converts to double, because a
+ * float cannot represent all 32 bit samples.
+ */
+static void
+polyphase_append_32(struct pcm_resample_state *state, unsigned channels,
+		    const int32_t *src, unsigned n_frames)
+{
+	assert(state->polyphase.precise);
+
+	double *history = polyphase_grow(state, channels, n_frames);
+	const unsigned capacity = state->polyphase.capacity;
+
+	for (unsigned c = 0; c < channels; ++c) {
+		double *dest = history + c * capacity + state->polyphase.frames;
+		for (unsigned i = 0; i < n_frames; ++i)
+			dest[i] = src[i * channels + c];
+	}
+
+	state->polyphase.frames += n_frames;
+}
+
+static double
+polyphase_dot_double(const double *a, const double *b, unsigned n)
+{
+	double sum = 0;
+	for (unsigned i = 0; i < n; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+/**
+ * Calculate as many output frames as the history allows, and discard
+ * input frames which are not needed anymore.
+ *
+ * @return the (interleaved) output buffer; floats, or doubles if
+ * the state is "precise"
+ */
+static void *
+polyphase_run(struct pcm_resample_state *state, unsigned channels,
+	      unsigned *n_frames_r)
+{
+	const unsigned taps = state->polyphase.taps;
+	const unsigned half = taps / 2;
+	const unsigned up = state->polyphase.up;
+	const unsigned down = state->polyphase.down;
+	const unsigned phases = state->polyphase.phases;
+	const unsigned capacity = state->polyphase.capacity;
+	const bool precise = state->polyphase.precise;
+	const size_t sample_size = polyphase_sample_size(state);
+
+	unsigned position = state->polyphase.position;
+	unsigned phase = state->polyphase.phase;
+	const unsigned frames = state->polyphase.frames;
+
+	/* upper bound for the number of output frames */
+	const unsigned max_frames = frames > position + half
+		? ((uint64_t)(frames - position) * up) / down + 1
+		: 0;
+	void *dest = pcm_buffer_get(&state->polyphase.out,
+				    max_frames * channels * sample_size);
+
+	unsigned n = 0;
+	while (position + half < frames) {
+		assert(n < max_frames);
+
+		/* round to the nearest phase; this may select the
+		   extra row for the fractional position 1 */
+		const unsigned row = phases == up
+			? phase
+			: (unsigned)(((uint64_t)phase * phases + up / 2) / up);
+		assert(row <= phases);
+
+		const unsigned start = position - (half - 1);
+
+		if (precise) {
+			const double *filter =
+				state->polyphase.filter_double + row * taps;
+			const double *src =
+				(const double *)state->polyphase.history +
+				start;
+			double *d = (double *)dest + n * channels;
+
+			for (unsigned c = 0; c < channels; ++c)
+				d[c] = polyphase_dot_double(filter,
+							    src + c * capacity,
+							    taps);
+		} else {
+			const float *filter =
+				state->polyphase.filter + row * taps;
+			const float *src =
+				(const float *)state->polyphase.history +
+				start;
+			float *d = (float *)dest + n * channels;
+
+			for (unsigned c = 0; c < channels; ++c)
+				d[c] = pcm_simd_dot_float(filter,
+							  src + c * capacity,
+							  taps);
+		}
+
+		++n;
+
+		phase += down;
+		position += phase / up;
+		phase %= up;
+	}
+
+	/* discard the frames which are not needed anymore */
+
+	/* the filter is always longer than one step, so the window
+	   start cannot move beyond the end of the history */
+	const unsigned first = position - (half - 1);
+	assert(first <= frames);
+
+	if (first > 0) {
+		const unsigned keep = frames - first;
+		char *p = state->polyphase.history;
+
+		for (unsigned c = 0; c < channels; ++c)
+			memmove(p + c * capacity * sample_size,
+				p + (c * capacity + first) * sample_size,
+				keep * sample_size);
+
+		state->polyphase.frames = keep;
+		position -= first;
+	}
+
+	state->polyphase.position = position;
+	state->polyphase.phase = phase;
+
+	*n_frames_r = n;
+	return dest;
+}
+
+const float *
+pcm_resample_polyphase_float(struct pcm_resample_state *state,
+			     unsigned channels,
+			     unsigned src_rate,
+			     const float *src_buffer, size_t src_size,
+			     unsigned dest_rate, size_t *dest_size_r)
+{
+	assert((src_size % (sizeof(*src_buffer) * channels)) == 0);
+
+	polyphase_set(state, false, channels, src_rate, dest_rate);
+
+	const unsigned src_frames =
+		src_size / sizeof(*src_buffer) / channels;
+	polyphase_append_float(state, channels, src_buffer, src_frames);
+
+	unsigned dest_frames;
+	const float *dest = polyphase_run(state, channels, &dest_frames);
+
+	*dest_size_r = dest_frames * channels * sizeof(*dest);
+	return dest;
+}
+
+const int16_t *
+pcm_resample_polyphase_16(struct pcm_resample_state *state,
+			  unsigned channels,
+			  unsigned src_rate,
+			  const int16_t *src_buffer, size_t src_size,
+			  unsigned dest_rate, size_t *dest_size_r)
+{
+	assert((src_size % (sizeof(*src_buffer) * channels)) == 0);
+
+	polyphase_set(state, false, channels, src_rate, dest_rate);
+
+	const unsigned src_frames =
+		src_size / sizeof(*src_buffer) / channels;
+	polyphase_append_16(state, channels, src_buffer, src_frames);
+
+	unsigned dest_frames;
+	const float *out = polyphase_run(state, channels, &dest_frames);
+
+	const unsigned n = dest_frames * channels;
+	int16_t *dest = pcm_buffer_get(&state->buffer, n * sizeof(*dest));
+	for (unsigned i = 0; i < n; ++i)
+		dest[i] = pcm_clamp_16(lrintf(out[i]));
+
+	*dest_size_r = n * sizeof(*dest);
+	return dest;
+}
+
+const int32_t *
+pcm_resample_polyphase_32(struct pcm_resample_state *state,
+			  unsigned channels,
+			  unsigned src_rate,
+			  const int32_t *src_buffer, size_t src_size,
+			  unsigned dest_rate, unsigned bits,
+			  size_t *dest_size_r)
+{
+	assert((src_size % (sizeof(*src_buffer) * channels)) == 0);
+	assert(bits == 24 || bits == 32);
+
+	polyphase_set(state, true, channels, src_rate, dest_rate);
+
+	const unsigned src_frames =
+		src_size / sizeof(*src_buffer) / channels;
+	polyphase_append_32(state, channels, src_buffer, src_frames);
+
+	unsigned dest_frames;
+	const double *out = polyphase_run(state, channels, &dest_frames);
+
+	const unsigned n = dest_frames * channels;
+	int32_t *dest = pcm_buffer_get(&state->buffer, n * sizeof(*dest));
+	for (unsigned i = 0; i < n; ++i)
+		dest[i] = pcm_range_64(llrint(out[i]), bits);
+
+	*dest_size_r = n * sizeof(*dest);
+	return dest;
+}
@@ -0,0 +1,1651 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "pcm_simd.h"
+#include "pcm_volume.h"
+#include "pcm_utils.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <stdbool.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || GCC_CHECK_VERSION(4,9))
+#define PCM_SIMD_X86
+#include <immintrin.h>
+#define gcc_target(t) __attribute__((target(t)))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PCM_SIMD_ARM
+#include <arm_neon.h>
+#endif
+
+/**
+ * The bit mask of supported instruction sets, initialized lazily by
+ * pcm_simd_detect().  #pcm_simd_once makes sure this happens only
+ * once, even if several threads (decoder and outputs) call the
+ * first kernel at the same time.
+ */
+static unsigned pcm_simd_supported;
+
+/**
+ * The bit mask of enabled instruction sets; this is
+ * #pcm_simd_supported with pcm_simd_restrict() applied.
+ */
+static unsigned pcm_simd_enabled;
+
+static GOnce pcm_simd_once = G_ONCE_INIT;
+
+static unsigned
+pcm_simd_detect(void)
+{
+	unsigned mask = 0;
+
+#ifdef PCM_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		mask |= PCM_SIMD_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		mask |= PCM_SIMD_AVX2;
+#endif
+
+#ifdef PCM_SIMD_ARM
+	mask |= PCM_SIMD_NEON;
+#endif
+
+	return mask;
+}
+
+static gpointer
+pcm_simd_init(G_GNUC_UNUSED gpointer data)
+{
+	pcm_simd_supported = pcm_simd_enabled = pcm_simd_detect();
+	return NULL;
+}
+
+static inline unsigned
+pcm_simd_get(void)
+{
+	g_once(&pcm_simd_once, pcm_simd_init, NULL);
+	return pcm_simd_enabled;
+}
+
+unsigned
+pcm_simd_features(void)
+{
+	return pcm_simd_get();
+}
+
+void
+pcm_simd_restrict(unsigned mask)
+{
+	pcm_simd_get();
+	pcm_simd_enabled = pcm_simd_supported & mask;
+}
+
+const char *
+pcm_simd_features_string(unsigned mask)
+{
+	if (mask & PCM_SIMD_AVX2)
+		return mask & PCM_SIMD_SSE2 ? "sse2 avx2" : "avx2";
+	if (mask & PCM_SIMD_SSE2)
+		return "sse2";
+	if (mask & PCM_SIMD_NEON)
+		return "neon";
+	return "none";
+}
+
+/*
+ * Portable implementations.  These are also used for the remainder
+ * of a buffer which is not a multiple of the vector size.
+ *
+ */
+
+static void
+pcm_volume_16_generic(int16_t *buffer, unsigned n, int volume,
+		      const int32_t *dither)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int32_t sample = buffer[i];
+
+		sample = (sample * volume + dither[i] + PCM_VOLUME_1 / 2)
+			/ PCM_VOLUME_1;
+
+		buffer[i] = pcm_range(sample, 16);
+	}
+}
+
+static void
+pcm_volume_24_generic(int32_t *buffer, unsigned n, int volume,
+		      const int32_t *dither)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int64_t sample = buffer[i];
+
+		sample = (sample * volume + dither[i] + PCM_VOLUME_1 / 2)
+			/ PCM_VOLUME_1;
+
+		buffer[i] = pcm_range(sample, 24);
+	}
+}
+
+static void
+pcm_volume_32_generic(int32_t *buffer, unsigned n, int volume,
+		      const int32_t *dither)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int64_t sample = buffer[i];
+
+		sample = (sample * volume + dither[i] + PCM_VOLUME_1 / 2)
+			/ PCM_VOLUME_1;
+
+		buffer[i] = pcm_range_64(sample, 32);
+	}
+}
+
+static void
+pcm_add_vol_16_generic(int16_t *buffer1, const int16_t *buffer2,
+		       unsigned n, int volume1, int volume2,
+		       const int32_t *dither)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int32_t sample1 = buffer1[i];
+		int32_t sample2 = buffer2[i];
+
+		sample1 = ((sample1 * volume1 + sample2 * volume2) +
+			   dither[i] + PCM_VOLUME_1 / 2)
+			/ PCM_VOLUME_1;
+
+		buffer1[i] = pcm_range(sample1, 16);
+	}
+}
+
+static void
+pcm_add_vol_24_generic(int32_t *buffer1, const int32_t *buffer2,
+		       unsigned n, int volume1, int volume2,
+		       const int32_t *dither)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int64_t sample1 = buffer1[i];
+		int64_t sample2 = buffer2[i];
+
+		sample1 = ((sample1 * volume1 + sample2 * volume2) +
+			   dither[i] + PCM_VOLUME_1 / 2)
+			/ PCM_VOLUME_1;
+
+		buffer1[i] = pcm_range(sample1, 24);
+	}
+}
+
+static void
+pcm_add_vol_32_generic(int32_t *buffer1, const int32_t *buffer2,
+		       unsigned n, int volume1, int volume2,
+		       const int32_t *dither)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int64_t sample1 = buffer1[i];
+		int64_t sample2 = buffer2[i];
+
+		sample1 = ((sample1 * volume1 + sample2 * volume2) +
+			   dither[i] + PCM_VOLUME_1 / 2)
+			/ PCM_VOLUME_1;
+
+		buffer1[i] = pcm_range_64(sample1, 32);
+	}
+}
+
+static void
+pcm_shift_16_to_32_generic(int32_t *out, const int16_t *in, unsigned n,
+			   unsigned shift)
+{
+	for (unsigned i = 0; i < n; ++i)
+		out[i] = in[i] << shift;
+}
+
+static void
+pcm_shift_24_to_32_generic(int32_t *out, const int32_t *in, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		out[i] = in[i] << 8;
+}
+
+static void
+pcm_shift_32_to_24_generic(int32_t *out, const int32_t *in, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		out[i] = in[i] >> 8;
+}
+
+static void
+pcm_16_to_float_generic(float *out, const int16_t *in, unsigned n,
+			float factor)
+{
+	for (unsigned i = 0; i < n; ++i)
+		out[i] = (float)in[i] * factor;
+}
+
+static void
+pcm_32_to_float_generic(float *out, const int32_t *in, unsigned n,
+			float factor)
+{
+	for (unsigned i = 0; i < n; ++i)
+		out[i] = (float)in[i] * factor;
+}
+
+static void
+pcm_float_to_16_generic(int16_t *out, const float *in, unsigned n)
+{
+	const float factor = 1 << 15;
+
+	for (unsigned i = 0; i < n; ++i) {
+		int sample = in[i] * factor;
+		out[i] = pcm_clamp_16(sample);
+	}
+}
+
+static void
+pcm_float_to_24_generic(int32_t *out, const float *in, unsigned n)
+{
+	const float factor = 1 << 23;
+
+	for (unsigned i = 0; i < n; ++i) {
+		int sample = in[i] * factor;
+		out[i] = pcm_clamp_24(sample);
+	}
+}
+
+static float
+pcm_dot_float_generic(const float *a, const float *b, unsigned n)
+{
+	float sum = 0;
+	for (unsigned i = 0; i < n; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+/**
+ * Interleaves the samples [i, n) of each channel; #dest points to
+ * the destination of frame #i.
+ */
+static void
+pcm_interleave_16_generic(int16_t *dest, const int32_t *const*src,
+			  unsigned channels, unsigned i, unsigned n)
+{
+	for (; i < n; ++i)
+		for (unsigned c = 0; c < channels; ++c)
+			*dest++ = src[c][i];
+}
+
+/**
+ * Interleaves the samples [i, n) of each channel; #dest points to
+ * the destination of frame #i.
+ */
+static void
+pcm_interleave_32_generic(int32_t *dest, const int32_t *const*src,
+			  unsigned channels, unsigned i, unsigned n)
+{
+	for (; i < n; ++i)
+		for (unsigned c = 0; c < channels; ++c)
+			*dest++ = src[c][i];
+}
+
+static void
+pcm_narrow_32_to_16_generic(int16_t *out, const int32_t *in, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		out[i] = in[i];
+}
+
+static void
+pcm_pack_24_generic(uint8_t *dest, const int32_t *src, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		/* read the whole sample before writing, for in-place
+		   operation */
+		const int32_t x = src[i];
+
+		if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+			*dest++ = x >> 16;
+			*dest++ = x >> 8;
+			*dest++ = x;
+		} else {
+			*dest++ = x;
+			*dest++ = x >> 8;
+			*dest++ = x >> 16;
+		}
+	}
+}
+
+static void
+pcm_unpack_24_generic(int32_t *dest, const uint8_t *src, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i, src += 3) {
+		int32_t x = G_BYTE_ORDER == G_BIG_ENDIAN
+			? (src[0] << 16) | (src[1] << 8) | src[2]
+			: (src[2] << 16) | (src[1] << 8) | src[0];
+
+		/* extend the sign bit */
+		dest[i] = (x ^ 0x800000) - 0x800000;
+	}
+}
+
+#ifdef PCM_SIMD_X86
+
+/*
+ * SSE2 implementations.  SSE2 has no 32x32 bit multiplication, but
+ * _mm_madd_epi16() calculates exact 32 bit products of 16 bit
+ * operands, which is good enough for 16 bit samples and volumes up
+ * to 32767.
+ *
+ */
+
+/**
+ * Divide by #PCM_VOLUME_1, rounding towards zero like the C division
+ * operator does.
+ */
+gcc_target("sse2")
+static inline __m128i
+pcm_div_volume_sse2(__m128i x)
+{
+	__m128i bias = _mm_and_si128(_mm_srai_epi32(x, 31),
+				     _mm_set1_epi32(PCM_VOLUME_1 - 1));
+	return _mm_srai_epi32(_mm_add_epi32(x, bias), 10);
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_volume_16_sse2(int16_t *buffer, unsigned n, int volume,
+		   const int32_t *dither)
+{
+	const __m128i v = _mm_set1_epi32(volume);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(PCM_VOLUME_1 / 2);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(buffer + i));
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(s, zero), v);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(s, zero), v);
+
+		lo = _mm_add_epi32(lo, _mm_add_epi32(round,
+			_mm_loadu_si128((const __m128i *)(dither + i))));
+		hi = _mm_add_epi32(hi, _mm_add_epi32(round,
+			_mm_loadu_si128((const __m128i *)(dither + i + 4))));
+
+		s = _mm_packs_epi32(pcm_div_volume_sse2(lo),
+				    pcm_div_volume_sse2(hi));
+		_mm_storeu_si128((__m128i *)(buffer + i), s);
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_add_vol_16_sse2(int16_t *buffer1, const int16_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither)
+{
+	/* each 32 bit lane holds the pair (volume1, volume2) */
+	const __m128i v = _mm_set1_epi32((volume1 & 0xffff) |
+					 (volume2 << 16));
+	const __m128i round = _mm_set1_epi32(PCM_VOLUME_1 / 2);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i s1 = _mm_loadu_si128((const __m128i *)(buffer1 + i));
+		__m128i s2 = _mm_loadu_si128((const __m128i *)(buffer2 + i));
+
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(s1, s2), v);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(s1, s2), v);
+
+		lo = _mm_add_epi32(lo, _mm_add_epi32(round,
+			_mm_loadu_si128((const __m128i *)(dither + i))));
+		hi = _mm_add_epi32(hi, _mm_add_epi32(round,
+			_mm_loadu_si128((const __m128i *)(dither + i + 4))));
+
+		s1 = _mm_packs_epi32(pcm_div_volume_sse2(lo),
+				     pcm_div_volume_sse2(hi));
+		_mm_storeu_si128((__m128i *)(buffer1 + i), s1);
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_shift_16_to_32_sse2(int32_t *out, const int16_t *in, unsigned n,
+			unsigned shift)
+{
+	/* unpacking (0, x) yields x << 16; shift back as needed */
+	const __m128i count = _mm_cvtsi32_si128(16 - shift);
+	const __m128i zero = _mm_setzero_si128();
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i lo = _mm_sra_epi32(_mm_unpacklo_epi16(zero, s), count);
+		__m128i hi = _mm_sra_epi32(_mm_unpackhi_epi16(zero, s), count);
+		_mm_storeu_si128((__m128i *)(out + i), lo);
+		_mm_storeu_si128((__m128i *)(out + i + 4), hi);
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_shift_24_to_32_sse2(int32_t *out, const int32_t *in, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_slli_epi32(s, 8));
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_shift_32_to_24_sse2(int32_t *out, const int32_t *in, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_srai_epi32(s, 8));
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_16_to_float_sse2(float *out, const int16_t *in, unsigned n, float factor)
+{
+	const __m128 f = _mm_set1_ps(factor);
+	const __m128i zero = _mm_setzero_si128();
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, s), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), f));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), f));
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_32_to_float_sse2(float *out, const int32_t *in, unsigned n, float factor)
+{
+	const __m128 f = _mm_set1_ps(factor);
+
+	unsigned i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(s), f));
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_float_to_16_sse2(int16_t *out, const float *in, unsigned n)
+{
+	const __m128 f = _mm_set1_ps(1 << 15);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i),
+							 f));
+		__m128i hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4),
+							 f));
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm_packs_epi32(lo, hi));
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static float
+pcm_dot_float_sse2(const float *a, const float *b, unsigned n,
+		   unsigned *done_r)
+{
+	__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i),
+						   _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+						   _mm_loadu_ps(b + i + 4)));
+	}
+
+	float tmp[4];
+	_mm_storeu_ps(tmp, _mm_add_ps(sum0, sum1));
+	*done_r = i;
+	return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+}
+
+/**
+ * Transposes a 4x4 matrix of 32 bit values: on return, each vector
+ * contains one frame of four channels.
+ */
+gcc_target("sse2")
+static inline void
+pcm_transpose_4x4_sse2(__m128i *a, __m128i *b, __m128i *c, __m128i *d)
+{
+	__m128i t0 = _mm_unpacklo_epi32(*a, *b);
+	__m128i t1 = _mm_unpacklo_epi32(*c, *d);
+	__m128i t2 = _mm_unpackhi_epi32(*a, *b);
+	__m128i t3 = _mm_unpackhi_epi32(*c, *d);
+
+	*a = _mm_unpacklo_epi64(t0, t1);
+	*b = _mm_unpackhi_epi64(t0, t1);
+	*c = _mm_unpacklo_epi64(t2, t3);
+	*d = _mm_unpackhi_epi64(t2, t3);
+}
+
+/**
+ * Truncates 32 bit values to 16 bit, so the saturating
+ * _mm_packs_epi32() behaves like a C cast.
+ */
+gcc_target("sse2")
+static inline __m128i
+pcm_truncate_16_sse2(__m128i x)
+{
+	return _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_interleave_32_sse2(int32_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n)
+{
+	unsigned i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= n; i += 4) {
+			__m128i l = _mm_loadu_si128((const __m128i *)(src[0] + i));
+			__m128i r = _mm_loadu_si128((const __m128i *)(src[1] + i));
+			_mm_storeu_si128((__m128i *)(dest + i * 2),
+					 _mm_unpacklo_epi32(l, r));
+			_mm_storeu_si128((__m128i *)(dest + i * 2 + 4),
+					 _mm_unpackhi_epi32(l, r));
+		}
+	} else if (channels == 6) {
+		for (; i + 4 <= n; i += 4) {
+			__m128i f[4], p[2];
+			for (unsigned c = 0; c < 4; ++c)
+				f[c] = _mm_loadu_si128((const __m128i *)(src[c] + i));
+			pcm_transpose_4x4_sse2(&f[0], &f[1], &f[2], &f[3]);
+
+			/* channels 4 and 5: two frames per vector */
+			__m128i c4 = _mm_loadu_si128((const __m128i *)(src[4] + i));
+			__m128i c5 = _mm_loadu_si128((const __m128i *)(src[5] + i));
+			p[0] = _mm_unpacklo_epi32(c4, c5);
+			p[1] = _mm_unpackhi_epi32(c4, c5);
+
+			int32_t *d = dest + i * 6;
+			for (unsigned k = 0; k < 4; ++k, d += 6) {
+				__m128i q = k & 1
+					? _mm_srli_si128(p[k / 2], 8)
+					: p[k / 2];
+				_mm_storeu_si128((__m128i *)d, f[k]);
+				_mm_storel_epi64((__m128i *)(d + 4), q);
+			}
+		}
+	} else if (channels == 8) {
+		for (; i + 4 <= n; i += 4) {
+			__m128i lo[4], hi[4];
+			for (unsigned c = 0; c < 4; ++c) {
+				lo[c] = _mm_loadu_si128((const __m128i *)(src[c] + i));
+				hi[c] = _mm_loadu_si128((const __m128i *)(src[c + 4] + i));
+			}
+
+			pcm_transpose_4x4_sse2(&lo[0], &lo[1], &lo[2], &lo[3]);
+			pcm_transpose_4x4_sse2(&hi[0], &hi[1], &hi[2], &hi[3]);
+
+			int32_t *d = dest + i * 8;
+			for (unsigned k = 0; k < 4; ++k, d += 8) {
+				_mm_storeu_si128((__m128i *)d, lo[k]);
+				_mm_storeu_si128((__m128i *)(d + 4), hi[k]);
+			}
+		}
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_interleave_16_sse2(int16_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n)
+{
+	unsigned i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= n; i += 4) {
+			__m128i l = _mm_loadu_si128((const __m128i *)(src[0] + i));
+			__m128i r = _mm_loadu_si128((const __m128i *)(src[1] + i));
+			__m128i lo = pcm_truncate_16_sse2(_mm_unpacklo_epi32(l, r));
+			__m128i hi = pcm_truncate_16_sse2(_mm_unpackhi_epi32(l, r));
+			_mm_storeu_si128((__m128i *)(dest + i * 2),
+					 _mm_packs_epi32(lo, hi));
+		}
+	} else if (channels == 8) {
+		for (; i + 4 <= n; i += 4) {
+			__m128i lo[4], hi[4];
+			for (unsigned c = 0; c < 4; ++c) {
+				lo[c] = _mm_loadu_si128((const __m128i *)(src[c] + i));
+				hi[c] = _mm_loadu_si128((const __m128i *)(src[c + 4] + i));
+			}
+
+			pcm_transpose_4x4_sse2(&lo[0], &lo[1], &lo[2], &lo[3]);
+			pcm_transpose_4x4_sse2(&hi[0], &hi[1], &hi[2], &hi[3]);
+
+			int16_t *d = dest + i * 8;
+			for (unsigned k = 0; k < 4; ++k, d += 8)
+				_mm_storeu_si128((__m128i *)d,
+						 _mm_packs_epi32(pcm_truncate_16_sse2(lo[k]),
+								 pcm_truncate_16_sse2(hi[k])));
+		}
+	}
+
+	return i;
+}
+
+gcc_target("sse2")
+static unsigned
+pcm_narrow_32_to_16_sse2(int16_t *out, const int32_t *in, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		/* both loads happen before the store, which allows
+		   in-place operation */
+		__m128i lo = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(in + i + 4));
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm_packs_epi32(pcm_truncate_16_sse2(lo),
+						 pcm_truncate_16_sse2(hi)));
+	}
+
+	return i;
+}
+
+/*
+ * AVX2 implementations.  AVX2 adds 32 bit multiplication and signed
+ * 32x32->64 bit multiplication, which allows vectorizing the 24 and
+ * 32 bit kernels.
+ *
+ */
+
+gcc_target("avx2")
+static inline __m256i
+pcm_div_volume_avx2(__m256i x)
+{
+	__m256i bias = _mm256_and_si256(_mm256_srai_epi32(x, 31),
+					_mm256_set1_epi32(PCM_VOLUME_1 - 1));
+	return _mm256_srai_epi32(_mm256_add_epi32(x, bias), 10);
+}
+
+/**
+ * Divide 64 bit integers by #PCM_VOLUME_1 (rounding towards zero)
+ * and return the low 32 bits of each quotient in the 4 lower 32 bit
+ * lanes.  The caller must ensure that the quotients fit into 32
+ * bits; that allows using a logical shift, because AVX2 has no 64
+ * bit arithmetic shift.
+ */
+gcc_target("avx2")
+static inline __m128i
+pcm_div_volume_64_avx2(__m256i x)
+{
+	__m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), x);
+	__m256i bias = _mm256_and_si256(negative,
+					_mm256_set1_epi64x(PCM_VOLUME_1 - 1));
+	x = _mm256_srli_epi64(_mm256_add_epi64(x, bias), 10);
+
+	x = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 2, 4, 6,
+							     1, 3, 5, 7));
+	return _mm256_castsi256_si128(x);
+}
+
+gcc_target("avx2")
+static unsigned
+pcm_volume_16_avx2(int16_t *buffer, unsigned n, int volume,
+		   const int32_t *dither)
+{
+	const __m256i v = _mm256_set1_epi32(volume);
+	const __m256i round = _mm256_set1_epi32(PCM_VOLUME_1 / 2);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(buffer + i)));
+		s = _mm256_mullo_epi32(s, v);
+		s = _mm256_add_epi32(s, _mm256_add_epi32(round,
+			_mm256_loadu_si256((const __m256i *)(dither + i))));
+		s = pcm_div_volume_avx2(s);
+
+		s = _mm256_permute4x64_epi64(_mm256_packs_epi32(s, s), 0x08);
+		_mm_storeu_si128((__m128i *)(buffer + i),
+				 _mm256_castsi256_si128(s));
+	}
+
+	return i;
+}
+
+gcc_target("avx2")
+static unsigned
+pcm_add_vol_16_avx2(int16_t *buffer1, const int16_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither)
+{
+	const __m256i v1 = _mm256_set1_epi32(volume1);
+	const __m256i v2 = _mm256_set1_epi32(volume2);
+	const __m256i round = _mm256_set1_epi32(PCM_VOLUME_1 / 2);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i s1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(buffer1 + i)));
+		__m256i s2 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(buffer2 + i)));
+
+		s1 = _mm256_add_epi32(_mm256_mullo_epi32(s1, v1),
+				      _mm256_mullo_epi32(s2, v2));
+		s1 = _mm256_add_epi32(s1, _mm256_add_epi32(round,
+			_mm256_loadu_si256((const __m256i *)(dither + i))));
+		s1 = pcm_div_volume_avx2(s1);
+
+		s1 = _mm256_permute4x64_epi64(_mm256_packs_epi32(s1, s1), 0x08);
+		_mm_storeu_si128((__m128i *)(buffer1 + i),
+				 _mm256_castsi256_si128(s1));
+	}
+
+	return i;
+}
+
+/**
+ * Vectorized volume kernel for 24 and 32 bit samples.  The caller
+ * must ensure that the volume does not exceed #PCM_VOLUME_1, which
+ * guarantees that the 32 bit quotients cannot overflow.
+ */
+gcc_target("avx2")
+static unsigned
+pcm_volume_32_avx2(int32_t *buffer, unsigned n, int volume,
+		   const int32_t *dither, unsigned bits)
+{
+	const __m256i v = _mm256_set1_epi64x(volume);
+	const __m256i round = _mm256_set1_epi64x(PCM_VOLUME_1 / 2);
+	const __m128i min = _mm_set1_epi32((int32_t)-((int64_t)1 << (bits - 1)));
+	const __m128i max = _mm_set1_epi32((int32_t)(((int64_t)1 << (bits - 1)) - 1));
+
+	unsigned i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i s = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(buffer + i)));
+		__m256i d = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(dither + i)));
+
+		s = _mm256_add_epi64(_mm256_mul_epi32(s, v),
+				     _mm256_add_epi64(d, round));
+
+		__m128i r = pcm_div_volume_64_avx2(s);
+		r = _mm_min_epi32(_mm_max_epi32(r, min), max);
+		_mm_storeu_si128((__m128i *)(buffer + i), r);
+	}
+
+	return i;
+}
+
+/**
+ * Vectorized mixing kernel for 24 and 32 bit samples.  The caller
+ * must ensure that volume1+volume2 does not exceed #PCM_VOLUME_1.
+ */
+gcc_target("avx2")
+static unsigned
+pcm_add_vol_32_avx2(int32_t *buffer1, const int32_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither,
+		    unsigned bits)
+{
+	const __m256i v1 = _mm256_set1_epi64x(volume1);
+	const __m256i v2 = _mm256_set1_epi64x(volume2);
+	const __m256i round = _mm256_set1_epi64x(PCM_VOLUME_1 / 2);
+	const __m128i min = _mm_set1_epi32((int32_t)-((int64_t)1 << (bits - 1)));
+	const __m128i max = _mm_set1_epi32((int32_t)(((int64_t)1 << (bits - 1)) - 1));
+
+	unsigned i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i s1 = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(buffer1 + i)));
+		__m256i s2 = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(buffer2 + i)));
+		__m256i d = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(dither + i)));
+
+		s1 = _mm256_add_epi64(_mm256_mul_epi32(s1, v1),
+				      _mm256_mul_epi32(s2, v2));
+		s1 = _mm256_add_epi64(s1, _mm256_add_epi64(d, round));
+
+		__m128i r = pcm_div_volume_64_avx2(s1);
+		r = _mm_min_epi32(_mm_max_epi32(r, min), max);
+		_mm_storeu_si128((__m128i *)(buffer1 + i), r);
+	}
+
+	return i;
+}
+
+gcc_target("avx2")
+static unsigned
+pcm_shift_16_to_32_avx2(int32_t *out, const int16_t *in, unsigned n,
+			unsigned shift)
+{
+	const __m128i count = _mm_cvtsi32_si128(shift);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_sll_epi32(s, count));
+	}
+
+	return i;
+}
+
+gcc_target("avx2")
+static unsigned
+pcm_float_to_24_avx2(int32_t *out, const float *in, unsigned n)
+{
+	const __m256 f = _mm256_set1_ps(1 << 23);
+	const __m256i min = _mm256_set1_epi32(-(1 << 23));
+	const __m256i max = _mm256_set1_epi32((1 << 23) - 1);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i s = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(in + i), f));
+		s = _mm256_min_epi32(_mm256_max_epi32(s, min), max);
+		_mm256_storeu_si256((__m256i *)(out + i), s);
+	}
+
+	return i;
+}
+
+gcc_target("avx2")
+static float
+pcm_dot_float_avx2(const float *a, const float *b, unsigned n,
+		   unsigned *done_r)
+{
+	__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+
+	unsigned i = 0;
+	for (; i + 16 <= n; i += 16) {
+		sum0 = _mm256_add_ps(sum0,
+				     _mm256_mul_ps(_mm256_loadu_ps(a + i),
+						   _mm256_loadu_ps(b + i)));
+		sum1 = _mm256_add_ps(sum1,
+				     _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+						   _mm256_loadu_ps(b + i + 8)));
+	}
+
+	__m256 sum = _mm256_add_ps(sum0, sum1);
+	__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum),
+				 _mm256_extractf128_ps(sum, 1));
+
+	float tmp[4];
+	_mm_storeu_ps(tmp, sum4);
+	*done_r = i;
+	return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+}
+
+/*
+ * The 24 bit packing kernels need the SSSE3 byte shuffle, which all
+ * AVX2 capable CPUs have; 16 samples (48 packed bytes) are processed
+ * at a time.  Little endian only, like all x86 CPUs.
+ *
+ */
+
+gcc_target("avx2")
+static unsigned
+pcm_pack_24_avx2(uint8_t *dest, const int32_t *src, unsigned n)
+{
+	/* the lower 3 bytes of each sample, packed into the lower 12
+	   bytes of the vector */
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10,
+					      12, 13, 14, -1, -1, -1, -1);
+
+	unsigned i = 0;
+	for (; i + 16 <= n; i += 16) {
+		/* load everything before storing, which allows
+		   in-place operation */
+		__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), shuffle);
+		__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i + 4)), shuffle);
+		__m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i + 8)), shuffle);
+		__m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i + 12)), shuffle);
+
+		uint8_t *p = dest + i * 3;
+		_mm_storeu_si128((__m128i *)p,
+				 _mm_or_si128(a, _mm_slli_si128(b, 12)));
+		_mm_storeu_si128((__m128i *)(p + 16),
+				 _mm_or_si128(_mm_srli_si128(b, 4),
+					      _mm_slli_si128(c, 8)));
+		_mm_storeu_si128((__m128i *)(p + 32),
+				 _mm_or_si128(_mm_srli_si128(c, 8),
+					      _mm_slli_si128(d, 4)));
+	}
+
+	return i;
+}
+
+gcc_target("avx2")
+static unsigned
+pcm_unpack_24_avx2(int32_t *dest, const uint8_t *src, unsigned n)
+{
+	/* move the 3 bytes of each sample to the upper 3 bytes of a 32
+	   bit lane; the arithmetic shift then extends the sign bit */
+	const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					      -1, 6, 7, 8, -1, 9, 10, 11);
+
+	unsigned i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const uint8_t *p = src + i * 3;
+		__m128i x = _mm_loadu_si128((const __m128i *)p);
+		__m128i y = _mm_loadu_si128((const __m128i *)(p + 16));
+		__m128i z = _mm_loadu_si128((const __m128i *)(p + 32));
+
+		__m128i a = x;
+		__m128i b = _mm_alignr_epi8(y, x, 12);
+		__m128i c = _mm_alignr_epi8(z, y, 8);
+		__m128i d = _mm_srli_si128(z, 4);
+
+		_mm_storeu_si128((__m128i *)(dest + i),
+				 _mm_srai_epi32(_mm_shuffle_epi8(a, shuffle), 8));
+		_mm_storeu_si128((__m128i *)(dest + i + 4),
+				 _mm_srai_epi32(_mm_shuffle_epi8(b, shuffle), 8));
+		_mm_storeu_si128((__m128i *)(dest + i + 8),
+				 _mm_srai_epi32(_mm_shuffle_epi8(c, shuffle), 8));
+		_mm_storeu_si128((__m128i *)(dest + i + 12),
+				 _mm_srai_epi32(_mm_shuffle_epi8(d, shuffle), 8));
+	}
+
+	return i;
+}
+
+#endif /* PCM_SIMD_X86 */
+
+#ifdef PCM_SIMD_ARM
+
+/*
+ * NEON implementations.  Only the 16 bit volume/mix kernels are
+ * vectorized, because the 64 bit arithmetic needed for the others
+ * does not pay off on most ARM cores; interleaving and packing are
+ * pure data movement and vectorized for all widths.
+ *
+ */
+
+static inline int32x4_t
+pcm_div_volume_neon(int32x4_t x)
+{
+	int32x4_t bias = vandq_s32(vshrq_n_s32(x, 31),
+				   vdupq_n_s32(PCM_VOLUME_1 - 1));
+	return vshrq_n_s32(vaddq_s32(x, bias), 10);
+}
+
+static unsigned
+pcm_volume_16_neon(int16_t *buffer, unsigned n, int volume,
+		   const int32_t *dither)
+{
+	const int32x4_t round = vdupq_n_s32(PCM_VOLUME_1 / 2);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t s = vld1q_s16(buffer + i);
+		int32x4_t lo = vmulq_n_s32(vmovl_s16(vget_low_s16(s)), volume);
+		int32x4_t hi = vmulq_n_s32(vmovl_s16(vget_high_s16(s)), volume);
+
+		lo = vaddq_s32(lo, vaddq_s32(round, vld1q_s32(dither + i)));
+		hi = vaddq_s32(hi, vaddq_s32(round, vld1q_s32(dither + i + 4)));
+
+		s = vcombine_s16(vqmovn_s32(pcm_div_volume_neon(lo)),
+				 vqmovn_s32(pcm_div_volume_neon(hi)));
+		vst1q_s16(buffer + i, s);
+	}
+
+	return i;
+}
+
+static unsigned
+pcm_add_vol_16_neon(int16_t *buffer1, const int16_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither)
+{
+	const int32x4_t round = vdupq_n_s32(PCM_VOLUME_1 / 2);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t s1 = vld1q_s16(buffer1 + i);
+		int16x8_t s2 = vld1q_s16(buffer2 + i);
+
+		int32x4_t lo = vmulq_n_s32(vmovl_s16(vget_low_s16(s1)), volume1);
+		int32x4_t hi = vmulq_n_s32(vmovl_s16(vget_high_s16(s1)), volume1);
+		lo = vmlaq_n_s32(lo, vmovl_s16(vget_low_s16(s2)), volume2);
+		hi = vmlaq_n_s32(hi, vmovl_s16(vget_high_s16(s2)), volume2);
+
+		lo = vaddq_s32(lo, vaddq_s32(round, vld1q_s32(dither + i)));
+		hi = vaddq_s32(hi, vaddq_s32(round, vld1q_s32(dither + i + 4)));
+
+		s1 = vcombine_s16(vqmovn_s32(pcm_div_volume_neon(lo)),
+				  vqmovn_s32(pcm_div_volume_neon(hi)));
+		vst1q_s16(buffer1 + i, s1);
+	}
+
+	return i;
+}
+
+static unsigned
+pcm_shift_16_to_32_neon(int32_t *out, const int16_t *in, unsigned n,
+			unsigned shift)
+{
+	const int32x4_t count = vdupq_n_s32(shift);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t s = vld1q_s16(in + i);
+		vst1q_s32(out + i, vshlq_s32(vmovl_s16(vget_low_s16(s)), count));
+		vst1q_s32(out + i + 4,
+			  vshlq_s32(vmovl_s16(vget_high_s16(s)), count));
+	}
+
+	return i;
+}
+
+static float
+pcm_dot_float_neon(const float *a, const float *b, unsigned n,
+		   unsigned *done_r)
+{
+	float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+		sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4),
+				 vld1q_f32(b + i + 4));
+	}
+
+	float tmp[4];
+	vst1q_f32(tmp, vaddq_f32(sum0, sum1));
+	*done_r = i;
+	return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+}
+
+/**
+ * Transposes a 4x4 matrix of 32 bit values: on return, f[k] contains
+ * frame k of the four channels.
+ */
+static inline void
+pcm_transpose_4x4_neon(int32x4_t f[4], int32x4_t a, int32x4_t b,
+		       int32x4_t c, int32x4_t d)
+{
+	int32x4x2_t ab = vtrnq_s32(a, b), cd = vtrnq_s32(c, d);
+
+	f[0] = vcombine_s32(vget_low_s32(ab.val[0]), vget_low_s32(cd.val[0]));
+	f[1] = vcombine_s32(vget_low_s32(ab.val[1]), vget_low_s32(cd.val[1]));
+	f[2] = vcombine_s32(vget_high_s32(ab.val[0]), vget_high_s32(cd.val[0]));
+	f[3] = vcombine_s32(vget_high_s32(ab.val[1]), vget_high_s32(cd.val[1]));
+}
+
+static unsigned
+pcm_interleave_32_neon(int32_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n)
+{
+	unsigned i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= n; i += 4) {
+			int32x4x2_t v;
+			v.val[0] = vld1q_s32(src[0] + i);
+			v.val[1] = vld1q_s32(src[1] + i);
+			vst2q_s32(dest + i * 2, v);
+		}
+	} else if (channels == 6) {
+		for (; i + 4 <= n; i += 4) {
+			int32x4_t f[4];
+			pcm_transpose_4x4_neon(f, vld1q_s32(src[0] + i),
+					       vld1q_s32(src[1] + i),
+					       vld1q_s32(src[2] + i),
+					       vld1q_s32(src[3] + i));
+
+			/* channels 4 and 5: two frames per vector */
+			int32x4x2_t p = vzipq_s32(vld1q_s32(src[4] + i),
+						  vld1q_s32(src[5] + i));
+
+			int32_t *d = dest + i * 6;
+			for (unsigned k = 0; k < 4; ++k, d += 6) {
+				vst1q_s32(d, f[k]);
+				vst1_s32(d + 4, k & 1
+					 ? vget_high_s32(p.val[k / 2])
+					 : vget_low_s32(p.val[k / 2]));
+			}
+		}
+	} else if (channels == 8) {
+		for (; i + 4 <= n; i += 4) {
+			int32x4_t lo[4], hi[4];
+			pcm_transpose_4x4_neon(lo, vld1q_s32(src[0] + i),
+					       vld1q_s32(src[1] + i),
+					       vld1q_s32(src[2] + i),
+					       vld1q_s32(src[3] + i));
+			pcm_transpose_4x4_neon(hi, vld1q_s32(src[4] + i),
+					       vld1q_s32(src[5] + i),
+					       vld1q_s32(src[6] + i),
+					       vld1q_s32(src[7] + i));
+
+			int32_t *d = dest + i * 8;
+			for (unsigned k = 0; k < 4; ++k, d += 8) {
+				vst1q_s32(d, lo[k]);
+				vst1q_s32(d + 4, hi[k]);
+			}
+		}
+	}
+
+	return i;
+}
+
+static unsigned
+pcm_interleave_16_neon(int16_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n)
+{
+	unsigned i = 0;
+
+	/* vmovn_s32() truncates like a C cast */
+
+	if (channels == 2) {
+		for (; i + 4 <= n; i += 4) {
+			int16x4x2_t v;
+			v.val[0] = vmovn_s32(vld1q_s32(src[0] + i));
+			v.val[1] = vmovn_s32(vld1q_s32(src[1] + i));
+			vst2_s16(dest + i * 2, v);
+		}
+	} else if (channels == 8) {
+		for (; i + 4 <= n; i += 4) {
+			int32x4_t lo[4], hi[4];
+			pcm_transpose_4x4_neon(lo, vld1q_s32(src[0] + i),
+					       vld1q_s32(src[1] + i),
+					       vld1q_s32(src[2] + i),
+					       vld1q_s32(src[3] + i));
+			pcm_transpose_4x4_neon(hi, vld1q_s32(src[4] + i),
+					       vld1q_s32(src[5] + i),
+					       vld1q_s32(src[6] + i),
+					       vld1q_s32(src[7] + i));
+
+			int16_t *d = dest + i * 8;
+			for (unsigned k = 0; k < 4; ++k, d += 8)
+				vst1q_s16(d, vcombine_s16(vmovn_s32(lo[k]),
+							  vmovn_s32(hi[k])));
+		}
+	}
+
+	return i;
+}
+
+static unsigned
+pcm_narrow_32_to_16_neon(int16_t *out, const int32_t *in, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int32x4_t lo = vld1q_s32(in + i);
+		int32x4_t hi = vld1q_s32(in + i + 4);
+		vst1q_s16(out + i, vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+	}
+
+	return i;
+}
+
+/*
+ * The structured loads/stores split the 32 bit samples into byte
+ * planes, so these two are little endian only.
+ */
+
+static unsigned
+pcm_pack_24_neon(uint8_t *dest, const int32_t *src, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *)(src + i));
+		uint8x16x3_t w;
+		w.val[0] = v.val[0];
+		w.val[1] = v.val[1];
+		w.val[2] = v.val[2];
+		vst3q_u8(dest + i * 3, w);
+	}
+
+	return i;
+}
+
+static unsigned
+pcm_unpack_24_neon(int32_t *dest, const uint8_t *src, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x3_t v = vld3q_u8(src + i * 3);
+		uint8x16x4_t w;
+		w.val[0] = v.val[0];
+		w.val[1] = v.val[1];
+		w.val[2] = v.val[2];
+		/* extend the sign bit */
+		w.val[3] = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(v.val[2]), 7));
+		vst4q_u8((uint8_t *)(dest + i), w);
+	}
+
+	return i;
+}
+
+#endif /* PCM_SIMD_ARM */
+
+/*
+ * Dispatchers.  Each one lets the best available vectorized kernel
+ * process as many samples as it can, and finishes the rest with the
+ * portable implementation.
+ *
+ */
+
+/**
+ * Are the volume factors small enough for the 16 bit vectorized
+ * kernels?  They need them to fit into 16 bit.
+ */
+static inline bool
+pcm_simd_volume_16_ok(int volume)
+{
+	return volume >= 0 && volume <= G_MAXINT16;
+}
+
+void
+pcm_simd_volume_16(int16_t *buffer, unsigned n, int volume,
+		   const int32_t *dither)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+	if (pcm_simd_volume_16_ok(volume)) {
+#ifdef PCM_SIMD_X86
+		if (mask & PCM_SIMD_AVX2)
+			i = pcm_volume_16_avx2(buffer, n, volume, dither);
+		else if (mask & PCM_SIMD_SSE2)
+			i = pcm_volume_16_sse2(buffer, n, volume, dither);
+#endif
+#ifdef PCM_SIMD_ARM
+		if (mask & PCM_SIMD_NEON)
+			i = pcm_volume_16_neon(buffer, n, volume, dither);
+#endif
+	}
+
+	pcm_volume_16_generic(buffer + i, n - i, volume, dither + i);
+}
+
+void
+pcm_simd_volume_24(int32_t *buffer, unsigned n, int volume,
+		   const int32_t *dither)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if ((mask & PCM_SIMD_AVX2) && volume >= 0 && volume <= PCM_VOLUME_1)
+		i = pcm_volume_32_avx2(buffer, n, volume, dither, 24);
+#endif
+
+	pcm_volume_24_generic(buffer + i, n - i, volume, dither + i);
+}
+
+void
+pcm_simd_volume_32(int32_t *buffer, unsigned n, int volume,
+		   const int32_t *dither)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if ((mask & PCM_SIMD_AVX2) && volume >= 0 && volume <= PCM_VOLUME_1)
+		i = pcm_volume_32_avx2(buffer, n, volume, dither, 32);
+#endif
+
+	pcm_volume_32_generic(buffer + i, n - i, volume, dither + i);
+}
+
+void
+pcm_simd_add_vol_16(int16_t *buffer1, const int16_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+	/* the sum of both volumes is checked to rule out overflows
+	   in _mm_madd_epi16() */
+	if (pcm_simd_volume_16_ok(volume1) && pcm_simd_volume_16_ok(volume2) &&
+	    pcm_simd_volume_16_ok(volume1 + volume2)) {
+#ifdef PCM_SIMD_X86
+		if (mask & PCM_SIMD_AVX2)
+			i = pcm_add_vol_16_avx2(buffer1, buffer2, n,
+						volume1, volume2, dither);
+		else if (mask & PCM_SIMD_SSE2)
+			i = pcm_add_vol_16_sse2(buffer1, buffer2, n,
+						volume1, volume2, dither);
+#endif
+#ifdef PCM_SIMD_ARM
+		if (mask & PCM_SIMD_NEON)
+			i = pcm_add_vol_16_neon(buffer1, buffer2, n,
+						volume1, volume2, dither);
+#endif
+	}
+
+	pcm_add_vol_16_generic(buffer1 + i, buffer2 + i, n - i,
+			       volume1, volume2, dither + i);
+}
+
+/**
+ * Are the volume factors small enough for the vectorized 24/32 bit
+ * mixing kernels?
+ */
+static inline bool
+pcm_simd_add_vol_32_ok(int volume1, int volume2)
+{
+	return volume1 >= 0 && volume2 >= 0 &&
+		volume1 + volume2 <= PCM_VOLUME_1;
+}
+
+void
+pcm_simd_add_vol_24(int32_t *buffer1, const int32_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if ((mask & PCM_SIMD_AVX2) && pcm_simd_add_vol_32_ok(volume1, volume2))
+		i = pcm_add_vol_32_avx2(buffer1, buffer2, n,
+					volume1, volume2, dither, 24);
+#endif
+
+	pcm_add_vol_24_generic(buffer1 + i, buffer2 + i, n - i,
+			       volume1, volume2, dither + i);
+}
+
+void
+pcm_simd_add_vol_32(int32_t *buffer1, const int32_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if ((mask & PCM_SIMD_AVX2) && pcm_simd_add_vol_32_ok(volume1, volume2))
+		i = pcm_add_vol_32_avx2(buffer1, buffer2, n,
+					volume1, volume2, dither, 32);
+#endif
+
+	pcm_add_vol_32_generic(buffer1 + i, buffer2 + i, n - i,
+			       volume1, volume2, dither + i);
+}
+
+void
+pcm_simd_shift_16_to_32(int32_t *out, const int16_t *in, unsigned n,
+			unsigned shift)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+	assert(shift <= 16);
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_AVX2)
+		i = pcm_shift_16_to_32_avx2(out, in, n, shift);
+	else if (mask & PCM_SIMD_SSE2)
+		i = pcm_shift_16_to_32_sse2(out, in, n, shift);
+#endif
+#ifdef PCM_SIMD_ARM
+	if (mask & PCM_SIMD_NEON)
+		i = pcm_shift_16_to_32_neon(out, in, n, shift);
+#endif
+
+	pcm_shift_16_to_32_generic(out + i, in + i, n - i, shift);
+}
+
+void
+pcm_simd_shift_24_to_32(int32_t *out, const int32_t *in, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_shift_24_to_32_sse2(out, in, n);
+#endif
+
+	pcm_shift_24_to_32_generic(out + i, in + i, n - i);
+}
+
+void
+pcm_simd_shift_32_to_24(int32_t *out, const int32_t *in, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_shift_32_to_24_sse2(out, in, n);
+#endif
+
+	pcm_shift_32_to_24_generic(out + i, in + i, n - i);
+}
+
+void
+pcm_simd_16_to_float(float *out, const int16_t *in, unsigned n,
+		     float factor)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_16_to_float_sse2(out, in, n, factor);
+#endif
+
+	pcm_16_to_float_generic(out + i, in + i, n - i, factor);
+}
+
+void
+pcm_simd_32_to_float(float *out, const int32_t *in, unsigned n,
+		     float factor)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_32_to_float_sse2(out, in, n, factor);
+#endif
+
+	pcm_32_to_float_generic(out + i, in + i, n - i, factor);
+}
+
+void
+pcm_simd_float_to_16(int16_t *out, const float *in, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_float_to_16_sse2(out, in, n);
+#endif
+
+	pcm_float_to_16_generic(out + i, in + i, n - i);
+}
+
+void
+pcm_simd_float_to_24(int32_t *out, const float *in, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_AVX2)
+		i = pcm_float_to_24_avx2(out, in, n);
+#endif
+
+	pcm_float_to_24_generic(out + i, in + i, n - i);
+}
+
+float
+pcm_simd_dot_float(const float *a, const float *b, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	float sum = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_AVX2)
+		sum = pcm_dot_float_avx2(a, b, n, &i);
+	else if (mask & PCM_SIMD_SSE2)
+		sum = pcm_dot_float_sse2(a, b, n, &i);
+#endif
+#ifdef PCM_SIMD_ARM
+	if (mask & PCM_SIMD_NEON)
+		sum = pcm_dot_float_neon(a, b, n, &i);
+#endif
+
+	return sum + pcm_dot_float_generic(a + i, b + i, n - i);
+}
+
+void
+pcm_simd_interleave_32(int32_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_interleave_32_sse2(dest, src, channels, n);
+#endif
+#ifdef PCM_SIMD_ARM
+	if (mask & PCM_SIMD_NEON)
+		i = pcm_interleave_32_neon(dest, src, channels, n);
+#endif
+
+	pcm_interleave_32_generic(dest + i * channels, src, channels, i, n);
+}
+
+/**
+ * The number of frames which are interleaved through a temporary
+ * 32 bit buffer at a time by pcm_simd_interleave_16().
+ */
+#define PCM_INTERLEAVE_BLOCK 256
+
+void
+pcm_simd_interleave_16(int16_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+
+	if (channels == 6 && (mask & (PCM_SIMD_SSE2|PCM_SIMD_NEON)) != 0) {
+		/* there is no direct kernel for 5.1: interleave
+		   blocks to 32 bit (in the L1 cache), and narrow
+		   them */
+		int32_t tmp[PCM_INTERLEAVE_BLOCK * 6];
+		const int32_t *block[6];
+
+		while (i < n) {
+			unsigned count = n - i;
+			if (count > PCM_INTERLEAVE_BLOCK)
+				count = PCM_INTERLEAVE_BLOCK;
+
+			for (unsigned c = 0; c < 6; ++c)
+				block[c] = src[c] + i;
+
+			pcm_simd_interleave_32(tmp, block, 6, count);
+			pcm_simd_narrow_32_to_16(dest + i * 6, tmp, count * 6);
+			i += count;
+		}
+
+		return;
+	}
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_interleave_16_sse2(dest, src, channels, n);
+#endif
+#ifdef PCM_SIMD_ARM
+	if (mask & PCM_SIMD_NEON)
+		i = pcm_interleave_16_neon(dest, src, channels, n);
+#endif
+
+	pcm_interleave_16_generic(dest + i * channels, src, channels, i, n);
+}
+
+void
+pcm_simd_narrow_32_to_16(int16_t *out, const int32_t *in, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_SSE2)
+		i = pcm_narrow_32_to_16_sse2(out, in, n);
+#endif
+#ifdef PCM_SIMD_ARM
+	if (mask & PCM_SIMD_NEON)
+		i = pcm_narrow_32_to_16_neon(out, in, n);
+#endif
+
+	pcm_narrow_32_to_16_generic(out + i, in + i, n - i);
+}
+
+void
+pcm_simd_pack_24(uint8_t *dest, const int32_t *src, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_AVX2)
+		i = pcm_pack_24_avx2(dest, src, n);
+#endif
+#ifdef PCM_SIMD_ARM
+	if ((mask & PCM_SIMD_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN)
+		i = pcm_pack_24_neon(dest, src, n);
+#endif
+
+	pcm_pack_24_generic(dest + i * 3, src + i, n - i);
+}
+
+void
+pcm_simd_unpack_24(int32_t *dest, const uint8_t *src, unsigned n)
+{
+	unsigned mask = pcm_simd_get(), i = 0;
+	(void)mask;
+
+#ifdef PCM_SIMD_X86
+	if (mask & PCM_SIMD_AVX2)
+		i = pcm_unpack_24_avx2(dest, src, n);
+#endif
+#ifdef PCM_SIMD_ARM
+	if ((mask & PCM_SIMD_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN)
+		i = pcm_unpack_24_neon(dest, src, n);
+#endif
+
+	pcm_unpack_24_generic(dest + i, src + i * 3, n - i);
+}
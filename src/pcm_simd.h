@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Vectorized PCM kernels (SSE2, AVX2, NEON) with runtime CPU
+ * dispatch.  Every kernel has a portable implementation which is
+ * used when no suitable instruction set is available, and the
+ * vectorized variants produce bit-exact results compared to it.
+ *
+ * Kernels which apply dithering do not generate the dither values
+ * themselves; the caller passes an array with one value per sample,
+ * so the PRNG sequence (and thus the output) is the same no matter
+ * which implementation is chosen.
+ */
+
+#ifndef MPD_PCM_SIMD_H
+#define MPD_PCM_SIMD_H
+
+#include "gcc.h"
+
+#include <stdint.h>
+
+enum pcm_simd_feature {
+	PCM_SIMD_SSE2 = 0x1,
+	PCM_SIMD_AVX2 = 0x2,
+	PCM_SIMD_NEON = 0x4,
+
+	PCM_SIMD_ALL = PCM_SIMD_SSE2|PCM_SIMD_AVX2|PCM_SIMD_NEON,
+};
+
+/**
+ * The number of samples the callers of the dithering kernels should
+ * process at a time, i.e. the size of the dither array on the stack.
+ */
+enum {
+	PCM_SIMD_BLOCK = 256,
+};
+
+/**
+ * Returns the #pcm_simd_feature bit mask of the instruction sets
+ * which are currently in use.
+ */
+gcc_pure
+unsigned
+pcm_simd_features(void);
+
+/**
+ * Limits the instruction sets used by the kernels to the specified
+ * #pcm_simd_feature bit mask.  Passing 0 selects the portable
+ * implementation.  This is meant for debugging and for the unit
+ * tests; it is not thread-safe.
+ */
+void
+pcm_simd_restrict(unsigned mask);
+
+/**
+ * Formats a #pcm_simd_feature bit mask for log messages.
+ */
+gcc_const
+const char *
+pcm_simd_features_string(unsigned mask);
+
+/**
+ * buffer[i] = (buffer[i] * volume + dither[i] + PCM_VOLUME_1 / 2)
+ *   / PCM_VOLUME_1, clamped to 16 bit.
+ */
+void
+pcm_simd_volume_16(int16_t *buffer, unsigned n, int volume,
+		   const int32_t *dither);
+
+/**
+ * Same as pcm_simd_volume_16(), but for 24 bit samples (32 bit
+ * alignment).
+ */
+void
+pcm_simd_volume_24(int32_t *buffer, unsigned n, int volume,
+		   const int32_t *dither);
+
+/**
+ * Same as pcm_simd_volume_16(), but for 32 bit samples.
+ */
+void
+pcm_simd_volume_32(int32_t *buffer, unsigned n, int volume,
+		   const int32_t *dither);
+
+/**
+ * buffer1[i] = (buffer1[i] * volume1 + buffer2[i] * volume2 +
+ *   dither[i] + PCM_VOLUME_1 / 2) / PCM_VOLUME_1, clamped to 16 bit.
+ */
+void
+pcm_simd_add_vol_16(int16_t *buffer1, const int16_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither);
+
+/**
+ * Same as pcm_simd_add_vol_16(), but for 24 bit samples (32 bit
+ * alignment).
+ */
+void
+pcm_simd_add_vol_24(int32_t *buffer1, const int32_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither);
+
+/**
+ * Same as pcm_simd_add_vol_16(), but for 32 bit samples.
+ */
+void
+pcm_simd_add_vol_32(int32_t *buffer1, const int32_t *buffer2, unsigned n,
+		    int volume1, int volume2, const int32_t *dither);
+
+/**
+ * Widens 16 bit samples by shifting them left by the specified
+ * number of bits (8 for S24_P32, 16 for S32).
+ */
+void
+pcm_simd_shift_16_to_32(int32_t *out, const int16_t *in, unsigned n,
+			unsigned shift);
+
+/**
+ * Shifts 32 bit samples left by 8 bits (S24_P32 to S32).  In-place
+ * operation is allowed.
+ */
+void
+pcm_simd_shift_24_to_32(int32_t *out, const int32_t *in, unsigned n);
+
+/**
+ * Shifts 32 bit samples right by 8 bits (S32 to S24_P32).  In-place
+ * operation is allowed.
+ */
+void
+pcm_simd_shift_32_to_24(int32_t *out, const int32_t *in, unsigned n);
+
+/**
+ * out[i] = (float)in[i] * factor
+ */
+void
+pcm_simd_16_to_float(float *out, const int16_t *in, unsigned n,
+		     float factor);
+
+/**
+ * out[i] = (float)in[i] * factor
+ */
+void
+pcm_simd_32_to_float(float *out, const int32_t *in, unsigned n,
+		     float factor);
+
+/**
+ * out[i] = (int)(in[i] * 32768), clamped to 16 bit.
+ */
+void
+pcm_simd_float_to_16(int16_t *out, const float *in, unsigned n);
+
+/**
+ * out[i] = (int)(in[i] * 8388608), clamped to 24 bit.
+ */
+void
+pcm_simd_float_to_24(int32_t *out, const float *in, unsigned n);
+
+/**
+ * Interleaves planar 32 bit samples (as delivered by libFLAC and
+ * others) and truncates them to 16 bit.
+ *
+ * @param src an array of #channels pointers to #n samples each
+ * @param n the number of samples per channel
+ */
+void
+pcm_simd_interleave_16(int16_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n);
+
+/**
+ * Interleaves planar 32 bit samples (S24_P32 or S32).
+ *
+ * @param src an array of #channels pointers to #n samples each
+ * @param n the number of samples per channel
+ */
+void
+pcm_simd_interleave_32(int32_t *dest, const int32_t *const*src,
+		       unsigned channels, unsigned n);
+
+/**
+ * out[i] = (int16_t)in[i], i.e. the upper 16 bits are discarded.
+ * In-place operation is allowed.
+ */
+void
+pcm_simd_narrow_32_to_16(int16_t *out, const int32_t *in, unsigned n);
+
+/**
+ * Converts padded 24 bit samples to packed 24 bit samples (3 bytes
+ * per sample, host byte order).  In-place operation is allowed.
+ */
+void
+pcm_simd_pack_24(uint8_t *dest, const int32_t *src, unsigned n);
+
+/**
+ * Converts packed 24 bit samples (3 bytes per sample, host byte
+ * order) to padded 24 bit samples, extending the sign bit.
+ */
+void
+pcm_simd_unpack_24(int32_t *dest, const uint8_t *src, unsigned n);
+
+/**
+ * Returns the dot product of two float vectors.  Unlike the other
+ * kernels, the result is not bit-exact across implementations,
+ * because the summation order differs.
+ */
+gcc_pure
+float
+pcm_simd_dot_float(const float *a, const float *b, unsigned n);
+
+#endif
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "pcm_volume.h"
 #include "pcm_utils.h"
+#include "pcm_simd.h"
 #include "audio_format.h"
 
 #include <glib.h>
@@ -47,14 +48,16 @@ pcm_volume_change_8(int8_t *buffer, const int8_t *end, int volume)
 static void
 pcm_volume_change_16(int16_t *buffer, const int16_t *end, int volume)
 {
-	while (buffer < end) {
-		int32_t sample = *buffer;
+	int32_t dither[PCM_SIMD_BLOCK];
 
-		sample = (sample * volume + pcm_volume_dither() +
-			  PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
+	while (buffer < end) {
+		unsigned n = end - buffer;
+		if (n > PCM_SIMD_BLOCK)
+			n = PCM_SIMD_BLOCK;
 
-		*buffer++ = pcm_range(sample, 16);
+		pcm_volume_fill_dither(dither, n);
+		pcm_simd_volume_16(buffer, n, volume, dither);
+		buffer += n;
 	}
 }
 
@@ -87,26 +90,16 @@ pcm_volume_sample_24(int32_t sample, int32_t volume, G_GNUC_UNUSED int32_t dithe
 
 	return result;
 }
-#endif
 
 static void
 pcm_volume_change_24(int32_t *buffer, const int32_t *end, int volume)
 {
 	while (buffer < end) {
-#ifdef __i386__
 		/* assembly version for i386 */
 		int32_t sample = *buffer;
 
 		sample = pcm_volume_sample_24(sample, volume,
 					      pcm_volume_dither());
-#else
-		/* portable version */
-		int64_t sample = *buffer;
-
-		sample = (sample * volume + pcm_volume_dither() +
-			  PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
-#endif
 		*buffer++ = pcm_range(sample, 24);
 	}
 }
@@ -115,23 +108,49 @@ static void
 pcm_volume_change_32(int32_t *buffer, const int32_t *end, int volume)
 {
 	while (buffer < end) {
-#ifdef __i386__
 		/* assembly version for i386 */
 		int32_t sample = *buffer;
 
 		*buffer++ = pcm_volume_sample_24(sample, volume, 0);
+	}
+}
+
 #else
-		/* portable version */
-		int64_t sample = *buffer;
 
-		sample = (sample * volume + pcm_volume_dither() +
-			  PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
-		*buffer++ = pcm_range_64(sample, 32);
-#endif
+static void
+pcm_volume_change_24(int32_t *buffer, const int32_t *end, int volume)
+{
+	int32_t dither[PCM_SIMD_BLOCK];
+
+	while (buffer < end) {
+		unsigned n = end - buffer;
+		if (n > PCM_SIMD_BLOCK)
+			n = PCM_SIMD_BLOCK;
+
+		pcm_volume_fill_dither(dither, n);
+		pcm_simd_volume_24(buffer, n, volume, dither);
+		buffer += n;
 	}
 }
 
+static void
+pcm_volume_change_32(int32_t *buffer, const int32_t *end, int volume)
+{
+	int32_t dither[PCM_SIMD_BLOCK];
+
+	while (buffer < end) {
+		unsigned n = end - buffer;
+		if (n > PCM_SIMD_BLOCK)
+			n = PCM_SIMD_BLOCK;
+
+		pcm_volume_fill_dither(dither, n);
+		pcm_simd_volume_32(buffer, n, volume, dither);
+		buffer += n;
+	}
+}
+
+#endif
+
 static void
 pcm_volume_change_float(float *buffer, const float *end, float volume)
 {
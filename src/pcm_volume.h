@@ -65,6 +65,19 @@ pcm_volume_dither(void)
 	return (r & 511) - ((r >> 9) & 511);
 }
 
+/**
+ * Fills the array with values from pcm_volume_dither().  The
+ * vectorized kernels in pcm_simd.c consume these, so their results
+ * are the same as if pcm_volume_dither() had been called for each
+ * sample.
+ */
+static inline void
+pcm_volume_fill_dither(int32_t *dither, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		dither[i] = pcm_volume_dither();
+}
+
 /**
  * Adjust the volume of the specified PCM buffer.
  *
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2009-2013 Max Kellermann <max@duempel.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MPD_THREAD_LOCK_PROFILE_HXX
+#define MPD_THREAD_LOCK_PROFILE_HXX
+
+#include <atomic>
+
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+
+/**
+ * Contention counters for one or more mutexes.  Several mutexes
+ * (e.g. all music pipes) may share one object, so the counters are
+ * updated atomically; holding one of the mutexes does not protect
+ * them.  Readers may see slightly outdated values.
+ */
+struct LockProfile {
+	const char *name;
+
+	/**
+	 * The number of lock() calls, and how many of them had to
+	 * wait because another thread was holding the mutex.
+	 */
+	std::atomic<uint64_t> acquisitions, contentions;
+
+	/**
+	 * The total and the maximum time spent waiting for the
+	 * mutex [nanoseconds].
+	 */
+	std::atomic<uint64_t> wait_ns, max_wait_ns;
+
+	constexpr LockProfile(const char *_name)
+		:name(_name), acquisitions(0), contentions(0),
+		 wait_ns(0), max_wait_ns(0) {}
+
+	void Lock(pthread_mutex_t &mutex) {
+		if (pthread_mutex_trylock(&mutex) == 0) {
+			acquisitions.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		const uint64_t start = Now();
+		pthread_mutex_lock(&mutex);
+		const uint64_t wait = Now() - start;
+
+		acquisitions.fetch_add(1, std::memory_order_relaxed);
+		contentions.fetch_add(1, std::memory_order_relaxed);
+		wait_ns.fetch_add(wait, std::memory_order_relaxed);
+
+		uint64_t max = max_wait_ns.load(std::memory_order_relaxed);
+		while (wait > max &&
+		       !max_wait_ns.compare_exchange_weak(max, wait,
+							  std::memory_order_relaxed))
+			;
+	}
+
+private:
+	static uint64_t Now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+};
+
+#endif
@@ -30,6 +30,8 @@
 #ifndef MPD_THREAD_POSIX_MUTEX_HXX
 #define MPD_THREAD_POSIX_MUTEX_HXX
 
+#include "LockProfile.hxx"
+
 #include <pthread.h>
 
 /**
@@ -40,14 +42,32 @@ class PosixMutex {
 
 	pthread_mutex_t mutex;
 
+	/**
+	 * If not nullptr, then lock() records contention statistics
+	 * in this object.
+	 */
+	LockProfile *profile;
+
 public:
-	constexpr PosixMutex():mutex(PTHREAD_MUTEX_INITIALIZER) {}
+	constexpr PosixMutex()
+		:mutex(PTHREAD_MUTEX_INITIALIZER), profile(nullptr) {}
 
 	PosixMutex(const PosixMutex &other) = delete;
 	PosixMutex &operator=(const PosixMutex &other) = delete;
 
+	/**
+	 * Enable (or disable with nullptr) contention profiling.  This
+	 * must be called while no other thread uses the mutex.
+	 */
+	void SetProfile(LockProfile *_profile) {
+		profile = _profile;
+	}
+
 	void lock() {
-		pthread_mutex_lock(&mutex);
+		if (profile != nullptr)
+			profile->Lock(mutex);
+		else
+			pthread_mutex_lock(&mutex);
 	}
 
 	bool try_lock() {
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Runs the fake Icecast server (see icecast_server.h), and prints the
+ * receive rate once per second.  It can drop the source connection or
+ * stop reading it periodically, to exercise reconnects and queue
+ * overruns.  Use it together with test/run_output and a "shout"
+ * output with host "localhost".  test/test_shout_output runs the
+ * same server automatically.
+ */
+
+#include "config.h"
+#include "icecast_server.h"
+#include "clock.h"
+
+#include <glib.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 4) {
+		g_printerr("Usage: fake_icecast PORT [DROP_SECONDS [STALL_SECONDS]]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned port = strtoul(argv[1], NULL, 10);
+	const unsigned drop = argc > 2 ? strtoul(argv[2], NULL, 10) * 1000 : 0;
+	const unsigned stall = argc > 3 ? strtoul(argv[3], NULL, 10) * 1000 : 0;
+
+	g_thread_init(NULL);
+
+	struct icecast_server *server = icecast_server_new(port, drop, stall);
+	if (server == NULL) {
+		g_printerr("Failed to listen on port %u: %s\n",
+			   port, g_strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	unsigned last_report = monotonic_clock_ms(), seconds = 0;
+	uint64_t last_bytes = 0;
+
+	while (true) {
+		if (!icecast_server_poll(server, 100)) {
+			g_printerr("poll() failed: %s\n", g_strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		if (monotonic_clock_ms() - last_report >= 1000) {
+			struct icecast_server_stats stats;
+			icecast_server_get_stats(server, &stats);
+
+			++seconds;
+			g_print("%us: %u kB/s, total %u kB, "
+				"%u source connections, %u Ogg streams, "
+				"%u metadata updates\n",
+				seconds,
+				(unsigned)((stats.bytes - last_bytes) / 1024),
+				(unsigned)(stats.bytes / 1024),
+				stats.sources, stats.ogg_streams,
+				stats.metadata_updates);
+
+			last_bytes = stats.bytes;
+			last_report += 1000;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "httpd_listener.h"
+#include "fd_util.h"
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+int
+httpd_listener_connect(const struct addrinfo *ai, const char *path)
+{
+	int fd = socket_cloexec_nonblock(ai->ai_family, ai->ai_socktype,
+					 ai->ai_protocol);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0 &&
+	    errno != EINPROGRESS) {
+		close_socket(fd);
+		return -1;
+	}
+
+	struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+	int error = 0;
+	socklen_t error_size = sizeof(error);
+	if (poll(&pfd, 1, 5000) <= 0 ||
+	    getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_size) < 0 ||
+	    error != 0) {
+		close_socket(fd);
+		return -1;
+	}
+
+	char *request = g_strdup_printf("GET %s HTTP/1.0\r\n"
+					"User-Agent: httpd_load\r\n\r\n",
+					path);
+	const size_t length = strlen(request);
+	const ssize_t nbytes = send(fd, request, length, 0);
+	g_free(request);
+
+	if (nbytes != (ssize_t)length) {
+		close_socket(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Accounts received data, skipping the response header.
+ */
+static void
+httpd_listener_feed(struct httpd_listener *l, const char *data, size_t length)
+{
+	static const char end[] = "\r\n\r\n";
+
+	while (l->header < 4 && length > 0) {
+		if (*data == end[l->header])
+			++l->header;
+		else
+			l->header = *data == end[0];
+
+		++data;
+		--length;
+	}
+
+	l->bytes += length;
+	l->interval_bytes += length;
+}
+
+bool
+httpd_listener_read(struct httpd_listener *l, size_t max_length)
+{
+	char buffer[16384];
+	ssize_t nbytes = recv(l->fd, buffer, MIN(sizeof(buffer), max_length),
+			      0);
+	if (nbytes < 0 && (errno == EAGAIN || errno == EINTR))
+		return true;
+
+	if (nbytes <= 0)
+		return false;
+
+	httpd_listener_feed(l, buffer, nbytes);
+	return true;
+}
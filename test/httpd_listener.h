@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A simulated listener of the httpd output plugin, for the load
+ * generators.
+ */
+
+#ifndef MPD_TEST_HTTPD_LISTENER_H
+#define MPD_TEST_HTTPD_LISTENER_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct addrinfo;
+
+struct httpd_listener {
+	int fd;
+
+	/**
+	 * The number of characters of the "\r\n\r\n" sequence
+	 * terminating the response header which have been seen so
+	 * far; 4 means the header is complete.
+	 */
+	unsigned header;
+
+	/**
+	 * The number of body bytes received in total, and in the
+	 * current interval.
+	 */
+	uint64_t bytes, interval_bytes;
+};
+
+G_BEGIN_DECLS
+
+/**
+ * Connects to the server and sends the request.
+ *
+ * @return the non-blocking socket, or -1 on error
+ */
+int
+httpd_listener_connect(const struct addrinfo *ai, const char *path);
+
+/**
+ * Receives up to max_length bytes.
+ *
+ * @return false if the connection has been closed
+ */
+bool
+httpd_listener_read(struct httpd_listener *l, size_t max_length);
+
+G_END_DECLS
+
+#endif
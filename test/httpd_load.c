@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A load generator for the httpd output plugin: connects many
+ * listeners to a running stream, and prints the aggregate
+ * throughput, the per-listener rates and the drift between the
+ * fastest and the slowest listener once per second.
+ */
+
+#include "config.h"
+#include "httpd_listener.h"
+#include "resolver.h"
+#include "fd_util.h"
+#include "clock.h"
+
+#include <glib.h>
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+static void
+print_report(unsigned seconds, const struct httpd_listener *listeners,
+	     unsigned n, unsigned closed, uint64_t duration_us)
+{
+	uint64_t total = 0, min_rate = UINT64_MAX, max_rate = 0;
+	uint64_t min_bytes = UINT64_MAX, max_bytes = 0;
+	unsigned active = 0;
+
+	for (unsigned i = 0; i < n; ++i) {
+		const struct httpd_listener *l = &listeners[i];
+		if (l->fd < 0)
+			continue;
+
+		++active;
+		total += l->interval_bytes;
+		min_rate = MIN(min_rate, l->interval_bytes);
+		max_rate = MAX(max_rate, l->interval_bytes);
+		min_bytes = MIN(min_bytes, l->bytes);
+		max_bytes = MAX(max_bytes, l->bytes);
+	}
+
+	if (active == 0 || duration_us == 0) {
+		g_print("%us: no listeners, %u closed\n", seconds, closed);
+		return;
+	}
+
+	/* bytes per interval to kB/s */
+#define KBPS(x) ((unsigned)((x) * 1000000 / duration_us / 1024))
+
+	g_print("%us: %u listeners, %u closed, total %u kB/s, "
+		"min/avg/max %u/%u/%u kB/s, drift %u kB\n",
+		seconds, active, closed, KBPS(total),
+		KBPS(min_rate), KBPS(total / active), KBPS(max_rate),
+		(unsigned)((max_bytes - min_bytes) / 1024));
+
+#undef KBPS
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 4) {
+		g_printerr("Usage: httpd_load HOST:PORT[/PATH] COUNT [SECONDS]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned n = strtoul(argv[2], NULL, 10);
+	const unsigned duration = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+	if (n == 0) {
+		g_printerr("Invalid listener count\n");
+		return EXIT_FAILURE;
+	}
+
+	/* the optional path selects a mount */
+	const char *slash = strchr(argv[1], '/');
+	const char *path = slash != NULL ? slash : "/";
+	char *host = slash != NULL
+		? g_strndup(argv[1], slash - argv[1])
+		: g_strdup(argv[1]);
+
+	GError *error = NULL;
+	struct addrinfo *ai = resolve_host_port(host, 8000, 0,
+						SOCK_STREAM, &error);
+	g_free(host);
+	if (ai == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	struct httpd_listener *listeners = g_new0(struct httpd_listener, n);
+	struct pollfd *pfds = g_new(struct pollfd, n);
+
+	for (unsigned i = 0; i < n; ++i) {
+		listeners[i].fd = httpd_listener_connect(ai, path);
+		if (listeners[i].fd < 0) {
+			g_printerr("Failed to connect listener %u: %s\n",
+				   i, g_strerror(errno));
+			freeaddrinfo(ai);
+			return EXIT_FAILURE;
+		}
+	}
+
+	freeaddrinfo(ai);
+
+	const unsigned start = monotonic_clock_ms();
+	unsigned last_report = start, seconds = 0, closed = 0;
+
+	while (seconds < duration && closed < n) {
+		unsigned nfds = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			if (listeners[i].fd < 0)
+				continue;
+
+			pfds[nfds].fd = listeners[i].fd;
+			pfds[nfds].events = POLLIN;
+			pfds[nfds].revents = 0;
+			++nfds;
+		}
+
+		if (poll(pfds, nfds, 100) < 0 && errno != EINTR) {
+			g_printerr("poll() failed: %s\n", g_strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		/* the pollfd array is in the same order as the active
+		   listeners */
+		unsigned j = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			struct httpd_listener *l = &listeners[i];
+			if (l->fd < 0)
+				continue;
+
+			if (pfds[j++].revents != 0 &&
+			    !httpd_listener_read(l, SIZE_MAX)) {
+				close_socket(l->fd);
+				l->fd = -1;
+				++closed;
+			}
+		}
+
+		const unsigned now = monotonic_clock_ms();
+		if (now - last_report >= 1000) {
+			++seconds;
+			print_report(seconds, listeners, n, closed,
+				     (uint64_t)(now - last_report) * 1000);
+
+			for (unsigned i = 0; i < n; ++i)
+				listeners[i].interval_bytes = 0;
+			last_report = now;
+		}
+	}
+
+	uint64_t total = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		total += listeners[i].bytes;
+		if (listeners[i].fd >= 0)
+			close_socket(listeners[i].fd);
+	}
+
+	g_print("received %u kB in %u s\n",
+		(unsigned)(total / 1024),
+		(monotonic_clock_ms() - start) / 1000);
+
+	g_free(pfds);
+	g_free(listeners);
+	return EXIT_SUCCESS;
+}
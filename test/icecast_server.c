@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "icecast_server.h"
+#include "fd_util.h"
+#include "clock.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+	MAX_CONNECTIONS = 8,
+};
+
+struct icecast_connection {
+	int fd;
+
+	/**
+	 * Has the request header been received?  After that, the
+	 * connection is a source, and everything is stream data.
+	 */
+	bool source;
+
+	GString *request;
+
+	/**
+	 * The stream data of a source which has not been parsed yet
+	 * as an Ogg page.  NULL if the stream is not Ogg.
+	 */
+	GByteArray *ogg;
+
+	/**
+	 * When was the source connection established, or when did it
+	 * resume after a stall [milliseconds]?
+	 */
+	unsigned since;
+
+	/**
+	 * Reading is suspended until this time [milliseconds].
+	 */
+	unsigned stalled_until;
+};
+
+struct icecast_server {
+	int fd;
+	unsigned port;
+
+	unsigned drop, stall;
+
+	struct icecast_connection connections[MAX_CONNECTIONS];
+
+	/**
+	 * Protects #stats, which may be read by other threads.
+	 */
+	GMutex *mutex;
+
+	struct icecast_server_stats stats;
+};
+
+static int
+open_listener(unsigned *port_r)
+{
+	int fd = socket_cloexec_nonblock(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	const int reuse = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(*port_r);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	socklen_t sin_length = sizeof(sin);
+	if (bind(fd, (const struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+	    listen(fd, 4) < 0 ||
+	    getsockname(fd, (struct sockaddr *)&sin, &sin_length) < 0) {
+		const int e = errno;
+		close(fd);
+		errno = e;
+		return -1;
+	}
+
+	*port_r = ntohs(sin.sin_port);
+	return fd;
+}
+
+struct icecast_server *
+icecast_server_new(unsigned port, unsigned drop, unsigned stall)
+{
+	int fd = open_listener(&port);
+	if (fd < 0)
+		return NULL;
+
+	struct icecast_server *server = g_new(struct icecast_server, 1);
+	server->fd = fd;
+	server->port = port;
+	server->drop = drop;
+	server->stall = stall;
+
+	for (unsigned i = 0; i < MAX_CONNECTIONS; ++i)
+		server->connections[i].fd = -1;
+
+	server->mutex = g_mutex_new();
+	memset(&server->stats, 0, sizeof(server->stats));
+	return server;
+}
+
+static void
+connection_close(struct icecast_connection *c)
+{
+	close(c->fd);
+	c->fd = -1;
+	g_string_free(c->request, true);
+	if (c->ogg != NULL)
+		g_byte_array_free(c->ogg, true);
+}
+
+void
+icecast_server_free(struct icecast_server *server)
+{
+	for (unsigned i = 0; i < MAX_CONNECTIONS; ++i)
+		if (server->connections[i].fd >= 0)
+			connection_close(&server->connections[i]);
+
+	close(server->fd);
+	g_mutex_free(server->mutex);
+	g_free(server);
+}
+
+unsigned
+icecast_server_port(const struct icecast_server *server)
+{
+	return server->port;
+}
+
+void
+icecast_server_get_stats(struct icecast_server *server,
+			 struct icecast_server_stats *stats)
+{
+	g_mutex_lock(server->mutex);
+	*stats = server->stats;
+	g_mutex_unlock(server->mutex);
+}
+
+static void
+connection_reply(struct icecast_connection *c, const char *response)
+{
+	/* the responses are small enough for the socket buffer */
+	if (write(c->fd, response, strlen(response)) < 0)
+		g_printerr("write() failed: %s\n", g_strerror(errno));
+}
+
+/**
+ * Counts the "beginning of stream" pages in the Ogg stream of a
+ * source.  Gives up if the data is not Ogg.
+ */
+static void
+connection_parse_ogg(struct icecast_server *server,
+		     struct icecast_connection *c,
+		     const void *data, size_t length)
+{
+	if (c->ogg == NULL)
+		return;
+
+	g_byte_array_append(c->ogg, data, length);
+
+	while (c->ogg->len >= 27) {
+		const guint8 *p = c->ogg->data;
+		if (memcmp(p, "OggS", 4) != 0) {
+			/* not Ogg, or out of sync */
+			g_byte_array_free(c->ogg, true);
+			c->ogg = NULL;
+			return;
+		}
+
+		const unsigned n_segments = p[26];
+		if (c->ogg->len < 27 + n_segments)
+			break;
+
+		size_t page_size = 27 + n_segments;
+		for (unsigned i = 0; i < n_segments; ++i)
+			page_size += p[27 + i];
+
+		if (c->ogg->len < page_size)
+			break;
+
+		if (p[5] & 0x02) {
+			g_mutex_lock(server->mutex);
+			++server->stats.ogg_streams;
+			g_mutex_unlock(server->mutex);
+		}
+
+		g_byte_array_remove_range(c->ogg, 0, page_size);
+	}
+}
+
+static void
+connection_stream_data(struct icecast_server *server,
+		       struct icecast_connection *c,
+		       const void *data, size_t length)
+{
+	g_mutex_lock(server->mutex);
+	server->stats.bytes += length;
+	g_mutex_unlock(server->mutex);
+
+	connection_parse_ogg(server, c, data, length);
+}
+
+/**
+ * Handles a complete request header.
+ *
+ * @return false if the connection shall be closed
+ */
+static bool
+connection_request(struct icecast_server *server,
+		   struct icecast_connection *c)
+{
+	const char *request = c->request->str;
+
+	if (g_str_has_prefix(request, "GET /admin/metadata")) {
+		/* a metadata update from libshout; the song is
+		   URL-encoded in the query string */
+		const char *song = strstr(request, "song=");
+		const char *end = song != NULL
+			? strpbrk(song, "& \r\n")
+			: NULL;
+		if (song != NULL) {
+			song += 5;
+			char *value = g_strndup(song, end != NULL
+						? (size_t)(end - song)
+						: strlen(song));
+			g_print("metadata: %s\n", value);
+			g_free(value);
+		}
+
+		g_mutex_lock(server->mutex);
+		++server->stats.metadata_updates;
+		g_mutex_unlock(server->mutex);
+
+		connection_reply(c, "HTTP/1.0 200 OK\r\n"
+				 "Content-Type: text/xml\r\n\r\n"
+				 "<?xml version=\"1.0\"?>\n"
+				 "<iceresponse><message>Metadata update "
+				 "successful</message><return>1</return>"
+				 "</iceresponse>\n");
+		return false;
+	}
+
+	if (g_str_has_prefix(request, "SOURCE ") ||
+	    g_str_has_prefix(request, "PUT ")) {
+		char *line = g_strndup(request, strcspn(request, "\r\n"));
+		g_print("source: %s\n", line);
+		g_free(line);
+
+		connection_reply(c, "HTTP/1.0 200 OK\r\n\r\n");
+		c->source = true;
+		c->ogg = g_byte_array_new();
+		c->since = monotonic_clock_ms();
+
+		g_mutex_lock(server->mutex);
+		++server->stats.sources;
+		g_mutex_unlock(server->mutex);
+
+		/* stream data which follows the header */
+		const char *body = strstr(request, "\r\n\r\n") + 4;
+		const size_t body_length =
+			c->request->len - (body - request);
+		if (body_length > 0)
+			connection_stream_data(server, c, body, body_length);
+
+		return true;
+	}
+
+	connection_reply(c, "HTTP/1.0 400 Bad Request\r\n\r\n");
+	return false;
+}
+
+/**
+ * @return false if the connection shall be closed
+ */
+static bool
+connection_read(struct icecast_server *server, struct icecast_connection *c)
+{
+	char buffer[16384];
+	ssize_t nbytes = recv(c->fd, buffer, sizeof(buffer), 0);
+	if (nbytes < 0)
+		return errno == EAGAIN || errno == EINTR;
+	if (nbytes == 0)
+		return false;
+
+	if (c->source) {
+		connection_stream_data(server, c, buffer, nbytes);
+		return true;
+	}
+
+	g_string_append_len(c->request, buffer, nbytes);
+	if (strstr(c->request->str, "\r\n\r\n") == NULL)
+		return c->request->len < 8192;
+
+	return connection_request(server, c);
+}
+
+static void
+icecast_server_accept(struct icecast_server *server)
+{
+	struct sockaddr_storage address;
+	size_t address_length = sizeof(address);
+	int fd = accept_cloexec_nonblock(server->fd,
+					 (struct sockaddr *)&address,
+					 &address_length);
+	if (fd < 0) {
+		g_printerr("accept() failed: %s\n", g_strerror(errno));
+		return;
+	}
+
+	unsigned i = 0;
+	while (i < MAX_CONNECTIONS && server->connections[i].fd >= 0)
+		++i;
+
+	if (i == MAX_CONNECTIONS) {
+		close(fd);
+		return;
+	}
+
+	struct icecast_connection *c = &server->connections[i];
+	c->fd = fd;
+	c->source = false;
+	c->request = g_string_new(NULL);
+	c->ogg = NULL;
+	c->stalled_until = monotonic_clock_ms();
+}
+
+bool
+icecast_server_poll(struct icecast_server *server, int timeout)
+{
+	struct pollfd pfds[1 + MAX_CONNECTIONS];
+	unsigned index[1 + MAX_CONNECTIONS];
+	unsigned nfds = 0;
+	const unsigned now = monotonic_clock_ms();
+
+	pfds[nfds].fd = server->fd;
+	pfds[nfds].events = POLLIN;
+	pfds[nfds].revents = 0;
+	++nfds;
+
+	for (unsigned i = 0; i < MAX_CONNECTIONS; ++i) {
+		struct icecast_connection *c = &server->connections[i];
+		if (c->fd < 0)
+			continue;
+
+		if (c->source && server->drop > 0 &&
+		    (int)(now - c->since) >= (int)server->drop) {
+			if (server->stall == 0) {
+				g_print("dropping the source\n");
+				connection_close(c);
+				continue;
+			}
+
+			g_print("stalling the source\n");
+			c->stalled_until = now + server->stall;
+			c->since = now + server->stall;
+		}
+
+		if ((int)(c->stalled_until - now) > 0)
+			continue;
+
+		pfds[nfds].fd = c->fd;
+		pfds[nfds].events = POLLIN;
+		pfds[nfds].revents = 0;
+		index[nfds] = i;
+		++nfds;
+	}
+
+	if (poll(pfds, nfds, timeout) < 0)
+		return errno == EINTR;
+
+	if (pfds[0].revents != 0)
+		icecast_server_accept(server);
+
+	for (unsigned j = 1; j < nfds; ++j) {
+		struct icecast_connection *c =
+			&server->connections[index[j]];
+		if (pfds[j].revents != 0 && !connection_read(server, c))
+			connection_close(c);
+	}
+
+	return true;
+}
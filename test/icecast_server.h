@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A fake Icecast server on the loopback interface, for testing the
+ * shout output plugin.  It accepts source connections and metadata
+ * updates, and can drop the source connection or stop reading it
+ * periodically.
+ */
+
+#ifndef MPD_TEST_ICECAST_SERVER_H
+#define MPD_TEST_ICECAST_SERVER_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct icecast_server;
+
+struct icecast_server_stats {
+	/**
+	 * The number of stream bytes received from all sources.
+	 */
+	uint64_t bytes;
+
+	/**
+	 * The number of source connections accepted so far.
+	 */
+	unsigned sources;
+
+	/**
+	 * The number of Ogg streams begun, i.e. "beginning of
+	 * stream" pages received.  Each source connection must begin
+	 * with one.
+	 */
+	unsigned ogg_streams;
+
+	unsigned metadata_updates;
+};
+
+G_BEGIN_DECLS
+
+/**
+ * Starts listening.
+ *
+ * @param port the TCP port; 0 picks a free one
+ * @param drop if not zero, the source connection is dropped (or
+ * stalled) after this duration [milliseconds]
+ * @param stall if not zero, the source connection is not dropped,
+ * but not read for this duration [milliseconds]
+ * @return the new server, or NULL on error (with errno set)
+ */
+struct icecast_server *
+icecast_server_new(unsigned port, unsigned drop, unsigned stall);
+
+void
+icecast_server_free(struct icecast_server *server);
+
+/**
+ * Returns the TCP port the server listens on.
+ */
+G_GNUC_PURE
+unsigned
+icecast_server_port(const struct icecast_server *server);
+
+/**
+ * Waits for events, and handles them.
+ *
+ * @param timeout the maximum duration to wait [milliseconds]
+ * @return false on a fatal error (with errno set)
+ */
+bool
+icecast_server_poll(struct icecast_server *server, int timeout);
+
+/**
+ * Obtains a copy of the statistics.  May be called from any thread.
+ */
+void
+icecast_server_get_stats(struct icecast_server *server,
+			 struct icecast_server_stats *stats);
+
+G_END_DECLS
+
+#endif
@@ -77,6 +77,16 @@ decoder_read(G_GNUC_UNUSED struct decoder *decoder,
 	return input_stream_lock_read(is, buffer, length, NULL);
 }
 
+const void *
+decoder_read_mapped(G_GNUC_UNUSED struct decoder *decoder,
+		    G_GNUC_UNUSED struct input_stream *is,
+		    G_GNUC_UNUSED size_t length,
+		    G_GNUC_UNUSED size_t *nbytes_r)
+{
+	/* let the caller fall back to decoder_read() */
+	return NULL;
+}
+
 void
 decoder_timestamp(G_GNUC_UNUSED struct decoder *decoder,
 		  G_GNUC_UNUSED double t)
@@ -93,6 +103,28 @@ decoder_data(G_GNUC_UNUSED struct decoder *decoder,
 	return DECODE_COMMAND_NONE;
 }
 
+void *
+decoder_data_begin(G_GNUC_UNUSED struct decoder *decoder,
+		   G_GNUC_UNUSED struct input_stream *is,
+		   G_GNUC_UNUSED uint16_t kbit_rate,
+		   G_GNUC_UNUSED size_t *max_length_r)
+{
+	/* let the plugin fall back to decoder_data() */
+	return NULL;
+}
+
+enum decoder_command
+decoder_data_commit(G_GNUC_UNUSED struct decoder *decoder,
+		    G_GNUC_UNUSED size_t length)
+{
+	return DECODE_COMMAND_NONE;
+}
+
+void
+decoder_data_abort(G_GNUC_UNUSED struct decoder *decoder)
+{
+}
+
 enum decoder_command
 decoder_tag(G_GNUC_UNUSED struct decoder *decoder,
 	    G_GNUC_UNUSED struct input_stream *is,
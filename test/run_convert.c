@@ -27,6 +27,7 @@
 #include "audio_parser.h"
 #include "audio_format.h"
 #include "pcm_convert.h"
+#include "pcm_resample.h"
 #include "conf.h"
 #include "fifo_buffer.h"
 #include "stdbin.h"
@@ -35,6 +36,8 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 static void
@@ -47,9 +50,15 @@ my_log_func(const gchar *log_domain, G_GNUC_UNUSED GLogLevelFlags log_level,
 		g_printerr("%s\n", message);
 }
 
+static const char *converter;
+
 const char *
-config_get_string(G_GNUC_UNUSED const char *name, const char *default_value)
+config_get_string(const char *name, const char *default_value)
 {
+	if (converter != NULL &&
+	    strcmp(name, CONF_SAMPLERATE_CONVERTER) == 0)
+		return converter;
+
 	return default_value;
 }
 
@@ -62,13 +71,22 @@ int main(int argc, char **argv)
 	ssize_t nbytes;
 	size_t length;
 
-	if (argc != 3) {
-		g_printerr("Usage: run_convert IN_FORMAT OUT_FORMAT <IN >OUT\n");
+	if (argc != 3 && argc != 4) {
+		g_printerr("Usage: run_convert IN_FORMAT OUT_FORMAT [CONVERTER] <IN >OUT\n");
 		return 1;
 	}
 
+	if (argc > 3)
+		converter = argv[3];
+
 	g_log_set_default_handler(my_log_func, NULL);
 
+	if (!pcm_resample_global_init(&error)) {
+		g_printerr("Failed to initialize the resampler: %s\n",
+			   error->message);
+		return 1;
+	}
+
 	if (!audio_format_parse(&in_audio_format, argv[1],
 				false, &error)) {
 		g_printerr("Failed to parse audio format: %s\n",
@@ -93,6 +111,11 @@ int main(int argc, char **argv)
 
 	struct fifo_buffer *buffer = fifo_buffer_new(4096);
 
+	/* the CPU time spent in pcm_convert() and the amount of
+	   audio it has processed */
+	clock_t cpu_time = 0;
+	uint64_t n_frames = 0;
+
 	while (true) {
 		void *p = fifo_buffer_write(buffer, &length);
 		assert(p != NULL);
@@ -112,8 +135,13 @@ int main(int argc, char **argv)
 
 		fifo_buffer_consume(buffer, length);
 
+		n_frames += length / in_frame_size;
+
+		const clock_t start = clock();
 		output = pcm_convert(&state, &in_audio_format, src, length,
 				     &out_audio_format, &length, &error);
+		cpu_time += clock() - start;
+
 		if (output == NULL) {
 			g_printerr("Failed to convert: %s\n", error->message);
 			return 2;
@@ -123,4 +151,11 @@ int main(int argc, char **argv)
 	}
 
 	pcm_convert_deinit(&state);
+
+	const double seconds = (double)cpu_time / CLOCKS_PER_SEC;
+	const double duration =
+		(double)n_frames / in_audio_format.sample_rate;
+	g_printerr("converted %.1f s of audio in %.3f s CPU time (%.0fx realtime)\n",
+		   duration, seconds,
+		   seconds > 0 ? duration / seconds : 0.0);
 }
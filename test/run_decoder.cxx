@@ -26,6 +26,7 @@ extern "C" {
 #include "InputInit.hxx"
 #include "input_stream.h"
 #include "audio_format.h"
+#include "conf.h"
 #include "stdbin.h"
 
 #include <glib.h>
@@ -33,6 +34,7 @@ extern "C" {
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void
 my_log_func(const gchar *log_domain, G_GNUC_UNUSED GLogLevelFlags log_level,
@@ -50,6 +52,23 @@ struct decoder {
 	const struct decoder_plugin *plugin;
 
 	bool initialized;
+
+	struct audio_format audio_format;
+
+	/**
+	 * Discard the PCM data, and print the decoding speed?
+	 */
+	bool benchmark;
+
+	/**
+	 * The number of PCM bytes received from the plugin.
+	 */
+	guint64 bytes;
+
+	/**
+	 * The buffer returned by decoder_data_begin().
+	 */
+	char buffer[4096];
 };
 
 void
@@ -66,6 +85,7 @@ decoder_initialized(struct decoder *decoder,
 	g_printerr("audio_format=%s\n",
 		   audio_format_to_string(audio_format, &af_string));
 
+	decoder->audio_format = *audio_format;
 	decoder->initialized = true;
 }
 
@@ -96,6 +116,16 @@ decoder_read(G_GNUC_UNUSED struct decoder *decoder,
 	return input_stream_lock_read(is, buffer, length, NULL);
 }
 
+const void *
+decoder_read_mapped(G_GNUC_UNUSED struct decoder *decoder,
+		    G_GNUC_UNUSED struct input_stream *is,
+		    G_GNUC_UNUSED size_t length,
+		    G_GNUC_UNUSED size_t *nbytes_r)
+{
+	/* let the caller fall back to decoder_read() */
+	return NULL;
+}
+
 void
 decoder_timestamp(G_GNUC_UNUSED struct decoder *decoder,
 		  G_GNUC_UNUSED double t)
@@ -103,15 +133,44 @@ decoder_timestamp(G_GNUC_UNUSED struct decoder *decoder,
 }
 
 enum decoder_command
-decoder_data(G_GNUC_UNUSED struct decoder *decoder,
+decoder_data(struct decoder *decoder,
 	     G_GNUC_UNUSED struct input_stream *is,
 	     const void *data, size_t datalen,
 	     G_GNUC_UNUSED uint16_t kbit_rate)
 {
-	G_GNUC_UNUSED ssize_t nbytes = write(1, data, datalen);
+	decoder->bytes += datalen;
+
+	if (!decoder->benchmark) {
+		G_GNUC_UNUSED ssize_t nbytes = write(1, data, datalen);
+	}
+
 	return DECODE_COMMAND_NONE;
 }
 
+void *
+decoder_data_begin(struct decoder *decoder,
+		   G_GNUC_UNUSED struct input_stream *is,
+		   G_GNUC_UNUSED uint16_t kbit_rate, size_t *max_length_r)
+{
+	const size_t frame_size =
+		audio_format_frame_size(&decoder->audio_format);
+
+	*max_length_r = sizeof(decoder->buffer) -
+		sizeof(decoder->buffer) % frame_size;
+	return decoder->buffer;
+}
+
+enum decoder_command
+decoder_data_commit(struct decoder *decoder, size_t length)
+{
+	return decoder_data(decoder, NULL, decoder->buffer, length, 0);
+}
+
+void
+decoder_data_abort(G_GNUC_UNUSED struct decoder *decoder)
+{
+}
+
 enum decoder_command
 decoder_tag(G_GNUC_UNUSED struct decoder *decoder,
 	    G_GNUC_UNUSED struct input_stream *is,
@@ -148,10 +207,27 @@ int main(int argc, char **argv)
 {
 	GError *error = NULL;
 	const char *decoder_name;
+	const char *config_path = NULL;
 	struct decoder decoder;
 
+	decoder.benchmark = false;
+	decoder.bytes = 0;
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "--benchmark") == 0) {
+			decoder.benchmark = true;
+			--argc;
+			++argv;
+		} else if (strcmp(argv[1], "--config") == 0 && argc > 2) {
+			config_path = argv[2];
+			argc -= 2;
+			argv += 2;
+		} else
+			break;
+	}
+
 	if (argc != 3) {
-		g_printerr("Usage: run_decoder DECODER URI >OUT\n");
+		g_printerr("Usage: run_decoder [--config CONFIG] [--benchmark] DECODER URI >OUT\n");
 		return 1;
 	}
 
@@ -161,6 +237,15 @@ int main(int argc, char **argv)
 	g_thread_init(NULL);
 	g_log_set_default_handler(my_log_func, NULL);
 
+	/* the "decoder" blocks of the configuration file are passed to
+	   the plugins, e.g. for benchmarking plugin options */
+	config_global_init();
+	if (config_path != NULL && !config_read_file(config_path, &error)) {
+		g_printerr("%s:", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
 	io_thread_init();
 	if (!io_thread_start(&error)) {
 		g_warning("%s", error->message);
@@ -184,6 +269,8 @@ int main(int argc, char **argv)
 
 	decoder.initialized = false;
 
+	GTimer *timer = g_timer_new();
+
 	if (decoder.plugin->file_decode != NULL) {
 		decoder_plugin_file_decode(decoder.plugin, &decoder,
 					   decoder.uri);
@@ -214,14 +301,28 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	g_timer_stop(timer);
+
 	decoder_plugin_deinit_all();
 	input_stream_global_finish();
 	io_thread_deinit();
+	config_global_finish();
 
 	if (!decoder.initialized) {
 		g_printerr("Decoding failed\n");
 		return 1;
 	}
 
+	if (decoder.benchmark) {
+		const double elapsed = g_timer_elapsed(timer, NULL);
+		const double duration = (double)decoder.bytes /
+			audio_format_time_to_size(&decoder.audio_format);
+		g_printerr("decoded %.1f s in %.3f s (%.1fx realtime)\n",
+			   duration, elapsed,
+			   elapsed > 0 ? duration / elapsed : 0.0);
+	}
+
+	g_timer_destroy(timer);
+
 	return 0;
 }
@@ -0,0 +1,626 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A soak test for the httpd output plugin: it runs a configured
+ * httpd output in this process, feeds it with a generated tone in
+ * real time, and connects many local listeners, some of which may
+ * read slowly.  Once per second, it prints the receive rates, the
+ * server side queue lengths and drops (from the plugin's
+ * statistics), the CPU time spent by MPD per listener, and the
+ * memory growth.
+ */
+
+#include "config.h"
+#include "OutputControl.hxx"
+#include "conf.h"
+#include "Idle.hxx"
+#include "GlobalEvents.hxx"
+#include "IOThread.hxx"
+#include "output_plugin.h"
+#include "output_internal.h"
+#include "audio_parser.h"
+#include "filter_registry.h"
+#include "pcm_convert.h"
+#include "PlayerControl.hxx"
+#include "fd_util.h"
+#include "httpd_listener.h"
+
+extern "C" {
+#include "resolver.h"
+#include "clock.h"
+}
+
+#include <glib.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+void
+GlobalEvents::Emit(gcc_unused Event event)
+{
+}
+
+void pcm_convert_init(G_GNUC_UNUSED struct pcm_convert_state *state)
+{
+}
+
+void pcm_convert_deinit(G_GNUC_UNUSED struct pcm_convert_state *state)
+{
+}
+
+const void *
+pcm_convert(G_GNUC_UNUSED struct pcm_convert_state *state,
+	    G_GNUC_UNUSED const struct audio_format *src_format,
+	    G_GNUC_UNUSED const void *src, G_GNUC_UNUSED size_t src_size,
+	    G_GNUC_UNUSED const struct audio_format *dest_format,
+	    G_GNUC_UNUSED size_t *dest_size_r,
+	    GError **error_r)
+{
+	g_set_error(error_r, pcm_convert_quark(), 0,
+		    "Not implemented");
+	return NULL;
+}
+
+const struct filter_plugin *
+filter_plugin_by_name(G_GNUC_UNUSED const char *name)
+{
+	assert(false);
+	return NULL;
+}
+
+player_control::player_control(gcc_unused unsigned _buffer_chunks,
+			       gcc_unused unsigned _buffered_before_play) {}
+player_control::~player_control() {}
+
+static int option_listeners = 100;
+static int option_seconds = 10;
+static int option_slow = 0;
+static int option_slow_rate = 4;
+static char *option_path;
+static char *option_format;
+
+static const GOptionEntry option_entries[] = {
+	{ "listeners", 'n', 0, G_OPTION_ARG_INT, &option_listeners,
+	  "number of listeners (default 100)", "N" },
+	{ "seconds", 't', 0, G_OPTION_ARG_INT, &option_seconds,
+	  "duration of the test (default 10)", "SECONDS" },
+	{ "slow", 's', 0, G_OPTION_ARG_INT, &option_slow,
+	  "number of slow listeners (default 0)", "N" },
+	{ "slow-rate", 'r', 0, G_OPTION_ARG_INT, &option_slow_rate,
+	  "read speed of the slow listeners (default 4)", "KB/S" },
+	{ "path", 'p', 0, G_OPTION_ARG_STRING, &option_path,
+	  "request path, selects the mount (default /)", "PATH" },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &option_format,
+	  "audio format (default 44100:16:2)", "FORMAT" },
+	{ nullptr, 0, 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr }
+};
+
+/**
+ * The state shared between the main thread and the listener thread.
+ */
+struct load {
+	GMutex *mutex;
+
+	/**
+	 * Tells the listener thread to exit.  Protected by #mutex.
+	 */
+	bool quit;
+
+	struct httpd_listener *listeners;
+	unsigned n;
+
+	/**
+	 * The read speed of each listener [bytes per second]; 0
+	 * means unlimited.
+	 */
+	unsigned *rates;
+
+	/**
+	 * The number of listeners which were disconnected by the
+	 * server.  Protected by #mutex.
+	 */
+	unsigned closed;
+
+	/**
+	 * The CPU time [microseconds] used by the listener thread.
+	 * Protected by #mutex.
+	 */
+	uint64_t cpu_time;
+};
+
+static const struct config_param *
+find_named_config_block(const char *block, const char *name)
+{
+	const struct config_param *param = NULL;
+
+	while ((param = config_get_next_param(block, param)) != NULL) {
+		const char *current_name =
+			config_get_block_string(param, "name", NULL);
+		if (current_name != NULL && strcmp(current_name, name) == 0)
+			return param;
+	}
+
+	return NULL;
+}
+
+static uint64_t
+thread_cpu_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t
+process_cpu_time(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/**
+ * Returns the resident set size of this process [kB].
+ */
+static unsigned
+resident_size(void)
+{
+	unsigned long size, resident;
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0;
+
+	int n = fscanf(file, "%lu %lu", &size, &resident);
+	fclose(file);
+	if (n != 2)
+		return 0;
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * The listener thread: receives data on all sockets, limiting the
+ * slow listeners to their configured rate.
+ */
+static gpointer
+listener_thread(gpointer data)
+{
+	struct load *load = (struct load *)data;
+	const unsigned n = load->n;
+
+	struct pollfd *pfds = g_new(struct pollfd, n);
+	unsigned *index = g_new(unsigned, n);
+
+	/* the number of bytes each slow listener may read now */
+	uint64_t *budget = g_new0(uint64_t, n);
+
+	unsigned last_tick = monotonic_clock_ms();
+	bool quit = false;
+
+	while (!quit) {
+		const unsigned now = monotonic_clock_ms();
+		const unsigned elapsed = now - last_tick;
+		if (elapsed >= 10) {
+			for (unsigned i = 0; i < n; ++i) {
+				/* allow a burst of at most half a
+				   second */
+				budget[i] = MIN(budget[i] +
+						(uint64_t)load->rates[i] *
+						elapsed / 1000,
+						load->rates[i] / 2);
+			}
+
+			last_tick = now;
+		}
+
+		unsigned nfds = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			if (load->listeners[i].fd < 0 ||
+			    (load->rates[i] > 0 && budget[i] == 0))
+				continue;
+
+			pfds[nfds].fd = load->listeners[i].fd;
+			pfds[nfds].events = POLLIN;
+			pfds[nfds].revents = 0;
+			index[nfds] = i;
+			++nfds;
+		}
+
+		poll(pfds, nfds, 10);
+
+		unsigned closed = 0;
+		for (unsigned j = 0; j < nfds; ++j) {
+			if (pfds[j].revents == 0)
+				continue;
+
+			const unsigned i = index[j];
+			struct httpd_listener *l = &load->listeners[i];
+			const uint64_t before = l->bytes;
+			const size_t max_length = load->rates[i] > 0
+				? budget[i] : SIZE_MAX;
+
+			if (!httpd_listener_read(l, max_length)) {
+				close_socket(l->fd);
+				l->fd = -1;
+				++closed;
+			} else if (load->rates[i] > 0)
+				budget[i] -= MIN(budget[i], l->bytes - before);
+		}
+
+		const uint64_t cpu_time = thread_cpu_time();
+
+		g_mutex_lock(load->mutex);
+		load->closed += closed;
+		load->cpu_time = cpu_time;
+		quit = load->quit;
+		g_mutex_unlock(load->mutex);
+	}
+
+	g_free(budget);
+	g_free(index);
+	g_free(pfds);
+	return NULL;
+}
+
+/**
+ * Sums up the listener values in the output's statistics.
+ */
+struct server_stats {
+	unsigned listeners;
+	uint64_t queue_max, queue_sum;
+	unsigned drops;
+	uint64_t dropped;
+};
+
+static void
+parse_server_stats(const char *text, struct server_stats *s)
+{
+	memset(s, 0, sizeof(*s));
+
+	if (text == NULL)
+		return;
+
+	char **lines = g_strsplit(text, "\n", 0);
+	for (char **i = lines; *i != NULL; ++i) {
+		const char *line = *i;
+
+		if (g_str_has_prefix(line, "listener_queue: ")) {
+			uint64_t value = g_ascii_strtoull(line + 16,
+							  NULL, 10);
+			++s->listeners;
+			s->queue_sum += value;
+			s->queue_max = MAX(s->queue_max, value);
+		} else if (g_str_has_prefix(line, "listener_drops: "))
+			s->drops += strtoul(line + 16, NULL, 10);
+		else if (g_str_has_prefix(line, "listener_dropped: "))
+			s->dropped += g_ascii_strtoull(line + 18, NULL, 10);
+	}
+
+	g_strfreev(lines);
+}
+
+/**
+ * Prints the receive rates [kB/s] of one class of listeners.
+ */
+static void
+print_rates(struct load *load, bool slow, uint64_t duration_us)
+{
+	uint64_t total = 0, min_rate = UINT64_MAX, max_rate = 0;
+	unsigned active = 0;
+
+	for (unsigned i = 0; i < load->n; ++i) {
+		const struct httpd_listener *l = &load->listeners[i];
+		if (l->fd < 0 || (load->rates[i] > 0) != slow)
+			continue;
+
+		++active;
+		total += l->interval_bytes;
+		min_rate = MIN(min_rate, l->interval_bytes);
+		max_rate = MAX(max_rate, l->interval_bytes);
+	}
+
+	if (active == 0)
+		return;
+
+#define KBPS(x) ((unsigned)((x) * 1000000 / duration_us / 1024))
+
+	g_print(" %s %u min/avg/max %u/%u/%u kB/s,",
+		slow ? "slow" : "fast", active,
+		KBPS(min_rate), KBPS(total / active), KBPS(max_rate));
+
+#undef KBPS
+}
+
+static bool
+run_load(struct audio_output *ao, struct audio_format *audio_format,
+	 struct load *load)
+{
+	GError *error = NULL;
+
+	/* generate one second of a 440 Hz tone */
+
+	const size_t frame_size = audio_format_frame_size(audio_format);
+	const size_t tone_size = frame_size * audio_format->sample_rate;
+	char *tone = (char *)g_malloc0(tone_size);
+	if (audio_format->format == SAMPLE_FORMAT_S16) {
+		int16_t *p = (int16_t *)tone;
+		for (unsigned i = 0; i < audio_format->sample_rate; ++i) {
+			int16_t sample = 8192 *
+				sin(2 * M_PI * 440 * i /
+				    audio_format->sample_rate);
+			for (unsigned c = 0; c < audio_format->channels; ++c)
+				*p++ = sample;
+		}
+	}
+
+	GThread *thread = g_thread_create(listener_thread, load, true,
+					  &error);
+	if (thread == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_free(tone);
+		return false;
+	}
+
+	const unsigned start_rss = resident_size();
+	uint64_t last_cpu = process_cpu_time(), last_listener_cpu = 0;
+	const unsigned start = monotonic_clock_ms();
+	unsigned last_report = start, seconds = 0;
+	size_t position = 0;
+	bool success = true;
+
+	const size_t chunk_size = frame_size * (audio_format->sample_rate / 100);
+
+	while (seconds < (unsigned)option_seconds) {
+		unsigned delay = ao_plugin_delay(ao);
+		if (delay > 0)
+			g_usleep(MIN(delay, 100u) * 1000);
+
+		size_t length = MIN(chunk_size, tone_size - position);
+		size_t nbytes = ao_plugin_play(ao, tone + position, length,
+					       &error);
+		if (nbytes == 0) {
+			g_printerr("Failed to play: %s\n", error->message);
+			g_error_free(error);
+			success = false;
+			break;
+		}
+
+		position = (position + nbytes) % tone_size;
+
+		const unsigned now = monotonic_clock_ms();
+		if (now - last_report < 1000)
+			continue;
+
+		++seconds;
+
+		char *text = ao_plugin_stats(ao);
+		struct server_stats s;
+		parse_server_stats(text, &s);
+		g_free(text);
+
+		const uint64_t duration_us = (uint64_t)(now - last_report) * 1000;
+		const uint64_t cpu = process_cpu_time();
+
+		g_mutex_lock(load->mutex);
+		const uint64_t listener_cpu = load->cpu_time;
+		const unsigned closed = load->closed;
+
+		g_print("%us:", seconds);
+		print_rates(load, false, duration_us);
+		print_rates(load, true, duration_us);
+
+		for (unsigned i = 0; i < load->n; ++i)
+			load->listeners[i].interval_bytes = 0;
+		g_mutex_unlock(load->mutex);
+
+		/* everything but the listener thread is MPD */
+		const uint64_t server_cpu =
+			(cpu - last_cpu) - MIN(cpu - last_cpu,
+					       listener_cpu - last_listener_cpu);
+		const unsigned rss = resident_size();
+
+		g_print(" %u closed; server: %u listeners, "
+			"queue max/avg %u/%u kB, drops %u (%u kB), "
+			"cpu %u%% (%u us/s per listener); rss %u kB (%+d kB)\n",
+			closed, s.listeners,
+			(unsigned)(s.queue_max / 1024),
+			s.listeners > 0
+			? (unsigned)(s.queue_sum / s.listeners / 1024) : 0,
+			s.drops, (unsigned)(s.dropped / 1024),
+			(unsigned)(server_cpu * 100 / duration_us),
+			s.listeners > 0
+			? (unsigned)(server_cpu * 1000000 / duration_us /
+				     s.listeners) : 0,
+			rss, (int)(rss - start_rss));
+
+		last_cpu = cpu;
+		last_listener_cpu = listener_cpu;
+		last_report = now;
+	}
+
+	g_mutex_lock(load->mutex);
+	load->quit = true;
+	g_mutex_unlock(load->mutex);
+	g_thread_join(thread);
+
+	g_free(tone);
+	return success;
+}
+
+int main(int argc, char **argv)
+{
+	GError *error = NULL;
+
+	GOptionContext *context =
+		g_option_context_new("CONFIG NAME - httpd output soak test");
+	g_option_context_add_main_entries(context, option_entries, NULL);
+	bool success = g_option_context_parse(context, &argc, &argv, &error);
+	g_option_context_free(context);
+
+	if (!success) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	if (argc != 3 || option_listeners <= 0 || option_slow < 0 ||
+	    option_slow > option_listeners || option_slow_rate <= 0) {
+		g_printerr("Usage: run_httpd_load [OPTIONS] CONFIG NAME\n");
+		return EXIT_FAILURE;
+	}
+
+	struct audio_format audio_format;
+	audio_format_init(&audio_format, 44100, SAMPLE_FORMAT_S16, 2);
+	if (option_format != NULL &&
+	    !audio_format_parse(&audio_format, option_format, false,
+				&error)) {
+		g_printerr("Failed to parse audio format: %s\n",
+			   error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_thread_init(NULL);
+
+	/* read configuration file (mpd.conf) */
+
+	config_global_init();
+	if (!config_read_file(argv[1], &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	io_thread_init();
+	if (!io_thread_start(&error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	/* initialize the audio output */
+
+	const struct config_param *param =
+		find_named_config_block(CONF_AUDIO_OUTPUT, argv[2]);
+	if (param == NULL) {
+		g_printerr("No such configured audio output: %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	static struct player_control dummy_player_control(32, 4);
+	struct audio_output *ao =
+		audio_output_new(param, &dummy_player_control, &error);
+	if (ao == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	if (!ao_plugin_enable(ao, &error)) {
+		g_printerr("Failed to enable audio output: %s\n",
+			   error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	if (!ao_plugin_open(ao, &audio_format, &error)) {
+		g_printerr("Failed to open audio output: %s\n",
+			   error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	/* connect the listeners */
+
+	char *address = g_strdup_printf("localhost:%u",
+					config_get_block_unsigned(param,
+								  "port",
+								  8000));
+	struct addrinfo *ai = resolve_host_port(address, 8000, 0,
+						SOCK_STREAM, &error);
+	g_free(address);
+	if (ai == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	struct load load;
+	load.mutex = g_mutex_new();
+	load.quit = false;
+	load.n = option_listeners;
+	load.listeners = g_new0(struct httpd_listener, load.n);
+	load.rates = g_new0(unsigned, load.n);
+	load.closed = 0;
+	load.cpu_time = 0;
+
+	const char *path = option_path != NULL ? option_path : "/";
+	for (unsigned i = 0; i < load.n; ++i) {
+		load.listeners[i].fd = httpd_listener_connect(ai, path);
+		if (load.listeners[i].fd < 0) {
+			g_printerr("Failed to connect listener %u: %s\n",
+				   i, g_strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		/* the slow listeners are spread evenly */
+		if ((uint64_t)i * option_slow / load.n !=
+		    (uint64_t)(i + 1) * option_slow / load.n)
+			load.rates[i] = option_slow_rate * 1024;
+	}
+
+	freeaddrinfo(ai);
+
+	/* do it */
+
+	success = run_load(ao, &audio_format, &load);
+
+	/* cleanup and exit */
+
+	for (unsigned i = 0; i < load.n; ++i)
+		if (load.listeners[i].fd >= 0)
+			close_socket(load.listeners[i].fd);
+
+	g_free(load.rates);
+	g_free(load.listeners);
+	g_mutex_free(load.mutex);
+
+	ao_plugin_close(ao);
+	ao_plugin_disable(ao);
+	audio_output_free(ao);
+
+	io_thread_deinit();
+
+	config_global_finish();
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -36,6 +36,28 @@ extern "C" {
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static gboolean option_benchmark;
+static char *option_config;
+static int option_chunk = 4096;
+static double option_duration;
+
+static const GOptionEntry option_entries[] = {
+	{ "benchmark", 'b', 0, G_OPTION_ARG_NONE, &option_benchmark,
+	  "read the stream without dumping it, and print statistics",
+	  nullptr },
+	{ "config", 'c', 0, G_OPTION_ARG_FILENAME, &option_config,
+	  "load input plugin settings from this file", "FILE" },
+	{ "chunk", 's', 0, G_OPTION_ARG_INT, &option_chunk,
+	  "size of each read (default 4096)", "BYTES" },
+	{ "duration", 'd', 0, G_OPTION_ARG_DOUBLE, &option_duration,
+	  "duration of the song, for statistics per second", "SECONDS" },
+	{ nullptr, 0, 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr }
+};
 
 static void
 my_log_func(const gchar *log_domain, G_GNUC_UNUSED GLogLevelFlags log_level,
@@ -111,14 +133,136 @@ dump_input_stream(struct input_stream *is)
 	return 0;
 }
 
+/**
+ * Returns the number of read() system calls of this process so far,
+ * or 0 if the operating system doesn't tell.
+ */
+static unsigned long long
+read_syscalls(void)
+{
+	unsigned long long n = 0;
+
+#ifdef __linux__
+	FILE *file = fopen("/proc/self/io", "r");
+	if (file == NULL)
+		return 0;
+
+	char line[128];
+	while (fgets(line, sizeof(line), file) != NULL)
+		if (sscanf(line, "syscr: %llu", &n) == 1)
+			break;
+
+	fclose(file);
+#endif
+
+	return n;
+}
+
+static double
+cpu_seconds(void)
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return 0;
+
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Reads the whole stream in small chunks, like a decoder plugin
+ * does, and prints the number of system calls and the CPU time.  If
+ * the stream supports input_stream_read_mapped(), that is used
+ * instead of copying.
+ */
+static int
+benchmark_input_stream(struct input_stream *is)
+{
+	GError *error = NULL;
+	char *buffer = (char *)g_malloc(option_chunk);
+	unsigned long long nbytes = 0, ncalls = 0;
+	bool mapped = true;
+
+	input_stream_lock(is);
+	input_stream_wait_ready(is);
+
+	const unsigned long long syscalls_before = read_syscalls();
+	const double cpu_before = cpu_seconds();
+	GTimer *timer = g_timer_new();
+
+	while (!input_stream_eof(is)) {
+		size_t length;
+		if (mapped &&
+		    input_stream_read_mapped(is, option_chunk,
+					     &length) != NULL) {
+			++ncalls;
+			if (length == 0)
+				break;
+
+			nbytes += length;
+			continue;
+		}
+
+		mapped = false;
+
+		length = input_stream_read(is, buffer, option_chunk, &error);
+		++ncalls;
+		if (length == 0) {
+			if (error != NULL) {
+				g_warning("%s", error->message);
+				g_error_free(error);
+			}
+
+			break;
+		}
+
+		nbytes += length;
+	}
+
+	const double wall = g_timer_elapsed(timer, NULL);
+	const double cpu = cpu_seconds() - cpu_before;
+	const unsigned long long syscalls =
+		read_syscalls() - syscalls_before;
+	g_timer_destroy(timer);
+
+	input_stream_unlock(is);
+	g_free(buffer);
+
+	g_printerr("%llu bytes in %llu %s calls, %llu read() system calls\n",
+		   nbytes, ncalls, mapped ? "mapped" : "read",
+		   syscalls);
+	g_printerr("%.3f ms CPU, %.3f ms wall, %.3f ms CPU per MB\n",
+		   cpu * 1000, wall * 1000,
+		   nbytes > 0 ? cpu * 1000 * 1024 * 1024 / nbytes : 0.);
+
+	if (option_duration > 0)
+		g_printerr("per second of audio: %.1f system calls, "
+			   "%.3f ms CPU\n",
+			   syscalls / option_duration,
+			   cpu * 1000 / option_duration);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	GError *error = NULL;
 	struct input_stream *is;
 	int ret;
 
-	if (argc != 2) {
-		g_printerr("Usage: run_input URI\n");
+	GOptionContext *context = g_option_context_new("URI");
+	g_option_context_add_main_entries(context, option_entries, NULL);
+	bool success = g_option_context_parse(context, &argc, &argv, &error);
+	g_option_context_free(context);
+
+	if (!success) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	if (argc != 2 || option_chunk <= 0) {
+		g_printerr("Usage: run_input [OPTIONS] URI\n");
 		return 1;
 	}
 
@@ -131,6 +275,13 @@ int main(int argc, char **argv)
 
 	config_global_init();
 
+	if (option_config != NULL &&
+	    !config_read_file(option_config, &error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
 	io_thread_init();
 	if (!io_thread_start(&error)) {
 		g_warning("%s", error->message);
@@ -155,7 +306,9 @@ int main(int argc, char **argv)
 
 	is = input_stream_open(argv[1], mutex, cond, &error);
 	if (is != NULL) {
-		ret = dump_input_stream(is);
+		ret = option_benchmark
+			? benchmark_input_stream(is)
+			: dump_input_stream(is);
 		input_stream_close(is);
 	} else {
 		if (error != NULL) {
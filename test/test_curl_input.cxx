@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Tests the curl input plugin against a small HTTP server on the
+ * loopback interface: the range cache, and pausing the transfer when
+ * the stream's buffer is full.
+ */
+
+#include "config.h"
+#include "input/CurlInputPlugin.hxx"
+#include "input_plugin.h"
+#include "input_stream.h"
+#include "conf.h"
+#include "IOThread.hxx"
+
+#include <glib.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The size of each resource served by the test server.
+ */
+static const goffset RESOURCE_SIZE = 1024 * 1024;
+
+/**
+ * The buffer of each stream [kB]; much smaller than the resource, so
+ * the transfer gets paused.
+ */
+static const char *const BUFFER_SIZE = "64";
+
+static struct {
+	GMutex *mutex;
+
+	int fd;
+	unsigned port;
+
+	/**
+	 * The version of all resources, sent as "ETag".  Incrementing
+	 * it simulates a change on the server.
+	 */
+	unsigned version;
+
+	/**
+	 * Answer all requests with "200 OK" and the whole resource,
+	 * like a server which does not support the "Range" header.
+	 */
+	bool ignore_range;
+
+	/**
+	 * The number of requests received so far.
+	 */
+	unsigned requests;
+
+	/**
+	 * The status of the last response.
+	 */
+	unsigned last_status;
+} server;
+
+static GMutex *mutex;
+static GCond *cond;
+
+static unsigned char
+pattern(unsigned version, goffset offset)
+{
+	return (unsigned char)(offset * 7 + (offset >> 10) + version * 31);
+}
+
+static unsigned
+server_requests(void)
+{
+	g_mutex_lock(server.mutex);
+	const unsigned requests = server.requests;
+	g_mutex_unlock(server.mutex);
+	return requests;
+}
+
+static unsigned
+server_last_status(void)
+{
+	g_mutex_lock(server.mutex);
+	const unsigned status = server.last_status;
+	g_mutex_unlock(server.mutex);
+	return status;
+}
+
+/**
+ * Returns the value of a request header, or nullptr.
+ */
+static const char *
+find_header(const char *request, const char *name)
+{
+	const char *p = strstr(request, name);
+	return p != nullptr ? p + strlen(name) : nullptr;
+}
+
+static gpointer
+server_connection(gpointer data)
+{
+	const int fd = GPOINTER_TO_INT(data);
+
+	GString *request = g_string_new(nullptr);
+	while (strstr(request->str, "\r\n\r\n") == nullptr) {
+		char buffer[4096];
+		ssize_t nbytes = recv(fd, buffer, sizeof(buffer), 0);
+		if (nbytes <= 0) {
+			g_string_free(request, true);
+			close(fd);
+			return nullptr;
+		}
+
+		g_string_append_len(request, buffer, nbytes);
+	}
+
+	g_mutex_lock(server.mutex);
+	const unsigned version = server.version;
+	const bool ignore_range = server.ignore_range;
+	++server.requests;
+	g_mutex_unlock(server.mutex);
+
+	char etag[32];
+	snprintf(etag, sizeof(etag), "\"v%u\"", version);
+
+	const char *if_none_match = find_header(request->str,
+						"If-None-Match: ");
+	const char *range = find_header(request->str, "Range: bytes=");
+
+	unsigned status = 200;
+	goffset offset = 0;
+	if (if_none_match != nullptr &&
+	    strncmp(if_none_match, etag, strlen(etag)) == 0)
+		status = 304;
+	else if (range != nullptr && !ignore_range) {
+		status = 206;
+		offset = g_ascii_strtoull(range, nullptr, 10);
+	}
+
+	g_string_free(request, true);
+
+	g_mutex_lock(server.mutex);
+	server.last_status = status;
+	g_mutex_unlock(server.mutex);
+
+	GString *response = g_string_new(nullptr);
+	g_string_append_printf(response,
+			       "HTTP/1.1 %u %s\r\n"
+			       "Content-Type: audio/ogg\r\n"
+			       "Accept-Ranges: bytes\r\n"
+			       "ETag: %s\r\n"
+			       "Connection: close\r\n",
+			       status,
+			       status == 304 ? "Not Modified" : "OK",
+			       etag);
+	if (status == 206)
+		g_string_append_printf(response,
+				       "Content-Range: bytes %lu-%lu/%lu\r\n",
+				       (unsigned long)offset,
+				       (unsigned long)RESOURCE_SIZE - 1,
+				       (unsigned long)RESOURCE_SIZE);
+	if (status != 304)
+		g_string_append_printf(response, "Content-Length: %lu\r\n",
+				       (unsigned long)(RESOURCE_SIZE - offset));
+	g_string_append(response, "\r\n");
+
+	bool success = send(fd, response->str, response->len,
+			    MSG_NOSIGNAL) == (ssize_t)response->len;
+	g_string_free(response, true);
+
+	/* the client may close the connection at any time (after a
+	   seek); that ends this thread */
+	while (success && status != 304 && offset < RESOURCE_SIZE) {
+		unsigned char buffer[16384];
+		size_t length = sizeof(buffer);
+		if ((goffset)length > RESOURCE_SIZE - offset)
+			length = RESOURCE_SIZE - offset;
+
+		for (size_t i = 0; i < length; ++i)
+			buffer[i] = pattern(version, offset + i);
+
+		ssize_t nbytes = send(fd, buffer, length, MSG_NOSIGNAL);
+		success = nbytes > 0;
+		if (success)
+			offset += nbytes;
+	}
+
+	close(fd);
+	return nullptr;
+}
+
+static gpointer
+server_thread(G_GNUC_UNUSED gpointer data)
+{
+	int fd;
+	while ((fd = accept(server.fd, nullptr, nullptr)) >= 0)
+		g_thread_create(server_connection, GINT_TO_POINTER(fd),
+				false, nullptr);
+
+	return nullptr;
+}
+
+static void
+server_start(void)
+{
+	server.mutex = g_mutex_new();
+
+	server.fd = socket(AF_INET, SOCK_STREAM, 0);
+	g_assert(server.fd >= 0);
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	socklen_t address_length = sizeof(address);
+	g_assert(bind(server.fd, (const struct sockaddr *)&address,
+		      sizeof(address)) == 0);
+	g_assert(listen(server.fd, 8) == 0);
+	g_assert(getsockname(server.fd, (struct sockaddr *)&address,
+			     &address_length) == 0);
+	server.port = ntohs(address.sin_port);
+
+	g_thread_create(server_thread, nullptr, false, nullptr);
+}
+
+static struct input_stream *
+open_stream(const char *path)
+{
+	char url[64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u%s",
+		 server.port, path);
+
+	GError *error = nullptr;
+	struct input_stream *is =
+		input_plugin_curl.open(url, mutex, cond, &error);
+	g_assert(error == nullptr);
+	g_assert(is != nullptr);
+
+	input_stream_lock(is);
+	input_stream_wait_ready(is);
+	const bool success = input_stream_check(is, &error);
+	input_stream_unlock(is);
+
+	g_assert(error == nullptr);
+	g_assert(success);
+	g_assert(is->seekable);
+	g_assert_cmpint(is->size, ==, RESOURCE_SIZE);
+	g_assert_cmpstr(is->mime, ==, "audio/ogg");
+	return is;
+}
+
+static void
+seek_stream(struct input_stream *is, goffset offset)
+{
+	GError *error = nullptr;
+	const bool success = input_stream_lock_seek(is, offset, SEEK_SET,
+						    &error);
+	g_assert(error == nullptr);
+	g_assert(success);
+	g_assert_cmpint(is->offset, ==, offset);
+}
+
+/**
+ * Reads from the stream, and verifies the data.
+ */
+static void
+check_read(struct input_stream *is, unsigned version, goffset length)
+{
+	while (length > 0) {
+		unsigned char buffer[8192];
+		size_t size = sizeof(buffer);
+		if ((goffset)size > length)
+			size = length;
+
+		const goffset offset = is->offset;
+
+		GError *error = nullptr;
+		size_t nbytes = input_stream_lock_read(is, buffer, size,
+						       &error);
+		g_assert(error == nullptr);
+		g_assert_cmpuint(nbytes, >, 0);
+
+		for (size_t i = 0; i < nbytes; ++i)
+			g_assert_cmpuint(buffer[i], ==,
+					 pattern(version, offset + i));
+
+		length -= nbytes;
+	}
+}
+
+/**
+ * Reads the rest of the stream, and verifies the data.
+ */
+static void
+check_read_to_end(struct input_stream *is, unsigned version)
+{
+	check_read(is, version, RESOURCE_SIZE - is->offset);
+
+	char buffer[16];
+	GError *error = nullptr;
+	g_assert_cmpuint(input_stream_lock_read(is, buffer, sizeof(buffer),
+						&error), ==, 0);
+	g_assert(error == nullptr);
+}
+
+/**
+ * Read slowly, so the transfer is paused and resumed many times.
+ * Resuming must not rely on socket events, because libcurl stops
+ * monitoring the socket while it is paused.
+ */
+static void
+test_curl_pause(void)
+{
+	struct input_stream *is = open_stream("/pause");
+
+	while (is->offset < RESOURCE_SIZE) {
+		check_read(is, server.version, 32 * 1024);
+		g_usleep(1000);
+	}
+
+	check_read_to_end(is, server.version);
+	input_stream_close(is);
+}
+
+/**
+ * Seeks back into the cached range, which must not send a request,
+ * and reads past its end, which continues downloading there.
+ */
+static void
+test_curl_seek_cached(void)
+{
+	struct input_stream *is = open_stream("/seek");
+	check_read(is, server.version, 256 * 1024);
+
+	const unsigned requests = server_requests();
+
+	seek_stream(is, 1000);
+	check_read(is, server.version, 128 * 1024);
+	g_assert_cmpuint(server_requests(), ==, requests);
+
+	check_read_to_end(is, server.version);
+	g_assert_cmpuint(server_requests(), ==, requests + 1);
+	g_assert_cmpuint(server_last_status(), ==, 206);
+
+	input_stream_close(is);
+}
+
+/**
+ * Opens a resource whose beginning is cached.  The server confirms
+ * that the cached copy is still valid, and the stream is served from
+ * the cache up to the end of the cached range.
+ */
+static void
+test_curl_reopen(void)
+{
+	struct input_stream *is = open_stream("/reopen");
+	check_read(is, server.version, 128 * 1024);
+	input_stream_close(is);
+
+	const unsigned requests = server_requests();
+
+	is = open_stream("/reopen");
+	g_assert_cmpuint(server_requests(), ==, requests + 1);
+	g_assert_cmpuint(server_last_status(), ==, 304);
+
+	check_read(is, server.version, 128 * 1024);
+	g_assert_cmpuint(server_requests(), ==, requests + 1);
+
+	check_read_to_end(is, server.version);
+	g_assert_cmpuint(server_requests(), ==, requests + 2);
+	g_assert_cmpuint(server_last_status(), ==, 206);
+
+	input_stream_close(is);
+}
+
+/**
+ * The resource changes on the server: the stale cached copy must
+ * not be served.
+ */
+static void
+test_curl_changed(void)
+{
+	struct input_stream *is = open_stream("/changed");
+	check_read(is, server.version, 128 * 1024);
+	input_stream_close(is);
+
+	g_mutex_lock(server.mutex);
+	const unsigned version = ++server.version;
+	g_mutex_unlock(server.mutex);
+
+	is = open_stream("/changed");
+	g_assert_cmpuint(server_last_status(), ==, 200);
+	check_read(is, version, 128 * 1024);
+
+	/* the new version has replaced the old one in the cache */
+	const unsigned requests = server_requests();
+	seek_stream(is, 0);
+	check_read(is, version, 64 * 1024);
+	g_assert_cmpuint(server_requests(), ==, requests);
+
+	input_stream_close(is);
+}
+
+/**
+ * The server ignores the "Range" request header, and sends the whole
+ * resource from the beginning: that must not be cached at the
+ * requested offset.
+ */
+static void
+test_curl_ignore_range(void)
+{
+	struct input_stream *is = open_stream("/ignore");
+	check_read(is, server.version, 64 * 1024);
+
+	g_mutex_lock(server.mutex);
+	server.ignore_range = true;
+	g_mutex_unlock(server.mutex);
+
+	seek_stream(is, RESOURCE_SIZE / 2);
+	g_assert_cmpuint(server_last_status(), ==, 200);
+
+	/* this returns the wrong data, but it must not poison the
+	   cache */
+	char buffer[4096];
+	GError *error = nullptr;
+	g_assert_cmpuint(input_stream_lock_read(is, buffer, sizeof(buffer),
+						&error), >, 0);
+	g_assert(error == nullptr);
+	input_stream_close(is);
+
+	g_mutex_lock(server.mutex);
+	server.ignore_range = false;
+	g_mutex_unlock(server.mutex);
+
+	is = open_stream("/ignore");
+	g_assert_cmpuint(server_last_status(), ==, 304);
+
+	const unsigned requests = server_requests();
+	seek_stream(is, RESOURCE_SIZE / 2);
+	check_read(is, server.version, 64 * 1024);
+	g_assert_cmpuint(server_requests(), ==, requests + 1);
+	g_assert_cmpuint(server_last_status(), ==, 206);
+
+	input_stream_close(is);
+}
+
+int
+main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, nullptr);
+	g_thread_init(nullptr);
+
+	/* fail instead of hanging if a paused transfer is never
+	   resumed */
+	alarm(60);
+
+	server_start();
+
+	io_thread_init();
+	GError *error = nullptr;
+	if (!io_thread_start(&error))
+		g_error("%s", error->message);
+
+	struct config_param *param = config_new_param(nullptr, 0);
+	config_add_block_param(param, "buffer_size", BUFFER_SIZE, 0);
+	config_add_block_param(param, "max_buffer_size", BUFFER_SIZE, 0);
+	config_add_block_param(param, "cache_size", "16384", 0);
+
+	if (!input_plugin_curl.init(param, &error))
+		g_error("%s", error->message);
+
+	mutex = g_mutex_new();
+	cond = g_cond_new();
+
+	g_test_add_func("/curl/pause", test_curl_pause);
+	g_test_add_func("/curl/seek_cached", test_curl_seek_cached);
+	g_test_add_func("/curl/reopen", test_curl_reopen);
+	g_test_add_func("/curl/changed", test_curl_changed);
+	g_test_add_func("/curl/ignore_range", test_curl_ignore_range);
+
+	const int result = g_test_run();
+
+	g_cond_free(cond);
+	g_mutex_free(mutex);
+
+	input_plugin_curl.finish();
+	config_param_free(param);
+	io_thread_deinit();
+
+	return result;
+}
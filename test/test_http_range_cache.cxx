@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "input/HttpRangeCache.hxx"
+
+#include <glib.h>
+
+#include <string.h>
+
+static const char *const URL = "http://localhost/song.ogg";
+
+static char data[4096];
+
+static void
+check_read(HttpRangeCache &cache, const char *url, goffset offset,
+	   size_t length, size_t expected)
+{
+	char buffer[sizeof(data)];
+	size_t nbytes = cache.Read(url, offset, buffer, length);
+	g_assert_cmpuint(nbytes, ==, expected);
+	g_assert(memcmp(buffer, data + offset, nbytes) == 0);
+}
+
+static void
+test_http_range_cache_merge(void)
+{
+	HttpRangeCache cache(sizeof(data));
+
+	g_assert(!cache.Contains(URL, 0));
+
+	cache.Write(URL, 100, data + 100, 100);
+	cache.Write(URL, 300, data + 300, 100);
+	g_assert_cmpuint(cache.GetSize(), ==, 200);
+
+	g_assert(!cache.Contains(URL, 99));
+	g_assert(cache.Contains(URL, 100));
+	g_assert(cache.Contains(URL, 199));
+	g_assert(!cache.Contains(URL, 200));
+
+	check_read(cache, URL, 0, 10, 0);
+	check_read(cache, URL, 150, 1000, 50);
+	check_read(cache, URL, 300, 10, 10);
+
+	/* fill the gap, overlapping both neighbours: all three are
+	   merged */
+	cache.Write(URL, 150, data + 150, 200);
+	g_assert_cmpuint(cache.GetSize(), ==, 300);
+	check_read(cache, URL, 100, 1000, 300);
+
+	/* already cached */
+	cache.Write(URL, 120, data + 120, 50);
+	g_assert_cmpuint(cache.GetSize(), ==, 300);
+
+	/* sequential append */
+	cache.Write(URL, 400, data + 400, 100);
+	g_assert_cmpuint(cache.GetSize(), ==, 400);
+	check_read(cache, URL, 100, 1000, 400);
+
+	/* a range which swallows another one */
+	cache.Write(URL, 1000, data + 1000, 10);
+	cache.Write(URL, 900, data + 900, 200);
+	g_assert_cmpuint(cache.GetSize(), ==, 600);
+	check_read(cache, URL, 900, 1000, 200);
+}
+
+static void
+test_http_range_cache_info(void)
+{
+	HttpRangeCache cache(sizeof(data));
+
+	goffset size;
+	std::string mime, etag, last_modified;
+	g_assert(!cache.GetInfo(URL, size, mime, etag, last_modified));
+
+	cache.SetInfo(URL, 12345, "audio/ogg", "\"v1\"", nullptr);
+	g_assert(cache.GetInfo(URL, size, mime, etag, last_modified));
+	g_assert_cmpint(size, ==, 12345);
+	g_assert(mime == "audio/ogg");
+	g_assert(etag == "\"v1\"");
+	g_assert(last_modified.empty());
+}
+
+static void
+test_http_range_cache_validators(void)
+{
+	HttpRangeCache cache(sizeof(data));
+
+	cache.SetInfo(URL, sizeof(data), "audio/ogg", "\"v1\"", nullptr);
+	cache.Write(URL, 0, data, 100);
+
+	/* the same version: the data is kept */
+	cache.SetInfo(URL, sizeof(data), "audio/ogg", "\"v1\"", nullptr);
+	g_assert(cache.Contains(URL, 0));
+	g_assert_cmpuint(cache.GetSize(), ==, 100);
+
+	/* a new version: the old data must not be served */
+	cache.SetInfo(URL, sizeof(data), "audio/ogg", "\"v2\"", nullptr);
+	g_assert(!cache.Contains(URL, 0));
+	g_assert_cmpuint(cache.GetSize(), ==, 0);
+
+	cache.Write(URL, 0, data, 100);
+	cache.SetInfo(URL, sizeof(data), "audio/ogg", "\"v2\"",
+		      "Tue, 15 Jan 2013 12:00:00 GMT");
+	g_assert(!cache.Contains(URL, 0));
+
+	cache.Write(URL, 0, data, 100);
+	cache.Invalidate(URL);
+	g_assert(!cache.Contains(URL, 0));
+	g_assert_cmpuint(cache.GetSize(), ==, 0);
+
+	goffset size;
+	std::string mime, etag, last_modified;
+	g_assert(!cache.GetInfo(URL, size, mime, etag, last_modified));
+}
+
+static void
+test_http_range_cache_evict(void)
+{
+	HttpRangeCache cache(1000);
+
+	cache.Write("http://localhost/a", 0, data, 400);
+	cache.Write("http://localhost/b", 0, data, 400);
+
+	/* make "a" the most recently used resource */
+	check_read(cache, "http://localhost/a", 0, 10, 10);
+
+	cache.Write("http://localhost/c", 0, data, 400);
+	g_assert_cmpuint(cache.GetSize(), ==, 800);
+	g_assert(cache.Contains("http://localhost/a", 0));
+	g_assert(!cache.Contains("http://localhost/b", 0));
+	g_assert(cache.Contains("http://localhost/c", 0));
+
+	/* the resource being written is never evicted; data which
+	   does not fit is discarded */
+	cache.Write("http://localhost/c", 400, data + 400, 400);
+	g_assert_cmpuint(cache.GetSize(), ==, 800);
+	g_assert(!cache.Contains("http://localhost/a", 0));
+	cache.Write("http://localhost/c", 800, data + 800, 400);
+	g_assert_cmpuint(cache.GetSize(), ==, 800);
+	g_assert(!cache.Contains("http://localhost/c", 800));
+}
+
+int
+main(int argc, char **argv)
+{
+	for (unsigned i = 0; i < sizeof(data); ++i)
+		data[i] = g_random_int();
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/http_range_cache/merge",
+			test_http_range_cache_merge);
+	g_test_add_func("/http_range_cache/info",
+			test_http_range_cache_info);
+	g_test_add_func("/http_range_cache/validators",
+			test_http_range_cache_validators);
+	g_test_add_func("/http_range_cache/evict",
+			test_http_range_cache_evict);
+
+	return g_test_run();
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "output/httpd_client.h"
+#include "output/httpd_internal.h"
+#include "encoder_plugin.h"
+#include "page.h"
+#include "tag.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+/* the ICY metadata interval hard-coded in httpd_client.c */
+enum { METAINT = 8192 };
+
+static struct encoder_plugin plugin;
+static struct encoder encoder = { .plugin = &plugin };
+static struct httpd_output httpd;
+static struct httpd_mount mount;
+
+struct httpd_mount *
+httpd_output_find_mount(G_GNUC_UNUSED struct httpd_output *h,
+			G_GNUC_UNUSED const char *path)
+{
+	return &mount;
+}
+
+bool
+httpd_output_find_file(G_GNUC_UNUSED struct httpd_output *h,
+		       G_GNUC_UNUSED const char *path,
+		       G_GNUC_UNUSED struct page **page_r,
+		       G_GNUC_UNUSED bool *playlist_r,
+		       G_GNUC_UNUSED const char **content_type_r)
+{
+	return false;
+}
+
+struct page *
+httpd_output_get_header(G_GNUC_UNUSED struct httpd_output *h,
+			G_GNUC_UNUSED const struct httpd_mount *m)
+{
+	return NULL;
+}
+
+const char *
+tag_get_value(G_GNUC_UNUSED const struct tag *tag,
+	      G_GNUC_UNUSED enum tag_type type)
+{
+	return NULL;
+}
+
+static unsigned char
+pattern(uint64_t i)
+{
+	return (unsigned char)(i * 7 + (i >> 8));
+}
+
+/**
+ * Appends pages with a known byte pattern to the ring, and publishes
+ * them to the clients.
+ */
+static void
+produce(uint64_t *offset, unsigned n, size_t size)
+{
+	unsigned char buffer[4096];
+	g_assert(size <= sizeof(buffer));
+
+	for (unsigned k = 0; k < n; ++k) {
+		for (size_t i = 0; i < size; ++i)
+			buffer[i] = pattern(*offset + i);
+
+		struct page *page = page_new_copy(buffer, size);
+		g_assert(httpd_ring_push(&mount.ring, page, 0, true));
+		*offset += size;
+	}
+
+	mount.head = httpd_ring_head(&mount.ring);
+}
+
+/**
+ * Creates a metadata block of the maximum size, so a full socket
+ * buffer often interrupts it.
+ */
+static struct page *
+make_metadata(unsigned serial)
+{
+	unsigned char block[1 + 255 * 16];
+	memset(block, 0, sizeof(block));
+	block[0] = 255;
+	g_snprintf((char *)block + 1, sizeof(block) - 1,
+		   "StreamTitle='song %u';", serial);
+	return page_new_copy(block, sizeof(block));
+}
+
+/**
+ * Receives at most the specified number of bytes from the socket.
+ */
+static void
+append_received(int fd, GByteArray *dest, size_t limit)
+{
+	unsigned char buffer[65536];
+	ssize_t nbytes;
+	while (limit > 0 &&
+	       (nbytes = recv(fd, buffer, MIN(limit, sizeof(buffer)),
+			      MSG_DONTWAIT)) > 0) {
+		g_byte_array_append(dest, buffer, nbytes);
+		limit -= nbytes;
+	}
+}
+
+/**
+ * Changes the tag while a large metadata block is being sent, and
+ * lets the following writev() calls span more than one metadata
+ * interval.  The listener must be able to parse the stream: audio
+ * and metadata blocks alternate at exactly #METAINT bytes.
+ */
+static void
+test_httpd_client_metadata_change(void)
+{
+	int sv[2];
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+	int size = 4096;
+	setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	mount.path = (char *)"/";
+	mount.encoder = &encoder;
+	mount.content_type = "audio/mpeg";
+	httpd_ring_init(&mount.ring, HTTPD_RING_CAPACITY);
+	mount.head = mount.burst_seq = httpd_ring_head(&mount.ring);
+
+	struct httpd_client *client = httpd_client_new(&httpd, sv[0]);
+
+	static const char request[] =
+		"GET / HTTP/1.1\r\nIcy-MetaData: 1\r\n\r\n";
+	g_assert(write(sv[1], request, sizeof(request) - 1) ==
+		 sizeof(request) - 1);
+	g_assert(httpd_client_read(client));
+
+	GByteArray *received = g_byte_array_new();
+	uint64_t offset = 0;
+	for (unsigned i = 0; i < 1000; ++i) {
+		struct page *metadata = make_metadata(i);
+		httpd_client_send_metadata(client, metadata);
+		page_unref(metadata);
+
+		produce(&offset, 4, 3000);
+
+		/* the kernel splits a writev() into chunks of half
+		   the send buffer size; varying it makes writev()
+		   stop at arbitrary positions, often inside a
+		   metadata block, and lets the next one span more
+		   than one metadata interval */
+		for (unsigned j = 0; j < 4; ++j) {
+			size = 2048 + (i * 4 + j) * 7919 % 16384;
+			setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF,
+				   &size, sizeof(size));
+
+			httpd_client_writable(client);
+			g_assert(httpd_client_write(client));
+
+			append_received(sv[1], received,
+					(i * 4 + j) * 104729 % 8000);
+		}
+
+		/* let the ring go */
+		httpd_ring_release(&mount.ring, httpd_client_cursor(client));
+	}
+
+	/* flush the rest */
+	for (unsigned i = 0; i < 10000 && httpd_client_lag(client) > 0; ++i) {
+		httpd_client_writable(client);
+		g_assert(httpd_client_write(client));
+		append_received(sv[1], received, SIZE_MAX);
+	}
+
+	g_assert_cmpuint(httpd_client_lag(client), ==, 0);
+	httpd_client_free(client);
+	append_received(sv[1], received, SIZE_MAX);
+	close(sv[1]);
+
+	/* skip the response headers */
+	const unsigned char *p = received->data, *end = p + received->len;
+	const unsigned char *body = (const unsigned char *)
+		g_strstr_len((const char *)p, received->len, "\r\n\r\n");
+	g_assert(body != NULL);
+	p = body + 4;
+
+	uint64_t audio = 0;
+	unsigned nonempty = 0;
+	while (p < end) {
+		size_t n = MIN((size_t)(end - p), METAINT - audio % METAINT);
+		for (size_t i = 0; i < n; ++i)
+			g_assert_cmpuint(p[i], ==, pattern(audio + i));
+		audio += n;
+		p += n;
+
+		if (p < end) {
+			g_assert(audio % METAINT == 0);
+
+			const size_t length = *p++ * 16;
+			g_assert(p + length <= end);
+			if (length > 0) {
+				g_assert(memcmp(p, "StreamTitle='song ", 18) == 0);
+				++nonempty;
+			}
+
+			p += length;
+		}
+	}
+
+	g_assert_cmpuint(audio, ==, offset);
+	g_assert_cmpuint(nonempty, >, 0);
+
+	g_byte_array_free(received, true);
+	httpd_ring_deinit(&mount.ring);
+}
+
+int
+main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/httpd_client/metadata_change",
+			test_httpd_client_metadata_change);
+
+	return g_test_run();
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "output/httpd_segment.h"
+#include "page.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+/**
+ * Feeds pages of 100 bytes every 10 milliseconds; every second page
+ * begins at a frame boundary.
+ */
+static void
+feed(struct httpd_segmenter *s, unsigned from, unsigned to)
+{
+	for (unsigned t = from; t < to; t += 10) {
+		unsigned char data[100];
+		memset(data, t / 100, sizeof(data));
+
+		struct page *page = page_new_copy(data, sizeof(data));
+		unsigned duration;
+		struct page *segment =
+			httpd_segmenter_append(s, page, t, t % 20 == 0,
+					       &duration);
+		page_unref(page);
+
+		if (segment != NULL)
+			httpd_segmenter_push(s, segment, duration);
+	}
+}
+
+static void
+test_segment_cut(void)
+{
+	struct httpd_segmenter s;
+	httpd_segmenter_init(&s, "index", ".mp3", 100);
+
+	struct page *page;
+	bool playlist;
+	g_assert(httpd_segmenter_lookup(&s, "index.m3u8", &page, &playlist));
+	g_assert(playlist);
+	g_assert(page == NULL);
+
+	feed(&s, 0, 1010);
+	g_assert_cmpuint(s.num_segments, ==, HTTPD_SEGMENTS);
+	g_assert_cmpuint(s.segments[HTTPD_SEGMENTS - 1].seq, ==, 9);
+
+	/* the oldest segments have been discarded */
+	g_assert(httpd_segmenter_lookup(&s, "index-1.mp3", &page, &playlist));
+	g_assert(!playlist);
+	g_assert(page == NULL);
+
+	g_assert(httpd_segmenter_lookup(&s, "index-9.mp3", &page, &playlist));
+	g_assert(page != NULL);
+	g_assert_cmpuint(page->size, ==, 1000);
+	g_assert_cmpuint(page->data[0], ==, 9);
+	page_unref(page);
+
+	g_assert(httpd_segmenter_lookup(&s, "index.m3u8", &page, &playlist));
+	g_assert(page != NULL);
+	char *text = g_strndup((const char *)page->data, page->size);
+	g_assert(strstr(text, "#EXT-X-TARGETDURATION:1\n") != NULL);
+	g_assert(strstr(text, "#EXT-X-MEDIA-SEQUENCE:5\n") != NULL);
+	g_assert(strstr(text, "#EXTINF:0.100,\nindex-9.mp3\n") != NULL);
+	g_assert(strstr(text, "index-4.mp3") == NULL);
+	g_free(text);
+	page_unref(page);
+
+	/* other names are not handled by this segmenter */
+	g_assert(!httpd_segmenter_lookup(&s, "index-9.ogg", &page, &playlist));
+	g_assert(!httpd_segmenter_lookup(&s, "low.m3u8", &page, &playlist));
+	g_assert(!httpd_segmenter_lookup(&s, "index", &page, &playlist));
+
+	httpd_segmenter_deinit(&s);
+}
+
+static void
+test_segment_header(void)
+{
+	struct httpd_segmenter s;
+	httpd_segmenter_init(&s, "low", ".ogg", 100);
+
+	struct page *header = page_new_copy("HDR", 3);
+	unsigned duration;
+	g_assert(httpd_segmenter_set_header(&s, header, 0, &duration) == NULL);
+	page_unref(header);
+
+	feed(&s, 0, 50);
+
+	/* a new header finishes the current segment */
+	header = page_new_copy("NEW", 3);
+	struct page *segment =
+		httpd_segmenter_set_header(&s, header, 50, &duration);
+	page_unref(header);
+	g_assert(segment != NULL);
+	g_assert_cmpuint(duration, ==, 50);
+	g_assert_cmpuint(segment->size, ==, 3 + 5 * 100);
+	g_assert(memcmp(segment->data, "HDR", 3) == 0);
+	httpd_segmenter_push(&s, segment, duration);
+
+	feed(&s, 60, 200);
+
+	struct page *page;
+	bool playlist;
+	g_assert(httpd_segmenter_lookup(&s, "low-1.ogg", &page, &playlist));
+	g_assert(page != NULL);
+	g_assert(memcmp(page->data, "NEW", 3) == 0);
+	page_unref(page);
+
+	httpd_segmenter_deinit(&s);
+}
+
+int
+main(int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func("/httpd/segment/cut", test_segment_cut);
+	g_test_add_func("/httpd/segment/header", test_segment_header);
+
+	g_test_run();
+}
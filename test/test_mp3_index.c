@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "decoder/mp3_index.h"
+
+#include <glib.h>
+
+#include <glib/gstdio.h>
+
+#include <string.h>
+#include <unistd.h>
+
+enum {
+	/* 26.122 ms per frame at 44.1 kHz, 417 bytes at 128 kbit/s */
+	FRAME_US = 26122,
+	FRAME_BYTES = 417,
+	NUM_FRAMES = 10000,
+};
+
+static struct mp3_index *
+build_index(void)
+{
+	struct mp3_index *index = mp3_index_new(500);
+
+	for (unsigned i = 0; i < NUM_FRAMES; ++i) {
+		const uint64_t us = (uint64_t)i * FRAME_US;
+		const struct mp3_index_entry entry = {
+			.offset = 1024 + (uint64_t)i * FRAME_BYTES,
+			.frame = i,
+			.time_ms = us / 1000,
+			.timer_seconds = us / 1000000,
+			.timer_fraction = us % 1000000,
+		};
+
+		mp3_index_add(index, &entry);
+	}
+
+	mp3_index_finish(index, NUM_FRAMES,
+			 (uint64_t)NUM_FRAMES * FRAME_US / 1000);
+	return index;
+}
+
+static void
+test_mp3_index_lookup(void)
+{
+	struct mp3_index *index = build_index();
+
+	g_assert_cmpuint(mp3_index_frames(index), ==, NUM_FRAMES);
+	g_assert_cmpfloat(mp3_index_duration(index), >, 261.2);
+	g_assert_cmpfloat(mp3_index_duration(index), <, 261.3);
+
+	const struct mp3_index_entry *entry = mp3_index_lookup(index, 0);
+	g_assert(entry != NULL);
+	g_assert_cmpuint(entry->frame, ==, 0);
+	g_assert_cmpuint(entry->offset, ==, 1024);
+
+	/* never after the destination, and not more than one
+	   interval before it */
+	for (uint32_t t = 0; t < 262000; t += 777) {
+		entry = mp3_index_lookup(index, t);
+		g_assert(entry != NULL);
+		g_assert_cmpuint(entry->time_ms, <=, t);
+		if (t < 261000)
+			g_assert_cmpuint(entry->time_ms + 500 + 27, >, t);
+		g_assert_cmpuint(entry->offset, ==,
+				 1024 + (uint64_t)entry->frame * FRAME_BYTES);
+	}
+
+	entry = mp3_index_lookup(index, 1000000);
+	g_assert_cmpuint(entry->frame, >, NUM_FRAMES - 30);
+
+	mp3_index_free(index);
+}
+
+static void
+test_mp3_index_cache(void)
+{
+	char *dir = g_strdup_printf("%s/test_mp3_index_%d",
+				    g_get_tmp_dir(), (int)getpid());
+	g_assert(g_mkdir(dir, 0700) == 0);
+
+	char *song = g_build_filename(dir, "song.mp3", NULL);
+	g_assert(g_file_set_contents(song, "foo", 3, NULL));
+
+	g_assert(mp3_index_load(dir, song) == NULL);
+
+	struct mp3_index *index = build_index();
+	g_assert(mp3_index_save(index, dir, song, NULL));
+	mp3_index_free(index);
+
+	index = mp3_index_load(dir, song);
+	g_assert(index != NULL);
+	g_assert_cmpuint(mp3_index_frames(index), ==, NUM_FRAMES);
+
+	const struct mp3_index_entry *entry = mp3_index_lookup(index, 60000);
+	g_assert(entry != NULL);
+	g_assert_cmpuint(entry->time_ms, <=, 60000);
+	g_assert_cmpuint(entry->time_ms, >, 59400);
+	g_assert_cmpint(entry->timer_seconds, ==, 59);
+	mp3_index_free(index);
+
+	/* an index whose entries are not sorted is rejected */
+	char *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, song, -1);
+	char *cache_file = g_build_filename(dir, md5, NULL);
+	gchar *contents;
+	gsize length;
+	g_assert(g_file_get_contents(cache_file, &contents, &length, NULL));
+
+	struct mp3_index_entry last;
+	g_assert_cmpuint(length, >, sizeof(last));
+	memcpy(&last, contents + length - sizeof(last), sizeof(last));
+	last.time_ms = 0;
+	memcpy(contents + length - sizeof(last), &last, sizeof(last));
+
+	g_assert(g_file_set_contents(cache_file, contents, length, NULL));
+	g_assert(mp3_index_load(dir, song) == NULL);
+
+	g_free(contents);
+	g_free(cache_file);
+	g_free(md5);
+
+	/* another song does not get this index */
+	char *other = g_build_filename(dir, "other.mp3", NULL);
+	g_assert(g_file_set_contents(other, "foo", 3, NULL));
+	g_assert(mp3_index_load(dir, other) == NULL);
+
+	/* a modified song invalidates its index */
+	g_assert(g_file_set_contents(song, "foobar", 6, NULL));
+	g_assert(mp3_index_load(dir, song) == NULL);
+
+	GDir *d = g_dir_open(dir, 0, NULL);
+	const char *name;
+	while ((name = g_dir_read_name(d)) != NULL) {
+		char *path = g_build_filename(dir, name, NULL);
+		g_unlink(path);
+		g_free(path);
+	}
+	g_dir_close(d);
+	g_rmdir(dir);
+
+	g_free(other);
+	g_free(song);
+	g_free(dir);
+}
+
+int
+main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/mp3_index/lookup", test_mp3_index_lookup);
+	g_test_add_func("/mp3_index/cache", test_mp3_index_cache);
+
+	return g_test_run();
+}
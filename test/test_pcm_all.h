@@ -53,4 +53,37 @@ test_pcm_volume_32(void);
 void
 test_pcm_volume_float(void);
 
+void
+test_pcm_simd_volume_16(void);
+
+void
+test_pcm_simd_volume_24(void);
+
+void
+test_pcm_simd_volume_32(void);
+
+void
+test_pcm_simd_mix(void);
+
+void
+test_pcm_simd_convert(void);
+
+void
+test_pcm_simd_interleave(void);
+
+void
+test_pcm_simd_pack(void);
+
+void
+test_pcm_simd_throughput(void);
+
+void
+test_pcm_resample_polyphase(void);
+
+void
+test_pcm_resample_precision(void);
+
+void
+test_pcm_resample_throughput(void);
+
 #endif
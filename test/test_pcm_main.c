@@ -38,5 +38,21 @@ main(int argc, char **argv)
 	g_test_add_func("/pcm/volume/32", test_pcm_volume_32);
 	g_test_add_func("/pcm/volume/float", test_pcm_volume_float);
 
+	g_test_add_func("/pcm/simd/volume16", test_pcm_simd_volume_16);
+	g_test_add_func("/pcm/simd/volume24", test_pcm_simd_volume_24);
+	g_test_add_func("/pcm/simd/volume32", test_pcm_simd_volume_32);
+	g_test_add_func("/pcm/simd/mix", test_pcm_simd_mix);
+	g_test_add_func("/pcm/simd/convert", test_pcm_simd_convert);
+	g_test_add_func("/pcm/simd/interleave", test_pcm_simd_interleave);
+	g_test_add_func("/pcm/simd/pack", test_pcm_simd_pack);
+	g_test_add_func("/pcm/simd/throughput", test_pcm_simd_throughput);
+
+	g_test_add_func("/pcm/resample/polyphase",
+			test_pcm_resample_polyphase);
+	g_test_add_func("/pcm/resample/precision",
+			test_pcm_resample_precision);
+	g_test_add_func("/pcm/resample/throughput",
+			test_pcm_resample_throughput);
+
 	g_test_run();
 }
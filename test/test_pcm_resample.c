@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "test_pcm_all.h"
+#include "pcm_resample_internal.h"
+
+#include <glib.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+	SRC_RATE = 44100,
+	DEST_RATE = 48000,
+	FREQUENCY = 1000,
+
+	/* one second of input, fed in odd sized chunks */
+	N_FRAMES = SRC_RATE,
+	CHUNK = 941,
+};
+
+static void
+fill_sine(int16_t *buffer, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		buffer[i] = lrint(16384 * sin(2 * M_PI * FREQUENCY * i /
+					      SRC_RATE));
+}
+
+/**
+ * Calculates the THD+N of a sine wave of known frequency: the
+ * amplitude and phase of the fundamental are determined with a least
+ * squares fit, and everything else is counted as distortion or noise.
+ *
+ * @return the ratio of the residual to the fundamental [dB]
+ */
+static double
+thd_n(const int16_t *buffer, unsigned n, unsigned rate)
+{
+	/* skip the filter's settling time at both ends */
+	buffer += n / 10;
+	n -= n / 5;
+
+	double ss = 0, cc = 0, sc = 0, xs = 0, xc = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		double s = sin(2 * M_PI * FREQUENCY * i / rate);
+		double c = cos(2 * M_PI * FREQUENCY * i / rate);
+		ss += s * s;
+		cc += c * c;
+		sc += s * c;
+		xs += buffer[i] * s;
+		xc += buffer[i] * c;
+	}
+
+	const double det = ss * cc - sc * sc;
+	const double a = (xs * cc - xc * sc) / det;
+	const double b = (xc * ss - xs * sc) / det;
+
+	double signal = 0, residual = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		double fit = a * sin(2 * M_PI * FREQUENCY * i / rate) +
+			b * cos(2 * M_PI * FREQUENCY * i / rate);
+		signal += fit * fit;
+		residual += (buffer[i] - fit) * (buffer[i] - fit);
+	}
+
+	return 10 * log10(residual / signal);
+}
+
+static double
+resample_thd_n(bool polyphase)
+{
+	static int16_t src[N_FRAMES];
+	fill_sine(src, N_FRAMES);
+
+	struct pcm_resample_state state;
+	if (polyphase)
+		pcm_resample_polyphase_init(&state);
+	else
+		pcm_resample_fallback_init(&state);
+
+	int16_t *dest = g_new(int16_t, N_FRAMES * 2);
+	unsigned n = 0;
+
+	for (unsigned i = 0; i < N_FRAMES; i += CHUNK) {
+		const unsigned chunk = MIN(CHUNK, N_FRAMES - i);
+		size_t size;
+		const int16_t *p = polyphase
+			? pcm_resample_polyphase_16(&state, 1, SRC_RATE,
+						    src + i,
+						    chunk * sizeof(*src),
+						    DEST_RATE, &size)
+			: pcm_resample_fallback_16(&state, 1, SRC_RATE,
+						   src + i,
+						   chunk * sizeof(*src),
+						   DEST_RATE, &size);
+
+		g_assert_cmpuint(n + size / sizeof(*p), <=, N_FRAMES * 2);
+		memcpy(dest + n, p, size);
+		n += size / sizeof(*p);
+	}
+
+	/* the polyphase filter delays the output by half its length,
+	   and the fallback resampler rounds each chunk */
+	const unsigned expected = (unsigned)N_FRAMES * DEST_RATE / SRC_RATE;
+	g_assert_cmpuint(n, <, expected + 256);
+	g_assert_cmpuint(n, >, expected - 256);
+
+	const double result = thd_n(dest, n, DEST_RATE);
+
+	g_free(dest);
+
+	if (polyphase)
+		pcm_resample_polyphase_deinit(&state);
+	else
+		pcm_resample_fallback_deinit(&state);
+
+	return result;
+}
+
+void
+test_pcm_resample_polyphase(void)
+{
+	pcm_resample_polyphase_global_init(PCM_POLYPHASE_MEDIUM);
+
+	const double fallback = resample_thd_n(false);
+	const double polyphase = resample_thd_n(true);
+
+	if (g_test_verbose())
+		g_print("THD+N: fallback %.1f dB, polyphase %.1f dB\n",
+			fallback, polyphase);
+
+	/* a 16 bit result at -6 dBFS cannot be much better than
+	   -92 dB */
+	g_assert_cmpfloat(polyphase, <, -85);
+	g_assert_cmpfloat(polyphase, <, fallback - 40);
+}
+
+/**
+ * Resamples a constant 32 bit signal with a ratio which has more than
+ * MAX_PHASES phases.  Each filter phase has unity gain at DC, so the
+ * output must be the input again; a float accumulator would be off
+ * by up to 2^7.
+ */
+void
+test_pcm_resample_precision(void)
+{
+	enum { VALUE = 0x7654321f, FRAMES = 4410, DEST = 96001 };
+
+	static int32_t src[FRAMES];
+	for (unsigned i = 0; i < FRAMES; ++i)
+		src[i] = VALUE;
+
+	struct pcm_resample_state state;
+	pcm_resample_polyphase_init(&state);
+
+	unsigned n = 0;
+	for (unsigned i = 0; i < FRAMES; i += CHUNK) {
+		const unsigned n_frames = MIN(CHUNK, FRAMES - i);
+
+		size_t size;
+		const int32_t *dest =
+			pcm_resample_polyphase_32(&state, 1, SRC_RATE,
+						  src + i,
+						  n_frames * sizeof(*src),
+						  DEST, 32, &size);
+
+		for (unsigned j = 0; j < size / sizeof(*dest); ++j, ++n)
+			/* skip the filter's settling time */
+			if (n >= 1000)
+				g_assert_cmpint(abs(dest[j] - VALUE), <=, 1);
+	}
+
+	g_assert_cmpuint(n, >, FRAMES * 2);
+
+	pcm_resample_polyphase_deinit(&state);
+}
+
+/**
+ * Measures the speed of the polyphase presets.  Only runs in "perf"
+ * mode.
+ */
+void
+test_pcm_resample_throughput(void)
+{
+	if (!g_test_perf())
+		return;
+
+	enum { CHANNELS = 2, ROUNDS = 10 };
+
+	static float src[SRC_RATE * CHANNELS];
+	for (unsigned i = 0; i < G_N_ELEMENTS(src); ++i)
+		src[i] = g_random_double_range(-1, 1);
+
+	static const char *const names[] = { "fast", "medium", "best" };
+	for (unsigned q = 0; q < G_N_ELEMENTS(names); ++q) {
+		pcm_resample_polyphase_global_init(q);
+
+		struct pcm_resample_state state;
+		pcm_resample_polyphase_init(&state);
+
+		g_test_timer_start();
+		for (unsigned i = 0; i < ROUNDS; ++i) {
+			size_t size;
+			pcm_resample_polyphase_float(&state, CHANNELS,
+						     SRC_RATE, src,
+						     sizeof(src),
+						     DEST_RATE, &size);
+		}
+
+		g_test_minimized_result(g_test_timer_elapsed(),
+					"polyphase-%s %u->%u: %u seconds",
+					names[q], SRC_RATE, DEST_RATE,
+					ROUNDS);
+
+		pcm_resample_polyphase_deinit(&state);
+	}
+
+	pcm_resample_polyphase_global_init(PCM_POLYPHASE_MEDIUM);
+}
@@ -0,0 +1,473 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "test_pcm_all.h"
+#include "pcm_simd.h"
+#include "pcm_volume.h"
+#include "pcm_mix.h"
+#include "pcm_format.h"
+#include "pcm_buffer.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+/**
+ * The instruction set combinations which are compared with the
+ * portable implementation.  Unsupported ones are masked out by
+ * pcm_simd_restrict().
+ */
+static const unsigned simd_masks[] = {
+	PCM_SIMD_SSE2,
+	PCM_SIMD_ALL,
+};
+
+/* an odd number, to exercise the scalar remainder code */
+enum { N = 509 };
+
+static int32_t
+random24(void)
+{
+	int32_t x = g_random_int() & 0xffffff;
+	if (x & 0x800000)
+		x |= 0xff000000;
+	return x;
+}
+
+static void
+random_dither(int32_t *dither, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		dither[i] = g_random_int_range(-511, 512);
+}
+
+static int
+random_volume(void)
+{
+	return g_random_int_range(0, PCM_VOLUME_1 + 1);
+}
+
+void
+test_pcm_simd_volume_16(void)
+{
+	int16_t src[N], expected[N], dest[N];
+	int32_t dither[N];
+	for (unsigned i = 0; i < N; ++i)
+		src[i] = g_random_int();
+	random_dither(dither, N);
+
+	/* also check a volume above 100% which requires clamping */
+	static const int volumes[] = { 1, PCM_VOLUME_1 / 2, PCM_VOLUME_1,
+				       PCM_VOLUME_1 * 3, -1 };
+
+	for (unsigned v = 0; v < G_N_ELEMENTS(volumes); ++v) {
+		int volume = volumes[v] >= 0 ? volumes[v] : random_volume();
+
+		pcm_simd_restrict(0);
+		memcpy(expected, src, sizeof(src));
+		pcm_simd_volume_16(expected, N, volume, dither);
+
+		for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+			pcm_simd_restrict(simd_masks[m]);
+			memcpy(dest, src, sizeof(src));
+			pcm_simd_volume_16(dest, N, volume, dither);
+			g_assert_cmpint(memcmp(dest, expected, sizeof(dest)),
+					==, 0);
+		}
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+void
+test_pcm_simd_volume_24(void)
+{
+	int32_t src[N], expected[N], dest[N];
+	int32_t dither[N];
+	for (unsigned i = 0; i < N; ++i)
+		src[i] = random24();
+	random_dither(dither, N);
+
+	const int volume = random_volume();
+
+	pcm_simd_restrict(0);
+	memcpy(expected, src, sizeof(src));
+	pcm_simd_volume_24(expected, N, volume, dither);
+
+	for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+		pcm_simd_restrict(simd_masks[m]);
+		memcpy(dest, src, sizeof(src));
+		pcm_simd_volume_24(dest, N, volume, dither);
+		g_assert_cmpint(memcmp(dest, expected, sizeof(dest)), ==, 0);
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+void
+test_pcm_simd_volume_32(void)
+{
+	int32_t src[N], expected[N], dest[N];
+	int32_t dither[N];
+	for (unsigned i = 0; i < N; ++i)
+		src[i] = g_random_int();
+	random_dither(dither, N);
+
+	/* full scale samples at 100% exercise the extreme values of
+	   the 64 bit intermediate results */
+	src[0] = G_MININT32;
+	src[1] = G_MAXINT32;
+
+	static const int volumes[] = { PCM_VOLUME_1, -1 };
+
+	for (unsigned v = 0; v < G_N_ELEMENTS(volumes); ++v) {
+		int volume = volumes[v] >= 0 ? volumes[v] : random_volume();
+
+		pcm_simd_restrict(0);
+		memcpy(expected, src, sizeof(src));
+		pcm_simd_volume_32(expected, N, volume, dither);
+
+		for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+			pcm_simd_restrict(simd_masks[m]);
+			memcpy(dest, src, sizeof(src));
+			pcm_simd_volume_32(dest, N, volume, dither);
+			g_assert_cmpint(memcmp(dest, expected, sizeof(dest)),
+					==, 0);
+		}
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+void
+test_pcm_simd_mix(void)
+{
+	int16_t src16a[N], src16b[N], expected16[N], dest16[N];
+	int32_t src24a[N], src24b[N], src32a[N], src32b[N];
+	int32_t expected32[N], dest32[N];
+	int32_t dither[N];
+
+	for (unsigned i = 0; i < N; ++i) {
+		src16a[i] = g_random_int();
+		src16b[i] = g_random_int();
+		src24a[i] = random24();
+		src24b[i] = random24();
+		src32a[i] = g_random_int();
+		src32b[i] = g_random_int();
+	}
+
+	random_dither(dither, N);
+
+	const int volume1 = random_volume();
+	const int volume2 = PCM_VOLUME_1 - volume1;
+
+	pcm_simd_restrict(0);
+	memcpy(expected16, src16a, sizeof(src16a));
+	pcm_simd_add_vol_16(expected16, src16b, N, volume1, volume2, dither);
+
+	for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+		pcm_simd_restrict(simd_masks[m]);
+		memcpy(dest16, src16a, sizeof(src16a));
+		pcm_simd_add_vol_16(dest16, src16b, N,
+				    volume1, volume2, dither);
+		g_assert_cmpint(memcmp(dest16, expected16, sizeof(dest16)),
+				==, 0);
+	}
+
+	pcm_simd_restrict(0);
+	memcpy(expected32, src24a, sizeof(src24a));
+	pcm_simd_add_vol_24(expected32, src24b, N, volume1, volume2, dither);
+
+	for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+		pcm_simd_restrict(simd_masks[m]);
+		memcpy(dest32, src24a, sizeof(src24a));
+		pcm_simd_add_vol_24(dest32, src24b, N,
+				    volume1, volume2, dither);
+		g_assert_cmpint(memcmp(dest32, expected32, sizeof(dest32)),
+				==, 0);
+	}
+
+	pcm_simd_restrict(0);
+	memcpy(expected32, src32a, sizeof(src32a));
+	pcm_simd_add_vol_32(expected32, src32b, N, volume1, volume2, dither);
+
+	for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+		pcm_simd_restrict(simd_masks[m]);
+		memcpy(dest32, src32a, sizeof(src32a));
+		pcm_simd_add_vol_32(dest32, src32b, N,
+				    volume1, volume2, dither);
+		g_assert_cmpint(memcmp(dest32, expected32, sizeof(dest32)),
+				==, 0);
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+void
+test_pcm_simd_convert(void)
+{
+	int16_t src16[N], out16[N], expected16[N];
+	int32_t src32[N], out32[N], expected32[N];
+	float srcf[N], outf[N], expectedf[N];
+
+	for (unsigned i = 0; i < N; ++i) {
+		src16[i] = g_random_int();
+		src32[i] = g_random_int();
+		/* exceed the range a bit to check clamping */
+		srcf[i] = g_random_double_range(-1.2, 1.2);
+	}
+
+	for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+		pcm_simd_restrict(0);
+		pcm_simd_shift_16_to_32(expected32, src16, N, 8);
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_shift_16_to_32(out32, src16, N, 8);
+		g_assert_cmpint(memcmp(out32, expected32, sizeof(out32)),
+				==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_shift_16_to_32(expected32, src16, N, 16);
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_shift_16_to_32(out32, src16, N, 16);
+		g_assert_cmpint(memcmp(out32, expected32, sizeof(out32)),
+				==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_shift_24_to_32(expected32, src32, N);
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_shift_24_to_32(out32, src32, N);
+		g_assert_cmpint(memcmp(out32, expected32, sizeof(out32)),
+				==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_shift_32_to_24(expected32, src32, N);
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_shift_32_to_24(out32, src32, N);
+		g_assert_cmpint(memcmp(out32, expected32, sizeof(out32)),
+				==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_16_to_float(expectedf, src16, N, 2.0f / (1 << 16));
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_16_to_float(outf, src16, N, 2.0f / (1 << 16));
+		g_assert_cmpint(memcmp(outf, expectedf, sizeof(outf)), ==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_32_to_float(expectedf, src32, N, 0.5f / (1 << 30));
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_32_to_float(outf, src32, N, 0.5f / (1 << 30));
+		g_assert_cmpint(memcmp(outf, expectedf, sizeof(outf)), ==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_float_to_16(expected16, srcf, N);
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_float_to_16(out16, srcf, N);
+		g_assert_cmpint(memcmp(out16, expected16, sizeof(out16)),
+				==, 0);
+
+		pcm_simd_restrict(0);
+		pcm_simd_float_to_24(expected32, srcf, N);
+		pcm_simd_restrict(simd_masks[m]);
+		pcm_simd_float_to_24(out32, srcf, N);
+		g_assert_cmpint(memcmp(out32, expected32, sizeof(out32)),
+				==, 0);
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+void
+test_pcm_simd_interleave(void)
+{
+	/* a mono stream and 3 channels have no vectorized kernel, but
+	   the dispatcher must handle them */
+	static const unsigned channel_counts[] = { 1, 2, 3, 6, 8 };
+	enum { TEST_MAX_CHANNELS = 8 };
+
+	static int32_t planes[TEST_MAX_CHANNELS][N];
+	static int16_t out16[TEST_MAX_CHANNELS * N];
+	static int16_t expected16[TEST_MAX_CHANNELS * N];
+	static int32_t out32[TEST_MAX_CHANNELS * N];
+	static int32_t expected32[TEST_MAX_CHANNELS * N];
+
+	const int32_t *src[TEST_MAX_CHANNELS];
+	for (unsigned c = 0; c < TEST_MAX_CHANNELS; ++c) {
+		/* full 32 bit values, to check that the 16 bit kernels
+		   truncate like the portable implementation */
+		for (unsigned i = 0; i < N; ++i)
+			planes[c][i] = g_random_int();
+		src[c] = planes[c];
+	}
+
+	for (unsigned k = 0; k < G_N_ELEMENTS(channel_counts); ++k) {
+		const unsigned channels = channel_counts[k];
+		const size_t size16 = channels * N * sizeof(out16[0]);
+		const size_t size32 = channels * N * sizeof(out32[0]);
+
+		pcm_simd_restrict(0);
+		pcm_simd_interleave_16(expected16, src, channels, N);
+		pcm_simd_interleave_32(expected32, src, channels, N);
+
+		for (unsigned i = 0; i < N; ++i) {
+			for (unsigned c = 0; c < channels; ++c) {
+				g_assert_cmpint(expected16[i * channels + c], ==,
+						(int16_t)planes[c][i]);
+				g_assert_cmpint(expected32[i * channels + c], ==,
+						planes[c][i]);
+			}
+		}
+
+		for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+			pcm_simd_restrict(simd_masks[m]);
+
+			memset(out16, 0, size16);
+			pcm_simd_interleave_16(out16, src, channels, N);
+			g_assert_cmpint(memcmp(out16, expected16, size16),
+					==, 0);
+
+			memset(out32, 0, size32);
+			pcm_simd_interleave_32(out32, src, channels, N);
+			g_assert_cmpint(memcmp(out32, expected32, size32),
+					==, 0);
+		}
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+void
+test_pcm_simd_pack(void)
+{
+	int32_t src32[N], out32[N], expected32[N];
+	int16_t out16[N], expected16[N];
+	uint8_t src24[N * 3], out24[N * 3], expected24[N * 3];
+
+	for (unsigned i = 0; i < N; ++i)
+		src32[i] = g_random_int();
+	for (unsigned i = 0; i < sizeof(src24); ++i)
+		src24[i] = g_random_int();
+
+	pcm_simd_restrict(0);
+	pcm_simd_narrow_32_to_16(expected16, src32, N);
+	pcm_simd_pack_24(expected24, src32, N);
+	pcm_simd_unpack_24(expected32, src24, N);
+
+	for (unsigned m = 0; m < G_N_ELEMENTS(simd_masks); ++m) {
+		pcm_simd_restrict(simd_masks[m]);
+
+		pcm_simd_narrow_32_to_16(out16, src32, N);
+		g_assert_cmpint(memcmp(out16, expected16, sizeof(out16)),
+				==, 0);
+
+		pcm_simd_pack_24(out24, src32, N);
+		g_assert_cmpint(memcmp(out24, expected24, sizeof(out24)),
+				==, 0);
+
+		pcm_simd_unpack_24(out32, src24, N);
+		g_assert_cmpint(memcmp(out32, expected32, sizeof(out32)),
+				==, 0);
+
+		/* the WavPack decoder and pcm_export narrow and pack
+		   in-place */
+		memcpy(out32, src32, sizeof(src32));
+		pcm_simd_narrow_32_to_16((int16_t *)out32, out32, N);
+		g_assert_cmpint(memcmp(out32, expected16, sizeof(expected16)),
+				==, 0);
+
+		memcpy(out32, src32, sizeof(src32));
+		pcm_simd_pack_24((uint8_t *)out32, out32, N);
+		g_assert_cmpint(memcmp(out32, expected24, sizeof(expected24)),
+				==, 0);
+	}
+
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
+
+/**
+ * Measures the throughput of the public PCM functions with the
+ * portable and with the vectorized kernels.  Only runs in "perf"
+ * mode, i.e. "test/test_pcm -m perf".
+ */
+void
+test_pcm_simd_throughput(void)
+{
+	if (!g_test_perf())
+		return;
+
+	enum {
+		SIZE = 1024 * 1024,
+		ROUNDS = 64,
+	};
+
+	static int16_t a[SIZE / 2], b[SIZE / 2];
+	for (unsigned i = 0; i < G_N_ELEMENTS(a); ++i) {
+		a[i] = g_random_int();
+		b[i] = g_random_int();
+	}
+
+	struct pcm_buffer buffer;
+	pcm_buffer_init(&buffer);
+
+	const unsigned masks[] = { 0, PCM_SIMD_SSE2, PCM_SIMD_ALL };
+	for (unsigned m = 0; m < G_N_ELEMENTS(masks); ++m) {
+		pcm_simd_restrict(masks[m]);
+		const char *name =
+			pcm_simd_features_string(pcm_simd_features());
+
+		g_test_timer_start();
+		for (unsigned i = 0; i < ROUNDS; ++i)
+			pcm_volume(a, sizeof(a), SAMPLE_FORMAT_S16,
+				   PCM_VOLUME_1 - 1);
+		g_test_minimized_result(g_test_timer_elapsed(),
+					"pcm_volume S16 [%s]: %u MiB",
+					name, ROUNDS);
+
+		g_test_timer_start();
+		for (unsigned i = 0; i < ROUNDS; ++i)
+			if (!pcm_mix(a, b, sizeof(a), SAMPLE_FORMAT_S16, 0.7))
+				g_assert_not_reached();
+		g_test_minimized_result(g_test_timer_elapsed(),
+					"pcm_mix S16 [%s]: %u MiB",
+					name, ROUNDS);
+
+		g_test_timer_start();
+		for (unsigned i = 0; i < ROUNDS; ++i) {
+			size_t dest_size;
+			pcm_convert_to_32(&buffer, SAMPLE_FORMAT_S16,
+					  a, sizeof(a), &dest_size);
+		}
+		g_test_minimized_result(g_test_timer_elapsed(),
+					"pcm_convert_to_32 S16 [%s]: %u MiB",
+					name, ROUNDS);
+
+		g_test_timer_start();
+		for (unsigned i = 0; i < ROUNDS; ++i) {
+			size_t dest_size;
+			pcm_convert_to_float(&buffer, SAMPLE_FORMAT_S16,
+					     a, sizeof(a), &dest_size);
+		}
+		g_test_minimized_result(g_test_timer_elapsed(),
+					"pcm_convert_to_float S16 [%s]: %u MiB",
+					name, ROUNDS);
+	}
+
+	pcm_buffer_deinit(&buffer);
+	pcm_simd_restrict(PCM_SIMD_ALL);
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "output/pipe_writer.h"
+
+#include <glib.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+enum {
+	CHUNK_SIZE = 4096,
+	NUM_CHUNKS = 1000,
+};
+
+static int reader_fd;
+static uint64_t reader_position;
+static bool reader_corrupt;
+
+static unsigned char
+pattern(uint64_t position)
+{
+	return (unsigned char)(position % 251);
+}
+
+/**
+ * Reads from the pipe until EOF and checks the pattern; pauses now
+ * and then, so the ring fills up and wraps around.
+ */
+static gpointer
+reader_thread(G_GNUC_UNUSED gpointer data)
+{
+	unsigned char buffer[3000];
+	ssize_t nbytes;
+
+	while ((nbytes = read(reader_fd, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t i = 0; i < nbytes; ++i)
+			if (buffer[i] != pattern(reader_position + i))
+				reader_corrupt = true;
+
+		reader_position += nbytes;
+		if (reader_position % 65536 < sizeof(buffer))
+			g_usleep(2000);
+	}
+
+	return NULL;
+}
+
+static void
+fill_chunk(unsigned char *chunk, uint64_t position)
+{
+	for (unsigned i = 0; i < CHUNK_SIZE; ++i)
+		chunk[i] = pattern(position + i);
+}
+
+static void
+test_pipe_writer_lossless(void)
+{
+	int fds[2];
+	g_assert(pipe(fds) == 0);
+
+	reader_fd = fds[0];
+	reader_position = 0;
+	reader_corrupt = false;
+
+	struct pipe_writer *w = pipe_writer_new(fds[1], -1, 100000, NULL);
+	g_assert(w != NULL);
+
+	GThread *thread = g_thread_create(reader_thread, NULL, true, NULL);
+
+	unsigned char chunk[CHUNK_SIZE];
+	for (unsigned i = 0; i < NUM_CHUNKS; ++i) {
+		fill_chunk(chunk, (uint64_t)i * CHUNK_SIZE);
+		g_assert(pipe_writer_append(w, chunk, sizeof(chunk), NULL));
+	}
+
+	g_assert(pipe_writer_drain(w, NULL));
+	g_assert_cmpuint(pipe_writer_dropped(w), ==, 0);
+	pipe_writer_free(w);
+
+	close(fds[1]);
+	g_thread_join(thread);
+	close(fds[0]);
+
+	g_assert_cmpuint(reader_position, ==, NUM_CHUNKS * CHUNK_SIZE);
+	g_assert(!reader_corrupt);
+}
+
+static void
+test_pipe_writer_drop(void)
+{
+	int fds[2];
+	g_assert(pipe(fds) == 0);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	/* nobody reads: the writer must neither block nor grow */
+	struct pipe_writer *w = pipe_writer_new(fds[1], fds[0], 100000, NULL);
+	g_assert(w != NULL);
+
+	unsigned char chunk[CHUNK_SIZE];
+	fill_chunk(chunk, 0);
+	for (unsigned i = 0; i < NUM_CHUNKS; ++i)
+		g_assert(pipe_writer_append(w, chunk, sizeof(chunk), NULL));
+
+	g_assert_cmpuint(pipe_writer_dropped(w), >, 0);
+	g_assert_cmpuint(pipe_writer_dropped(w), <, NUM_CHUNKS * CHUNK_SIZE);
+
+	pipe_writer_cancel(w);
+	pipe_writer_free(w);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+	g_thread_init(NULL);
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/pipe_writer/lossless", test_pipe_writer_lossless);
+	g_test_add_func("/pipe_writer/drop", test_pipe_writer_drop);
+
+	return g_test_run();
+}
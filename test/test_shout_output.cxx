@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2003-2013 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Tests the shout output plugin against the fake Icecast server on
+ * the loopback interface: streaming with a stream tag, reconnecting
+ * after the server has dropped the source, and not blocking the
+ * output thread while the server does not respond.
+ */
+
+#include "config.h"
+#include "icecast_server.h"
+#include "conf.h"
+#include "GlobalEvents.hxx"
+
+extern "C" {
+#include "output_plugin.h"
+#include "audio_format.h"
+#include "output_internal.h"
+#include "output/shout_output_plugin.h"
+#include "filter_registry.h"
+#include "pcm_convert.h"
+#include "tag.h"
+#include "clock.h"
+}
+
+#include <glib.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void
+GlobalEvents::Emit(gcc_unused Event event)
+{
+}
+
+void pcm_convert_init(G_GNUC_UNUSED struct pcm_convert_state *state)
+{
+}
+
+void pcm_convert_deinit(G_GNUC_UNUSED struct pcm_convert_state *state)
+{
+}
+
+const void *
+pcm_convert(G_GNUC_UNUSED struct pcm_convert_state *state,
+	    G_GNUC_UNUSED const struct audio_format *src_format,
+	    G_GNUC_UNUSED const void *src, G_GNUC_UNUSED size_t src_size,
+	    G_GNUC_UNUSED const struct audio_format *dest_format,
+	    G_GNUC_UNUSED size_t *dest_size_r,
+	    GError **error_r)
+{
+	g_set_error(error_r, pcm_convert_quark(), 0,
+		    "Not implemented");
+	return NULL;
+}
+
+const struct filter_plugin *
+filter_plugin_by_name(G_GNUC_UNUSED const char *name)
+{
+	assert(false);
+	return NULL;
+}
+
+/**
+ * The longest duration a single ao_plugin_play() call may take
+ * [milliseconds].  Encoding one chunk takes far less; this only
+ * detects waiting for the server.
+ */
+static const unsigned MAX_PLAY_DURATION = 250;
+
+static struct icecast_server *server;
+static GThread *server_thread;
+static volatile gint server_quit;
+
+static gpointer
+server_run(G_GNUC_UNUSED gpointer data)
+{
+	while (!g_atomic_int_get(&server_quit)) {
+		const bool success = icecast_server_poll(server, 20);
+		g_assert(success);
+	}
+
+	return nullptr;
+}
+
+static unsigned
+server_start(unsigned drop)
+{
+	server = icecast_server_new(0, drop, 0);
+	g_assert(server != nullptr);
+
+	g_atomic_int_set(&server_quit, false);
+	server_thread = g_thread_create(server_run, nullptr, true, nullptr);
+	g_assert(server_thread != nullptr);
+
+	return icecast_server_port(server);
+}
+
+static void
+server_stop(void)
+{
+	g_atomic_int_set(&server_quit, true);
+	g_thread_join(server_thread);
+	icecast_server_free(server);
+}
+
+/**
+ * Waits until the server has seen at least the specified number of
+ * source connections and Ogg streams, and each source connection has
+ * begun with an Ogg stream header; but not longer than 5 seconds.
+ */
+static void
+server_wait(unsigned sources, unsigned ogg_streams,
+	    struct icecast_server_stats *stats)
+{
+	const unsigned deadline = monotonic_clock_ms() + 5000;
+
+	while (true) {
+		icecast_server_get_stats(server, stats);
+		if ((stats->sources >= sources &&
+		     stats->ogg_streams >= ogg_streams &&
+		     stats->ogg_streams >= stats->sources) ||
+		    (int)(monotonic_clock_ms() - deadline) >= 0)
+			break;
+
+		g_usleep(10000);
+	}
+}
+
+static struct config_param *
+make_config(unsigned port, const char *max_queue)
+{
+	char port_string[16];
+	snprintf(port_string, sizeof(port_string), "%u", port);
+
+	struct config_param *param = config_new_param(nullptr, 1);
+	config_add_block_param(param, "name", "test", 1);
+	config_add_block_param(param, "type", "shout", 1);
+	config_add_block_param(param, "host", "127.0.0.1", 1);
+	config_add_block_param(param, "port", port_string, 1);
+	config_add_block_param(param, "mount", "/test.ogg", 1);
+	config_add_block_param(param, "password", "hackme", 1);
+	config_add_block_param(param, "encoding", "ogg", 1);
+	config_add_block_param(param, "quality", "2", 1);
+	config_add_block_param(param, "format", "44100:16:2", 1);
+	config_add_block_param(param, "timeout", "1", 1);
+	config_add_block_param(param, "reconnect_interval", "1", 1);
+	if (max_queue != nullptr)
+		config_add_block_param(param, "max_queue", max_queue, 1);
+	return param;
+}
+
+static struct audio_output *
+open_output(const struct config_param *param)
+{
+	GError *error = nullptr;
+	struct audio_output *ao =
+		ao_plugin_init(&shout_output_plugin, param, &error);
+	g_assert(error == nullptr);
+	g_assert(ao != nullptr);
+
+	bool success = ao_plugin_enable(ao, &error);
+	g_assert(error == nullptr);
+	g_assert(success);
+
+	struct audio_format audio_format;
+	audio_format_init(&audio_format, 44100, SAMPLE_FORMAT_S16, 2);
+	success = ao_plugin_open(ao, &audio_format, &error);
+	g_assert(error == nullptr);
+	g_assert(success);
+
+	return ao;
+}
+
+static void
+close_output(struct audio_output *ao)
+{
+	ao_plugin_close(ao);
+	ao_plugin_disable(ao);
+	ao_plugin_finish(ao);
+}
+
+/**
+ * Plays a tone in real time, pacing like the output thread does.
+ *
+ * @return the longest duration of a single ao_plugin_play() call
+ * [milliseconds]
+ */
+static unsigned
+play(struct audio_output *ao, unsigned ms)
+{
+	static int16_t buffer[2048];
+	for (unsigned i = 0; i < G_N_ELEMENTS(buffer); ++i)
+		buffer[i] = (int16_t)((int)((i * 997) % 4000) - 2000);
+
+	const unsigned frames = ms * 44100 / 1000;
+	unsigned longest = 0;
+
+	for (unsigned played = 0; played < frames;
+	     played += G_N_ELEMENTS(buffer) / 2) {
+		const unsigned delay = ao_plugin_delay(ao);
+		if (delay > 0)
+			g_usleep(delay * 1000);
+
+		const unsigned start = monotonic_clock_ms();
+
+		GError *error = nullptr;
+		size_t nbytes = ao_plugin_play(ao, buffer, sizeof(buffer),
+					       &error);
+		g_assert(error == nullptr);
+		g_assert_cmpuint(nbytes, ==, sizeof(buffer));
+
+		const unsigned duration = monotonic_clock_ms() - start;
+		if (duration > longest)
+			longest = duration;
+	}
+
+	return longest;
+}
+
+/**
+ * Returns a numeric attribute from ao_plugin_stats().
+ */
+static unsigned
+get_stat(struct audio_output *ao, const char *name)
+{
+	char *stats = ao_plugin_stats(ao);
+	g_assert(stats != nullptr);
+
+	const char *p = strstr(stats, name);
+	g_assert(p != nullptr);
+	g_assert(p[strlen(name)] == ':');
+
+	const unsigned value = strtoul(p + strlen(name) + 1, nullptr, 10);
+	g_free(stats);
+	return value;
+}
+
+static void
+test_shout_output_stream(void)
+{
+	struct config_param *param = make_config(server_start(0), nullptr);
+	struct audio_output *ao = open_output(param);
+
+	g_assert_cmpuint(play(ao, 500), <, MAX_PLAY_DURATION);
+
+	/* the Vorbis encoder supports stream tags; a tag begins a
+	   new Ogg stream */
+	struct tag *tag = tag_new();
+	tag_add_item(tag, TAG_ARTIST, "Artist");
+	tag_add_item(tag, TAG_TITLE, "Title");
+	ao_plugin_send_tag(ao, tag);
+	tag_free(tag);
+
+	g_assert_cmpuint(play(ao, 500), <, MAX_PLAY_DURATION);
+
+	struct icecast_server_stats stats;
+	server_wait(1, 2, &stats);
+
+	g_assert_cmpuint(stats.sources, ==, 1);
+	g_assert_cmpuint(stats.ogg_streams, ==, 2);
+	g_assert_cmpuint(stats.bytes, >, 0);
+
+	g_assert_cmpuint(get_stat(ao, "shout_connected"), ==, 1);
+	g_assert_cmpuint(get_stat(ao, "shout_connects"), ==, 1);
+	g_assert_cmpuint(get_stat(ao, "shout_drops"), ==, 0);
+
+	close_output(ao);
+	config_param_free(param);
+	server_stop();
+}
+
+static void
+test_shout_output_reconnect(void)
+{
+	/* the server drops each source connection after 300 ms */
+	struct config_param *param = make_config(server_start(300), nullptr);
+	struct audio_output *ao = open_output(param);
+
+	g_assert_cmpuint(play(ao, 2000), <, MAX_PLAY_DURATION);
+
+	/* the plugin reconnects in the background, and each new
+	   connection begins with the encoder header */
+	struct icecast_server_stats stats;
+	server_wait(2, 2, &stats);
+	g_assert_cmpuint(stats.sources, >=, 2);
+	g_assert_cmpuint(stats.ogg_streams, ==, stats.sources);
+
+	g_assert_cmpuint(get_stat(ao, "shout_connects"), >=, 2);
+
+	close_output(ao);
+	config_param_free(param);
+	server_stop();
+}
+
+static void
+test_shout_output_unresponsive(void)
+{
+	/* a server which accepts the TCP connection, but never
+	   answers the request */
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	g_assert(fd >= 0);
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	socklen_t address_length = sizeof(address);
+	g_assert(bind(fd, (const struct sockaddr *)&address,
+		      sizeof(address)) == 0);
+	g_assert(listen(fd, 4) == 0);
+	g_assert(getsockname(fd, (struct sockaddr *)&address,
+			     &address_length) == 0);
+
+	struct config_param *param =
+		make_config(ntohs(address.sin_port), "8");
+	struct audio_output *ao = open_output(param);
+
+	/* the output thread must not wait for the server; the queue
+	   overflows instead */
+	g_assert_cmpuint(play(ao, 1500), <, MAX_PLAY_DURATION);
+
+	g_assert_cmpuint(get_stat(ao, "shout_connected"), ==, 0);
+	g_assert_cmpuint(get_stat(ao, "shout_drops"), >, 0);
+
+	close_output(ao);
+	config_param_free(param);
+	close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, nullptr);
+	g_thread_init(nullptr);
+
+	/* lost connections and timeouts are expected here; the
+	   plugin reports them with g_warning() */
+	g_log_set_always_fatal((GLogLevelFlags)(G_LOG_LEVEL_ERROR |
+						G_LOG_LEVEL_CRITICAL));
+
+	/* libshout writes to sockets which the server may have
+	   closed */
+	signal(SIGPIPE, SIG_IGN);
+
+	config_global_init();
+
+	g_test_add_func("/shout_output/stream", test_shout_output_stream);
+	g_test_add_func("/shout_output/reconnect",
+			test_shout_output_reconnect);
+	g_test_add_func("/shout_output/unresponsive",
+			test_shout_output_unresponsive);
+
+	const int result = g_test_run();
+
+	config_global_finish();
+	return result;
+}